@@ -50,6 +50,11 @@
                 the diagnostics goes to stderr.
    MTA_APPEND   When set to any non-empty value, directs mta to append
                 to the diagnostics file, not to overwrite it. 
+   MTA_EXTENSIONS
+                Whitespace-separated list of SMTP extensions to advertise
+                in reply to EHLO.  The following extensions are actually
+                supported: PIPELINING, CHUNKING.  Any other names are just
+                listed in the reply.
 
 */
 
@@ -531,6 +536,91 @@ smtp_reply (mu_stream_t str, int code, char *fmt, ...)
 #define KW_DATA      4   
 #define KW_HELP      5
 #define KW_QUIT      6
+#define KW_BDAT      7
+
+char *extensions;        /* Value of MTA_EXTENSIONS */
+
+/* Return true if extension NAME is advertised. */
+int
+smtp_extension (const char *name)
+{
+  size_t len = strlen (name);
+  const char *p;
+
+  if (!extensions)
+    return 0;
+  for (p = extensions; *p; )
+    {
+      size_t n;
+      
+      p = mu_str_skip_class (p, MU_CTYPE_SPACE);
+      n = mu_str_skip_class_comp (p, MU_CTYPE_SPACE) - p;
+      if (n == len && mu_c_strncasecmp (p, name, n) == 0)
+	return 1;
+      p += n;
+    }
+  return 0;
+}
+
+void
+smtp_ehlo_reply (mu_stream_t str)
+{
+  struct mu_wordsplit ws;
+  size_t i;
+  
+  if (!extensions
+      || mu_wordsplit (extensions, &ws, MU_WRDSF_DEFFLAGS)
+      || ws.ws_wordc == 0)
+    {
+      smtp_reply (str, 250, "pleased to meet you");
+      return;
+    }
+  mu_stream_printf (str, "250-pleased to meet you\n");
+  for (i = 0; i < ws.ws_wordc; i++)
+    mu_stream_printf (str, "250%c%s\n", i + 1 < ws.ws_wordc ? '-' : ' ',
+		      ws.ws_wordv[i]);
+  mu_wordsplit_free (&ws);
+}
+
+/* Read a BDAT chunk of SIZE octets from STR and append it to OUT.
+   The data are read directly from the input transport of STR, because
+   the line buffer of the latter would block at the end of a chunk that
+   does not end with a newline.  The CRLF pairs are decoded by the
+   transport, so each newline counts for two octets. */
+int
+smtp_bdat_read (mu_stream_t str, mu_stream_t out, size_t size)
+{
+  mu_stream_t trans[2];
+  int rc;
+  
+  rc = mu_stream_ioctl (str, MU_IOCTL_SUBSTREAM, MU_IOCTL_OP_GET, trans);
+  if (rc)
+    return rc;
+  while (size)
+    {
+      char c;
+      size_t n;
+      
+      rc = mu_stream_read (trans[0], &c, 1, &n);
+      if (rc)
+	break;
+      if (n == 0)
+	{
+	  rc = MU_ERR_PARSE;
+	  break;
+	}
+      rc = mu_stream_write (out, &c, 1, NULL);
+      if (rc)
+	break;
+      if (c == '\n' && size > 1)
+	size -= 2;
+      else
+	size--;
+    }
+  mu_stream_unref (trans[0]);
+  mu_stream_unref (trans[1]);
+  return rc;
+}
 
 int
 smtp_kw (const char *name)
@@ -546,6 +636,7 @@ smtp_kw (const char *name)
     { "data", KW_DATA },
     { "help", KW_HELP },
     { "quit", KW_QUIT },
+    { "bdat", KW_BDAT },
     { NULL },
   };
   int i;
@@ -575,7 +666,9 @@ smtp (mu_stream_t str)
   char *rcpt_addr;
   int wsflags = MU_WRDSF_DEFFLAGS;
   struct mu_wordsplit ws;
+  mu_stream_t bdat = NULL;
 
+  extensions = getenv ("MTA_EXTENSIONS");
   smtp_reply (str, 220, "Ready");
   for (state = STATE_INIT; state != STATE_QUIT; )
     {
@@ -618,7 +711,10 @@ smtp (mu_stream_t str)
 	    case KW_HELO:
 	      if (ws.ws_wordc == 2)
 		{
-		  smtp_reply (str, 250, "pleased to meet you");
+		  if (kw == KW_EHLO)
+		    smtp_ehlo_reply (str);
+		  else
+		    smtp_reply (str, 250, "pleased to meet you");
 		  state = STATE_EHLO;
 		}
 	      else
@@ -748,6 +844,75 @@ smtp (mu_stream_t str)
 	      }
 	      break;
 
+	    case KW_BDAT:
+	      {
+		char *p;
+		unsigned long n;
+		int last = 0;
+		
+		if (!smtp_extension ("CHUNKING"))
+		  {
+		    smtp_reply (str, 503, "Invalid command");
+		    break;
+		  }
+		if (ws.ws_wordc == 3
+		    && mu_c_strcasecmp (ws.ws_wordv[2], "last") == 0)
+		  last = 1;
+		else if (ws.ws_wordc != 2)
+		  {
+		    smtp_reply (str, 501, "Syntax error");
+		    break;
+		  }
+		n = strtoul (ws.ws_wordv[1], &p, 10);
+		if (*p)
+		  {
+		    smtp_reply (str, 501, "Syntax error");
+		    break;
+		  }
+		if (!bdat)
+		  {
+		    rc = mu_temp_file_stream_create (&bdat, NULL, 0);
+		    if (rc)
+		      {
+			mu_diag_funcall (MU_DIAG_ERROR,
+					 "mu_temp_file_stream_create",
+					 NULL, rc);
+			exit (EX_UNAVAILABLE);
+		      }
+		  }
+		rc = smtp_bdat_read (str, bdat, n);
+		if (rc)
+		  {
+		    mu_diag_funcall (MU_DIAG_ERROR, "smtp_bdat_read",
+				     NULL, rc);
+		    exit (EX_PROTOCOL);
+		  }
+		if (!last)
+		  {
+		    smtp_reply (str, 250, "%lu octets received", n);
+		    break;
+		  }
+		else
+		  {
+		    mu_message_t msg;
+
+		    mu_stream_seek (bdat, 0, MU_SEEK_SET, NULL);
+		    msg = make_tmp (bdat);
+		    mu_stream_destroy (&bdat);
+		    if (message_finalize (msg, 0) == 0)
+		      mta_send (msg);
+		    else
+		      smtp_reply (str, 501, "can't send message");
+		    mu_message_destroy (&msg, mu_message_get_owner (msg));
+		    mu_address_destroy (&recipients);
+		    from_person = NULL;
+		    
+		    smtp_reply (str, 250, "Message accepted for delivery");
+		    state = STATE_EHLO;
+		  }
+	      }
+	      break;
+
 	    default:
 	      smtp_reply (str, 503, "Invalid command");
 	      break;
@@ -871,7 +1036,9 @@ mta_smtp (int argc, char **argv)
 			   "MU_STREAM_READ", rc);
 	  return 1;
 	}
-      mu_stream_set_buffer (istream, mu_buffer_line, 0);
+      /* Underlying input streams are not buffered, because BDAT chunks
+	 need not end at the line boundary (see smtp_bdat_read). */
+      mu_stream_set_buffer (istream, mu_buffer_none, 0);
       rc = mu_filter_create (&flt, istream, "CRLF", MU_FILTER_DECODE,
 			     MU_STREAM_READ);
       mu_stream_unref (istream);
@@ -881,7 +1048,7 @@ mta_smtp (int argc, char **argv)
 			   "CRLF,MU_FILTER_DECODE", rc);
 	  return 1;
 	}
-      mu_stream_set_buffer (flt, mu_buffer_line, 0);
+      mu_stream_set_buffer (flt, mu_buffer_none, 0);
       istream = flt;
 
       rc = mu_stdio_stream_create (&ostream, sfd, MU_STREAM_WRITE);
@@ -16,6 +16,13 @@
 
 #include "imap4d.h"
 
+/* Polling interval, used if the mailbox cannot be watched for changes. */
+#define IDLE_POLL_INTERVAL 5
+/* Interval between mailbox checks when it is being watched.  Changes
+   made on another host of a networked file system are not notified,
+   and the mailbox lock needs to be touched from time to time. */
+#define IDLE_WATCH_INTERVAL 60
+
 int
 imap4d_idle (struct imap4d_session *session,
              struct imap4d_command *command, imap4d_tokbuf_t tok)
@@ -23,6 +30,8 @@ imap4d_idle (struct imap4d_session *session,
   time_t start;
   char *token_str = NULL;
   size_t token_size = 0, token_len;
+  int watch_fd;
+  int watching;
   
   if (imap4d_tokbuf_argc (tok) != 2)
     return io_completion_response (command, RESP_BAD, "Invalid arguments");
@@ -30,18 +39,61 @@ imap4d_idle (struct imap4d_session *session,
   if (io_wait_input (0) == -1)
     return io_completion_response (command, RESP_NO, "Cannot idle");
 
+  watching = mu_mailbox_watch (mbox, &watch_fd) == 0;
+  
   io_sendf ("+ idling\n");
   io_flush ();
 
+  if (watching)
+    {
+      /* Discard notifications about the changes made before IDLE */
+      mu_mailbox_watch_clear (mbox, NULL);
+      imap4d_sync ();
+      io_flush ();
+    }
+  
   start = time (NULL);
   while (1)
     {
-      if (io_wait_input (5))
+      int rc;
+
+      if (watching)
+	{
+	  time_t timeout = IDLE_WATCH_INTERVAL;
+	  time_t left = idle_timeout - (time (NULL) - start) + 1;
+
+	  if (left < timeout)
+	    timeout = left > 0 ? left : 0;
+	  rc = io_wait_input_fd (watch_fd, timeout);
+	}
+      else
+	rc = io_wait_input (IDLE_POLL_INTERVAL);
+
+      if (rc == -1)
+	{
+	  if (watching)
+	    {
+	      /* Fall back to polling the input stream */
+	      watching = 0;
+	      continue;
+	    }
+	  /* Let io_getline report the error */
+	  rc = 1;
+	}
+      
+      if (rc == 1)
 	{
           io_getline (&token_str, &token_size, &token_len); 	  
 	  if (token_len == 4 && mu_c_strcasecmp (token_str, "done") == 0)
 	    break;
 	}
+      else if (rc == 2)
+	{
+	  int changed;
+	  
+	  if (mu_mailbox_watch_clear (mbox, &changed) || !changed)
+	    continue;
+	}
       else if (time (NULL) - start > idle_timeout)
 	imap4d_bye (ERR_TIMEOUT);
 
@@ -51,4 +103,3 @@ imap4d_idle (struct imap4d_session *session,
   free (token_str);
   return io_completion_response (command, RESP_OK, "terminated");
 }
-
@@ -355,6 +355,16 @@ static struct mu_cfg_param imap4d_cfg_param[] = {
     N_("Use only encrypted ident responses.") },
   { "id-fields", MU_CFG_LIST_OF(mu_cfg_string), &imap4d_id_list, 0, NULL,
     N_("List of fields to return in response to ID command.") },
+  { "search-index-directory", mu_cfg_string, &search_index_dir, 0, NULL,
+    N_("Keep full-text search indexes in this directory.  Relative names "
+       "are taken relative to the user's home directory."),
+    N_("dir") },
+  { "search-threads", mu_cfg_size, &search_threads, 0, NULL,
+    N_("Evaluate expensive SEARCH queries in this number of threads.") },
+  { "search-parallel-threshold", mu_cfg_size, &search_parallel_threshold,
+    0, NULL,
+    N_("Evaluate SEARCH queries in parallel only if they involve at least "
+       "this number of messages.") },
   { "mandatory-locking", mu_cfg_section },
   { ".server", mu_cfg_section, NULL, 0, NULL,
     N_("Server configuration.") },
@@ -762,6 +772,11 @@ main (int argc, char **argv)
 		   argc, argv, 0, NULL, server))
     exit (EX_CONFIG); /* FIXME: No way to discern from EX_USAGE? */
 
+  /* A session ends in imap4d_bye, which exits.  Its state, including
+     the privileges of the logged in user, must never be inherited by
+     another client, so a pre-forked worker serves one connection. */
+  mu_m_server_set_max_worker_requests (server, 1);
+
   if (login_disabled)
     imap4d_capability_add (IMAP_CAPA_LOGINDISABLED);
 
@@ -80,6 +80,7 @@
 #include <mailutils/header.h>
 #include <mailutils/iterator.h>
 #include <mailutils/list.h>
+#include <mailutils/locker.h>
 #include <mailutils/mailbox.h>
 #include <mailutils/message.h>
 #include <mailutils/mime.h>
@@ -244,6 +245,7 @@ void io_getline (char **pbuf, size_t *psize, size_t *pnbytes);
 void io_setio (int, int, int);
 void io_flush (void);
 int io_wait_input (int);
+int io_wait_input_fd (int, int);
   
 imap4d_tokbuf_t imap4d_tokbuf_init (void);
 void imap4d_tokbuf_destroy (imap4d_tokbuf_t *tok);
@@ -330,6 +332,8 @@ extern int  imap4d_preauth_setup (int fd);
 extern int  imap4d_search (struct imap4d_session *,
 			     struct imap4d_command *, imap4d_tokbuf_t);
 extern int  imap4d_search0 (imap4d_tokbuf_t, int isuid, char **repyptr);
+extern size_t search_threads;
+extern size_t search_parallel_threshold;
 extern int  imap4d_select (struct imap4d_session *,
 			   struct imap4d_command *, imap4d_tokbuf_t);
 extern int  imap4d_select0 (struct imap4d_command *, const char *, int);
@@ -381,6 +385,11 @@ extern void imap4d_sync_invalidate (void);
 extern int imap4d_sync_flags (size_t);
 extern size_t uid_to_msgno (size_t);
 extern void imap4d_set_observer (mu_mailbox_t mbox);
+
+/* Full-text search index */
+extern char *search_index_dir;
+extern int search_index_update (void);
+extern int search_index_lookup (const char *text, char *set, size_t count);
   
 /* Signal handling.  */
 extern RETSIGTYPE imap4d_master_signal (int);
@@ -435,6 +444,7 @@ extern char *util_localname (void);
 
 void util_print_flags (mu_attribute_t attr);
 int util_attribute_matches_flag (mu_attribute_t attr, const char *item);
+int util_flags_match (int flags, const char *item);
 int util_uidvalidity (mu_mailbox_t smbox, unsigned long *uidvp);
 
   
@@ -17,6 +17,7 @@
 #include "imap4d.h"
 
 mu_stream_t iostream;
+static int io_ifd = -1;
 
 void
 io_setio (int ifd, int ofd, int tls)
@@ -27,6 +28,7 @@ io_setio (int ifd, int ofd, int tls)
     imap4d_bye (ERR_NO_IFILE);
   if (ofd == -1)
     imap4d_bye (ERR_NO_OFILE);
+  io_ifd = ifd;
 
   if (mu_stdio_stream_create (&istream, ifd, MU_STREAM_READ))
     imap4d_bye (ERR_STREAM_CREATE);
@@ -309,6 +311,45 @@ io_wait_input (int timeout)
   return wflags & MU_STREAM_READY_RD;
 }
 
+/* Wait up to TIMEOUT seconds for data on the input stream or on the
+   file descriptor FD.
+   Returns 0   if neither is ready
+           1   if some data is available on the input stream
+	   2   if FD is ready for reading
+	   -1  an error occurred */
+int
+io_wait_input_fd (int fd, int timeout)
+{
+  fd_set rdset;
+  struct timeval tv;
+  int rc;
+
+  /* The input stream can have buffered data */
+  rc = io_wait_input (0);
+  if (rc)
+    return rc;
+
+  FD_ZERO (&rdset);
+  FD_SET (io_ifd, &rdset);
+  FD_SET (fd, &rdset);
+  tv.tv_sec = timeout;
+  tv.tv_usec = 0;
+  rc = select ((fd > io_ifd ? fd : io_ifd) + 1, &rdset, NULL, NULL, &tv);
+  if (rc < 0)
+    {
+      if (errno == EINTR)
+	return 0;
+      mu_diag_output (MU_DIAG_ERROR, _("cannot poll input stream: %s"),
+		      mu_strerror (errno));
+      return -1;
+    }
+  if (FD_ISSET (io_ifd, &rdset))
+    return 1;
+  if (FD_ISSET (fd, &rdset))
+    return 2;
+  return 0;
+}
+
 void
 io_flush ()
 {
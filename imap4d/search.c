@@ -16,6 +16,9 @@
    along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include "imap4d.h"
+#ifdef WITH_PTHREAD
+# include <pthread.h>
+#endif
 
 /*
  * This will be a royal pain in the arse to implement
@@ -30,9 +33,19 @@
    node is of type search_node (see below) and contains either data
    (struct value) or an instruction, which evaluates to a boolean value.
 
+   Before execution, the tree is passed to the planner (plan_search),
+   which reorders the operands of AND and OR nodes so that cheaper
+   conditions are evaluated first, and precomputes the message set and
+   UID conditions, which do not depend on message contents.
+
    The function search_run recursively evaluates the tree and returns a
    boolean number, 0 or 1 depending on whether the current message meets
-   the search conditions. */
+   the search conditions.
+
+   If search-threads is set and the query is expensive enough, messages
+   are evaluated by several threads at once (see search_parallel).  Each
+   thread reads the mailbox through its own read-only instance, so that
+   no mailbox object is shared between threads. */
 
 struct parsebuf;
 
@@ -82,6 +95,8 @@ struct search_node
     {
       char *keyword;
       instr_fn fun;
+      int cost;                 /* Evaluation cost */
+      char *set;                /* Precomputed set of matching messages */
       int narg;
       struct search_node *arg[MAX_NODE_ARGS];
     } key;
@@ -136,8 +151,18 @@ struct cond
   char *argtypes;      /* String of argument types or NULL if it takes no
 			  args */
   instr_fn inst;       /* Corresponding instruction function */
+  int cost;            /* Relative cost of evaluation */
 };
 
+/* Costs of evaluating conditions, depending on the message data they
+   need */
+#define COST_SET       1     /* Precomputed message set */
+#define COST_FLAGS     2     /* Message attributes */
+#define COST_ENVELOPE  4     /* Envelope or message size */
+#define COST_HEADER    16    /* Message header */
+#define COST_BODY      256   /* Message body */
+#define COST_TEXT      (COST_HEADER + COST_BODY) /* Entire message */
+
 /* Types are: s -- string
               n -- number
 	      d -- date
@@ -147,24 +172,24 @@ struct cond
 /* List of basic conditions. "ALL" and <message set> is handled separately */
 struct cond condlist[] =
 {
-  { "BCC",        "s",  cond_bcc },
-  { "BEFORE",     "d",  cond_before },
-  { "BODY",       "s",  cond_body },
-  { "CC",         "s",  cond_cc },
-  { "FROM",       "s",  cond_from },
-  { "HEADER",     "ss", cond_header },
-  { "KEYWORD",    "s",  cond_keyword },
-  { "LARGER",     "n",  cond_larger },
-  { "ON",         "d",  cond_on },
-  { "SENTBEFORE", "d",  cond_sentbefore },
-  { "SENTON",     "d",  cond_senton },
-  { "SENTSINCE",  "d",  cond_sentsince },
-  { "SINCE",      "d",  cond_since },
-  { "SMALLER",    "n",  cond_smaller },
-  { "SUBJECT",    "s",  cond_subject },
-  { "TEXT",       "s",  cond_text },
-  { "TO",         "s",  cond_to },
-  { "UID",        "u",  cond_uid },
+  { "BCC",        "s",  cond_bcc,        COST_HEADER },
+  { "BEFORE",     "d",  cond_before,     COST_ENVELOPE },
+  { "BODY",       "s",  cond_body,       COST_BODY },
+  { "CC",         "s",  cond_cc,         COST_HEADER },
+  { "FROM",       "s",  cond_from,       COST_HEADER },
+  { "HEADER",     "ss", cond_header,     COST_HEADER },
+  { "KEYWORD",    "s",  cond_keyword,    COST_FLAGS },
+  { "LARGER",     "n",  cond_larger,     COST_ENVELOPE },
+  { "ON",         "d",  cond_on,         COST_ENVELOPE },
+  { "SENTBEFORE", "d",  cond_sentbefore, COST_HEADER },
+  { "SENTON",     "d",  cond_senton,     COST_HEADER },
+  { "SENTSINCE",  "d",  cond_sentsince,  COST_HEADER },
+  { "SINCE",      "d",  cond_since,      COST_ENVELOPE },
+  { "SMALLER",    "n",  cond_smaller,    COST_ENVELOPE },
+  { "SUBJECT",    "s",  cond_subject,    COST_HEADER },
+  { "TEXT",       "s",  cond_text,       COST_TEXT },
+  { "TO",         "s",  cond_to,         COST_HEADER },
+  { "UID",        "u",  cond_uid,        COST_SET },
   { NULL }
 };
 
@@ -229,6 +254,11 @@ struct parsebuf
   struct search_node *tree;     /* Parse tree */
   
                                 /* Execution time only: */
+  size_t count;                 /* Number of messages in the mailbox */
+  int cost;                     /* Evaluation cost of the tree */
+  int use_index;                /* Search index is available */
+  int *flags;                   /* If not NULL, attributes of the messages,
+				   indexed by message number */
   size_t msgno;                 /* Number of current message */
   mu_message_t msg;             /* Current message */ 
 };
@@ -241,7 +271,20 @@ static struct search_node *parse_search_key_list (struct parsebuf *pb);
 static struct search_node *parse_search_key (struct parsebuf *pb);
 static int parse_gettoken (struct parsebuf *pb, int req);
 static int search_run (struct parsebuf *pb);
+static void plan_search (struct parsebuf *pb);
 static void do_search (struct parsebuf *pb);
+static int search_candidates (struct parsebuf *pb, struct search_node *node,
+			      char *set, size_t count);
+static int search_text_keys (struct search_node *node);
+#ifdef WITH_PTHREAD
+static signed char *search_parallel (struct parsebuf *pb, char *cand);
+#endif
+
+/* Number of threads to use for evaluating search queries.  Values less
+   than 2 disable parallel evaluation. */
+size_t search_threads;
+/* Minimal number of messages to be evaluated in parallel */
+size_t search_parallel_threshold = 1000;
 
 /*
 6.4.4.  SEARCH Command
@@ -325,7 +368,9 @@ imap4d_search0 (imap4d_tokbuf_t tok, int isuid, char **err_text)
       return RESP_BAD;
     }
   
-  /* Execute compiled expression */
+  /* Optimize and execute compiled expression */
+  mu_mailbox_messages_count (mbox, &parsebuf.count);
+  plan_search (&parsebuf);
   do_search (&parsebuf);
   
   parse_free_mem (&parsebuf);
@@ -339,15 +384,37 @@ imap4d_search0 (imap4d_tokbuf_t tok, int isuid, char **err_text)
 void
 do_search (struct parsebuf *pb)
 {
-  size_t count = 0;
+  size_t count = pb->count;
+  char *cand;
+  signed char *result = NULL;
+  
+  pb->use_index = search_text_keys (pb->tree)
+		  && search_index_update () == 0;
+  cand = mu_alloc (count + 1);
+  if (!search_candidates (pb, pb->tree, cand, count))
+    {
+      free (cand);
+      cand = NULL;
+    }
+#ifdef WITH_PTHREAD
+  result = search_parallel (pb, cand);
+#endif
   
-  mu_mailbox_messages_count (mbox, &count);
-
   io_sendf ("* SEARCH");
   for (pb->msgno = 1; pb->msgno <= count; pb->msgno++)
     {
-      if (mu_mailbox_get_message (mbox, pb->msgno, &pb->msg) == 0
-	  && search_run (pb))
+      int match;
+      
+      if (cand && !cand[pb->msgno])
+	continue;
+      if (mu_mailbox_get_message (mbox, pb->msgno, &pb->msg))
+	continue;
+      /* Evaluate the messages that the threads were not able to */
+      if (result && result[pb->msgno] >= 0)
+	match = result[pb->msgno];
+      else
+	match = search_run (pb);
+      if (match)
 	{
 	  if (pb->isuid)
 	    {
@@ -360,6 +427,317 @@ do_search (struct parsebuf *pb)
 	}
     }
   io_sendf ("\n");
+  free (cand);
+}
+
+#ifdef WITH_PTHREAD
+/* Parallel evaluation */
+
+/* Maximal number of messages a thread takes at a time */
+#define SEARCH_CHUNK 64
+
+struct search_job
+{
+  struct parsebuf *pb;          /* Query */
+  char *cand;                   /* Candidate messages, or NULL */
+  size_t *uid;                  /* UIDs of the messages */
+  signed char *result;          /* Results: 0, 1, or -1 if not evaluated */
+  unsigned long uidvalidity;    /* UIDVALIDITY of the mailbox */
+  pthread_mutex_t mutex;        /* Protects next */
+  size_t next;                  /* Next message to evaluate */
+  size_t chunk;                 /* Number of messages to take at a time */
+};
+
+struct search_worker
+{
+  struct search_job *job;
+  mu_mailbox_t mbox;            /* Private mailbox, NULL for the main
+				   thread */
+  size_t count;                 /* Number of messages in mbox */
+  pthread_t tid;
+  int joinable;                 /* True if tid must be joined */
+};
+
+/* Find in MBX, which has COUNT messages, the message with the given UID.
+   Message numbers in MBX are likely to be the same as in the selected
+   mailbox, so HINT is tried first. */
+static int
+search_locate (mu_mailbox_t mbx, size_t count, size_t uid, size_t hint,
+	       mu_message_t *pmsg)
+{
+  size_t lo = 1, hi = count, n;
+
+  if (hint <= count
+      && mu_mailbox_get_message (mbx, hint, pmsg) == 0
+      && mu_message_get_uid (*pmsg, &n) == 0
+      && n == uid)
+    return 0;
+  while (lo <= hi)
+    {
+      size_t mid = (lo + hi) / 2;
+
+      if (mu_mailbox_get_message (mbx, mid, pmsg)
+	  || mu_message_get_uid (*pmsg, &n))
+	break;
+      if (n == uid)
+	return 0;
+      if (n < uid)
+	lo = mid + 1;
+      else
+	hi = mid - 1;
+    }
+  return MU_ERR_NOENT;
+}
+
+/* Open a private instance of the selected mailbox for the worker W.
+   The mailbox is scanned here, so that the threads don't rescan it and
+   update its index concurrently.  It is read without locking, since
+   the selected mailbox is not modified while the search runs. */
+static int
+search_worker_open (struct search_worker *w, mu_url_t url)
+{
+  mu_url_t wurl;
+  mu_locker_t lck;
+  unsigned long uidvalidity;
+
+  if (mu_url_dup (url, &wurl))
+    return 1;
+  if (mu_mailbox_create_from_url (&w->mbox, wurl))
+    {
+      mu_url_destroy (&wurl);
+      return 1;
+    }
+  if (mu_locker_create (&lck, "/dev/null", MU_LOCKER_NULL) == 0)
+    mu_mailbox_set_locker (w->mbox, lck);
+  if (mu_mailbox_open (w->mbox, MU_STREAM_READ))
+    {
+      mu_mailbox_destroy (&w->mbox);
+      return 1;
+    }
+  if (mu_mailbox_messages_count (w->mbox, &w->count)
+      || mu_mailbox_uidvalidity (w->mbox, &uidvalidity)
+      || uidvalidity != w->job->uidvalidity)
+    {
+      mu_mailbox_close (w->mbox);
+      mu_mailbox_destroy (&w->mbox);
+      return 1;
+    }
+  return 0;
+}
+
+static void *
+search_thread (void *data)
+{
+  struct search_worker *w = data;
+  struct search_job *job = w->job;
+  struct parsebuf pb = *job->pb;
+  mu_mailbox_t mbx = w->mbox ? w->mbox : mbox;
+  size_t start, end, i;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&job->mutex);
+      start = job->next;
+      end = start + job->chunk;
+      if (end > pb.count + 1)
+	end = pb.count + 1;
+      job->next = end;
+      pthread_mutex_unlock (&job->mutex);
+      if (start >= end)
+	break;
+      
+      for (i = start; i < end; i++)
+	{
+	  int rc;
+	  
+	  if (job->cand && !job->cand[i])
+	    continue;
+	  /* Messages the thread cannot find are left for the main loop */
+	  if (w->mbox)
+	    rc = search_locate (mbx, w->count, job->uid[i], i, &pb.msg);
+	  else
+	    rc = mu_mailbox_get_message (mbx, i, &pb.msg);
+	  if (rc == 0)
+	    {
+	      /* Keep the numbering of the selected mailbox, which is
+		 what the precomputed sets use */
+	      pb.msgno = i;
+	      job->result[i] = search_run (&pb);
+	    }
+	}
+    }
+  return NULL;
+}
+
+/* Evaluate the query in several threads, if it is worth it.  Return an
+   array of results indexed by message number, or NULL if the query
+   should be evaluated sequentially.  Messages that could not be evaluated
+   have the result -1. */
+static signed char *
+search_parallel (struct parsebuf *pb, char *cand)
+{
+  struct search_job job;
+  struct search_worker *wtab;
+  size_t nthreads = search_threads, n, i;
+  mu_url_t url;
+  
+  /* Cheap conditions do not repay the cost of opening the mailbox */
+  if (nthreads < 2 || pb->cost < COST_HEADER)
+    return NULL;
+  if (cand)
+    for (i = 1, n = 0; i <= pb->count; i++)
+      n += cand[i] != 0;
+  else
+    n = pb->count;
+  if (n == 0 || n < search_parallel_threshold)
+    return NULL;
+  if (nthreads > n)
+    nthreads = n;
+  if (nthreads < 2
+      || mu_mailbox_uidvalidity (mbox, &job.uidvalidity)
+      || mu_mailbox_get_url (mbox, &url))
+    return NULL;
+  
+  /* Take a snapshot of the UIDs and flags, which may have been changed
+     by this session without being saved yet. */
+  job.pb = pb;
+  job.cand = cand;
+  job.uid = parse_alloc (pb, (pb->count + 1) * sizeof (job.uid[0]));
+  job.result = parse_alloc (pb, pb->count + 1);
+  pb->flags = parse_alloc (pb, (pb->count + 1) * sizeof (pb->flags[0]));
+  for (i = 1; i <= pb->count; i++)
+    {
+      mu_message_t msg;
+      mu_attribute_t attr;
+
+      job.uid[i] = 0;
+      pb->flags[i] = 0;
+      job.result[i] = -1;
+      if ((cand && !cand[i]) || mu_mailbox_get_message (mbox, i, &msg))
+	continue;
+      mu_message_get_uid (msg, &job.uid[i]);
+      mu_message_get_attribute (msg, &attr);
+      mu_attribute_get_flags (attr, &pb->flags[i]);
+    }
+  pthread_mutex_init (&job.mutex, NULL);
+  job.next = 1;
+  /* Small chunks balance the load, large ones reduce the contention */
+  job.chunk = pb->count / (4 * nthreads);
+  if (job.chunk == 0)
+    job.chunk = 1;
+  else if (job.chunk > SEARCH_CHUNK)
+    job.chunk = SEARCH_CHUNK;
+
+  /* The mailboxes are opened and destroyed in this thread, because
+     the list of known folders is global.  The main thread takes its
+     share using the selected mailbox. */
+  wtab = mu_calloc (nthreads, sizeof (wtab[0]));
+  for (i = 0; i < nthreads; i++)
+    {
+      wtab[i].job = &job;
+      if (i > 0 && search_worker_open (&wtab[i], url) == 0
+	  && pthread_create (&wtab[i].tid, NULL, search_thread,
+			     &wtab[i]) == 0)
+	wtab[i].joinable = 1;
+    }
+  search_thread (&wtab[0]);
+  for (i = 1; i < nthreads; i++)
+    {
+      if (wtab[i].joinable)
+	pthread_join (wtab[i].tid, NULL);
+      if (wtab[i].mbox)
+	{
+	  mu_mailbox_close (wtab[i].mbox);
+	  mu_mailbox_destroy (&wtab[i].mbox);
+	}
+    }
+  pthread_mutex_destroy (&job.mutex);
+  free (wtab);
+  return job.result;
+}
+#endif
+
+/* Return true if the expression NODE contains BODY or TEXT keys for
+   which search_candidates can consult the search index. */
+static int
+search_text_keys (struct search_node *node)
+{
+  switch (node->type)
+    {
+    case node_call:
+      return node->v.key.fun == cond_body || node->v.key.fun == cond_text;
+
+    case node_and:
+    case node_or:
+      return search_text_keys (node->v.arg[0])
+	     || search_text_keys (node->v.arg[1]);
+
+    default:
+      break;
+    }
+  return 0;
+}
+
+/* Compute in SET the messages that can satisfy the expression NODE,
+   using the precomputed message sets and the search index.  SET has
+   COUNT + 1 elements and is indexed by message numbers.  Return 0 if the
+   set of messages cannot be narrowed, i.e. any message can match. */
+static int
+search_candidates (struct parsebuf *pb, struct search_node *node,
+		   char *set, size_t count)
+{
+  char *tmp;
+  int rc;
+  size_t i;
+  
+  switch (node->type)
+    {
+    case node_call:
+      if (node->v.key.set)
+	{
+	  memcpy (set, node->v.key.set, count + 1);
+	  return 1;
+	}
+      if (pb->use_index
+	  && (node->v.key.fun == cond_body || node->v.key.fun == cond_text))
+	return search_index_lookup (node->v.key.arg[0]->v.value.v.string,
+				    set, count);
+      break;
+
+    case node_and:
+      tmp = mu_alloc (count + 1);
+      if (search_candidates (pb, node->v.arg[0], set, count))
+	{
+	  if (search_candidates (pb, node->v.arg[1], tmp, count))
+	    for (i = 1; i <= count; i++)
+	      set[i] &= tmp[i];
+	  rc = 1;
+	}
+      else if (search_candidates (pb, node->v.arg[1], tmp, count))
+	{
+	  memcpy (set, tmp, count + 1);
+	  rc = 1;
+	}
+      else
+	rc = 0;
+      free (tmp);
+      return rc;
+
+    case node_or:
+      if (!search_candidates (pb, node->v.arg[0], set, count))
+	break;
+      tmp = mu_alloc (count + 1);
+      rc = search_candidates (pb, node->v.arg[1], tmp, count);
+      if (rc)
+	for (i = 1; i <= count; i++)
+	  set[i] |= tmp[i];
+      free (tmp);
+      return rc;
+
+    default:
+      break;
+    }
+  return 0;
 }
 
 /* Parse buffer functions */
@@ -619,6 +997,8 @@ parse_simple_key (struct parsebuf *pb)
 	  node = parse_alloc (pb, sizeof *node);
 	  node->type = node_call;
 	  node->v.key.keyword = "msgset";
+	  node->v.key.cost = COST_SET;
+	  node->v.key.set = NULL;
 	  node->v.key.narg = 1;
 	  node->v.key.arg[0] = np;
 	  node->v.key.fun = cond_msgset;
@@ -638,6 +1018,8 @@ parse_simple_key (struct parsebuf *pb)
   node->type = node_call;
   node->v.key.keyword = condp->name;
   node->v.key.fun = condp->inst;
+  node->v.key.cost = condp->cost;
+  node->v.key.set = NULL;
   node->v.key.narg = 0;
   
   parse_gettoken (pb, 0);
@@ -694,12 +1076,11 @@ parse_simple_key (struct parsebuf *pb)
 	      break;
 	      
 	    case 'u': /* UID message set */
-	      arg->v.value.v.msgset = parse_msgset_create (pb, NULL,
-							   MU_MSGSET_NUM);
+	      arg->v.value.v.msgset = parse_msgset_create (pb, mbox,
+							   MU_MSGSET_UID);
 	      if (mu_msgset_parse_imap (arg->v.value.v.msgset, MU_MSGSET_UID,
 					pb->token, NULL)) 
 		{
-		  mu_msgset_free (arg->v.value.v.msgset);
 		  pb->err_mesg = "Bogus number set";
 		  return NULL;
 		}
@@ -718,6 +1099,132 @@ parse_simple_key (struct parsebuf *pb)
   return node;
 }
 
+/* Query planner */
+
+/* Compute the set of messages matching the message set or UID condition
+   NODE. */
+static void
+plan_set (struct parsebuf *pb, struct search_node *node)
+{
+  mu_msgset_t msgset = node->v.key.arg[0]->v.value.v.msgset;
+  char *set = parse_alloc (pb, pb->count + 1);
+  size_t i;
+
+  set[0] = 0;
+  for (i = 1; i <= pb->count; i++)
+    {
+      size_t n = i;
+      
+      if (node->v.key.fun == cond_uid
+	  && mu_mailbox_translate (mbox, MU_MAILBOX_MSGNO_TO_UID, i, &n))
+	n = 0;
+      set[i] = n && mu_msgset_locate (msgset, n, NULL) == 0;
+    }
+  node->v.key.set = set;
+}
+
+/* Count the operands of a chain of binary nodes of type TYPE */
+static size_t
+count_operands (struct search_node *node, enum node_type type)
+{
+  if (node->type != type)
+    return 1;
+  return count_operands (node->v.arg[0], type)
+         + count_operands (node->v.arg[1], type);
+}
+
+/* Store the operands of a chain of binary nodes of type TYPE in OPS,
+   and the binary nodes themselves in LINKS, the topmost one last. */
+static void
+collect_operands (struct search_node *node, enum node_type type,
+		  struct search_node **ops, size_t *nops,
+		  struct search_node **links, size_t *nlinks)
+{
+  if (node->type != type)
+    ops[(*nops)++] = node;
+  else
+    {
+      collect_operands (node->v.arg[0], type, ops, nops, links, nlinks);
+      collect_operands (node->v.arg[1], type, ops, nops, links, nlinks);
+      links[(*nlinks)++] = node;
+    }
+}
+
+static int plan_node (struct parsebuf *pb, struct search_node *node);
+
+/* Plan a chain of AND or OR nodes.  The operands are sorted in order of
+   increasing cost, so that the short-circuit evaluation avoids expensive
+   conditions whenever possible.  NODE remains the top of the chain. */
+static int
+plan_chain (struct parsebuf *pb, struct search_node *node)
+{
+  size_t n = count_operands (node, node->type);
+  struct search_node **ops = mu_calloc (n, sizeof (ops[0]));
+  struct search_node **links = mu_calloc (n - 1, sizeof (links[0]));
+  int *cost = mu_calloc (n, sizeof (cost[0]));
+  size_t nops = 0, nlinks = 0, i, j;
+  int total = 0;
+
+  collect_operands (node, node->type, ops, &nops, links, &nlinks);
+  /* Insertion sort keeps operands of equal cost in their original
+     order */
+  for (i = 0; i < n; i++)
+    {
+      struct search_node *op = ops[i];
+      int c = plan_node (pb, op);
+
+      for (j = i; j > 0 && cost[j - 1] > c; j--)
+	{
+	  ops[j] = ops[j - 1];
+	  cost[j] = cost[j - 1];
+	}
+      ops[j] = op;
+      cost[j] = c;
+      total += c;
+    }
+
+  for (i = 0; i < nlinks; i++)
+    {
+      links[i]->v.arg[0] = i == 0 ? ops[0] : links[i - 1];
+      links[i]->v.arg[1] = ops[i + 1];
+    }
+
+  free (ops);
+  free (links);
+  free (cost);
+  return total;
+}
+
+/* Optimize the subtree NODE and return its evaluation cost */
+static int
+plan_node (struct parsebuf *pb, struct search_node *node)
+{
+  switch (node->type)
+    {
+    case node_call:
+      if (node->v.key.fun == cond_msgset || node->v.key.fun == cond_uid)
+	plan_set (pb, node);
+      return node->v.key.cost;
+
+    case node_and:
+    case node_or:
+      return plan_chain (pb, node);
+
+    case node_not:
+      return plan_node (pb, node->v.arg[0]);
+
+    case node_value:
+      break;
+    }
+  return 0;
+}
+
+static void
+plan_search (struct parsebuf *pb)
+{
+  pb->cost = plan_node (pb, pb->tree);
+}
+
 /* Executes a query from parsebuf */
 void
 evaluate_node (struct search_node *node, struct parsebuf *pb,
@@ -834,7 +1341,7 @@ _scan_header_all (struct parsebuf *pb, char *text)
 
   mu_message_get_header (pb->msg, &header);
   mu_header_get_field_count (header, &fcount);
-  for (i = rc = 0; i < fcount; i++)
+  for (i = 1, rc = 0; rc == 0 && i <= fcount; i++)
     {
       if (mu_header_sget_field_value (header, i, &hval) == 0)
 	rc = util_strcasestr (hval, text) != NULL;
@@ -843,30 +1350,39 @@ _scan_header_all (struct parsebuf *pb, char *text)
 }
 
 /* Scan body of the message for the occurrence of a substring */
-/* FIXME: The algorithm below is broken */
 static int
 _scan_body (struct parsebuf *pb, char *text)
 {
   mu_body_t body = NULL;
   mu_stream_t stream = NULL;
-  size_t size = 0, lines = 0;
-  char buffer[128];
-  size_t n = 0;
+  size_t len = strlen (text);
+  size_t bufsize = 1024;
+  char *buffer;
+  size_t keep = 0, n = 0;
   int rc;
-  
+
+  if (len == 0)
+    return 1;
+  /* Keep the last LEN-1 bytes of each chunk, so that the matches
+     spanning chunk boundaries are not missed */
+  if (bufsize < 2 * len)
+    bufsize = 2 * len;
+  buffer = mu_alloc (bufsize + 1);
   mu_message_get_body (pb->msg, &body);
-  mu_body_size (body, &size);
-  mu_body_lines (body, &lines);
   mu_body_get_streamref (body, &stream);
   rc = 0;
   while (rc == 0
-	 && mu_stream_read (stream, buffer, sizeof(buffer)-1, &n) == 0
+	 && mu_stream_read (stream, buffer + keep, bufsize - keep, &n) == 0
 	 && n > 0)
     {
+      n += keep;
       buffer[n] = 0;
       rc = util_strcasestr (buffer, text) != NULL;
+      keep = n < len - 1 ? n : len - 1;
+      memmove (buffer, buffer + n - keep, keep);
     }
   mu_stream_destroy (&stream);
+  free (buffer);
   return rc;
 }
 
@@ -876,9 +1392,12 @@ static void
 cond_msgset (struct parsebuf *pb, struct search_node *node, struct value *arg,
 	     struct value *retval)
 {
-  int rc = mu_msgset_locate (arg[0].v.msgset, pb->msgno, NULL);
   retval->type = value_number;
-  retval->v.number = rc == 0;
+  if (node->v.key.set)
+    retval->v.number = node->v.key.set[pb->msgno];
+  else
+    retval->v.number = mu_msgset_locate (arg[0].v.msgset, pb->msgno,
+					 NULL) == 0;
 }
 
 static void
@@ -958,11 +1477,18 @@ cond_keyword (struct parsebuf *pb, struct search_node *node, struct value *arg,
 	     struct value *retval)
 {
   char *s = arg[0].v.string;
-  mu_attribute_t attr = NULL;
+  int flags = 0;
   
-  mu_message_get_attribute (pb->msg, &attr);
+  if (pb->flags)
+    flags = pb->flags[pb->msgno];
+  else
+    {
+      mu_attribute_t attr = NULL;
+      mu_message_get_attribute (pb->msg, &attr);
+      mu_attribute_get_flags (attr, &flags);
+    }
   retval->type = value_number;
-  retval->v.number = util_attribute_matches_flag (attr, s);
+  retval->v.number = util_flags_match (flags, s);
 }                  
 
 static void
@@ -1094,12 +1620,15 @@ static void
 cond_uid (struct parsebuf *pb, struct search_node *node, struct value *arg,
 	  struct value *retval)
 {
-  int rc;
   size_t uid = 0;
   
-  mu_message_get_uid (pb->msg, &uid);
-  rc = mu_msgset_locate (arg[0].v.msgset, pb->msgno, NULL);
   retval->type = value_number;
-  retval->v.number = rc == 0;
+  if (node->v.key.set)
+    retval->v.number = node->v.key.set[pb->msgno];
+  else
+    {
+      mu_message_get_uid (pb->msg, &uid);
+      retval->v.number = mu_msgset_locate (arg[0].v.msgset, uid, NULL) == 0;
+    }
 }                      
 
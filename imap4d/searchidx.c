@@ -0,0 +1,871 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   GNU Mailutils is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GNU Mailutils is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Full-text search index.
+
+   The index maps each word occurring in the messages of a mailbox to the
+   list of UIDs of the messages that contain it.  SEARCH consults it to
+   narrow the set of messages that can satisfy BODY and TEXT keys, so
+   that only these messages have to be read.
+
+   A word is a maximal sequence of ASCII alphanumerics and bytes with the
+   eighth bit set, folded to lower case.  A string can occur in a message
+   only if each of its words is a part of some word of the message.
+   Therefore, the candidates for a string are the messages that have,
+   for each word of the string, at least one indexed word that contains
+   it as a substring.
+
+   Words longer than MAXWORD bytes are indexed as overlapping fragments
+   of MAXWORD bytes, starting at each FRAGSTEP'th byte.  Words of the
+   search string are truncated to FRAGSTEP + 1 bytes, so that each of
+   them, if present in the message, lies entirely within one of the
+   fragments.
+
+   Messages that contain more than MAXMSGWORDS distinct words (normally,
+   these are messages with large encoded attachments) are not indexed.
+   Their UIDs are kept in a separate list and they are always regarded
+   as candidates.
+
+   The index of the selected mailbox is kept in memory.  It is brought
+   up to date before each search: messages with UIDs greater than the
+   last indexed one are indexed, and the UIDs of expunged messages are
+   removed from it.  Then the index is saved to a file in the directory
+   set by the "search-index-directory" configuration statement.  The
+   file is named after the mailbox path, with "/" and "%" characters
+   encoded as "%2F" and "%25", and has the following format:
+
+     # GNU Mailutils search index
+     version 1
+     uidvalidity UIDVALIDITY
+     last UID
+     uids UID...
+     unindexed UID...
+     w WORD UID...
+
+   where "last" gives the last indexed UID, "uids" lists all the UIDs
+   covered by the index, "unindexed" lists the UIDs of messages that
+   are not indexed, and each "w" line gives a word and the UIDs of
+   messages it occurs in.  All lists of UIDs are delta-encoded. */
+
+#include "imap4d.h"
+
+#define SEARCH_INDEX_VERSION 1
+
+#define MAXWORD     64
+#define FRAGSTEP    (MAXWORD / 2)
+#define MAXMSGWORDS 10000
+
+char *search_index_dir;
+
+struct uidlist
+{
+  size_t *uid;
+  size_t count;
+  size_t max;
+};
+
+struct word
+{
+  struct uidlist uids;       /* UIDs of messages containing this word */
+  char name[1];              /* The word itself */
+};
+
+struct search_index
+{
+  char *file;                /* Index file name */
+  unsigned long uidvalidity; /* UIDVALIDITY of the mailbox */
+  size_t last;               /* Last indexed UID */
+  struct uidlist msgs;       /* UIDs of all messages covered by the index */
+  struct uidlist unindexed;  /* UIDs of messages that are not indexed */
+  struct word **tab;         /* Hash table of words */
+  size_t tab_size;           /* Size of tab (a power of 2) */
+  size_t word_count;         /* Number of words in tab */
+  int modified;              /* Index must be saved */
+};
+
+static struct search_index *cur_index;
+
+/* UID lists */
+
+static int
+uidlist_append (struct uidlist *lp, size_t uid)
+{
+  if (lp->count == lp->max)
+    {
+      size_t n = lp->max ? lp->max * 2 : 4;
+      size_t *p = realloc (lp->uid, n * sizeof (lp->uid[0]));
+      if (!p)
+	return ENOMEM;
+      lp->uid = p;
+      lp->max = n;
+    }
+  lp->uid[lp->count++] = uid;
+  return 0;
+}
+
+static int
+uidlist_locate (struct uidlist *lp, size_t uid, size_t *pidx)
+{
+  size_t lo = 0, hi = lp->count;
+
+  while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if (lp->uid[mid] < uid)
+	lo = mid + 1;
+      else if (lp->uid[mid] > uid)
+	hi = mid;
+      else
+	{
+	  if (pidx)
+	    *pidx = mid;
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+/* Remove from LP the UIDs that are not in KEEP */
+static void
+uidlist_filter (struct uidlist *lp, struct uidlist *keep)
+{
+  size_t i, j;
+
+  for (i = j = 0; i < lp->count; i++)
+    if (uidlist_locate (keep, lp->uid[i], NULL))
+      lp->uid[j++] = lp->uid[i];
+  lp->count = j;
+}
+
+/* Word table */
+
+static size_t
+word_hash (const char *s, size_t len)
+{
+  size_t h = 2166136261u;
+
+  while (len--)
+    {
+      h ^= *(unsigned char*) s++;
+      h *= 16777619;
+    }
+  return h;
+}
+
+/* Return the slot for the word S of length LEN.  If the word is not
+   in the table, the slot is empty. */
+static size_t
+word_slot (struct search_index *idx, const char *s, size_t len)
+{
+  size_t i = word_hash (s, len) & (idx->tab_size - 1);
+
+  while (idx->tab[i]
+	 && !(strncmp (idx->tab[i]->name, s, len) == 0
+	      && idx->tab[i]->name[len] == 0))
+    i = (i + 1) & (idx->tab_size - 1);
+  return i;
+}
+
+static int
+word_table_grow (struct search_index *idx)
+{
+  struct word **old_tab = idx->tab;
+  size_t old_size = idx->tab_size;
+  size_t i;
+
+  idx->tab_size = old_size ? old_size * 2 : 1024;
+  idx->tab = calloc (idx->tab_size, sizeof (idx->tab[0]));
+  if (!idx->tab)
+    {
+      idx->tab = old_tab;
+      idx->tab_size = old_size;
+      return ENOMEM;
+    }
+  for (i = 0; i < old_size; i++)
+    if (old_tab[i])
+      {
+	struct word *wp = old_tab[i];
+	idx->tab[word_slot (idx, wp->name, strlen (wp->name))] = wp;
+      }
+  free (old_tab);
+  return 0;
+}
+
+static int
+word_install (struct search_index *idx, const char *s, size_t len,
+	      struct word **pwp)
+{
+  struct word *wp;
+  size_t i;
+
+  if ((idx->word_count + 1) * 2 > idx->tab_size)
+    {
+      int rc = word_table_grow (idx);
+      if (rc)
+	return rc;
+    }
+  i = word_slot (idx, s, len);
+  if (!idx->tab[i])
+    {
+      wp = malloc (sizeof (*wp) + len);
+      if (!wp)
+	return ENOMEM;
+      memset (&wp->uids, 0, sizeof (wp->uids));
+      memcpy (wp->name, s, len);
+      wp->name[len] = 0;
+      idx->tab[i] = wp;
+      idx->word_count++;
+    }
+  *pwp = idx->tab[i];
+  return 0;
+}
+
+/* Remove the word in slot I, rearranging the collision chain that
+   follows it. */
+static void
+word_remove (struct search_index *idx, size_t i)
+{
+  size_t mask = idx->tab_size - 1;
+  size_t j;
+
+  free (idx->tab[i]->uids.uid);
+  free (idx->tab[i]);
+  idx->tab[i] = NULL;
+  idx->word_count--;
+
+  for (j = (i + 1) & mask; idx->tab[j]; j = (j + 1) & mask)
+    {
+      struct word *wp = idx->tab[j];
+      size_t k = word_hash (wp->name, strlen (wp->name)) & mask;
+
+      /* Move the entry to slot I unless its home slot K lies cyclically
+	 in (I, J]. */
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+	continue;
+      idx->tab[i] = wp;
+      idx->tab[j] = NULL;
+      i = j;
+    }
+}
+
+static void
+word_remove_empty (struct search_index *idx)
+{
+  size_t i = 0;
+
+  while (i < idx->tab_size)
+    {
+      if (idx->tab[i] && idx->tab[i]->uids.count == 0)
+	/* Another entry may have moved into this slot */
+	word_remove (idx, i);
+      else
+	i++;
+    }
+}
+
+static void
+search_index_clear (struct search_index *idx)
+{
+  size_t i;
+
+  for (i = 0; i < idx->tab_size; i++)
+    if (idx->tab[i])
+      {
+	free (idx->tab[i]->uids.uid);
+	free (idx->tab[i]);
+      }
+  free (idx->tab);
+  idx->tab = NULL;
+  idx->tab_size = idx->word_count = 0;
+  free (idx->msgs.uid);
+  free (idx->unindexed.uid);
+  memset (&idx->msgs, 0, sizeof (idx->msgs));
+  memset (&idx->unindexed, 0, sizeof (idx->unindexed));
+  idx->last = 0;
+  idx->modified = 1;
+}
+
+static void
+search_index_free (struct search_index *idx)
+{
+  search_index_clear (idx);
+  free (idx->file);
+  free (idx);
+}
+
+/* Indexing */
+
+/* Words of the message being indexed */
+struct msgwords
+{
+  struct search_index *idx;
+  size_t uid;
+  struct word **words;       /* Words this message has been added to */
+  size_t count;
+  size_t max;
+  char buf[MAXWORD];         /* Current word */
+  size_t len;                /* Its length */
+};
+
+/* Add the current word of MW to the index.  Return MU_ERR_BUFSPACE if
+   there are too many distinct words in the message. */
+static int
+msgwords_flush (struct msgwords *mw)
+{
+  struct word *wp;
+  int rc;
+
+  rc = word_install (mw->idx, mw->buf, mw->len, &wp);
+  if (rc)
+    return rc;
+  if (wp->uids.count && wp->uids.uid[wp->uids.count - 1] == mw->uid)
+    return 0;
+  if (mw->count == MAXMSGWORDS)
+    return MU_ERR_BUFSPACE;
+  if (mw->count == mw->max)
+    {
+      size_t n = mw->max ? mw->max * 2 : 256;
+      struct word **p = realloc (mw->words, n * sizeof (mw->words[0]));
+      if (!p)
+	return ENOMEM;
+      mw->words = p;
+      mw->max = n;
+    }
+  rc = uidlist_append (&wp->uids, mw->uid);
+  if (rc == 0)
+    mw->words[mw->count++] = wp;
+  return rc;
+}
+
+static int
+msgwords_scan (struct msgwords *mw, const char *buf, size_t size)
+{
+  int rc;
+
+  for (; size; buf++, size--)
+    {
+      int c = *(unsigned char*) buf;
+
+      if ((c & 0x80) || mu_isalnum (c))
+	{
+	  if (mw->len == MAXWORD)
+	    {
+	      rc = msgwords_flush (mw);
+	      if (rc)
+		return rc;
+	      memmove (mw->buf, mw->buf + FRAGSTEP, MAXWORD - FRAGSTEP);
+	      mw->len -= FRAGSTEP;
+	    }
+	  mw->buf[mw->len++] = mu_tolower (c);
+	}
+      else if (mw->len)
+	{
+	  rc = msgwords_flush (mw);
+	  mw->len = 0;
+	  if (rc)
+	    return rc;
+	}
+    }
+  return 0;
+}
+
+/* Undo the changes made to the index while scanning the message */
+static void
+msgwords_rollback (struct msgwords *mw)
+{
+  size_t i;
+
+  for (i = 0; i < mw->count; i++)
+    mw->words[i]->uids.count--;
+  word_remove_empty (mw->idx);
+}
+
+static int
+index_message (struct search_index *idx, mu_message_t msg, size_t uid)
+{
+  struct msgwords mw;
+  mu_stream_t str;
+  char buf[8192];
+  size_t n;
+  int rc;
+
+  rc = mu_message_get_streamref (msg, &str);
+  if (rc)
+    return rc;
+  memset (&mw, 0, sizeof (mw));
+  mw.idx = idx;
+  mw.uid = uid;
+  while ((rc = mu_stream_read (str, buf, sizeof buf, &n)) == 0 && n > 0)
+    {
+      rc = msgwords_scan (&mw, buf, n);
+      if (rc)
+	break;
+    }
+  mu_stream_destroy (&str);
+  if (rc == 0 && mw.len)
+    rc = msgwords_flush (&mw);
+
+  if (rc == MU_ERR_BUFSPACE)
+    {
+      msgwords_rollback (&mw);
+      rc = uidlist_append (&idx->unindexed, uid);
+    }
+  else if (rc)
+    msgwords_rollback (&mw);
+  free (mw.words);
+  if (rc == 0)
+    {
+      rc = uidlist_append (&idx->msgs, uid);
+      idx->last = uid;
+    }
+  return rc;
+}
+
+/* Remove from the index the messages that are no longer in the
+   mailbox.  COUNT is the number of messages in the mailbox that are
+   covered by the index. */
+static int
+index_purge (struct search_index *idx, size_t count)
+{
+  struct uidlist present;
+  size_t i;
+  int rc = 0;
+
+  memset (&present, 0, sizeof (present));
+  for (i = 1; i <= count; i++)
+    {
+      size_t uid;
+
+      rc = mu_mailbox_translate (mbox, MU_MAILBOX_MSGNO_TO_UID, i, &uid);
+      if (rc == 0)
+	rc = uidlist_append (&present, uid);
+      if (rc)
+	break;
+    }
+
+  if (rc == 0)
+    {
+      uidlist_filter (&idx->msgs, &present);
+      if (idx->msgs.count != present.count)
+	/* Some of the messages have not been indexed, which means the
+	   index is inconsistent with the mailbox */
+	rc = MU_ERR_FAILURE;
+    }
+  if (rc == 0)
+    {
+      uidlist_filter (&idx->unindexed, &present);
+      for (i = 0; i < idx->tab_size; i++)
+	if (idx->tab[i])
+	  uidlist_filter (&idx->tab[i]->uids, &present);
+      word_remove_empty (idx);
+      idx->modified = 1;
+    }
+  free (present.uid);
+  return rc;
+}
+
+static int
+index_update (struct search_index *idx)
+{
+  size_t count = 0, start, msgno;
+  unsigned long uidvalidity;
+  int rc;
+
+  rc = util_uidvalidity (mbox, &uidvalidity);
+  if (rc)
+    return rc;
+  if (uidvalidity != idx->uidvalidity)
+    {
+      search_index_clear (idx);
+      idx->uidvalidity = uidvalidity;
+    }
+
+  rc = mu_mailbox_messages_count (mbox, &count);
+  if (rc)
+    return rc;
+
+  /* Find the first message that has not been indexed yet */
+  for (start = count; start > 0; start--)
+    {
+      size_t uid;
+
+      rc = mu_mailbox_translate (mbox, MU_MAILBOX_MSGNO_TO_UID, start, &uid);
+      if (rc)
+	return rc;
+      if (uid <= idx->last)
+	break;
+    }
+  start++;
+
+  if (idx->msgs.count != start - 1)
+    {
+      /* Messages have been expunged */
+      rc = index_purge (idx, start - 1);
+      if (rc)
+	{
+	  mu_diag_output (MU_DIAG_NOTICE,
+			  _("rebuilding search index %s"), idx->file);
+	  search_index_clear (idx);
+	  idx->uidvalidity = uidvalidity;
+	  start = 1;
+	}
+    }
+
+  for (msgno = start; msgno <= count; msgno++)
+    {
+      mu_message_t msg;
+      size_t uid;
+
+      rc = mu_mailbox_get_message (mbox, msgno, &msg);
+      if (rc == 0)
+	rc = mu_message_get_uid (msg, &uid);
+      if (rc == 0)
+	rc = index_message (idx, msg, uid);
+      if (rc)
+	return rc;
+      idx->modified = 1;
+    }
+  return 0;
+}
+
+/* Index file */
+
+static int
+read_uidlist (char *p, struct uidlist *lp)
+{
+  size_t uid = 0;
+
+  while (*p == ' ')
+    {
+      char *q;
+      unsigned long n = strtoul (p + 1, &q, 10);
+      if (q == p + 1)
+	return MU_ERR_PARSE;
+      uid += n;
+      if (uidlist_append (lp, uid))
+	return ENOMEM;
+      p = q;
+    }
+  return *p == '\n' || *p == 0 ? 0 : MU_ERR_PARSE;
+}
+
+static int
+index_read (struct search_index *idx, mu_stream_t str)
+{
+  char *buf = NULL;
+  size_t size = 0, n;
+  unsigned long v;
+  int state = 0;
+  int rc;
+
+  while ((rc = mu_stream_getline (str, &buf, &size, &n)) == 0 && n > 0)
+    {
+      if (buf[0] == '#')
+	continue;
+      switch (state)
+	{
+	case 0:
+	  if (sscanf (buf, "version %lu", &v) != 1
+	      || v != SEARCH_INDEX_VERSION)
+	    rc = MU_ERR_PARSE;
+	  break;
+
+	case 1:
+	  if (sscanf (buf, "uidvalidity %lu", &idx->uidvalidity) != 1)
+	    rc = MU_ERR_PARSE;
+	  break;
+
+	case 2:
+	  if (sscanf (buf, "last %lu", &v) != 1)
+	    rc = MU_ERR_PARSE;
+	  else
+	    idx->last = v;
+	  break;
+
+	case 3:
+	  if (strncmp (buf, "uids", 4))
+	    rc = MU_ERR_PARSE;
+	  else
+	    rc = read_uidlist (buf + 4, &idx->msgs);
+	  break;
+
+	case 4:
+	  if (strncmp (buf, "unindexed", 9))
+	    rc = MU_ERR_PARSE;
+	  else
+	    rc = read_uidlist (buf + 9, &idx->unindexed);
+	  break;
+
+	default:
+	  {
+	    struct word *wp;
+	    size_t len;
+
+	    if (strncmp (buf, "w ", 2))
+	      {
+		rc = MU_ERR_PARSE;
+		break;
+	      }
+	    len = strcspn (buf + 2, " \n");
+	    if (len == 0 || len > MAXWORD)
+	      {
+		rc = MU_ERR_PARSE;
+		break;
+	      }
+	    rc = word_install (idx, buf + 2, len, &wp);
+	    if (rc == 0)
+	      {
+		if (wp->uids.count)
+		  rc = MU_ERR_PARSE;
+		else
+		  rc = read_uidlist (buf + 2 + len, &wp->uids);
+	      }
+	  }
+	}
+      if (rc)
+	break;
+      if (state < 5)
+	state++;
+    }
+  free (buf);
+
+  if (rc == 0 && state < 5)
+    rc = MU_ERR_PARSE;
+  if (rc == 0 && idx->msgs.count
+      && idx->msgs.uid[idx->msgs.count - 1] > idx->last)
+    rc = MU_ERR_PARSE;
+  return rc;
+}
+
+static void
+write_uidlist (mu_stream_t str, struct uidlist *lp)
+{
+  size_t i, prev = 0;
+
+  for (i = 0; i < lp->count; i++)
+    {
+      mu_stream_printf (str, " %lu", (unsigned long) (lp->uid[i] - prev));
+      prev = lp->uid[i];
+    }
+  mu_stream_write (str, "\n", 1, NULL);
+}
+
+static int
+index_write (struct search_index *idx, mu_stream_t str)
+{
+  size_t i;
+
+  mu_stream_printf (str, "# GNU Mailutils search index\n");
+  mu_stream_printf (str, "version %d\n", SEARCH_INDEX_VERSION);
+  mu_stream_printf (str, "uidvalidity %lu\n", idx->uidvalidity);
+  mu_stream_printf (str, "last %lu\n", (unsigned long) idx->last);
+  mu_stream_printf (str, "uids");
+  write_uidlist (str, &idx->msgs);
+  mu_stream_printf (str, "unindexed");
+  write_uidlist (str, &idx->unindexed);
+  for (i = 0; i < idx->tab_size && mu_stream_err (str) == 0; i++)
+    {
+      struct word *wp = idx->tab[i];
+      if (wp && wp->uids.count)
+	{
+	  mu_stream_printf (str, "w %s", wp->name);
+	  write_uidlist (str, &wp->uids);
+	}
+    }
+  if (mu_stream_err (str))
+    return mu_stream_last_error (str);
+  return mu_stream_flush (str);
+}
+
+static void
+search_index_load (struct search_index *idx)
+{
+  mu_stream_t str;
+  int rc;
+
+  rc = mu_file_stream_create (&str, idx->file, MU_STREAM_READ);
+  if (rc)
+    return;
+  rc = index_read (idx, str);
+  mu_stream_destroy (&str);
+  if (rc)
+    {
+      mu_diag_output (MU_DIAG_NOTICE, _("ignoring invalid search index %s"),
+		      idx->file);
+      search_index_clear (idx);
+      idx->uidvalidity = 0;
+    }
+  else
+    idx->modified = 0;
+}
+
+static int
+search_index_save (struct search_index *idx)
+{
+  struct mu_tempfile_hints hints;
+  char *tmpname;
+  mu_stream_t str;
+  int fd;
+  int rc;
+
+  hints.tmpdir = search_index_dir;
+  rc = mu_tempfile (&hints, MU_TEMPFILE_TMPDIR, &fd, &tmpname);
+  if (rc)
+    return rc;
+  rc = mu_fd_stream_create (&str, tmpname, fd, MU_STREAM_WRITE);
+  if (rc)
+    close (fd);
+  else
+    {
+      rc = index_write (idx, str);
+      mu_stream_destroy (&str);
+    }
+  if (rc == 0 && rename (tmpname, idx->file))
+    rc = errno;
+  if (rc)
+    unlink (tmpname);
+  else
+    idx->modified = 0;
+  free (tmpname);
+  return rc;
+}
+
+/* Return the name of the index file for the currently selected mailbox */
+static char *
+index_file_name (void)
+{
+  mu_url_t url;
+  const char *path;
+  char *name;
+
+  if (mu_mailbox_get_url (mbox, &url) || mu_url_sget_path (url, &path))
+    return NULL;
+  while (*path == '/')
+    path++;
+  name = mu_make_file_name_encoded (search_index_dir, path);
+  if (!name)
+    mu_alloc_die ();
+  return name;
+}
+
+/* Public interface */
+
+/* Prepare the search index of the selected mailbox for use.  Return 0
+   on success. */
+int
+search_index_update (void)
+{
+  char *file;
+  int rc;
+
+  if (!search_index_dir || !mbox)
+    return ENOSYS;
+  file = index_file_name ();
+  if (!file)
+    return ENOSYS;
+
+  if (cur_index && strcmp (cur_index->file, file) == 0)
+    free (file);
+  else
+    {
+      if (cur_index)
+	search_index_free (cur_index);
+      cur_index = mu_zalloc (sizeof (*cur_index));
+      cur_index->file = file;
+      search_index_load (cur_index);
+    }
+
+  rc = index_update (cur_index);
+  if (rc)
+    {
+      mu_diag_output (MU_DIAG_ERROR, _("cannot update search index %s: %s"),
+		      cur_index->file, mu_strerror (rc));
+      search_index_free (cur_index);
+      cur_index = NULL;
+      return rc;
+    }
+  if (cur_index->modified)
+    {
+      if (mkdir (search_index_dir, MKDIR_PERMISSIONS) && errno != EEXIST)
+	rc = errno;
+      else
+	rc = search_index_save (cur_index);
+      if (rc)
+	mu_diag_output (MU_DIAG_ERROR, _("cannot save search index %s: %s"),
+			cur_index->file, mu_strerror (rc));
+    }
+  return 0;
+}
+
+static void
+mark_uids (struct uidlist *lp, char *set, size_t count)
+{
+  size_t i, n;
+
+  for (i = 0; i < lp->count; i++)
+    if (uidlist_locate (&cur_index->msgs, lp->uid[i], &n) && n < count)
+      set[n + 1] = 1;
+}
+
+/* Compute in SET the messages that can contain TEXT.  SET is indexed by
+   message numbers and has COUNT + 1 elements.  Messages that arrived
+   after COUNT are ignored.  Return 0 if the index does not allow to
+   narrow the search.  Must be called after a successful
+   search_index_update. */
+int
+search_index_lookup (const char *text, char *set, size_t count)
+{
+  char *tmp = NULL;
+  int narrowed = 0;
+  const char *p = text;
+
+  while (*p)
+    {
+      char word[FRAGSTEP + 2];
+      size_t len = 0, i;
+
+      for (; *p && !((*p & 0x80) || mu_isalnum (*p)); p++)
+	;
+      for (; *p && ((*p & 0x80) || mu_isalnum (*p)); p++)
+	if (len <= FRAGSTEP)
+	  word[len++] = mu_tolower (*p);
+      if (len == 0)
+	break;
+      word[len] = 0;
+
+      if (!narrowed)
+	tmp = set;
+      else if (!tmp || tmp == set)
+	tmp = mu_alloc (count + 1);
+      memset (tmp, 0, count + 1);
+
+      mark_uids (&cur_index->unindexed, tmp, count);
+      for (i = 0; i < cur_index->tab_size; i++)
+	{
+	  struct word *wp = cur_index->tab[i];
+	  if (wp && strstr (wp->name, word))
+	    mark_uids (&wp->uids, tmp, count);
+	}
+
+      if (narrowed)
+	for (i = 1; i <= count; i++)
+	  set[i] &= tmp[i];
+      narrowed = 1;
+    }
+  if (tmp != set)
+    free (tmp);
+  return narrowed;
+}
@@ -25,6 +25,7 @@ static int *attr_table;
 static size_t attr_table_count;
 static size_t attr_table_max;
 static int attr_table_valid;
+static unsigned long attr_table_modseq;
 
 static void
 realloc_attributes (size_t total)
@@ -63,9 +64,47 @@ reread_attributes (void)
       mu_message_get_attribute (msg, &attr);
       mu_attribute_get_flags (attr, &attr_table[i-1]);
     }
+  mu_mailbox_modseq (mbox, &attr_table_modseq);
   attr_table_valid = 1;
 }
 
+/* Compare flags of the message MSGNO with the cached ones and notify
+   the client if they differ.  If MSGNO is past the end of the table,
+   just record its flags. */
+static void
+notify_flags (size_t msgno, size_t old_total)
+{
+  mu_message_t msg = NULL;
+  mu_attribute_t nattr = NULL;
+  int nflags;
+
+  mu_mailbox_get_message (mbox, msgno, &msg);
+  mu_message_get_attribute (msg, &nattr);
+  mu_attribute_get_flags (nattr, &nflags);
+
+  if (msgno <= old_total)
+    {
+      if (nflags != attr_table[msgno-1])
+	{
+	  io_sendf ("* %lu FETCH FLAGS (",  (unsigned long) msgno);
+	  mu_imap_format_flags (iostream, nflags, 1);
+	  io_sendf (")\n");
+	  attr_table[msgno-1] = nflags;
+	}
+    }
+  else
+    attr_table[msgno-1] = nflags;
+}
+
+static int
+notify_changed (size_t msgno, void *data)
+{
+  size_t *old_total = data;
+  if (msgno <= *old_total)
+    notify_flags (msgno, *old_total);
+  return 0;
+}
+
 static void
 notify (void)
 {
@@ -83,31 +122,24 @@ notify (void)
     {
       size_t old_total = attr_table_count;
       size_t i;
+      mu_msgset_t changes;
 
       realloc_attributes (total);
-      for (i = 1; i <= total; i++)
+      if (mu_mailbox_changes (mbox, attr_table_modseq, &changes) == 0)
+	{
+	  /* Examine only the messages changed since the last notification,
+	     plus the new ones. */
+	  mu_msgset_foreach_msgno (changes, notify_changed, &old_total);
+	  mu_msgset_free (changes);
+	  for (i = old_total + 1; i <= total; i++)
+	    notify_flags (i, old_total);
+	}
+      else
 	{
-	  mu_message_t msg = NULL;
-	  mu_attribute_t nattr = NULL;
-	  int nflags;
-	  
-	  mu_mailbox_get_message (mbox, i, &msg);
-	  mu_message_get_attribute (msg, &nattr);
-	  mu_attribute_get_flags (nattr, &nflags);
-
-	  if (i <= old_total)
-	    {
-	      if (nflags != attr_table[i-1])
-		{
-		  io_sendf ("* %lu FETCH FLAGS (",  (unsigned long) i);
-		  mu_imap_format_flags (iostream, nflags, 1);
-		  io_sendf (")\n");
-		  attr_table[i-1] = nflags;
-		}
-	    }
-	  else
-	    attr_table[i-1] = nflags;
+	  for (i = 1; i <= total; i++)
+	    notify_flags (i, old_total);
 	}
+      mu_mailbox_modseq (mbox, &attr_table_modseq);
     }
   
   io_untagged_response (RESP_NONE, "%lu EXISTS", (unsigned long) total);
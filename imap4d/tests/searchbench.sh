@@ -0,0 +1,108 @@
+#! /bin/sh
+# Measure the time imap4d takes to execute various SEARCH queries.
+# Copyright (C) 2013 Free Software Foundation, Inc.
+#
+# GNU Mailutils is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 3, or (at
+# your option) any later version.
+#
+# GNU Mailutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>.
+
+# Usage: searchbench.sh [-n REPEAT] [-o IMAP4D-OPTION]... [SIZE]
+#
+# Run from the imap4d/tests build directory.  A synthetic mailbox of
+# SIZE bytes (default 32m) is created with testsuite/mbscan.  Each query
+# is executed REPEAT times (default 3) within a single session, and the
+# average time per query is printed, excluding the time needed to open
+# the mailbox.  Additional imap4d options, e.g.
+# "--set search-index-directory=idx", can be given with -o.
+
+repeat=3
+opts=
+while test $# -gt 0
+do
+  case $1 in
+  -n) repeat=$2; shift 2;;
+  -o) opts="$opts $2"; shift 2;;
+  *)  break
+  esac
+done
+size=${1:-32m}
+
+: ${IMAP4D:=`pwd`/../imap4d}
+: ${MBSCAN:=`pwd`/../../testsuite/mbscan}
+
+dir=`mktemp -d ${TMPDIR:-/tmp}/searchbench.XXXXXX` || exit 1
+trap 'rm -rf $dir' 0 1 2 13 15
+$MBSCAN -g $size $dir/INBOX || exit 1
+
+now() {
+  date +%s%N
+}
+
+# run
+# Run imap4d on the commands from $dir/input.  Print the elapsed time in ns.
+run() {
+  start=`now`
+  (cd $dir &&
+   $IMAP4D --no-site-config --no-user-config --test \
+           --set logging.syslog=0 --set .gsasl.enable=0 \
+           --set "|homedir=$dir" --set "|mailbox|folder=$dir" \
+           --set "|mailbox|mailbox-pattern=$dir/INBOX" \
+           $opts --preauth < input > output 2>/dev/null)
+  stop=`now`
+  echo `expr $stop - $start`
+}
+
+# session QUERY
+# Open INBOX and run QUERY $repeat times.  Print the elapsed time in ns.
+session() {
+  { echo "1 SELECT INBOX"
+    i=0
+    while test $i -lt $repeat
+    do
+      test -n "$1" && echo "2 SEARCH $1"
+      i=`expr $i + 1`
+    done
+    echo "X LOGOUT"
+  } > $dir/input
+  run
+}
+
+# Mark the first 1000 messages as answered.  This also lets imap4d update
+# the status of messages, so that the mailbox is not rewritten by the
+# measured sessions.
+{ echo "1 SELECT INBOX"
+  echo "2 STORE 1:1000 +FLAGS (\\Answered)"
+  echo "X LOGOUT"
+} > $dir/input
+run > /dev/null
+base=`session ""`
+
+while read query
+do
+  t=`session "$query"`
+  hits=`grep '^\* SEARCH' $dir/output | head -1 | wc -w`
+  printf "%-40s %6d hits %10.3f ms\n" "$query" `expr $hits - 2` \
+    `expr \( $t - $base \) / $repeat / 1000`e-3
+done <<EOF
+ALL
+ANSWERED
+BODY delivery
+BODY delivery ANSWERED
+ANSWERED BODY delivery
+BODY delivery LARGER 20000
+1:100 BODY quoted
+UID 1:100 TEXT quoted
+OR SUBJECT 123 BODY xyzzy
+OR BODY xyzzy SUBJECT 123
+LARGER 8000 FROM user1
+TEXT xyzzy
+EOF
@@ -0,0 +1,131 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   GNU Mailutils is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GNU Mailutils is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Usage: tcpexec COMMAND [ARGS...]
+
+   Listen on a free TCP port of the loopback interface and run COMMAND
+   for each incoming connection, with its standard input and output
+   connected to the socket, like inetd does.  The utility switches to
+   the background and prints its PID and the port number on two
+   separate lines.  It exits after 60 seconds.
+
+   This allows to test network clients against servers run in inetd
+   mode, e.g.:
+
+     set -- `tcpexec imap4d --inetd`
+     mbscan imap://localhost:$2/INBOX
+     kill $1
+*/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+int
+main (int argc, char **argv)
+{
+  struct sockaddr_in address;
+  socklen_t len;
+  int fd, i;
+  pid_t pid;
+
+  if (argc < 2)
+    {
+      fprintf (stderr, "usage: %s COMMAND [ARGS...]\n", argv[0]);
+      return 1;
+    }
+
+  fd = socket (PF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    {
+      perror ("socket");
+      return 1;
+    }
+
+  memset (&address, 0, sizeof (address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  address.sin_port = 0;
+  len = sizeof (address);
+  if (bind (fd, (struct sockaddr *) &address, sizeof (address))
+      || getsockname (fd, (struct sockaddr *) &address, &len)
+      || listen (fd, 5))
+    {
+      perror ("bind");
+      return 1;
+    }
+
+  pid = fork ();
+  if (pid == -1)
+    {
+      perror ("fork");
+      return 1;
+    }
+  if (pid)
+    {
+      printf ("%lu\n", (unsigned long) pid);
+      printf ("%d\n", ntohs (address.sin_port));
+      return 0;
+    }
+
+  /* Child: don't hold the descriptors of the caller open */
+  fclose (stdout);
+  for (i = getdtablesize (); i > 2; i--)
+    if (i != fd)
+      close (i);
+  signal (SIGCHLD, SIG_IGN);
+  alarm (60);
+
+  while (1)
+    {
+      int sfd = accept (fd, NULL, NULL);
+      if (sfd < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  perror ("accept");
+	  return 1;
+	}
+      pid = fork ();
+      if (pid == -1)
+	perror ("fork");
+      else if (pid == 0)
+	{
+	  close (fd);
+	  dup2 (sfd, 0);
+	  dup2 (sfd, 1);
+	  /* The socket may get descriptor 1, since stdout is closed */
+	  if (sfd > 1)
+	    close (sfd);
+	  signal (SIGCHLD, SIG_DFL);
+	  alarm (0);
+	  execvp (argv[1], argv + 1);
+	  perror (argv[1]);
+	  _exit (127);
+	}
+      close (sfd);
+    }
+}
@@ -194,11 +194,10 @@ util_print_flags (mu_attribute_t attr)
 }
 
 int
-util_attribute_matches_flag (mu_attribute_t attr, const char *item)
+util_flags_match (int flags, const char *item)
 {
-  int flags = 0, mask = 0;
+  int mask = 0;
 
-  mu_attribute_get_flags (attr, &flags);
   mu_imap_flag_to_attribute (item, &mask);
   if (mask == MU_ATTRIBUTE_RECENT)
     return MU_ATTRIBUTE_IS_UNSEEN (flags);
@@ -206,6 +205,15 @@ util_attribute_matches_flag (mu_attribute_t attr, const char *item)
   return flags & mask;
 }
 
+int
+util_attribute_matches_flag (mu_attribute_t attr, const char *item)
+{
+  int flags = 0;
+
+  mu_attribute_get_flags (attr, &flags);
+  return util_flags_match (flags, item);
+}
+
 char *
 util_localname ()
 {
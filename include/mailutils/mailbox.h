@@ -86,6 +86,15 @@ extern int  mu_mailbox_get_size        (mu_mailbox_t, mu_off_t *size);
 extern int  mu_mailbox_is_updated      (mu_mailbox_t);
 extern int  mu_mailbox_scan            (mu_mailbox_t, size_t no, size_t *count);
 
+/* Change notification.  */
+extern int  mu_mailbox_watch           (mu_mailbox_t, int *pfd);
+extern int  mu_mailbox_watch_clear     (mu_mailbox_t, int *pchanged);
+
+/* Modification sequences.  */
+extern int  mu_mailbox_modseq          (mu_mailbox_t, unsigned long *);
+extern int  mu_mailbox_changes         (mu_mailbox_t, unsigned long since,
+					  mu_msgset_t *);
+
 /* Lock settings.  */
 extern int  mu_mailbox_get_locker      (mu_mailbox_t, mu_locker_t *);
 extern int  mu_mailbox_set_locker      (mu_mailbox_t, mu_locker_t);
@@ -25,6 +25,8 @@ extern unsigned long mu_session_id;
 
 typedef int (*mu_conn_loop_fp) (int fd, void *conn_data, void *server_data);
 typedef void (*mu_conn_free_fp) (void *conn_data, void *server_data);
+typedef int (*mu_conn_timeout_fp) (int fd, void *conn_data,
+				   void *server_data);
 typedef int (*mu_server_idle_fp) (void *server_data);
 typedef void (*mu_server_free_fp) (void *server_data);
 
@@ -42,6 +44,8 @@ int mu_server_add_connection (mu_server_t srv,
 			      mu_conn_loop_fp loop, mu_conn_free_fp free);
 struct timeval;
 int mu_server_set_timeout (mu_server_t srv, struct timeval *to);
+int mu_server_set_conn_timeout (mu_server_t srv, int fd, struct timeval *to,
+				mu_conn_timeout_fp fp);
 int mu_server_count (mu_server_t srv, size_t *pcount);
 
 
@@ -109,6 +113,10 @@ void mu_m_server_set_conn (mu_m_server_t srv, mu_m_server_handler_fp f);
 void mu_m_server_set_prefork (mu_m_server_t srv, mu_m_server_handler_fp fun);
 void mu_m_server_set_data (mu_m_server_t srv, void *data);
 void mu_m_server_set_max_children (mu_m_server_t srv, size_t num);
+void mu_m_server_set_workers (mu_m_server_t srv, size_t num);
+void mu_m_server_set_spare_workers (mu_m_server_t srv, size_t min,
+				    size_t max);
+void mu_m_server_set_max_worker_requests (mu_m_server_t srv, size_t num);
 int mu_m_server_set_pidfile (mu_m_server_t srv, const char *pidfile);
 int mu_m_server_set_foreground (mu_m_server_t srv, int enable);
 void mu_m_server_set_default_port (mu_m_server_t srv, int port);
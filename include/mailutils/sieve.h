@@ -229,6 +229,7 @@ size_t mu_sieve_get_message_num (mu_sieve_machine_t mach);
 int mu_sieve_get_debug_level (mu_sieve_machine_t mach);
 mu_mailer_t mu_sieve_get_mailer (mu_sieve_machine_t mach);
 int mu_sieve_get_locus (mu_sieve_machine_t mach, struct mu_locus *);
+int mu_sieve_get_source_list (mu_sieve_machine_t mach, mu_list_t *plist);
 char *mu_sieve_get_daemon_email (mu_sieve_machine_t mach);
 const char *mu_sieve_get_identifier (mu_sieve_machine_t mach);
 
@@ -76,6 +76,8 @@ int mu_smtp_mail_basic (mu_smtp_t smtp, const char *email,
 int mu_smtp_rcpt_basic (mu_smtp_t smtp, const char *email,
 			const char *fmt, ...) MU_PRINTFLIKE(3,4);
 
+int mu_smtp_pipeline_begin (mu_smtp_t smtp);
+int mu_smtp_pipeline_reply (mu_smtp_t smtp);
 int mu_smtp_data (mu_smtp_t smtp, mu_stream_t *pstream);
 int mu_smtp_send_stream (mu_smtp_t smtp, mu_stream_t str);
 int mu_smtp_dot (mu_smtp_t smtp);
@@ -19,6 +19,10 @@
 #ifndef _MAILUTILS_SQL_H
 #define _MAILUTILS_SQL_H
 
+#include <sys/types.h>
+#include <time.h>
+#include <mailutils/types.h>
+
 /* Configuration */
 enum mu_password_type
   {
@@ -41,6 +45,9 @@ struct mu_sql_module_config
   enum mu_password_type password_type;
   int positional;
   mu_assoc_t field_map;
+  size_t pool_size;          /* Max. number of idle connections to keep */
+  time_t check_interval;     /* Check idle connections older than this */
+  int prepared;              /* Use prepared statements */
 };
 
 /* FIXME: Should not be here, but needed for several other sources
@@ -59,6 +66,9 @@ struct mu_internal_sql_config
   enum mu_password_type password_type;
   int positional;
   mu_assoc_t field_map;
+  size_t pool_size;          /* Max. number of idle connections to keep */
+  time_t check_interval;     /* Check idle connections older than this */
+  int prepared;              /* Use prepared statements */
 };
 
 extern struct mu_internal_sql_config mu_sql_module_config;
@@ -99,6 +109,9 @@ struct mu_sql_connection
   char *dbname;
   void *data;
   enum mu_sql_connection_state state;
+  pid_t pid;             /* PID of the process that connected */
+  time_t mtime;          /* Time the connection was last used */
+  mu_list_t stmts;       /* Names of the statements prepared on it */
 };
 
 typedef struct mu_sql_dispatch mu_sql_dispatch_t;
@@ -128,6 +141,17 @@ struct mu_sql_dispatch
 			   size_t *fno);
 
   const char *(*errstr) (mu_sql_connection_t conn);
+
+  /* Optional methods */
+  /* Check if the connection is alive */
+  int (*ping) (mu_sql_connection_t conn);
+  /* Prepare QUERY as statement NAME.  Parameters in QUERY are referred
+     to as $1, $2, etc. */
+  int (*prepare) (mu_sql_connection_t conn, const char *name,
+		  const char *query, int nparams);
+  /* Execute the prepared statement NAME */
+  int (*execute) (mu_sql_connection_t conn, const char *name,
+		  int nparams, const char **params);
 };
 
 /* Public interfaces */
@@ -156,7 +180,24 @@ int mu_sql_get_field (mu_sql_connection_t conn, size_t nrow, const char *fname,
 
 const char *mu_sql_strerror (mu_sql_connection_t conn);
 
+int mu_sql_ping (mu_sql_connection_t conn);
+int mu_sql_prepare (mu_sql_connection_t conn, const char *name,
+		    const char *query, int nparams);
+int mu_sql_execute (mu_sql_connection_t conn, const char *name,
+		    int nparams, const char **params);
+
+/* Connection pool */
+void mu_sql_pool_set_size (size_t size);
+void mu_sql_pool_set_check_interval (time_t interval);
+int mu_sql_pool_get (mu_sql_connection_t *pconn, int *reused, int interface,
+		     char *server, int port, char *login,
+		     char *password, char *dbname);
+void mu_sql_pool_put (mu_sql_connection_t *pconn, int status);
+void mu_sql_pool_clear (void);
+
 extern char *mu_sql_expand_query (const char *query, const char *ustr);
+extern int mu_sql_run_query (mu_sql_connection_t *pconn, const char *name,
+			     const char *query, const char *value);
 extern int mu_sql_getpass (const char *username, char **passwd);
 extern int mu_check_mysql_scrambled_password (const char *scrambled,
 					      const char *message);
@@ -76,6 +76,8 @@ enum mu_buffer_type
 #define MU_IOCTL_TOPSTREAM       12 /* Same as MU_IOCTL_SUBSTREAM, but
 				       always returns the topmost substream.
 				    */
+#define MU_IOCTL_MAPFILESTREAM   13 /* Memory-mapped file streams (see
+				       below) */
   
   /* Opcodes common for various families */
 #define MU_IOCTL_OP_GET 0
@@ -174,6 +176,14 @@ enum mu_buffer_type
      Arg: int *
   */
 #define MU_IOCTL_FD_SET_BORROW 1
+  /* Get the file descriptor and the part of the file the stream
+     operates upon.  Stream references (see mu_streamref_create) narrow
+     the segment of the underlying stream.  Streams that alter or
+     record the data passing through them (filters, transcript streams)
+     don't support it.
+     Arg: struct mu_fd_segment *
+  */
+#define MU_IOCTL_FD_GET_SEGMENT 2
 
   /* Opcodes for MU_IOCTL_SYSLOGSTREAM */
   /* Set logger function.
@@ -191,6 +201,13 @@ enum mu_buffer_type
   */
 #define MU_IOCTL_FILTER_GET_DISABLED 0
 #define MU_IOCTL_FILTER_SET_DISABLED 1  
+
+  /* Opcodes for MU_IOCTL_MAPFILESTREAM */
+  /* Get the memory region the file is mapped to.  The region is valid
+     until the next operation on the stream.
+     Arg: struct mu_mapfile_region *
+  */
+#define MU_IOCTL_MAPFILESTREAM_GET_REGION 0
   
 #define MU_TRANSPORT_INPUT  0
 #define MU_TRANSPORT_OUTPUT 1
@@ -203,6 +220,20 @@ struct mu_nullstream_pattern
   size_t size;
 };
   
+struct mu_mapfile_region
+{
+  const char *start;            /* Start of the mapped file */
+  size_t size;                  /* Size of the mapped file */
+};
+  
+struct mu_fd_segment
+{
+  int fd;                       /* File descriptor */
+  mu_off_t start;               /* Offset of the first byte */
+  mu_off_t end;                 /* Offset of the last byte, or -1 if the
+				   segment extends to the end of file */
+};
+  
 struct mu_buffer_query
 {
   int type;                     /* One of MU_TRANSPORT_ defines */
@@ -291,6 +322,10 @@ int mu_stream_printf (mu_stream_t stream, const char *fmt, ...)
 
 int mu_stream_copy (mu_stream_t dst, mu_stream_t src, mu_off_t size,
 		    mu_off_t *pcsz);
+int mu_copy_file_range (int dst, mu_off_t *pdstoff, int src, mu_off_t *psrcoff,
+			mu_off_t size, mu_off_t *pcsz);
+int mu_stream_fd_scan (mu_stream_t str,
+		       int (*fun) (const char *, size_t, void *), void *data);
 
 
 int mu_file_stream_create (mu_stream_t *pstream, const char *filename, int flags);
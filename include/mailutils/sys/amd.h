@@ -94,6 +94,8 @@ struct _amd_data
   int (*remove) (struct _amd_data *);
   int (*delete_msg) (struct _amd_data *, struct _amd_message *);
   int (*chattr_msg) (struct _amd_message *, int);
+  int (*close) (struct _amd_data *);
+  int (*is_updated) (struct _amd_data *);
   
   /* List of messages: */
   size_t msg_count; /* number of messages in the list */
@@ -35,6 +35,10 @@ struct _mu_attribute
   int (*_get_flags)   (mu_attribute_t, int *);
   int (*_set_flags)   (mu_attribute_t, int);
   int (*_unset_flags) (mu_attribute_t, int);
+
+  /* Called after the flags have been changed */
+  void (*_notify)     (mu_attribute_t, void *);
+  void *notify_data;
 };
 
 #ifdef __cplusplus
@@ -45,6 +45,16 @@ struct mu_hdrent
   size_t nlines;
 };
 
+/* A group of header entries having the same name.  Used by the lookup
+   index. */
+struct mu_hdrent_group
+{
+  struct mu_hdrent *ent;     /* First entry in the group */
+  unsigned hash;             /* Hash of its name */
+  size_t off;                /* Offset of the group in idx_name */
+  size_t count;              /* Number of entries in it */
+};
+
 struct _mu_header
 {
   /* Data.  */
@@ -57,6 +67,14 @@ struct _mu_header
   size_t numhdr;
   size_t numlines;
   size_t size;
+
+  /* Lookup index, built on demand */
+  struct mu_hdrent **idx_pos;       /* Entries in header order */
+  struct mu_hdrent **idx_name;      /* Same entries, grouped by name */
+  struct mu_hdrent_group *idx_grp;  /* Name groups */
+  size_t *idx_tab;                  /* Hash table of group numbers + 1 */
+  size_t idx_max;                   /* Allocated size of the above */
+  size_t idx_count;                 /* Number of entries indexed */
   
   /* Temporary storage */
   mu_stream_t mstream;
@@ -268,6 +268,8 @@ struct _mu_imap_message
 
 #define _MU_IMAP_MBX_UPTODATE  0x01
 
+struct _mu_imap_cache;
+
 struct _mu_imap_mailbox
 {
   int flags;
@@ -277,10 +279,22 @@ struct _mu_imap_mailbox
   size_t msgs_cnt;               /* Number of used slots in msgs */
   size_t msgs_max;               /* Number of slots in msgs */
   mu_stream_t cache;          /* Message cache stream */
+  struct _mu_imap_cache *pcache; /* Persistent cache, if enabled */
+  size_t prefetch_max;        /* Maximum number of messages to read ahead */
+  size_t prefetch_window;     /* Current read-ahead window */
+  size_t prefetch_next;       /* Expected next message number if the
+				 messages are accessed sequentially */
   int last_error;             /* Last error code */
   mu_mailbox_t mbox;
 };
 
+int _mu_imap_cache_open (struct _mu_imap_mailbox *imbx,
+			 const char *mbox_name);
+int _mu_imap_cache_restore (struct _mu_imap_mailbox *imbx,
+			    struct _mu_imap_message *imsg);
+void _mu_imap_cache_forget (struct _mu_imap_mailbox *imbx);
+int _mu_imap_cache_close (struct _mu_imap_mailbox *imbx);
+
 # ifdef __cplusplus
 }
 # endif
@@ -42,6 +42,13 @@ struct _mu_mailbox
   mu_folder_t folder;
   mu_monitor_t monitor;
   mu_iterator_t iterator;
+  struct _mu_mailbox_watch *watch;
+
+  /* Attribute change log */
+  unsigned long chlog_base;  /* Modification sequence of the first entry */
+  size_t *chlog;             /* UIDs of the modified messages */
+  size_t chlog_count;        /* Number of entries in chlog */
+  size_t chlog_max;          /* Capacity of chlog */
   
   /* Back pointer to the specific mailbox */
   void *data;
@@ -78,6 +85,12 @@ struct _mu_mailbox
   int  (*_copy) (mu_mailbox_t, mu_msgset_t, const char *, int);
 };
 
+void _mu_mailbox_watch_destroy (mu_mailbox_t);
+
+void _mu_mailbox_changes_note (mu_mailbox_t, size_t uid);
+void _mu_mailbox_changes_reset (mu_mailbox_t);
+void _mu_mailbox_changes_destroy (mu_mailbox_t);
+
 # ifdef __cplusplus
 }
 # endif
@@ -31,6 +31,7 @@
 # define _MU_SMTP_AUTH    0x20 /* Authorization passed */
 # define _MU_SMTP_CLNPASS 0x40 /* Password has been de-obfuscated */
 # define _MU_SMTP_SAVEBUF 0x80 /* Buffering state saved */
+# define _MU_SMTP_PIPE    0x1000 /* Commands are being pipelined */
 
 #define MU_SMTP_XSCRIPT_MASK(n) (0x100<<(n))
 
@@ -46,6 +47,11 @@ enum mu_smtp_state
     MU_SMTP_CLOS
   };
 
+/* Commands whose replies are deferred */
+#define _MU_SMTP_PIPE_MAIL 'M'
+#define _MU_SMTP_PIPE_RCPT 'R'
+#define _MU_SMTP_PIPE_BDAT 'B'
+
 struct _mu_smtp
 {
   int flags;
@@ -73,6 +79,12 @@ struct _mu_smtp
   
   mu_list_t mlrepl;
   struct mu_buffer_query savebuf;
+
+  /* Pipelining */
+  char *pipeq;                 /* Commands awaiting replies */
+  size_t pipeq_max;            /* Size of pipeq */
+  size_t pipeq_cnt;            /* Number of commands in pipeq */
+  size_t pipeq_pos;            /* Next command to get a reply for */
 };
 
 #define MU_SMTP_FSET(p,f) ((p)->flags |= (f))
@@ -96,7 +108,10 @@ int _mu_smtp_xscript_level (mu_smtp_t smtp, int xlev);
 int _mu_smtp_gsasl_auth (mu_smtp_t smtp);
 int _mu_smtp_mech_impl (mu_smtp_t smtp, mu_list_t list);
 int _mu_smtp_data_begin (mu_smtp_t smtp);
+void _mu_smtp_payload_begin (mu_smtp_t smtp);
 int _mu_smtp_data_end (mu_smtp_t smtp);
+int _mu_smtp_capa_p (mu_smtp_t smtp, const char *name);
+int _mu_smtp_pipeq_add (mu_smtp_t smtp, int cmd);
 
 int _mu_smtp_get_streams (mu_smtp_t smtp, mu_stream_t *streams);
 int _mu_smtp_set_streams (mu_smtp_t smtp, mu_stream_t *streams);
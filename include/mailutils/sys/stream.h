@@ -81,5 +81,6 @@ mu_stream_t _mu_stream_create (size_t size, int flags);
 
 void _mu_stream_cleareof (mu_stream_t str);
 void _mu_stream_seteof (mu_stream_t str);
+int _mu_stream_fd_segment (mu_stream_t str, struct mu_fd_segment *seg);
 
 #endif
@@ -35,7 +35,7 @@ struct _mu_url
   mu_secret_t secret;
   char  *auth;
   char  *host;
-  short port;
+  unsigned short port;
   char  *portstr;
   char  *path;
   char  **fvpairs;
@@ -62,6 +62,7 @@ char *mu_getcwd (void);
 char *mu_make_file_name_suf (const char *dir, const char *file,
 			     const char *suf);
 #define mu_make_file_name(dir, file) mu_make_file_name_suf (dir, file, NULL)
+char *mu_make_file_name_encoded (const char *dir, const char *key);
 
   /* ------------------------ */
   /* Temporary file creation. */
@@ -80,6 +81,8 @@ struct mu_tempfile_hints
 int mu_tempfile (struct mu_tempfile_hints *hints, int flags,
 		 int *pfd, char **namep);
 char *mu_tempname (const char *tmpdir);
+int mu_tempfile_replace (const char *name,
+			 int (*writer) (mu_stream_t, void *), void *data);
   
   /* ----------------------- */
   /* Current user email.     */
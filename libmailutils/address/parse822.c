@@ -50,8 +50,6 @@ Things to consider:
 
   - test for memory leaks on malloc failure
 
-  - fix the realloc, try a struct _string { char* b, size_t sz };
-
 The lexer finds consecutive sequences of characters, so it should
 define:
 
@@ -152,12 +150,6 @@ str_append (char **to, const char *from)
   return str_append_n (to, from, strlen (from));
 }
 
-static int
-str_append_char (char **to, char c)
-{
-  return str_append_n (to, &c, 1);
-}
-
 static int
 str_append_range (char **to, const char *b, const char *e)
 {
@@ -174,6 +166,123 @@ str_free (char **s)
     }
 }
 
+/*
+ * Strings assembled from many pieces are built in a struct strbuf,
+ * which keeps track of its length and grows geometrically, and are
+ * handed over to the caller when complete.  A null SB silently
+ * discards the data, same as a null TO above.
+ */
+
+struct strbuf
+{
+  char *base;			/* nul-terminated string, or NULL */
+  size_t len;			/* its length */
+  size_t size;			/* allocated size */
+};
+
+#define STRBUF_INITIALIZER { NULL, 0, 0 }
+
+/* Mark value meaning "no string at all", as opposed to an empty one */
+#define STRBUF_NONE ((size_t)-1)
+
+static int
+strbuf_append_n (struct strbuf *sb, const char *from, size_t n)
+{
+  if (!sb)
+    return EOK;
+
+  if (sb->len + n + 1 > sb->size)
+    {
+      size_t size = sb->size ? sb->size : 16;
+      char *p;
+
+      while (sb->len + n + 1 > size)
+	size *= 2;
+      p = realloc (sb->base, size);
+      if (!p)
+	return ENOMEM;
+      sb->base = p;
+      sb->size = size;
+    }
+  memcpy (sb->base + sb->len, from, n);
+  sb->len += n;
+  sb->base[sb->len] = 0;
+  return EOK;
+}
+
+static int
+strbuf_append_char (struct strbuf *sb, char c)
+{
+  if (sb && sb->len + 1 < sb->size)
+    {
+      sb->base[sb->len++] = c;
+      sb->base[sb->len] = 0;
+      return EOK;
+    }
+  return strbuf_append_n (sb, &c, 1);
+}
+
+/* Return the current position in SB, for use with strbuf_reset. */
+static size_t
+strbuf_mark (struct strbuf *sb)
+{
+  return (sb && sb->base) ? sb->len : STRBUF_NONE;
+}
+
+/* Discard anything appended to SB since MARK was taken. */
+static void
+strbuf_reset (struct strbuf *sb, size_t mark)
+{
+  if (!sb || !sb->base)
+    return;
+  if (mark == STRBUF_NONE)
+    {
+      free (sb->base);
+      sb->base = NULL;
+      sb->len = sb->size = 0;
+    }
+  else
+    {
+      sb->len = mark;
+      sb->base[mark] = 0;
+    }
+}
+
+static void
+strbuf_free (struct strbuf *sb)
+{
+  strbuf_reset (sb, STRBUF_NONE);
+}
+
+/* Append the string collected in SB to *TO and free SB.  If *TO is
+   NULL, the buffer itself is handed over. */
+static int
+strbuf_finish (struct strbuf *sb, char **to)
+{
+  int rc = EOK;
+
+  if (sb->base && to)
+    {
+      if (!*to)
+	{
+	  char *p = realloc (sb->base, sb->len + 1);
+	  *to = p ? p : sb->base;
+	  sb->base = NULL;
+	}
+      else
+	rc = str_append_n (to, sb->base, sb->len);
+    }
+  strbuf_free (sb);
+  return rc;
+}
+
+static int parse822_domain (const char **p, const char *e,
+			    struct strbuf *sb);
+static int parse822_sub_domain (const char **p, const char *e,
+				struct strbuf *sb);
+static int parse822_domain_literal (const char **p, const char *e,
+				    struct strbuf *sb);
+
 /*
  * Character Classification - could be rewritten in a C library
  * independent way, my system's C library matches the RFC
@@ -404,8 +513,30 @@ mu_parse822_special (const char **p, const char *e, char c)
   return EPARSE;
 }
 
-int
-mu_parse822_comment (const char **p, const char *e, char **comment)
+static int
+parse822_quoted_pair (const char **p, const char *e, struct strbuf *sb)
+{
+  /* quoted-pair = "\" char */
+
+  int rc;
+
+  /* need TWO characters to be available */
+  if ((e - *p) < 2)
+    return EPARSE;
+
+  if (**p != '\\')
+    return EPARSE;
+
+  if ((rc = strbuf_append_char (sb, *(*p + 1))))
+    return rc;
+
+  *p += 2;
+
+  return EOK;
+}
+
+static int
+parse822_comment (const char **p, const char *e, struct strbuf *sb)
 {
   /* comment = "(" *(ctext / quoted-pair / comment) ")"
    * ctext = <any char except "(", ")", "\", & CR, including lwsp>
@@ -429,11 +560,11 @@ mu_parse822_comment (const char **p, const char *e, char **comment)
 	}
       else if (c == '(')
 	{
-	  rc = mu_parse822_comment (p, e, comment);
+	  rc = parse822_comment (p, e, sb);
 	}
       else if (c == '\\')
 	{
-	  rc = mu_parse822_quoted_pair (p, e, comment);
+	  rc = parse822_quoted_pair (p, e, sb);
 	}
       else if (c == '\r')
 	{
@@ -442,7 +573,7 @@ mu_parse822_comment (const char **p, const char *e, char **comment)
 	}
       else if (mu_parse822_is_char (c))
 	{
-	  rc = str_append_char (comment, c);
+	  rc = strbuf_append_char (sb, c);
 	  *p += 1;
 	}
       else
@@ -467,79 +598,103 @@ mu_parse822_comment (const char **p, const char *e, char **comment)
 }
 
 int
-mu_parse822_atom (const char **p, const char *e, char **atom)
+mu_parse822_comment (const char **p, const char *e, char **comment)
 {
-  /* atom = 1*<an atom char> */
-
+  struct strbuf sb = STRBUF_INITIALIZER;
   const char *save = *p;
-  int rc = EPARSE;
+  int rc, rc2;
 
-  mu_parse822_skip_comments (p, e);
+  if (!comment)
+    return parse822_comment (p, e, NULL);
 
-  save = *p;
-
-  while ((*p != e) && (**p == '.' || mu_parse822_is_atom_char (**p)))
+  rc = parse822_comment (p, e, &sb);
+  /* Whatever was collected is kept even if the comment turned out to
+     be malformed. */
+  rc2 = strbuf_finish (&sb, comment);
+  if (rc == EOK && rc2)
     {
-      rc = str_append_char (atom, **p);
-      *p += 1;
-      if (rc != EOK)
-	{
-	  *p = save;
-	  break;
-	}
+      *p = save;
+      rc = rc2;
     }
   return rc;
 }
 
-int
-parse822_atom_ex (const char **p, const char *e, char **atom)
+static int
+parse822_atom (const char **p, const char *e, struct strbuf *sb)
 {
   /* atom = 1*<an atom char> */
+
   const char *ptr;
   int rc;
 
   mu_parse822_skip_comments (p, e);
 
-  for (ptr = *p; (ptr != e) && parse822_is_atom_char_ex (*ptr); ptr++)
+  for (ptr = *p;
+       (ptr != e) && (*ptr == '.' || mu_parse822_is_atom_char (*ptr));
+       ptr++)
     ;
-  if (ptr - *p == 0)
+  if (ptr == *p)
     return EPARSE;
-  rc = str_append_n (atom, *p, ptr - *p);
+  rc = strbuf_append_n (sb, *p, ptr - *p);
   if (rc == 0)
     *p = ptr;
   return rc;
 }
 
 int
-mu_parse822_quoted_pair (const char **p, const char *e, char **qpair)
+mu_parse822_atom (const char **p, const char *e, char **atom)
 {
-  /* quoted-pair = "\" char */
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_atom (p, e, &sb);
+
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, atom);
+  else
+    strbuf_free (&sb);
+  return rc;
+}
 
+static int
+parse822_atom_ex (const char **p, const char *e, struct strbuf *sb)
+{
+  /* atom = 1*<an atom char> */
+  const char *ptr;
   int rc;
 
-  /* need TWO characters to be available */
-  if ((e - *p) < 2)
-    return EPARSE;
+  mu_parse822_skip_comments (p, e);
 
-  if (**p != '\\')
+  for (ptr = *p; (ptr != e) && parse822_is_atom_char_ex (*ptr); ptr++)
+    ;
+  if (ptr - *p == 0)
     return EPARSE;
+  rc = strbuf_append_n (sb, *p, ptr - *p);
+  if (rc == 0)
+    *p = ptr;
+  return rc;
+}
 
-  if ((rc = str_append_char (qpair, *(*p + 1))))
-    return rc;
-
-  *p += 2;
+int
+mu_parse822_quoted_pair (const char **p, const char *e, char **qpair)
+{
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_quoted_pair (p, e, &sb);
 
-  return EOK;
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, qpair);
+  else
+    strbuf_free (&sb);
+  return rc;
 }
 
-int
-mu_parse822_quoted_string (const char **p, const char *e, char **qstr)
+static int
+parse822_quoted_string (const char **p, const char *e, struct strbuf *sb)
 {
   /* quoted-string = <"> *(qtext/quoted-pair) <">
    * qtext = char except <">, "\", & CR, including lwsp-char
    */
 
   const char *save = *p;
+  size_t mark = strbuf_mark (sb);
   int rc;
 
   mu_parse822_skip_comments (p, e);
@@ -560,7 +715,7 @@ mu_parse822_quoted_string (const char **p, const char *e, char **qstr)
 	}
       else if (c == '\\')
 	{
-	  rc = mu_parse822_quoted_pair (p, e, qstr);
+	  rc = parse822_quoted_pair (p, e, sb);
 	}
       else if (c == '\r')
 	{
@@ -569,7 +724,7 @@ mu_parse822_quoted_string (const char **p, const char *e, char **qstr)
 	}
       else if (mu_parse822_is_char (c))
 	{
-	  rc = str_append_char (qstr, c);
+	  rc = strbuf_append_char (sb, c);
 	  *p += 1;
 	}
       else
@@ -580,46 +735,44 @@ mu_parse822_quoted_string (const char **p, const char *e, char **qstr)
       if (rc)
 	{
 	  *p = save;
-	  str_free (qstr);
+	  strbuf_reset (sb, mark);
 	  return rc;
 	}
     }
   *p = save;
-  str_free (qstr);
+  strbuf_reset (sb, mark);
   return EPARSE;		/* end-of-qstr not found */
 }
 
 int
-mu_parse822_word (const char **p, const char *e, char **word)
+mu_parse822_quoted_string (const char **p, const char *e, char **qstr)
 {
-  /* word = atom / quoted-string */
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_quoted_string (p, e, &sb);
 
-  const char *save = *p;
-  int rc = EOK;
-
-  mu_parse822_skip_comments (p, e);
-
-  save = *p;
-
-  {
-    char *qstr = 0;
-    if ((rc = mu_parse822_quoted_string (p, e, &qstr)) == EOK && qstr)
-      {
-	rc = str_append (word, qstr);
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, qstr);
+  else
+    {
+      strbuf_free (&sb);
+      str_free (qstr);
+    }
+  return rc;
+}
 
-	str_free (&qstr);
+static int
+parse822_word (const char **p, const char *e, struct strbuf *sb)
+{
+  /* word = atom / quoted-string */
 
-	if (rc != EOK)
-	  *p = save;
+  int rc;
 
-	return rc;
-      }
-    assert (qstr == NULL);
-  }
+  mu_parse822_skip_comments (p, e);
 
+  rc = parse822_quoted_string (p, e, sb);
   if (rc != EPARSE)
     {
-      /* it's fatal */
+      /* either success or fatal */
       return rc;
     }
 
@@ -631,72 +784,85 @@ mu_parse822_word (const char **p, const char *e, char **word)
    * "Be liberal in what you accept, and conservative in what you send."
    */
 
-  {
-    char *atom = 0;
-    if (parse822_atom_ex (p, e, &atom) == EOK)
-      {
-	rc = str_append (word, atom);
-
-	str_free (&atom);
+  if (parse822_atom_ex (p, e, sb) == EOK)
+    return EOK;
 
-	if (rc != EOK)
-	  *p = save;
+  return EPARSE;
+}
 
-	return rc;
-      }
-    assert (atom == NULL);
-  }
+int
+mu_parse822_word (const char **p, const char *e, char **word)
+{
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_word (p, e, &sb);
 
-  return EPARSE;
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, word);
+  else
+    strbuf_free (&sb);
+  return rc;
 }
 
 /* Some mailers do not quote personal part even if it contains dot.
    Try to be smart about it.
 */
 	
-int
-parse822_word_dot (const char **p, const char *e, char **word)
+static int
+parse822_word_dot (const char **p, const char *e, struct strbuf *sb)
 {
-  int rc = mu_parse822_word (p, e, word);
+  int rc = parse822_word (p, e, sb);
   for (;rc == 0 && (*p != e) && **p == '.'; ++*p)
-    rc = str_append (word, ".");
+    rc = strbuf_append_char (sb, '.');
   return rc;
 }
 
-int
-mu_parse822_phrase (const char **p, const char *e, char **phrase)
+static int
+parse822_phrase (const char **p, const char *e, struct strbuf *sb)
 {
   /* phrase = 1*word */
 
   const char *save = *p;
+  size_t mark = strbuf_mark (sb);
   int rc;
 
-  if ((rc = parse822_word_dot (p, e, phrase)))
+  if ((rc = parse822_word_dot (p, e, sb)))
     return rc;
 
   /* ok, got the 1 word, now append all the others we can */
-  {
-    char *word = 0;
+  for (;;)
+    {
+      size_t wmark = strbuf_mark (sb);
 
-    while ((rc = parse822_word_dot (p, e, &word)) == EOK)
-      {
-	rc = str_append_char (phrase, ' ');
+      if ((rc = strbuf_append_char (sb, ' ')))
+	break;
+      if ((rc = parse822_word_dot (p, e, sb)))
+	{
+	  strbuf_reset (sb, wmark);
+	  break;
+	}
+    }
+  if (rc == EPARSE)
+    rc = EOK;			/* its not an error to find no more words */
 
-	if (rc == EOK)
-	  rc = str_append (phrase, word);
+  if (rc)
+    {
+      *p = save;
+      strbuf_reset (sb, mark);
+    }
 
-	str_free (&word);
+  return rc;
+}
 
-	if (rc != EOK)
-	  break;
-      }
-    assert (word == NULL);
-    if (rc == EPARSE)
-      rc = EOK;			/* its not an error to find no more words */
-  }
-  if (rc)
-    *p = save;
+int
+mu_parse822_phrase (const char **p, const char *e, char **phrase)
+{
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_phrase (p, e, &sb);
 
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, phrase);
+  else
+    strbuf_free (&sb);
   return rc;
 }
 
@@ -1133,13 +1299,13 @@ mu_parse822_route_addr (const char **p, const char *e, mu_address_t *a,
   return EOK;
 }
 
-int
-mu_parse822_route (const char **p, const char *e, char **route)
+static int
+parse822_route (const char **p, const char *e, struct strbuf *sb)
 {
   /* route = 1#("@" domain ) ":" */
 
   const char *save = *p;
-  char *accumulator = 0;
+  size_t mark = strbuf_mark (sb);
   int rc = EOK;
 
   for (;;)
@@ -1151,14 +1317,14 @@ mu_parse822_route (const char **p, const char *e, char **route)
 	  break;
 	}
 
-      if ((rc = str_append (&accumulator, "@")))
+      if ((rc = strbuf_append_char (sb, '@')))
 	{
 	  break;
 	}
 
       mu_parse822_skip_comments (p, e);
 
-      if ((rc = mu_parse822_domain (p, e, &accumulator)))
+      if ((rc = parse822_domain (p, e, sb)))
 	{
 	  /* it looked like a route, but there's no domain! */
 	  break;
@@ -1172,7 +1338,7 @@ mu_parse822_route (const char **p, const char *e, char **route)
 	  rc = EOK;
 	  break;
 	}
-      if ((rc = str_append (&accumulator, ", ")))
+      if ((rc = strbuf_append_n (sb, ", ", 2)))
 	{
 	  break;
 	}
@@ -1185,15 +1351,24 @@ mu_parse822_route (const char **p, const char *e, char **route)
       rc = mu_parse822_special (p, e, ':');
     }
 
-  if (!rc)
-    {
-      rc = str_append (route, accumulator);
-    }
   if (rc)
     {
       *p = save;
+      strbuf_reset (sb, mark);
     }
-  str_free (&accumulator);
+  return rc;
+}
+
+int
+mu_parse822_route (const char **p, const char *e, char **route)
+{
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_route (p, e, &sb);
+
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, route);
+  else
+    strbuf_free (&sb);
   return rc;
 }
 
@@ -1259,48 +1434,51 @@ mu_parse822_unix_mbox (const char **p, const char *e, mu_address_t *a,
   return rc;
 }
 
-int
-mu_parse822_local_part (const char **p, const char *e, char **local_part)
+static int
+parse822_local_part (const char **p, const char *e, struct strbuf *sb)
 {
   /* local-part = word *("." word)
-   *
-   * Note: rewrite as ->  word ["." local-part]
    */
 
   const char *save = *p;
   const char *save2 = *p;
+  size_t mark = strbuf_mark (sb);
   int rc;
 
   mu_parse822_skip_comments (p, e);
 
-  if ((rc = mu_parse822_word (p, e, local_part)))
+  if ((rc = parse822_word (p, e, sb)))
     {
       *p = save;
       return rc;
     }
   /* We've got a local-part, but keep looking for more. */
 
-  mu_parse822_skip_comments (p, e);
+  for (;;)
+    {
+      size_t wmark;
+      
+      mu_parse822_skip_comments (p, e);
 
-  /* If we get a parse error, we roll back to save2, but if
-   * something else failed, we have to roll back to save.
-   */
-  save2 = *p;
+      /* If we get a parse error, we roll back to save2, but if
+       * something else failed, we have to roll back to save.
+       */
+      save2 = *p;
 
-  rc = mu_parse822_special (p, e, '.');
+      if ((rc = mu_parse822_special (p, e, '.')))
+	break;
 
-  if (!rc)
-    {
-      char *more = 0;
-      if ((rc = mu_parse822_local_part (p, e, &more)) == EOK)
+      wmark = strbuf_mark (sb);
+      if ((rc = strbuf_append_char (sb, '.')))
+	break;
+
+      mu_parse822_skip_comments (p, e);
+
+      if ((rc = parse822_word (p, e, sb)))
 	{
-	  /* append more */
-	  if ((rc = str_append (local_part, ".")) == EOK)
-	    {
-	      rc = str_append (local_part, more);
-	    }
+	  strbuf_reset (sb, wmark);
+	  break;
 	}
-      str_free (&more);
     }
 
   if (rc == EPARSE)
@@ -1313,56 +1491,73 @@ mu_parse822_local_part (const char **p, const char *e, char **local_part)
     {
       /* if anything else failed, that's real */
       *p = save;
-      str_free (local_part);
+      strbuf_reset (sb, mark);
     }
   return rc;
 }
 
 int
-mu_parse822_domain (const char **p, const char *e, char **domain)
+mu_parse822_local_part (const char **p, const char *e, char **local_part)
+{
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_local_part (p, e, &sb);
+
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, local_part);
+  else
+    strbuf_free (&sb);
+  return rc;
+}
+
+static int
+parse822_domain (const char **p, const char *e, struct strbuf *sb)
 {
   /* domain = sub-domain *("." sub-domain)
-   *
-   * Note: rewrite as -> sub-domain ("." domain)
    */
 
   const char *save = *p;
   const char *save2 = 0;
+  size_t mark = strbuf_mark (sb);
   int rc;
 
   mu_parse822_skip_comments (p, e);
 
-  if ((rc = mu_parse822_sub_domain (p, e, domain)))
+  if ((rc = parse822_sub_domain (p, e, sb)))
     {
       *p = save;
       return rc;
     }
 
+  /* we've got the 1, keep looking for more */
 
-  /* We save before skipping comments to preserve the comment
-   * at the end of a domain, the addr-spec may want to abuse it
-   * for a personal name.
-   */
-  save2 = *p;
+  for (;;)
+    {
+      size_t wmark;
 
-  /* we've got the 1, keep looking for more */
+      /* We save before skipping comments to preserve the comment
+       * at the end of a domain, the addr-spec may want to abuse it
+       * for a personal name.
+       */
+      save2 = *p;
 
-  mu_parse822_skip_comments (p, e);
+      mu_parse822_skip_comments (p, e);
 
-  rc = mu_parse822_special (p, e, '.');
+      if ((rc = mu_parse822_special (p, e, '.')))
+	break;
 
-  if (!rc)
-    {
-      char *more = 0;
-      if ((rc = mu_parse822_domain (p, e, &more)) == EOK)
+      wmark = strbuf_mark (sb);
+      if ((rc = strbuf_append_char (sb, '.')))
+	break;
+
+      mu_parse822_skip_comments (p, e);
+
+      if ((rc = parse822_sub_domain (p, e, sb)))
 	{
-	  if ((rc = str_append (domain, ".")) == EOK)
-	    {
-	      rc = str_append (domain, more);
-	    }
+	  strbuf_reset (sb, wmark);
+	  break;
 	}
-      str_free (&more);
     }
+
   if (rc == EPARSE)
     {
       /* we didn't parse more ("." sub-domain) pairs, that's ok */
@@ -1374,22 +1569,49 @@ mu_parse822_domain (const char **p, const char *e, char **domain)
     {
       /* something else failed, roll it all back */
       *p = save;
-      str_free (domain);
+      strbuf_reset (sb, mark);
     }
   return rc;
 }
 
 int
-mu_parse822_sub_domain (const char **p, const char *e, char **sub_domain)
+mu_parse822_domain (const char **p, const char *e, char **domain)
+{
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_domain (p, e, &sb);
+
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, domain);
+  else
+    strbuf_free (&sb);
+  return rc;
+}
+
+static int
+parse822_sub_domain (const char **p, const char *e, struct strbuf *sb)
 {
   /* sub-domain = domain-ref / domain-literal
+   * domain-ref = atom
    */
 
   int rc;
 
-  if ((rc = mu_parse822_domain_ref (p, e, sub_domain)) == EPARSE)
-    rc = mu_parse822_domain_literal (p, e, sub_domain);
+  if ((rc = parse822_atom (p, e, sb)) == EPARSE)
+    rc = parse822_domain_literal (p, e, sb);
+
+  return rc;
+}
+
+int
+mu_parse822_sub_domain (const char **p, const char *e, char **sub_domain)
+{
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_sub_domain (p, e, &sb);
 
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, sub_domain);
+  else
+    strbuf_free (&sb);
   return rc;
 }
 
@@ -1401,8 +1623,8 @@ mu_parse822_domain_ref (const char **p, const char *e, char **domain_ref)
   return mu_parse822_atom (p, e, domain_ref);
 }
 
-int
-mu_parse822_d_text (const char **p, const char *e, char **dtext)
+static int
+parse822_d_text (const char **p, const char *e, struct strbuf *sb)
 {
   /* d-text = 1*dtext
    *
@@ -1424,7 +1646,7 @@ mu_parse822_d_text (const char **p, const char *e, char **dtext)
       return EPARSE;
     }
 
-  if ((rc = str_append_range (dtext, start, *p)))
+  if ((rc = strbuf_append_n (sb, start, *p - start)))
     {
       *p = start;
     }
@@ -1433,26 +1655,39 @@ mu_parse822_d_text (const char **p, const char *e, char **dtext)
 }
 
 int
-mu_parse822_domain_literal (const char **p, const char *e, char **domain_literal)
+mu_parse822_d_text (const char **p, const char *e, char **dtext)
+{
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_d_text (p, e, &sb);
+
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, dtext);
+  else
+    strbuf_free (&sb);
+  return rc;
+}
+
+static int
+parse822_domain_literal (const char **p, const char *e, struct strbuf *sb)
 {
   /* domain-literal = "[" *(dtext / quoted-pair) "]" */
 
   const char *save = *p;
-  char *literal = 0;
+  size_t mark = strbuf_mark (sb);
   int rc;
 
   if ((rc = mu_parse822_special (p, e, '[')))
     {
       return rc;
     }
-  if ((rc = str_append_char (&literal, '[')))
+  if ((rc = strbuf_append_char (sb, '[')))
     {
       *p = save;
       return rc;
     }
 
-  while ((rc = mu_parse822_d_text (p, e, &literal)) == EOK ||
-	 (rc = mu_parse822_quoted_pair (p, e, &literal)) == EOK)
+  while ((rc = parse822_d_text (p, e, sb)) == EOK ||
+	 (rc = parse822_quoted_pair (p, e, sb)) == EOK)
     {
       /* Eat all of this we can get! */
     }
@@ -1466,22 +1701,30 @@ mu_parse822_domain_literal (const char **p, const char *e, char **domain_literal
     }
   if (!rc)
     {
-      rc = str_append_char (&literal, ']');
-    }
-  if (!rc)
-    {
-      rc = str_append (domain_literal, literal);
+      rc = strbuf_append_char (sb, ']');
     }
 
-  str_free (&literal);
-
   if (rc)
     {
       *p = save;
+      strbuf_reset (sb, mark);
     }
   return rc;
 }
 
+int
+mu_parse822_domain_literal (const char **p, const char *e, char **domain_literal)
+{
+  struct strbuf sb = STRBUF_INITIALIZER;
+  int rc = parse822_domain_literal (p, e, &sb);
+
+  if (rc == EOK)
+    rc = strbuf_finish (&sb, domain_literal);
+  else
+    strbuf_free (&sb);
+  return rc;
+}
+
 /***** From RFC 822, 5.1 Date and Time Specification Syntax *****/
 
 int
@@ -1889,15 +2132,15 @@ mu_parse822_field_name (const char **p, const char *e, char **fieldname)
       if (c == ':')
 	break;
 
-      str_append_char (&fn, c);
       *p += 1;
     }
   /* must be at least one char in the field name */
-  if (!fn)
+  if (*p == save)
     {
-      *p = save;
       return EPARSE;
     }
+  str_append_range (&fn, save, *p);
+  
   mu_parse822_skip_comments (p, e);
 
   if (!mu_parse822_special (p, e, ':'))
@@ -1966,6 +2209,7 @@ mu_parse822_quote_string (char **quoted, const char *raw)
    * isn't qtext.
    */
 
+  struct strbuf sb = STRBUF_INITIALIZER;
   int rc = EOK;
   const char *s;
 
@@ -1976,31 +2220,31 @@ mu_parse822_quote_string (char **quoted, const char *raw)
 
   s = raw;
 
-  rc = str_append_char (quoted, '"');
+  rc = strbuf_append_char (&sb, '"');
 
   while (!rc && *s)
     {
       if (!mu_parse822_is_q_text (*s))
 	{
-	  rc = str_append_char (quoted, '\\');
+	  rc = strbuf_append_char (&sb, '\\');
 	}
 
       if (!rc)
 	{
-	  rc = str_append_char (quoted, *s);
+	  rc = strbuf_append_char (&sb, *s);
 	}
       ++s;
     }
 
   if (!rc)
     {
-      rc = str_append_char (quoted, '"');
+      rc = strbuf_append_char (&sb, '"');
     }
 
   if (rc)
-    {
-      str_free (quoted);
-    }
+    strbuf_free (&sb);
+  else
+    rc = strbuf_finish (&sb, quoted);
   return rc;
 }
 
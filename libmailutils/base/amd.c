@@ -536,7 +536,10 @@ amd_close (mu_mailbox_t mailbox)
     return EINVAL;
 
   amd = mailbox->data;
-  
+
+  if (amd->close)
+    amd->close (amd);
+
   /* Destroy all cached data */
   amd_pool_flush (amd);
   mu_monitor_wrlock (mailbox->monitor);
@@ -793,6 +796,60 @@ _amd_delim (char *str)
   return str[0] == '\n';
 }
 
+static int
+_amd_count_lines (const char *ptr, size_t size, void *data)
+{
+  size_t *pn = data;
+  const char *end = ptr + size;
+
+  while ((ptr = memchr (ptr, '\n', end - ptr)) != NULL)
+    {
+      ++*pn;
+      ptr++;
+    }
+  return 0;
+}
+
+/* Copy the body stream STREAM to the end of FP without reading it into
+   memory, if it is kept in a file.  Store the number of lines and bytes
+   copied in *PLINES and *PSIZE.  Return ENOSYS if this is not possible,
+   in which case nothing is written. */
+static int
+_amd_body_copy_fd (mu_stream_t stream, FILE *fp,
+		   size_t *plines, size_t *psize)
+{
+  mu_stream_t ostr;
+  mu_off_t off, size;
+  size_t nlines = 0;
+  int yes = 1;
+  int status;
+
+  status = mu_stream_fd_scan (stream, _amd_count_lines, &nlines);
+  if (status)
+    return status;
+  if (fflush (fp) || (off = ftello (fp)) == -1)
+    return errno;
+  status = mu_fd_stream_create (&ostr, NULL, fileno (fp),
+				MU_STREAM_WRITE|MU_STREAM_SEEK);
+  if (status)
+    return status;
+  mu_stream_ioctl (ostr, MU_IOCTL_FD, MU_IOCTL_FD_SET_BORROW, &yes);
+  status = mu_stream_seek (ostr, off, MU_SEEK_SET, NULL);
+  if (status == 0)
+    status = mu_stream_copy (ostr, stream, 0, &size);
+  if (status == 0)
+    status = mu_stream_flush (ostr);
+  mu_stream_destroy (&ostr);
+  if (status == 0 && fseeko (fp, 0, SEEK_END))
+    status = errno;
+  if (status == 0)
+    {
+      *plines = nlines;
+      *psize = size;
+    }
+  return status;
+}
+
 static int
 _amd_message_save (struct _amd_data *amd, struct _amd_message *mhm,
 		   int expunge)
@@ -942,15 +999,29 @@ _amd_message_save (struct _amd_data *amd, struct _amd_message *mhm,
     }
     
   nlines = 0;
-  while (mu_stream_read (stream, buf, bsize, &n) == 0 && n != 0)
+  status = _amd_body_copy_fd (stream, fp, &nlines, &n);
+  if (status == 0)
+    nbytes += n;
+  else if (status != ENOSYS)
     {
-      char *p;
-      for (p = buf; p < buf + n; p++)
-	if (*p == '\n')
-	  nlines++;
-      fwrite (buf, 1, n, fp);
-      nbytes += n;
+      fclose (fp);
+      unlink (name);
+      free (name);
+      free (msg_name);
+      free (buf);
+      mu_stream_destroy (&stream);
+      return status;
     }
+  else
+    while (mu_stream_read (stream, buf, bsize, &n) == 0 && n != 0)
+      {
+	char *p;
+	for (p = buf; p < buf + n; p++)
+	  if (*p == '\n')
+	    nlines++;
+	fwrite (buf, 1, n, fp);
+	nbytes += n;
+      }
   mu_stream_destroy (&stream);
   
   mhm->header_lines = new_header_lines;
@@ -1634,6 +1705,7 @@ amd_scan_message (struct _amd_message *mhm)
   char *msg_name;
   struct _amd_data *amd = mhm->amd;
   int amd_capa = amd->capabilities;
+  int oflags = mhm->attr_flags;
   
   /* Check if the message was modified after the last scan */
   status = mhm->amd->cur_msg_file_name (mhm, &msg_name);
@@ -1719,6 +1791,16 @@ amd_scan_message (struct _amd_message *mhm)
       mhm->body_lines = blines;
       mhm->body_start = body_start;
       mhm->body_end = off;
+
+      if (mhm->message && mhm->attr_flags != oflags)
+	{
+	  size_t uid;
+	  
+	  if (mu_message_get_uid (mhm->message, &uid) == 0 && uid)
+	    _mu_mailbox_changes_note (amd->mailbox, uid);
+	  else
+	    _mu_mailbox_changes_reset (amd->mailbox);
+	}
     }
   return status;
 }
@@ -1745,6 +1827,8 @@ amd_is_updated (mu_mailbox_t mailbox)
   struct stat st;
   struct _amd_data *amd = mailbox->data;
 
+  if (amd->is_updated)
+    return amd->is_updated (amd);
   if (stat (amd->name, &st) < 0)
     return 1;
 
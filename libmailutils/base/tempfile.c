@@ -20,6 +20,7 @@
 # include <config.h>
 #endif
 
+#include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -34,6 +35,7 @@
 #include <mailutils/error.h>
 #include <mailutils/errno.h>
 #include <mailutils/util.h>
+#include <mailutils/stream.h>
 
 #ifndef P_tmpdir
 # define P_tmpdir "/tmp"
@@ -208,6 +210,55 @@ mu_tempfile (struct mu_tempfile_hints *hints, int flags,
   return rc;
 }
 
+/* Replace the file NAME with new contents.  The contents are written by
+   WRITER, which is passed a stream open on a temporary file in the same
+   directory as NAME, and DATA.  If WRITER returns 0, the temporary file
+   is renamed to NAME.  Otherwise it is removed, and NAME is left intact.
+   Either way, readers of NAME never see partially written contents. */
+int
+mu_tempfile_replace (const char *name,
+		     int (*writer) (mu_stream_t, void *), void *data)
+{
+  struct mu_tempfile_hints hints;
+  const char *p;
+  char *dir = NULL, *tmpname;
+  mu_stream_t str;
+  int fd;
+  int rc;
+
+  p = strrchr (name, '/');
+  if (p)
+    {
+      dir = strdup (name);
+      if (!dir)
+	return ENOMEM;
+      dir[p - name] = 0;
+      hints.tmpdir = dir[0] ? dir : (char*) "/";
+    }
+  else
+    hints.tmpdir = (char*) ".";
+  rc = mu_tempfile (&hints, MU_TEMPFILE_TMPDIR, &fd, &tmpname);
+  free (dir);
+  if (rc)
+    return rc;
+
+  rc = mu_fd_stream_create (&str, tmpname, fd, MU_STREAM_WRITE);
+  if (rc)
+    close (fd);
+  else
+    {
+      rc = writer (str, data);
+      mu_stream_destroy (&str);
+    }
+
+  if (rc == 0 && rename (tmpname, name))
+    rc = errno;
+  if (rc)
+    unlink (tmpname);
+  free (tmpname);
+  return rc;
+}
+
 /* Create a unique temporary file name in tmpdir. The function
    creates an empty file with this name to avoid possible race
    conditions. Returns a pointer to the malloc'ed file name.
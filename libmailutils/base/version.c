@@ -97,6 +97,12 @@ static struct mu_conf_option mu_conf_option[] = {
 #ifdef WITH_LIBWRAP
   { "WITH_LIBWRAP", N_("Support for TCP wrappers") },
 #endif
+#ifdef HAVE_SYS_INOTIFY_H
+  { "HAVE_SYS_INOTIFY_H", N_("Mailbox change notification via inotify") },
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+  { "HAVE_SYS_EPOLL_H", N_("Server event loop using epoll") },
+#endif
 #ifdef ENABLE_VIRTUAL_DOMAINS
   { "ENABLE_VIRTUAL_DOMAINS", N_("Support for virtual mail domains") },
 #endif
@@ -121,7 +121,11 @@ mu_attribute_set_flags (mu_attribute_t attr, int flags)
   else
     attr->flags |= flags;
   if (status == 0)
-    mu_attribute_set_modified (attr);
+    {
+      mu_attribute_set_modified (attr);
+      if (attr->_notify)
+	attr->_notify (attr, attr->notify_data);
+    }
   return 0;
 }
 
@@ -144,7 +148,11 @@ mu_attribute_unset_flags (mu_attribute_t attr, int flags)
   else
     attr->flags &= ~flags;
   if (status == 0)
-    mu_attribute_set_modified (attr);
+    {
+      mu_attribute_set_modified (attr);
+      if (attr->_notify)
+	attr->_notify (attr, attr->notify_data);
+    }
   return 0;
 }
 
@@ -45,15 +45,19 @@
 #include <mailutils/util.h>
 #include <mailutils/errno.h>
 #include <mailutils/cstr.h>
+#include <mailutils/cctype.h>
 #include <mailutils/sys/header_stream.h>
 #include <mailutils/sys/header.h>
 
 #define HEADER_MODIFIED   0x01
 #define HEADER_INVALIDATE 0x02
 #define HEADER_STREAMMOD  0x04
+#define HEADER_INDEXED    0x08
 
 #define HEADER_SET_MODIFIED(h) \
   ((h)->flags |= (HEADER_MODIFIED|HEADER_INVALIDATE))
+#define HEADER_DROP_INDEX(h) \
+  ((h)->flags &= ~HEADER_INDEXED)
 
 
 /* mu_hdrent manipulation */
@@ -63,7 +67,7 @@
 #define MU_STR_SIZE(nlen,vlen) ((nlen) + 2 + (vlen) + 1)
 
 static struct mu_hdrent *
-mu_hdrent_nth (struct _mu_header *hdr, int n)
+mu_hdrent_nth_linear (struct _mu_header *hdr, int n)
 {
   struct mu_hdrent *p;
   for (p = hdr->head; p; p = p->next)
@@ -73,7 +77,7 @@ mu_hdrent_nth (struct _mu_header *hdr, int n)
 }
 
 static struct mu_hdrent *
-mu_hdrent_find (struct _mu_header *hdr, const char *name, int pos)
+mu_hdrent_find_linear (struct _mu_header *hdr, const char *name, int pos)
 {
   struct mu_hdrent *p;
 
@@ -96,6 +100,185 @@ mu_hdrent_find (struct _mu_header *hdr, const char *name, int pos)
   return p;
 }
 
+/* Lookup index.
+
+   The index is built on first lookup and dropped by any function that
+   modifies the list of entries.  It consists of an array of entries in
+   header order, which serves mu_hdrent_nth, and of the same entries
+   grouped by name, so that the Nth occurrence of a given field is found
+   with a single hash lookup.  The hash table maps case-folded names
+   to groups.  If the index cannot be allocated, lookups fall back to
+   scanning the list. */
+
+#define HDRENT_INDEX_MIN 16
+
+static unsigned
+mu_hdrent_hash (const char *name)
+{
+  unsigned h = 0;
+
+  /* Fold the case the same way mu_c_strcasecmp does */
+  for (; *name; name++)
+    h = h * 31 + (unsigned char) mu_toupper (*name);
+  return h;
+}
+
+/* Return the slot of the hash table where the group NAME is stored, or
+   the empty slot where it should be stored. */
+static size_t
+mu_hdrent_slot (struct _mu_header *hdr, const char *name, unsigned hash)
+{
+  size_t mask = 2 * hdr->idx_max - 1;
+  size_t i;
+
+  for (i = hash & mask; hdr->idx_tab[i]; i = (i + 1) & mask)
+    {
+      struct mu_hdrent_group *grp = &hdr->idx_grp[hdr->idx_tab[i] - 1];
+      if (grp->hash == hash
+	  && mu_c_strcasecmp (MU_HDRENT_NAME (hdr, grp->ent), name) == 0)
+	break;
+    }
+  return i;
+}
+
+static void
+mu_hdrent_index_free (struct _mu_header *hdr)
+{
+  free (hdr->idx_pos);
+  free (hdr->idx_name);
+  free (hdr->idx_grp);
+  free (hdr->idx_tab);
+  hdr->idx_pos = hdr->idx_name = NULL;
+  hdr->idx_grp = NULL;
+  hdr->idx_tab = NULL;
+  hdr->idx_max = hdr->idx_count = 0;
+  HEADER_DROP_INDEX (hdr);
+}
+
+static int
+mu_hdrent_index (struct _mu_header *hdr)
+{
+  struct mu_hdrent *p;
+  size_t i, n, ngrp, off;
+
+  if (hdr->flags & HEADER_INDEXED)
+    return 0;
+
+  for (n = 0, p = hdr->head; p; p = p->next)
+    n++;
+  
+  if (n > hdr->idx_max)
+    {
+      size_t max = hdr->idx_max ? hdr->idx_max : HDRENT_INDEX_MIN;
+
+      while (max < n)
+	max *= 2;
+      mu_hdrent_index_free (hdr);
+      hdr->idx_pos = calloc (max, sizeof (hdr->idx_pos[0]));
+      hdr->idx_name = calloc (max, sizeof (hdr->idx_name[0]));
+      hdr->idx_grp = calloc (max, sizeof (hdr->idx_grp[0]));
+      hdr->idx_tab = calloc (2 * max, sizeof (hdr->idx_tab[0]));
+      if (!hdr->idx_pos || !hdr->idx_name || !hdr->idx_grp || !hdr->idx_tab)
+	{
+	  mu_hdrent_index_free (hdr);
+	  return ENOMEM;
+	}
+      hdr->idx_max = max;
+    }
+  else if (hdr->idx_max)
+    memset (hdr->idx_tab, 0, 2 * hdr->idx_max * sizeof (hdr->idx_tab[0]));
+
+  /* Collect the groups and count their members */
+  ngrp = 0;
+  for (i = 0, p = hdr->head; p; p = p->next, i++)
+    {
+      const char *name = MU_HDRENT_NAME (hdr, p);
+      unsigned hash = mu_hdrent_hash (name);
+      size_t slot = mu_hdrent_slot (hdr, name, hash);
+      struct mu_hdrent_group *grp;
+
+      if (hdr->idx_tab[slot])
+	grp = &hdr->idx_grp[hdr->idx_tab[slot] - 1];
+      else
+	{
+	  grp = &hdr->idx_grp[ngrp++];
+	  grp->ent = p;
+	  grp->hash = hash;
+	  grp->count = 0;
+	  hdr->idx_tab[slot] = ngrp;
+	}
+      grp->count++;
+      hdr->idx_pos[i] = p;
+    }
+
+  /* Lay out the groups */
+  for (i = off = 0; i < ngrp; i++)
+    {
+      hdr->idx_grp[i].off = off;
+      off += hdr->idx_grp[i].count;
+      hdr->idx_grp[i].count = 0;
+    }
+  for (i = 0; i < n; i++)
+    {
+      const char *name = MU_HDRENT_NAME (hdr, hdr->idx_pos[i]);
+      size_t slot = mu_hdrent_slot (hdr, name, mu_hdrent_hash (name));
+      struct mu_hdrent_group *grp = &hdr->idx_grp[hdr->idx_tab[slot] - 1];
+      hdr->idx_name[grp->off + grp->count++] = hdr->idx_pos[i];
+    }
+
+  hdr->idx_count = n;
+  hdr->flags |= HEADER_INDEXED;
+  return 0;
+}
+
+static struct mu_hdrent *
+mu_hdrent_nth (struct _mu_header *hdr, int n)
+{
+  if (n < 1)
+    return NULL;
+  if (mu_hdrent_index (hdr))
+    return mu_hdrent_nth_linear (hdr, n);
+  if (n > hdr->idx_count)
+    return NULL;
+  return hdr->idx_pos[n - 1];
+}
+
+static struct mu_hdrent *
+mu_hdrent_find (struct _mu_header *hdr, const char *name, int pos)
+{
+  struct mu_hdrent_group *grp;
+  size_t slot;
+  
+  if (pos == 0)
+    return NULL;
+  if (mu_hdrent_index (hdr))
+    return mu_hdrent_find_linear (hdr, name, pos);
+  if (!name)
+    {
+      if (pos > 0)
+	return mu_hdrent_nth (hdr, pos);
+      if (-pos > hdr->idx_count)
+	return NULL;
+      return hdr->idx_pos[hdr->idx_count + pos];
+    }
+  if (hdr->idx_count == 0)
+    return NULL;
+  
+  slot = mu_hdrent_slot (hdr, name, mu_hdrent_hash (name));
+  if (!hdr->idx_tab[slot])
+    return NULL;
+  grp = &hdr->idx_grp[hdr->idx_tab[slot] - 1];
+  if (pos > 0)
+    {
+      if (pos > grp->count)
+	return NULL;
+      return hdr->idx_name[grp->off + pos - 1];
+    }
+  if (-pos > grp->count)
+    return NULL;
+  return hdr->idx_name[grp->off + grp->count + pos];
+}
+
 static int
 mu_hdrent_find_stream_pos (struct _mu_header *hdr, mu_off_t pos,
 			   struct mu_hdrent **pent, size_t *poff)
@@ -157,6 +340,8 @@ static void
 mu_hdrent_remove (struct _mu_header *hdr, struct mu_hdrent *ent)
 {
   struct mu_hdrent *p = ent->prev;
+
+  HEADER_DROP_INDEX (hdr);
   if (p)
     p->next = ent->next;
   else
@@ -173,6 +358,8 @@ static void
 mu_hdrent_prepend (struct _mu_header *hdr, struct mu_hdrent *ent)
 {
   struct mu_hdrent *p = hdr->head;
+
+  HEADER_DROP_INDEX (hdr);
   ent->prev = NULL;
   ent->next = p;
   if (p)
@@ -186,6 +373,8 @@ static void
 mu_hdrent_append (struct _mu_header *hdr, struct mu_hdrent *ent)
 {
   struct mu_hdrent *p = hdr->tail;
+
+  HEADER_DROP_INDEX (hdr);
   ent->next = NULL;
   ent->prev = p;
   if (p)
@@ -204,6 +393,8 @@ mu_hdrent_insert (struct _mu_header *hdr, struct mu_hdrent *ent,
   if (!ref)
     return MU_ERR_NOENT;
 
+  HEADER_DROP_INDEX (hdr);
+
   if (before)
     {
       ref = ref->prev;
@@ -240,6 +431,9 @@ mu_hdrent_create (struct _mu_header *ph,
   size_t strsize;
   size_t sizeleft;
   const char *p;
+
+  /* The name of ENT may change */
+  HEADER_DROP_INDEX (ph);
   
   if (!ent)
     {
@@ -299,6 +493,7 @@ mu_hdrent_free_list (struct _mu_header *hdr)
     }
   hdr->head = hdr->tail = NULL;
   hdr->spool_used = 0;
+  HEADER_DROP_INDEX (hdr);
 }
   
 
@@ -485,6 +680,7 @@ mu_header_destroy (mu_header_t *ph)
       mu_stream_destroy (&header->mstream);
       mu_stream_destroy (&header->stream);
       mu_hdrent_free_list (header);
+      mu_hdrent_index_free (header);
       free (header->spool);
       free (header);
       *ph = NULL;
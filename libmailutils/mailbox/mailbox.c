@@ -297,6 +297,9 @@ mu_mailbox_destroy (mu_mailbox_t *pmbox)
 	  mu_observable_destroy (&mbox->observable, mbox);
 	}
 
+      _mu_mailbox_watch_destroy (mbox);
+      _mu_mailbox_changes_destroy (mbox);
+
       /* Call the concrete mailbox _destroy method. So it can clean itself.  */
       if (mbox->_destroy)
 	mbox->_destroy (mbox);
@@ -370,9 +373,14 @@ mu_mailbox_close (mu_mailbox_t mbox)
   if (mbox == NULL || mbox->_close == NULL)
     return MU_ERR_EMPTY_VFN;
 
+  _mu_mailbox_watch_destroy (mbox);
   rc = mbox->_close (mbox);
   if (rc == 0)
-    mbox->flags &= ~_MU_MAILBOX_OPEN;
+    {
+      mbox->flags &= ~_MU_MAILBOX_OPEN;
+      /* UIDs may change before the mailbox is reopened */
+      _mu_mailbox_changes_reset (mbox);
+    }
   return rc;
 }
 
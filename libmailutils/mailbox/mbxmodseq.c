@@ -0,0 +1,143 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General
+   Public License along with this library.  If not, see
+   <http://www.gnu.org/licenses/>. */
+
+/* Attribute change log.
+
+   Each mailbox keeps a modification sequence number, which is incremented
+   each time attributes of one of its messages change.  The UIDs of the
+   changed messages are kept in a bounded log, so that the caller that
+   remembers the modification sequence it has last seen can obtain the set
+   of messages changed since then, instead of examining each message in
+   the mailbox.
+
+   The log is fed by mu_attribute_set_flags and mu_attribute_unset_flags,
+   via the notification hook installed by mu_message_set_attribute.
+   Drivers that learn about attribute changes by other means (e.g. when
+   rescanning the mailbox) call _mu_mailbox_changes_note themselves, or
+   _mu_mailbox_changes_reset if they cannot tell which messages changed.
+
+   When the log overflows, its older half is discarded.  Requests for
+   changes since a sequence number that is no longer covered by the log
+   fail with MU_ERR_NOENT, in which case the caller must examine the
+   whole mailbox. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <mailutils/types.h>
+#include <mailutils/errno.h>
+#include <mailutils/msgset.h>
+#include <mailutils/sys/mailbox.h>
+
+#define CHLOG_MIN 64
+#define CHLOG_MAX 4096
+
+void
+_mu_mailbox_changes_note (mu_mailbox_t mbox, size_t uid)
+{
+  if (mbox->chlog_count == mbox->chlog_max)
+    {
+      if (mbox->chlog_max == CHLOG_MAX)
+	{
+	  size_t half = mbox->chlog_count / 2;
+	  memmove (mbox->chlog, mbox->chlog + half,
+		   (mbox->chlog_count - half) * sizeof (mbox->chlog[0]));
+	  mbox->chlog_count -= half;
+	  mbox->chlog_base += half;
+	}
+      else
+	{
+	  size_t n = mbox->chlog_max ? mbox->chlog_max * 2 : CHLOG_MIN;
+	  size_t *p = realloc (mbox->chlog, n * sizeof (mbox->chlog[0]));
+	  if (!p)
+	    {
+	      /* Can't record this change: invalidate the log */
+	      _mu_mailbox_changes_reset (mbox);
+	      return;
+	    }
+	  mbox->chlog = p;
+	  mbox->chlog_max = n;
+	}
+    }
+  mbox->chlog[mbox->chlog_count++] = uid;
+}
+
+void
+_mu_mailbox_changes_reset (mu_mailbox_t mbox)
+{
+  mbox->chlog_base += mbox->chlog_count + 1;
+  mbox->chlog_count = 0;
+}
+
+void
+_mu_mailbox_changes_destroy (mu_mailbox_t mbox)
+{
+  free (mbox->chlog);
+  mbox->chlog = NULL;
+  mbox->chlog_count = mbox->chlog_max = 0;
+}
+
+int
+mu_mailbox_modseq (mu_mailbox_t mbox, unsigned long *pmodseq)
+{
+  if (!mbox)
+    return EINVAL;
+  if (!pmodseq)
+    return MU_ERR_OUT_PTR_NULL;
+  *pmodseq = mbox->chlog_base + mbox->chlog_count;
+  return 0;
+}
+
+/* Return in *PSET the set of UIDs of messages whose attributes have
+   changed since modification sequence SINCE. */
+int
+mu_mailbox_changes (mu_mailbox_t mbox, unsigned long since, mu_msgset_t *pset)
+{
+  mu_msgset_t set;
+  size_t i;
+  int rc;
+
+  if (!mbox)
+    return EINVAL;
+  if (!pset)
+    return MU_ERR_OUT_PTR_NULL;
+  if (since > mbox->chlog_base + mbox->chlog_count)
+    return EINVAL;
+  if (since < mbox->chlog_base)
+    return MU_ERR_NOENT;
+
+  rc = mu_msgset_create (&set, mbox, MU_MSGSET_UID);
+  if (rc)
+    return rc;
+  for (i = since - mbox->chlog_base; i < mbox->chlog_count; i++)
+    {
+      rc = mu_msgset_add_range (set, mbox->chlog[i], mbox->chlog[i],
+				MU_MSGSET_UID);
+      if (rc)
+	{
+	  mu_msgset_free (set);
+	  return rc;
+	}
+    }
+  *pset = set;
+  return 0;
+}
@@ -0,0 +1,233 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General
+   Public License along with this library.  If not, see
+   <http://www.gnu.org/licenses/>. */
+
+/* Mailbox change notification.
+
+   mu_mailbox_watch returns a file descriptor that becomes readable when
+   the mailbox may have been changed by another process.  The caller
+   waits for it (along with whatever other descriptors it is interested
+   in) and, when it becomes readable, calls mu_mailbox_watch_clear to
+   consume the notification and then rescans the mailbox.
+
+   The implementation uses inotify.  UNIX mailboxes are watched for
+   modifications of the mailbox file.  For directory-based mailboxes,
+   the new/ and cur/ subdirectories are watched if they exist (maildir),
+   otherwise the directory itself is (MH).  Changes to files whose names
+   begin with a dot are ignored, since these are auxiliary files
+   maintained by the library itself. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
+
+#include <mailutils/types.h>
+#include <mailutils/debug.h>
+#include <mailutils/errno.h>
+#include <mailutils/registrar.h>
+#include <mailutils/url.h>
+#include <mailutils/util.h>
+#include <mailutils/sys/mailbox.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+struct _mu_mailbox_watch
+{
+  int fd;            /* inotify descriptor */
+  char *path;        /* Mailbox file or directory name */
+};
+
+#define WATCH_FILE_MASK \
+  (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+#define WATCH_DIR_MASK \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE \
+   | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/* Add inotify watches for the mailbox.  It is safe to call this function
+   several times: existing watches are not duplicated. */
+static int
+watch_add (struct _mu_mailbox_watch *wp)
+{
+  static char *subdirs[] = { "new", "cur", NULL };
+  struct stat st;
+  int i, n = 0;
+
+  if (stat (wp->path, &st))
+    return errno;
+
+  if (!S_ISDIR (st.st_mode))
+    {
+      if (inotify_add_watch (wp->fd, wp->path, WATCH_FILE_MASK) == -1)
+	return errno;
+      return 0;
+    }
+
+  for (i = 0; subdirs[i]; i++)
+    {
+      char *name = mu_make_file_name (wp->path, subdirs[i]);
+      if (!name)
+	return ENOMEM;
+      if (stat (name, &st) == 0 && S_ISDIR (st.st_mode)
+	  && inotify_add_watch (wp->fd, name, WATCH_DIR_MASK) != -1)
+	n++;
+      free (name);
+    }
+  if (n == 0
+      && inotify_add_watch (wp->fd, wp->path, WATCH_DIR_MASK) == -1)
+    return errno;
+  return 0;
+}
+
+int
+mu_mailbox_watch (mu_mailbox_t mbox, int *pfd)
+{
+  struct _mu_mailbox_watch *wp;
+  const char *path;
+  int local;
+  int rc;
+
+  if (!mbox)
+    return EINVAL;
+  if (!pfd)
+    return MU_ERR_OUT_PTR_NULL;
+  if (mbox->watch)
+    {
+      *pfd = mbox->watch->fd;
+      return 0;
+    }
+
+  rc = mu_registrar_test_local_url (mbox->url, &local);
+  if (rc)
+    return rc;
+  if (!local)
+    return ENOSYS;
+  rc = mu_url_sget_path (mbox->url, &path);
+  if (rc)
+    return rc;
+
+  wp = malloc (sizeof (*wp));
+  if (!wp)
+    return ENOMEM;
+  wp->path = strdup (path);
+  if (!wp->path)
+    {
+      free (wp);
+      return ENOMEM;
+    }
+  wp->fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (wp->fd == -1)
+    rc = errno;
+  else
+    rc = watch_add (wp);
+  if (rc)
+    {
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+		("cannot watch %s: %s", wp->path, mu_strerror (rc)));
+      if (wp->fd != -1)
+	close (wp->fd);
+      free (wp->path);
+      free (wp);
+      return rc;
+    }
+  mbox->watch = wp;
+  *pfd = wp->fd;
+  return 0;
+}
+
+int
+mu_mailbox_watch_clear (mu_mailbox_t mbox, int *pchanged)
+{
+  struct _mu_mailbox_watch *wp;
+  char buf[4096]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  int changed = 0, rearm = 0;
+  ssize_t n;
+
+  if (!mbox)
+    return EINVAL;
+  wp = mbox->watch;
+  if (!wp)
+    return MU_ERR_NOENT;
+
+  while ((n = read (wp->fd, buf, sizeof buf)) > 0)
+    {
+      char *p;
+
+      for (p = buf; p < buf + n; )
+	{
+	  struct inotify_event *ev = (struct inotify_event *) p;
+
+	  if (ev->mask & IN_IGNORED)
+	    /* The watched file was removed or renamed */
+	    rearm = 1;
+	  if (ev->len == 0 || ev->name[0] != '.')
+	    changed = 1;
+	  p += sizeof (*ev) + ev->len;
+	}
+    }
+  if (n == -1 && errno != EAGAIN && errno != EINTR)
+    return errno;
+
+  if (rearm)
+    watch_add (wp);
+  if (pchanged)
+    *pchanged = changed;
+  return 0;
+}
+
+void
+_mu_mailbox_watch_destroy (mu_mailbox_t mbox)
+{
+  struct _mu_mailbox_watch *wp = mbox->watch;
+  if (wp)
+    {
+      close (wp->fd);
+      free (wp->path);
+      free (wp);
+      mbox->watch = NULL;
+    }
+}
+
+#else
+
+int
+mu_mailbox_watch (mu_mailbox_t mbox, int *pfd)
+{
+  return ENOSYS;
+}
+
+int
+mu_mailbox_watch_clear (mu_mailbox_t mbox, int *pchanged)
+{
+  return ENOSYS;
+}
+
+void
+_mu_mailbox_watch_destroy (mu_mailbox_t mbox)
+{
+}
+
+#endif
@@ -24,6 +24,23 @@
 #include <mailutils/errno.h>
 #include <mailutils/attribute.h>
 #include <mailutils/sys/message.h>
+#include <mailutils/sys/attribute.h>
+#include <mailutils/sys/mailbox.h>
+
+/* Record the attribute change in the change log of the owning mailbox */
+static void
+_attr_notify (mu_attribute_t attr, void *data)
+{
+  mu_message_t msg = data;
+  size_t uid;
+
+  if (!msg->mailbox)
+    return;
+  if (mu_message_get_uid (msg, &uid) == 0 && uid)
+    _mu_mailbox_changes_note (msg->mailbox, uid);
+  else
+    _mu_mailbox_changes_reset (msg->mailbox);
+}
 
 int
 mu_message_get_attribute (mu_message_t msg, mu_attribute_t *pattribute)
@@ -38,6 +55,8 @@ mu_message_get_attribute (mu_message_t msg, mu_attribute_t *pattribute)
       int status = mu_attribute_create (&attribute, msg);
       if (status != 0)
 	return status;
+      attribute->_notify = _attr_notify;
+      attribute->notify_data = msg;
       msg->attribute = attribute;
     }
   *pattribute = msg->attribute;
@@ -54,6 +73,11 @@ mu_message_set_attribute (mu_message_t msg, mu_attribute_t attribute, void *owne
   if (msg->attribute)
     mu_attribute_destroy (&msg->attribute, owner);
   msg->attribute = attribute;
+  if (attribute)
+    {
+      attribute->_notify = _attr_notify;
+      attribute->notify_data = msg;
+    }
   msg->flags |= MESSAGE_MODIFIED;
   return 0;
 }
@@ -32,7 +32,12 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <signal.h>
+#ifdef _POSIX_MAPPED_FILES
+# include <sys/mman.h>
+#endif
 #include <mailutils/cctype.h>
 #include <mailutils/server.h>
 #include <mailutils/error.h>
@@ -67,6 +72,16 @@ set_signal (int sig, mu_sig_handler_t handler)
 # define NSIG 64
 #endif
 
+/* Status of a pre-forked worker process.  The array of these is kept
+   in memory shared between the master and the workers.  Each member is
+   written by a single process only: BUSY by the worker, RETIRE by the
+   master. */
+struct worker_status
+{
+  volatile sig_atomic_t busy;    /* The worker is serving a connection */
+  volatile sig_atomic_t retire;  /* The worker should exit when idle */
+};
+
 struct _mu_m_server
 {
   char *ident;                   /* Server identifier, for logging purposes.*/
@@ -87,6 +102,19 @@ struct _mu_m_server
   size_t max_children;           /* Maximum number of sub-processes to run. */
   size_t num_children;           /* Current number of running sub-processes. */
   pid_t *child_pid;
+  size_t workers;                /* Number of workers to pre-fork (0 means
+				    fork a process for each connection). */
+  size_t min_spare_workers;      /* Minimum number of idle workers. */
+  size_t max_spare_workers;      /* Maximum number of idle workers. */
+  size_t spawn_rate;             /* Number of workers to start at the next
+				    check, if there are too few idle ones. */
+  size_t max_worker_requests;    /* Max. connections served by a worker. */
+  struct worker_status *scoreboard; /* Status of workers, indexed as
+				       child_pid. */
+  int worker_slot;               /* Index of this worker in scoreboard, or
+				    -1 in the master process. */
+  size_t worker_requests;        /* Number of connections served by this
+				    worker. */
   char *pidfile;                 /* Name of a PID-file. */
   struct mu_sockaddr_hints hints; /* Default address hints. */
   time_t timeout;                /* Default idle timeout. */
@@ -124,20 +152,29 @@ alloc_children (mu_m_server_t srv)
     srv->child_pid[i] = UNUSED_PID;
 }
 
+static int
+find_free_slot (mu_m_server_t msrv)
+{
+  int i;
+  
+  for (i = 0; i < msrv->max_children; i++)
+    if (msrv->child_pid[i] == UNUSED_PID)
+      return i;
+  return -1;
+}
+
 static void
 register_child (mu_m_server_t msrv, pid_t pid)
 {
   int i;
   
   msrv->num_children++;
-  for (i = 0; i < msrv->max_children; i++)
-    if (msrv->child_pid[i] == UNUSED_PID)
-      {
-	msrv->child_pid[i] = pid;
-	return;
-      }
-  mu_error ("%s:%d: cannot find free PID slot (internal error?)",
-	    __FILE__, __LINE__);
+  i = find_free_slot (msrv);
+  if (i >= 0)
+    msrv->child_pid[i] = pid;
+  else
+    mu_error ("%s:%d: cannot find free PID slot (internal error?)",
+	      __FILE__, __LINE__);
 }
 
 static int
@@ -150,6 +187,11 @@ unregister_child (mu_m_server_t msrv, pid_t pid)
     if (msrv->child_pid[i] == pid)
       {
 	msrv->child_pid[i] = UNUSED_PID;
+	if (msrv->scoreboard)
+	  {
+	    msrv->scoreboard[i].busy = 0;
+	    msrv->scoreboard[i].retire = 0;
+	  }
 	return 0;
       }
   return 1;
@@ -271,6 +313,9 @@ mu_m_server_create (mu_m_server_t *psrv, const char *ident)
 	}
     }
   srv->deftype = MU_IP_TCP;
+  srv->min_spare_workers = 1;
+  srv->max_spare_workers = 4;
+  srv->worker_slot = -1;
   MU_ASSERT (mu_server_create (&srv->server));
   mu_server_set_idle (srv->server, mu_m_server_idle);
   sigemptyset (&srv->sigmask);
@@ -340,6 +385,25 @@ mu_m_server_set_max_children (mu_m_server_t srv, size_t num)
   srv->max_children = num;
 }
 
+void
+mu_m_server_set_workers (mu_m_server_t srv, size_t num)
+{
+  srv->workers = num;
+}
+
+void
+mu_m_server_set_spare_workers (mu_m_server_t srv, size_t min, size_t max)
+{
+  srv->min_spare_workers = min;
+  srv->max_spare_workers = max;
+}
+
+void
+mu_m_server_set_max_worker_requests (mu_m_server_t srv, size_t num)
+{
+  srv->max_worker_requests = num;
+}
+
 int
 mu_m_server_set_pidfile (mu_m_server_t srv, const char *pidfile)
 {
@@ -541,6 +605,17 @@ mu_m_server_begin (mu_m_server_t msrv)
       msrv->sigtab[i] = set_signal (i, m_srv_signal);
 }
 
+/* Reinstall m-server signal handlers after mu_m_server_restore_signals */
+static void
+install_signals (mu_m_server_t msrv)
+{
+  int i;
+  
+  for (i = 0; i < NSIG; i++)
+    if (sigismember (&msrv->sigmask, i))
+      set_signal (i, m_srv_signal);
+}
+
 void
 mu_m_server_restore_signals (mu_m_server_t msrv)
 {
@@ -564,6 +639,11 @@ mu_m_server_destroy (mu_m_server_t *pmsrv)
   mu_list_remove (m_server_list, msrv);
   mu_server_destroy (&msrv->server);
   free (msrv->child_pid);
+#ifdef _POSIX_MAPPED_FILES
+  if (msrv->scoreboard)
+    munmap (msrv->scoreboard,
+	    msrv->max_children * sizeof (msrv->scoreboard[0]));
+#endif
   /* FIXME: Send processes the TERM signal here?*/
   free (msrv->ident);
   free (msrv);
@@ -575,7 +655,11 @@ tcp_conn_handler (int fd, void *conn_data, void *server_data)
 {
   mu_ip_server_t tcpsrv = (mu_ip_server_t) conn_data;
   int rc = mu_ip_server_accept (tcpsrv, server_data);
-  if (rc && rc != EINTR)
+  /* In prefork mode the listening sockets are non-blocking and shared
+     between the workers, so the connection may have been taken by
+     another one. */
+  if (rc && rc != EINTR && rc != EAGAIN && rc != EWOULDBLOCK
+      && rc != ECONNABORTED)
     {
       mu_ip_server_shutdown (tcpsrv);
       return MU_SERVER_CLOSE_CONN;
@@ -613,9 +697,193 @@ _open_conn (void *item, void *data)
       mu_ip_server_shutdown (tcpsrv);
       mu_ip_server_destroy (&tcpsrv);
     }
+  else if (msrv->workers)
+    {
+      int fd = mu_ip_server_get_fd (tcpsrv);
+      int flags = fcntl (fd, F_GETFL);
+      if (flags == -1 || fcntl (fd, F_SETFL, flags | O_NONBLOCK) == -1)
+	mu_error (_("cannot set non-blocking mode on %s: %s"),
+		  mu_ip_server_addrstr (tcpsrv), mu_strerror (errno));
+    }
   return 0;
 }  
 
+/* Pre-forked workers.
+
+   In prefork mode, the master process starts a pool of workers in
+   advance.  Each worker runs its own copy of the server loop on the
+   listening sockets inherited from the master and serves connections
+   itself, without forking.  The master keeps the number of idle workers
+   between min_spare_workers and max_spare_workers: it starts new workers
+   if there are too few of them, and asks the idle ones to exit if there
+   are too many.  A worker exits after having served max_worker_requests
+   connections (if that is set), or when the connection handler exits.
+
+   The master checks the pool once a second, and each time a worker
+   starts serving a connection.  While the idle workers stay short, the
+   number of workers started at each check doubles, up to
+   MAX_SPAWN_RATE, so that a burst of connections does not wait for
+   workers being started one at a time. */
+
+#define MAX_SPAWN_RATE 32
+
+static int
+alloc_scoreboard (mu_m_server_t msrv)
+{
+#ifdef _POSIX_MAPPED_FILES
+  void *p;
+  size_t size = msrv->max_children * sizeof (msrv->scoreboard[0]);
+# ifndef MAP_ANONYMOUS
+#  define MAP_ANONYMOUS MAP_ANON
+# endif
+  p = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+	    -1, 0);
+  if (p == MAP_FAILED)
+    return errno;
+  memset (p, 0, size);
+  msrv->scoreboard = p;
+  return 0;
+#else
+  return ENOSYS;
+#endif
+}
+
+static int
+worker_idle (void *data)
+{
+  mu_m_server_t msrv = data;
+  struct worker_status *ws = &msrv->scoreboard[msrv->worker_slot];
+
+  if (mu_m_server_idle (NULL))
+    return 1;
+  return ws->retire && !ws->busy;
+}
+
+static void
+worker_main (mu_m_server_t msrv, int slot)
+{
+  struct timeval tv;
+
+  msrv->worker_slot = slot;
+  msrv->worker_requests = 0;
+  /* Wake up periodically to see if we are requested to exit */
+  tv.tv_sec = 1;
+  tv.tv_usec = 0;
+  mu_server_set_timeout (msrv->server, &tv);
+  mu_server_set_data (msrv->server, msrv, NULL);
+  mu_server_set_idle (msrv->server, worker_idle);
+  mu_server_run (msrv->server);
+  closelog ();
+  exit (0);
+}
+
+static void
+spawn_worker (mu_m_server_t msrv)
+{
+  int slot = find_free_slot (msrv);
+  pid_t pid;
+
+  if (slot == -1)
+    return;
+  msrv->scoreboard[slot].busy = 0;
+  msrv->scoreboard[slot].retire = 0;
+  pid = fork ();
+  if (pid == -1)
+    mu_diag_output (MU_DIAG_ERROR, "fork: %s", strerror (errno));
+  else if (pid == 0)
+    worker_main (msrv, slot);
+  else
+    {
+      msrv->num_children++;
+      msrv->child_pid[slot] = pid;
+    }
+}
+
+/* Adjust the number of idle workers */
+static void
+maintain_workers (mu_m_server_t msrv)
+{
+  size_t i, idle = 0;
+  int last_idle = -1;
+
+  for (i = 0; i < msrv->max_children; i++)
+    if (msrv->child_pid[i] != UNUSED_PID
+	&& !msrv->scoreboard[i].busy && !msrv->scoreboard[i].retire)
+      {
+	idle++;
+	last_idle = i;
+      }
+
+  if (idle < msrv->min_spare_workers)
+    {
+      size_t n = msrv->min_spare_workers - idle;
+
+      if (n < msrv->spawn_rate)
+	n = msrv->spawn_rate;
+      for (i = 0; i < n; i++)
+	{
+	  if (msrv->num_children >= msrv->max_children)
+	    {
+	      mu_diag_output (MU_DIAG_ERROR, _("too many children (%lu)"),
+			      (unsigned long) msrv->num_children);
+	      break;
+	    }
+	  spawn_worker (msrv);
+	}
+      if (msrv->spawn_rate < MAX_SPAWN_RATE)
+	msrv->spawn_rate *= 2;
+    }
+  else
+    {
+      msrv->spawn_rate = 1;
+      if (idle > msrv->max_spare_workers && last_idle != -1)
+	/* Retire one worker at a time, so that the pool shrinks gradually */
+	msrv->scoreboard[last_idle].retire = 1;
+    }
+}
+
+static int
+prefork_run (mu_m_server_t msrv)
+{
+  size_t i;
+
+  if (msrv->max_spare_workers < msrv->min_spare_workers)
+    msrv->max_spare_workers = msrv->min_spare_workers;
+  msrv->spawn_rate = 1;
+  for (i = 0; i < msrv->workers && msrv->num_children < msrv->max_children;
+       i++)
+    spawn_worker (msrv);
+  while (!stop)
+    {
+      mu_m_server_idle (NULL);
+      maintain_workers (msrv);
+      if (!stop && !need_cleanup)
+	sleep (1);
+    }
+  return 0;
+}
+
+static void
+worker_conn (int fd, struct sockaddr *sa, int salen,
+	     struct mu_srv_config *pconf)
+{
+  mu_m_server_t msrv = pconf->msrv;
+  struct worker_status *ws = &msrv->scoreboard[msrv->worker_slot];
+
+  ws->busy = 1;
+  /* Let the master see at once that there is one idle worker less */
+  kill (getppid (), SIGCHLD);
+  mu_m_server_restore_signals (msrv);
+  if (!msrv->prefork || msrv->prefork (fd, sa, salen, pconf, msrv->data) == 0)
+    msrv->conn (fd, sa, salen, pconf, msrv->data);
+  install_signals (msrv);
+  ws->busy = 0;
+  if (ws->retire
+      || (msrv->max_worker_requests
+	  && ++msrv->worker_requests >= msrv->max_worker_requests))
+    stop = 1;
+}
+
 int
 mu_m_server_run (mu_m_server_t msrv)
 {
@@ -633,7 +901,24 @@ mu_m_server_run (mu_m_server_t msrv)
     }
   if (msrv->ident)
     mu_diag_output (MU_DIAG_INFO, _("%s started"), msrv->ident);
-  rc = mu_server_run (msrv->server);
+  if (msrv->workers && msrv->deftype == MU_IP_UDP)
+    {
+      mu_diag_output (MU_DIAG_WARNING,
+		      _("prefork mode is not supported for UDP servers"));
+      msrv->workers = 0;
+    }
+  if (msrv->workers && (rc = alloc_scoreboard (msrv)) != 0)
+    {
+      mu_diag_output (MU_DIAG_WARNING,
+		      _("cannot allocate worker scoreboard: %s; "
+			"prefork mode disabled"),
+		      mu_strerror (rc));
+      msrv->workers = 0;
+    }
+  if (msrv->workers)
+    rc = prefork_run (msrv);
+  else
+    rc = mu_server_run (msrv->server);
   terminate_children (msrv);
   if (msrv->ident)
     mu_diag_output (MU_DIAG_INFO, _("%s terminated"), msrv->ident);
@@ -698,7 +983,9 @@ m_srv_conn (int fd, struct sockaddr *sa, int salen,
   if (mu_m_server_check_acl (pconf->msrv, sa, salen))
     return 0;
 
-  if (!pconf->single_process)
+  if (pconf->msrv->worker_slot >= 0)
+    worker_conn (fd, sa, salen, pconf);
+  else if (!pconf->single_process)
     {
       pid_t pid;
 
@@ -890,6 +1177,20 @@ static struct mu_cfg_param dot_server_cfg_param[] = {
   { "max-children", mu_cfg_size,
     NULL, mu_offsetof (struct _mu_m_server,max_children), NULL,
     N_("Maximum number of children processes to run simultaneously.") },
+  { "workers", mu_cfg_size,
+    NULL, mu_offsetof (struct _mu_m_server,workers), NULL,
+    N_("Number of worker processes to start in advance.  If 0, start "
+       "a new process for each connection.") },
+  { "min-spare-workers", mu_cfg_size,
+    NULL, mu_offsetof (struct _mu_m_server,min_spare_workers), NULL,
+    N_("Minimum number of idle worker processes.") },
+  { "max-spare-workers", mu_cfg_size,
+    NULL, mu_offsetof (struct _mu_m_server,max_spare_workers), NULL,
+    N_("Maximum number of idle worker processes.") },
+  { "max-worker-requests", mu_cfg_size,
+    NULL, mu_offsetof (struct _mu_m_server,max_worker_requests), NULL,
+    N_("Maximum number of connections a worker process serves before "
+       "exiting (0 means unlimited).") },
   { "mode", mu_cfg_callback,
     NULL, mu_offsetof (struct _mu_m_server,mode), _cb_daemon_mode,
     N_("Set daemon mode (either inetd (or interactive) or daemon)."),
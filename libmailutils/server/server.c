@@ -24,11 +24,22 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 #include <mailutils/server.h>
 #include <mailutils/errno.h>
 #include <mailutils/acl.h>
+#include <mailutils/diag.h>
+#include <mailutils/nls.h>
+
+/* The server loop waits for input on a set of connections and calls
+   their handlers.  Two backends are provided: epoll(7), which is used
+   when available, and select(2).  Connections may be added while the
+   loop is running, e.g. by other connection handlers.  A connection can
+   have an idle timeout: if no input arrives on it within the given
+   time, its timeout handler is called. */
 
-
 struct _mu_connection
 {
   struct _mu_connection *next, *prev;
@@ -36,9 +47,13 @@ struct _mu_connection
   mu_conn_loop_fp f_loop;
   mu_conn_free_fp f_free;
   void *data;
+  mu_conn_timeout_fp f_timeout;  /* Timeout handler */
+  struct timeval timeout;        /* Idle timeout */
+  struct timeval deadline;       /* Time when the timeout expires */
 };
 
 #define MU_SERVER_TIMEOUT 0x1
+#define MU_SERVER_SELECT  0x2   /* The select loop is running */
 
 unsigned long mu_session_id;
 
@@ -52,6 +67,8 @@ struct _mu_server
   mu_server_idle_fp f_idle;
   mu_server_free_fp f_free;
   void *server_data;
+  int epfd;                 /* epoll descriptor, or -1 if not in use */
+  size_t ntimers;           /* Number of connections with timeouts */
 };
 
 void
@@ -77,9 +94,16 @@ void
 remove_connection (mu_server_t srv, struct _mu_connection *conn)
 {
   struct _mu_connection *p;
-  
+
+#ifdef HAVE_SYS_EPOLL_H
+  if (srv->epfd != -1)
+    epoll_ctl (srv->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+#endif
   close (conn->fd);
-  FD_CLR (conn->fd, &srv->fdset);
+  if (conn->fd < FD_SETSIZE)
+    FD_CLR (conn->fd, &srv->fdset);
+  if (conn->f_timeout)
+    srv->ntimers--;
 
   p = conn->prev;
   if (p)
@@ -99,29 +123,72 @@ remove_connection (mu_server_t srv, struct _mu_connection *conn)
   destroy_connection (srv, conn);
 }
 
-int
-connection_loop (mu_server_t srv, fd_set *fdset)
+static void
+set_deadline (struct _mu_connection *conn, struct timeval *now)
+{
+  timeradd (now, &conn->timeout, &conn->deadline);
+}
+
+/* Call the handler of CONN.  Return 1 if the server must shut down. */
+static int
+dispatch (mu_server_t srv, struct _mu_connection *conn)
+{
+  int rc;
+
+  ++mu_session_id;
+  if (conn->f_timeout)
+    {
+      struct timeval now;
+      gettimeofday (&now, NULL);
+      set_deadline (conn, &now);
+    }
+  rc = conn->f_loop (conn->fd, conn->data, srv->server_data);
+  switch (rc)
+    {
+    case 0:
+      break;
+	      
+    case MU_SERVER_CLOSE_CONN:
+    default:
+      remove_connection (srv, conn);
+      break;
+	      
+    case MU_SERVER_SHUTDOWN:
+      return 1;
+    }
+  return 0;
+}
+
+/* Call timeout handlers of the connections whose timeouts have expired.
+   Return 1 if the server must shut down. */
+static int
+expire_timers (mu_server_t srv)
 {
   struct _mu_connection *conn;
+  struct timeval now;
+
+  if (srv->ntimers == 0)
+    return 0;
+  gettimeofday (&now, NULL);
   for (conn = srv->head; conn;)
     {
       struct _mu_connection *next = conn->next;
-      if (FD_ISSET (conn->fd, fdset))
+      if (conn->f_timeout && !timercmp (&now, &conn->deadline, <))
 	{
 	  int rc;
-
-	  ++mu_session_id;
-	  rc = conn->f_loop (conn->fd, conn->data, srv->server_data);
+	  
+	  set_deadline (conn, &now);
+	  rc = conn->f_timeout (conn->fd, conn->data, srv->server_data);
 	  switch (rc)
 	    {
 	    case 0:
 	      break;
-	      
+
 	    case MU_SERVER_CLOSE_CONN:
 	    default:
 	      remove_connection (srv, conn);
 	      break;
-	      
+
 	    case MU_SERVER_SHUTDOWN:
 	      return 1;
 	    }
@@ -131,7 +198,58 @@ connection_loop (mu_server_t srv, fd_set *fdset)
   return 0;
 }
 
-void
+/* Compute the time to wait for input.  Return NULL if there is no
+   limit. */
+static struct timeval *
+wait_time (mu_server_t srv, struct timeval *tv)
+{
+  struct timeval *to = NULL;
+
+  if (srv->flags & MU_SERVER_TIMEOUT)
+    {
+      *tv = srv->timeout;
+      to = tv;
+    }
+  if (srv->ntimers)
+    {
+      struct _mu_connection *conn;
+      struct timeval now, rem;
+
+      gettimeofday (&now, NULL);
+      for (conn = srv->head; conn; conn = conn->next)
+	{
+	  if (!conn->f_timeout)
+	    continue;
+	  if (timercmp (&conn->deadline, &now, <))
+	    timerclear (&rem);
+	  else
+	    timersub (&conn->deadline, &now, &rem);
+	  if (!to || timercmp (&rem, tv, <))
+	    {
+	      *tv = rem;
+	      to = tv;
+	    }
+	}
+    }
+  return to;
+}
+
+int
+connection_loop (mu_server_t srv, fd_set *fdset)
+{
+  struct _mu_connection *conn;
+  for (conn = srv->head; conn;)
+    {
+      struct _mu_connection *next = conn->next;
+      if (conn->fd < FD_SETSIZE && FD_ISSET (conn->fd, fdset)
+	  && dispatch (srv, conn))
+	return 1;
+      conn = next;
+    }
+  return 0;
+}
+
+int
 make_fdset (mu_server_t srv)
 {
   struct _mu_connection *p;
@@ -140,51 +258,151 @@ make_fdset (mu_server_t srv)
   FD_ZERO (&srv->fdset);
   for (p = srv->head; p; p = p->next)
     {
+      if (p->fd >= FD_SETSIZE)
+	return EMFILE;
       FD_SET (p->fd, &srv->fdset);
       if (p->fd > nfd)
 	nfd = p->fd;
     }
   srv->nfd = nfd + 1;
+  return 0;
 }
 
-int
-mu_server_run (mu_server_t srv)
+static int
+select_run (mu_server_t srv)
 {
   int status = 0;
+
+  status = make_fdset (srv);
+  if (status)
+    return status;
   
-  if (!srv)
-    return EINVAL;
-  if (!srv->head)
-    return MU_ERR_NOENT;
-  
-  make_fdset (srv);  
-  
+  srv->flags |= MU_SERVER_SELECT;
   while (1)
     {
       int rc;
       fd_set rdset;
-      struct timeval *to;
+      struct timeval tv, *to;
       
       rdset = srv->fdset;
-      to = (srv->flags & MU_SERVER_TIMEOUT) ? &srv->timeout : NULL;
+      to = wait_time (srv, &tv);
       rc = select (srv->nfd, &rdset, NULL, NULL, to);
-      if (rc == -1 && errno == EINTR)
+      if ((rc == -1 && errno == EINTR) || rc == 0)
 	{
 	  if (srv->f_idle && srv->f_idle (srv->server_data))
 	    break;
-	  continue;
 	}
-      if (rc < 0)
-	return errno;
+      else if (rc < 0)
+	{
+	  status = errno;
+	  break;
+	}
+      else if (connection_loop (srv, &rdset))
+	{
+	  status = MU_ERR_FAILURE;
+	  break;
+	}
+      if (expire_timers (srv))
+	{
+	  status = MU_ERR_FAILURE;
+	  break;
+	}
+    }
+  srv->flags &= ~MU_SERVER_SELECT;
+  return status;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+# define EPOLL_MAX_EVENTS 64
 
-      if (connection_loop (srv, &rdset))
+static int
+epoll_add (mu_server_t srv, struct _mu_connection *conn)
+{
+  struct epoll_event ev;
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = conn;
+  if (epoll_ctl (srv->epfd, EPOLL_CTL_ADD, conn->fd, &ev))
+    return errno;
+  return 0;
+}
+
+static int
+epoll_run (mu_server_t srv)
+{
+  int status = 0;
+  struct _mu_connection *conn;
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+
+  srv->epfd = epoll_create1 (EPOLL_CLOEXEC);
+  if (srv->epfd == -1)
+    return ENOSYS;
+
+  for (conn = srv->head; conn; conn = conn->next)
+    {
+      status = epoll_add (srv, conn);
+      if (status)
+	goto end;
+    }
+
+  while (1)
+    {
+      int i, n, ms = -1;
+      struct timeval tv, *to;
+
+      to = wait_time (srv, &tv);
+      if (to)
+	ms = tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+      n = epoll_wait (srv->epfd, events, EPOLL_MAX_EVENTS, ms);
+      if ((n == -1 && errno == EINTR) || n == 0)
+	{
+	  if (srv->f_idle && srv->f_idle (srv->server_data))
+	    break;
+	}
+      else if (n < 0)
+	{
+	  status = errno;
+	  break;
+	}
+      else
+	{
+	  for (i = 0; i < n; i++)
+	    if (dispatch (srv, events[i].data.ptr))
+	      {
+		status = MU_ERR_FAILURE;
+		goto end;
+	      }
+	}
+      if (expire_timers (srv))
 	{
 	  status = MU_ERR_FAILURE;
 	  break;
 	}
     }
+ end:
+  close (srv->epfd);
+  srv->epfd = -1;
   return status;
 }
+#endif
+
+int
+mu_server_run (mu_server_t srv)
+{
+  if (!srv)
+    return EINVAL;
+  if (!srv->head)
+    return MU_ERR_NOENT;
+
+#ifdef HAVE_SYS_EPOLL_H
+  {
+    int rc = epoll_run (srv);
+    if (rc != ENOSYS)
+      return rc;
+  }
+#endif
+  return select_run (srv);
+}
 
 int
 mu_server_create (mu_server_t *psrv)
@@ -192,6 +410,7 @@ mu_server_create (mu_server_t *psrv)
   mu_server_t srv = calloc (1, sizeof (*srv));
   if (!srv)
     return ENOMEM;
+  srv->epfd = -1;
   *psrv = srv;
   return 0;
 }
@@ -274,21 +493,57 @@ mu_server_set_timeout (mu_server_t srv, struct timeval *to)
 int
 mu_server_add_connection (mu_server_t srv,
 			  int fd, void *data,
-			  mu_conn_loop_fp loop, mu_conn_free_fp free)
+			  mu_conn_loop_fp loop, mu_conn_free_fp f_free)
 {
   struct _mu_connection *p;
 
   if (!srv || !loop)
     return EINVAL;
 
-  p = malloc (sizeof (*p));
+  /* Select cannot watch such descriptors.  Unless epoll is available,
+     that would make the server loop fail at startup, so reject them
+     right away.  When the select loop is running, they would be silently
+     ignored otherwise. */
+  if (fd >= FD_SETSIZE
+#ifdef HAVE_SYS_EPOLL_H
+      && (srv->flags & MU_SERVER_SELECT)
+#endif
+      )
+    {
+      mu_diag_output (MU_DIAG_ERROR,
+		      _("cannot add connection: descriptor %d exceeds "
+			"FD_SETSIZE (%d)"), fd, FD_SETSIZE);
+      return EMFILE;
+    }
+
+  p = calloc (1, sizeof (*p));
   if (!p)
     return ENOMEM;
   p->fd = fd;
   p->f_loop = loop;
-  p->f_free = free;
+  p->f_free = f_free;
   p->data = data;
 
+#ifdef HAVE_SYS_EPOLL_H
+  if (srv->epfd != -1)
+    {
+      int rc = epoll_add (srv, p);
+      if (rc)
+	{
+	  free (p);
+	  return rc;
+	}
+    }
+  else
+#endif
+  if (fd < FD_SETSIZE)
+    {
+      /* Update the descriptor set, in case the select loop is running */
+      FD_SET (fd, &srv->fdset);
+      if (fd >= srv->nfd)
+	srv->nfd = fd + 1;
+    }
+  
   p->next = NULL;
   p->prev = srv->tail;
   if (srv->tail)
@@ -299,6 +554,41 @@ mu_server_add_connection (mu_server_t srv,
   return 0;
 }
 
+/* Set idle timeout for the connection on descriptor FD.  If no input
+   arrives on it within TO, FP is called.  Its return value is
+   interpreted the same way as that of the connection handler.  If TO is
+   NULL, the timeout is removed. */
+int
+mu_server_set_conn_timeout (mu_server_t srv, int fd, struct timeval *to,
+			    mu_conn_timeout_fp fp)
+{
+  struct _mu_connection *p;
+
+  if (!srv)
+    return EINVAL;
+  for (p = srv->head; p; p = p->next)
+    if (p->fd == fd)
+      break;
+  if (!p)
+    return MU_ERR_NOENT;
+
+  if (p->f_timeout)
+    srv->ntimers--;
+  if (to && fp)
+    {
+      struct timeval now;
+      
+      p->f_timeout = fp;
+      p->timeout = *to;
+      gettimeofday (&now, NULL);
+      set_deadline (p, &now);
+      srv->ntimers++;
+    }
+  else
+    p->f_timeout = NULL;
+  return 0;
+}
+
 int
 mu_acl_set_session_id (mu_acl_t acl)
 {
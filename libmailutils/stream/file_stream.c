@@ -283,6 +283,21 @@ fd_ioctl (struct _mu_stream *str, int code, int opcode, void *ptr)
 	  else
 	    fstr->flags &= ~_MU_FILE_STREAM_FD_BORROWED;
 	  break;
+
+	case MU_IOCTL_FD_GET_SEGMENT:
+	  {
+	    struct mu_fd_segment *seg = ptr;
+
+	    if (fstr->fd == -1)
+	      return EINVAL;
+	    seg->fd = fstr->fd;
+	    seg->start = 0;
+	    seg->end = -1;
+	  }
+	  break;
+
+	default:
+	  return EINVAL;
 	}
       break;
 	    
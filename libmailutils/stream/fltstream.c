@@ -478,6 +478,10 @@ filter_ctl (struct _mu_stream *stream, int code, int opcode, void *ptr)
 	  return ENOSYS;
 	}
       break;
+
+    case MU_IOCTL_FD:
+      /* The descriptor of the transport holds unfiltered data */
+      return ENOSYS;
       
     default:
       return mu_stream_ioctl (fs->transport, code, opcode, ptr);
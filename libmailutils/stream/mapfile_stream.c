@@ -250,6 +250,21 @@ _mapfile_ioctl (struct _mu_stream *str, int code, int opcode, void *ptr)
 	    }
 	}
       break;
+
+    case MU_IOCTL_MAPFILESTREAM:
+      if (!ptr)
+	return EINVAL;
+      else if (opcode != MU_IOCTL_MAPFILESTREAM_GET_REGION)
+	return EINVAL;
+      else if (mfs->ptr == MAP_FAILED || !(str->flags & MU_STREAM_READ))
+	return EACCES;
+      else
+	{
+	  struct mu_mapfile_region *reg = ptr;
+	  reg->start = mfs->ptr;
+	  reg->size = mfs->size;
+	}
+      break;
       
     default:
       return ENOSYS;
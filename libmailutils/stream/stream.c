@@ -1165,6 +1165,18 @@ mu_stream_ioctl (mu_stream_t stream, int family, int opcode, void *ptr)
   return stream->ctl (stream, family, opcode, ptr);
 }
 
+/* Get the descriptor segment STR operates upon.  Unlike mu_stream_ioctl,
+   don't flush the stream buffer, so that a stream which turns out not
+   to be backed by a descriptor is left intact. */
+int
+_mu_stream_fd_segment (mu_stream_t stream, struct mu_fd_segment *seg)
+{
+  _bootstrap_event (stream);
+  if (stream->ctl == NULL)
+    return ENOSYS;
+  return stream->ctl (stream, MU_IOCTL_FD, MU_IOCTL_FD_GET_SEGMENT, seg);
+}
+
 int
 mu_stream_wait (mu_stream_t stream, int *pflags, struct timeval *tvp)
 {
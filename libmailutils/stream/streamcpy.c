@@ -18,6 +18,18 @@
 # include <config.h>
 #endif
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _POSIX_MAPPED_FILES
+# include <sys/mman.h>
+# ifndef MAP_FAILED
+#  define MAP_FAILED (void*)-1
+# endif
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 #include <mailutils/types.h>
 #include <mailutils/alloc.h>
 #include <mailutils/error.h>
@@ -27,6 +39,218 @@
 
 #define STREAMCPY_MIN_BUF_SIZE 2
 #define STREAMCPY_MAX_BUF_SIZE 16384
+#define STREAMCPY_MAX_KERNEL_CHUNK (1024*1024*1024)
+
+/* Is the error code RC returned by copy_file_range or sendfile an
+   indication that the call is not supported for the given descriptors? */
+#define NOT_SUPPORTED(rc) \
+  ((rc) == ENOSYS || (rc) == EXDEV || (rc) == EINVAL || (rc) == EBADF \
+   || (rc) == EOPNOTSUPP)
+
+/* Copy SIZE bytes from the file descriptor SRC, starting at offset
+   *PSRCOFF, to the file descriptor DST, starting at offset *PDSTOFF,
+   without passing the data through the user space.  Copying stops
+   earlier if end of file is reached on SRC.  Both offsets are advanced
+   by the number of bytes copied, which is also stored in *PCSZ.  The
+   file offset of SRC is not changed, that of DST is unspecified.
+
+   Return 0 on success.  If the system provides no means for copying
+   data between the two descriptors, return ENOSYS without copying
+   anything. */
+int
+mu_copy_file_range (int dst, mu_off_t *pdstoff, int src, mu_off_t *psrcoff,
+		    mu_off_t size, mu_off_t *pcsz)
+{
+  mu_off_t total = 0;
+  int rc = ENOSYS;
+
+#ifdef HAVE_COPY_FILE_RANGE
+  while (total < size)
+    {
+      off_t ioff = *psrcoff, ooff = *pdstoff;
+      size_t n = size - total;
+      ssize_t rdsize;
+
+      if (n > STREAMCPY_MAX_KERNEL_CHUNK)
+	n = STREAMCPY_MAX_KERNEL_CHUNK;
+      rdsize = copy_file_range (src, &ioff, dst, &ooff, n, 0);
+      if (rdsize == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  rc = errno;
+	  break;
+	}
+      rc = 0;
+      if (rdsize == 0)
+	break;
+      *psrcoff += rdsize;
+      *pdstoff += rdsize;
+      total += rdsize;
+    }
+  if (total == size)
+    rc = 0;
+#endif
+
+#if defined (HAVE_SENDFILE) && defined (HAVE_SYS_SENDFILE_H)
+  /* Linux sendfile can write to regular files since 2.6.33 */
+  if (total == 0 && NOT_SUPPORTED (rc))
+    {
+      rc = ENOSYS;
+      if (lseek (dst, *pdstoff, SEEK_SET) != -1)
+	while (total < size)
+	  {
+	    off_t ioff = *psrcoff;
+	    size_t n = size - total;
+	    ssize_t rdsize;
+
+	    if (n > STREAMCPY_MAX_KERNEL_CHUNK)
+	      n = STREAMCPY_MAX_KERNEL_CHUNK;
+	    rdsize = sendfile (dst, src, &ioff, n);
+	    if (rdsize == -1)
+	      {
+		if (errno == EINTR)
+		  continue;
+		rc = errno;
+		break;
+	      }
+	    rc = 0;
+	    if (rdsize == 0)
+	      break;
+	    *psrcoff += rdsize;
+	    *pdstoff += rdsize;
+	    total += rdsize;
+	  }
+      if (total == size)
+	rc = 0;
+    }
+#endif
+  
+  if (total == 0 && NOT_SUPPORTED (rc))
+    rc = ENOSYS;
+  if (pcsz)
+    *pcsz = total;
+  return rc;
+}
+
+/* Copy SIZE bytes (up to EOF, if SIZE is 0) from SRC to DST, provided
+   that both are seekable streams backed by file descriptors.  Return
+   ENOSYS if they are not, or if the kernel is unable to copy between
+   them.  In that case, the stream positions remain unchanged. */
+static int
+stream_copy_fd (mu_stream_t dst, mu_stream_t src, mu_off_t size,
+		mu_off_t *pcsz)
+{
+  struct mu_fd_segment iseg, oseg;
+  int flags, rc, status;
+  mu_off_t ipos, opos, ioff, ooff, total = 0;
+  struct stat st, ost;
+  
+  mu_stream_get_flags (src, &flags);
+  if (!(flags & MU_STREAM_SEEK))
+    return ENOSYS;
+  mu_stream_get_flags (dst, &flags);
+  if (!(flags & MU_STREAM_SEEK))
+    return ENOSYS;
+
+  /* Streams that are not eligible must be left untouched: seeking
+     a filter, for instance, restarts it */
+  if (_mu_stream_fd_segment (src, &iseg)
+      || _mu_stream_fd_segment (dst, &oseg)
+      || oseg.start != 0 || oseg.end != -1
+      /* Writes to a descriptor open for appending go to the end of
+	 file, which copy_file_range and sendfile don't support */
+      || (flags = fcntl (oseg.fd, F_GETFL)) == -1 || (flags & O_APPEND)
+      /* Copying within the same file is left to the generic code */
+      || fstat (oseg.fd, &ost) || fstat (iseg.fd, &st)
+      || (st.st_dev == ost.st_dev && st.st_ino == ost.st_ino))
+    return ENOSYS;
+
+  /* Flushing discards the read-ahead.  Save the positions, so that
+     they can be restored explicitly below. */
+  if ((rc = mu_stream_seek (src, 0, MU_SEEK_CUR, &ipos))
+      || (rc = mu_stream_seek (dst, 0, MU_SEEK_CUR, &opos)))
+    return rc;
+
+  /* Write out any pending data, so that the descriptors reflect the
+     streams. */
+  if ((rc = mu_stream_flush (dst)) == 0
+      && (rc = mu_stream_flush (src)) == 0
+      && (rc = fstat (iseg.fd, &st) ? errno : 0) == 0)
+    {
+      ioff = iseg.start + ipos;
+      if (iseg.end == -1 || iseg.end >= st.st_size)
+	iseg.end = st.st_size - 1;
+      if (ioff > iseg.end)
+	size = 0;
+      else if (size == 0 || size > iseg.end - ioff + 1)
+	size = iseg.end - ioff + 1;
+      ooff = opos;
+      if (size)
+	rc = mu_copy_file_range (oseg.fd, &ooff, iseg.fd, &ioff, size,
+				 &total);
+    }
+
+  status = mu_stream_seek (src, ipos + total, MU_SEEK_SET, NULL);
+  if (status == 0)
+    status = mu_stream_seek (dst, opos + total, MU_SEEK_SET, NULL);
+  if (rc == 0)
+    rc = status;
+  *pcsz = total;
+  return rc;
+}
+
+/* Map into memory the file segment STR operates upon and pass it to
+   FUN along with DATA.  Return the value returned by FUN, or ENOSYS if
+   STR is not backed by a file descriptor or the segment cannot be
+   mapped. */
+int
+mu_stream_fd_scan (mu_stream_t str,
+		   int (*fun) (const char *, size_t, void *), void *data)
+{
+#ifdef _POSIX_MAPPED_FILES
+  struct mu_fd_segment seg;
+  struct stat st;
+  mu_off_t pos, base;
+  size_t len;
+  char *ptr;
+  int rc, status, flags;
+
+  mu_stream_get_flags (str, &flags);
+  if (!(flags & MU_STREAM_SEEK))
+    return ENOSYS;
+  if (_mu_stream_fd_segment (str, &seg))
+    return ENOSYS;
+  /* Make sure the file is up to date.  Flushing discards the read-ahead,
+     so restore the position afterwards. */
+  if ((rc = mu_stream_seek (str, 0, MU_SEEK_CUR, &pos)))
+    return rc;
+  rc = mu_stream_flush (str);
+  if ((status = mu_stream_seek (str, pos, MU_SEEK_SET, NULL)) && rc == 0)
+    rc = status;
+  if (rc)
+    return rc;
+  if (fstat (seg.fd, &st))
+    return errno;
+  if (seg.end == -1 || seg.end >= st.st_size)
+    seg.end = st.st_size - 1;
+  if (seg.end < seg.start)
+    return fun ("", 0, data);
+
+  base = seg.start - seg.start % sysconf (_SC_PAGESIZE);
+  len = seg.end - base + 1;
+  if (len != seg.end - base + 1)
+    return ENOSYS;
+  ptr = mmap (NULL, len, PROT_READ, MAP_SHARED, seg.fd, base);
+  if (ptr == MAP_FAILED)
+    return ENOSYS;
+  rc = fun (ptr + (seg.start - base), seg.end - seg.start + 1, data);
+  munmap (ptr, len);
+  return rc;
+#else
+  return ENOSYS;
+#endif
+}
 
 /* Copy SIZE bytes from SRC to DST.  If SIZE is 0, copy everything up to
    EOF. */
@@ -41,6 +265,15 @@ mu_stream_copy (mu_stream_t dst, mu_stream_t src, mu_off_t size,
   
   if (pcsz)
     *pcsz = 0;
+
+  status = stream_copy_fd (dst, src, size, &total);
+  if (status != ENOSYS)
+    {
+      if (pcsz)
+	*pcsz = total;
+      return status;
+    }
+  
   if (size == 0)
     {
       status = mu_stream_size (src, &size);
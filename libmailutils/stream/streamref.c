@@ -230,6 +230,27 @@ _streamref_ctl (struct _mu_stream *str, int code, int opcode, void *arg)
 	      return EINVAL;
 	    }
 	}
+
+    case MU_IOCTL_FD:
+      if (opcode == MU_IOCTL_FD_GET_SEGMENT)
+	{
+	  struct mu_fd_segment *seg = arg;
+	  int rc;
+	  mu_off_t base;
+	  
+	  if (!arg)
+	    return EINVAL;
+	  /* Don't use streamref_return here: the transport state (e.g. its
+	     EOF flag) is irrelevant for the caller */
+	  rc = _mu_stream_fd_segment (sp->transport, seg);
+	  if (rc)
+	    return rc;
+	  base = seg->start;
+	  seg->start = base + sp->start;
+	  if (sp->end && (seg->end == -1 || base + sp->end < seg->end))
+	    seg->end = base + sp->end;
+	  return 0;
+	}
     }
   return streamref_return (sp, mu_stream_ioctl (sp->transport, code,
 						opcode, arg));
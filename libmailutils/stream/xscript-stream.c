@@ -370,6 +370,10 @@ _xscript_ctl (struct _mu_stream *str, int code, int opcode, void *arg)
 	  return EINVAL;
 	}
       break;
+
+    case MU_IOCTL_FD:
+      /* Data copied through the descriptor would bypass the transcript */
+      return ENOSYS;
       
     default:
       return mu_stream_ioctl (sp->transport, code, opcode, arg);
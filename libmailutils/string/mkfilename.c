@@ -50,3 +50,34 @@ mu_make_file_name_suf (const char *dir, const char *file, const char *suf)
     }
   return tmp;
 }
+
+/* Make the name of a file in DIR from KEY, an arbitrary string such as
+   a mailbox name.  Slashes and percent signs in KEY are encoded as %XX,
+   so that each KEY maps to a distinct file right in DIR.  Return NULL if
+   there is not enough memory. */
+char *
+mu_make_file_name_encoded (const char *dir, const char *key)
+{
+  size_t dirlen = strlen (dir);
+  const char *p;
+  char *name, *q;
+
+  while (dirlen > 0 && dir[dirlen-1] == '/')
+    dirlen--;
+  name = malloc (dirlen + 1 + 3 * strlen (key) + 1);
+  if (!name)
+    return NULL;
+  memcpy (name, dir, dirlen);
+  q = name + dirlen;
+  if (dir[0])
+    *q++ = '/';
+  for (p = key; *p; p++)
+    {
+      if (*p == '/' || *p == '%')
+	q += sprintf (q, "%%%02X", *p);
+      else
+	*q++ = *p;
+    }
+  *q = 0;
+  return name;
+}
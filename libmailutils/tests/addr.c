@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/time.h>
 
 #include <mailutils/address.h>
 #include <mailutils/errno.h>
@@ -29,6 +30,9 @@
 #include <mailutils/util.h>
 #include <mailutils/cstr.h>
 #include <mailutils/cctype.h>
+#include <mailutils/opool.h>
+#include <mailutils/debug.h>
+#include <mailutils/alloc.h>
 
 #define EPARSE MU_ERR_NOENT
 
@@ -95,14 +99,122 @@ parse (const char *str)
   return 0;
 }
 
+/* Synthetic address lists for benchmarking the parser.
+
+     addr -g COUNT
+       Print a list of COUNT addresses of various forms.
+
+     addr -t COUNT [REPEAT]
+       Parse such a list REPEAT times (default 10) and report the
+       average time per parse.
+*/
+
+static char *
+generate (unsigned long count)
+{
+  mu_opool_t pool;
+  unsigned long i;
+  char buf[128];
+  char *str;
+
+  MU_ASSERT (mu_opool_create (&pool, 1));
+  for (i = 0; i < count; i++)
+    {
+      if (i)
+	mu_opool_appendz (pool, ", ");
+      switch (i % 6)
+	{
+	case 0:
+	  snprintf (buf, sizeof buf, "user%lu@host%lu.example.org", i, i % 7);
+	  break;
+
+	case 1:
+	  snprintf (buf, sizeof buf, "\"Person %lu\" <user%lu@mail.example.com>",
+		    i, i);
+	  break;
+
+	case 2:
+	  snprintf (buf, sizeof buf,
+		    "Person Number %lu <first.last.%lu@a.b.example.net>", i, i);
+	  break;
+
+	case 3:
+	  snprintf (buf, sizeof buf,
+		    "user%lu@example.org (Comment %lu (nested))", i, i);
+	  break;
+
+	case 4:
+	  snprintf (buf, sizeof buf,
+		    "\"Last, First \\\"%lu\\\"\" <user%lu@[192.0.2.%lu]>",
+		    i, i, i % 256);
+	  break;
+
+	case 5:
+	  snprintf (buf, sizeof buf,
+		    "list%lu: a%lu@example.org, <@relay.example.org:b%lu@example.org>;",
+		    i, i, i);
+	  break;
+	}
+      mu_opool_appendz (pool, buf);
+    }
+  mu_opool_append_char (pool, 0);
+  str = mu_strdup (mu_opool_finish (pool, NULL));
+  mu_opool_destroy (&pool);
+  return str;
+}
+
+static void
+time_parse (unsigned long count, unsigned long repeat)
+{
+  char *str = generate (count);
+  struct timeval start, stop;
+  size_t pcount = 0;
+  unsigned long i;
+  double t;
+
+  gettimeofday (&start, NULL);
+  for (i = 0; i < repeat; i++)
+    {
+      mu_address_t address;
+      
+      MU_ASSERT (mu_address_create (&address, str));
+      mu_address_get_count (address, &pcount);
+      mu_address_destroy (&address);
+    }
+  gettimeofday (&stop, NULL);
+  t = (stop.tv_sec - start.tv_sec)
+        + (stop.tv_usec - start.tv_usec) / 1000000.0;
+  printf ("%lu addresses, %lu bytes, %.3f ms per parse\n",
+	  (unsigned long) pcount, (unsigned long) strlen (str),
+	  t * 1000 / repeat);
+  free (str);
+}
+
 int
 main (int argc, char *argv[])
 {
   char buf[256];
 
+  if (argc == 3 && strcmp (argv[1], "-g") == 0)
+    {
+      char *str = generate (strtoul (argv[2], NULL, 10));
+      printf ("%s\n", str);
+      free (str);
+      return 0;
+    }
+
+  if ((argc == 3 || argc == 4) && strcmp (argv[1], "-t") == 0)
+    {
+      time_parse (strtoul (argv[2], NULL, 10),
+		  argc == 4 ? strtoul (argv[3], NULL, 10) : 10);
+      return 0;
+    }
+  
   if (argc > 2)
     {
       fprintf (stderr, "usage: %s [address]\n", argv[0]);
+      fprintf (stderr, "       %s -g COUNT\n", argv[0]);
+      fprintf (stderr, "       %s -t COUNT [REPEAT]\n", argv[0]);
       return 2;
     }
 
@@ -82,7 +82,7 @@ usage (const char *diag)
     fp = stdout;
 
   fprintf (fp, "%s",
-	   "usage: fltst FILTER {encode|decode} {read|write} [shift=N] [verbose] [printable] [nl] [bufsize=N] [-- args]\n");
+	   "usage: fltst FILTER {encode|decode} {read|write} [shift=N] [verbose] [printable] [nl] [bufsize=N] [in=FILE] [out=FILE] [-- args]\n");
   exit (diag ? 1 : 0);
 }
 
@@ -97,6 +97,7 @@ main (int argc, char * argv [])
   mu_off_t shift = 0;
   int newline_option = 0;
   size_t bufsize = 0;
+  char *infile = NULL, *outfile = NULL;
   
   if (argc == 1)
     usage (NULL);
@@ -125,6 +126,10 @@ main (int argc, char * argv [])
 	shift = strtoul (argv[i] + 6, NULL, 0);
       else if (strncmp (argv[i], "bufsize=", 8) == 0)
 	bufsize = strtoul (argv[i] + 8, NULL, 0);
+      else if (strncmp (argv[i], "in=", 3) == 0)
+	infile = argv[i] + 3;
+      else if (strncmp (argv[i], "out=", 4) == 0)
+	outfile = argv[i] + 4;
       else if (strcmp (argv[i], "verbose") == 0)
 	verbose++;
       else if (strcmp (argv[i], "printable") == 0)
@@ -143,10 +148,21 @@ main (int argc, char * argv [])
   argc -= i;
   argv += i;
   
-  MU_ASSERT (mu_stdio_stream_create (&in, MU_STDIN_FD, 0));
+  /* Named files are opened seekable, which lets mu_stream_copy use
+     their descriptors directly */
+  if (infile)
+    MU_ASSERT (mu_file_stream_create (&in, infile,
+				      MU_STREAM_READ|MU_STREAM_SEEK));
+  else
+    MU_ASSERT (mu_stdio_stream_create (&in, MU_STDIN_FD, 0));
   if (bufsize)
     mu_stream_set_buffer (in, mu_buffer_full, bufsize);
-  MU_ASSERT (mu_stdio_stream_create (&out, MU_STDOUT_FD, 0));
+  if (outfile)
+    MU_ASSERT (mu_file_stream_create (&out, outfile,
+				      MU_STREAM_WRITE|MU_STREAM_CREAT|
+				      MU_STREAM_SEEK));
+  else
+    MU_ASSERT (mu_stdio_stream_create (&out, MU_STDOUT_FD, 0));
 
   if (flags == MU_STREAM_READ)
     {
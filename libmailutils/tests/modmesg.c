@@ -48,7 +48,8 @@ main (int argc, char **argv)
     {
       if (strcmp (argv[i], "-h") == 0)
 	{
-	  mu_printf ("usage: %s [-a HDR:VAL] [-t TEXT]\n", mu_program_name);
+	  mu_printf ("usage: %s [-a HDR:VAL] [-A HDR:VAL] [-r HDR] [-v HDR[:N]] "
+		     "[-t TEXT]\n", mu_program_name);
 	  return 0;
 	}
       
@@ -63,6 +64,41 @@ main (int argc, char **argv)
 	    p++;
 	  assert (mu_header_set_value (hdr, argv[i], p, 1) == 0);
 	}
+      else if (strcmp (argv[i], "-A") == 0)
+	{
+	  i++;
+	  assert (argv[i] != NULL);
+	  p = strchr (argv[i], ':');
+	  assert (p != NULL);
+	  *p++ = 0;
+	  while (*p && mu_isspace (*p))
+	    p++;
+	  assert (mu_header_append (hdr, argv[i], p) == 0);
+	}
+      else if (strcmp (argv[i], "-r") == 0)
+	{
+	  i++;
+	  assert (argv[i] != NULL);
+	  assert (mu_header_remove (hdr, argv[i], 1) == 0);
+	}
+      else if (strcmp (argv[i], "-v") == 0)
+	{
+	  const char *val;
+	  int n = 1;
+	  
+	  i++;
+	  assert (argv[i] != NULL);
+	  p = strchr (argv[i], ':');
+	  if (p)
+	    {
+	      *p++ = 0;
+	      n = strtol (p, NULL, 10);
+	    }
+	  if (mu_header_sget_value_n (hdr, argv[i], n, &val) == 0)
+	    mu_printf ("%s[%d]: %s\n", argv[i], n, val);
+	  else
+	    mu_printf ("%s[%d]: not found\n", argv[i], n);
+	}
       else if (strcmp (argv[i], "-l") == 0)
 	{
 	  mu_off_t off;
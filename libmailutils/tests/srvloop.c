@@ -0,0 +1,141 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   GNU Mailutils is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GNU Mailutils is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Usage: srvloop [-n NUM]
+
+   Without arguments, check the basic operation of the server loop:
+   connections added while the loop is running and connection timeouts.
+
+   With -n, serve NUM connections at once.  Exit with code 77 if the
+   descriptor limit does not allow that.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <mailutils/server.h>
+#include <mailutils/errno.h>
+#include <mailutils/error.h>
+
+static mu_server_t server;
+
+static int
+make_conn (char *text, mu_conn_loop_fp loop, void *data)
+{
+  int p[2];
+
+  if (pipe (p))
+    return -1;
+  if (text)
+    write (p[1], text, strlen (text));
+  MU_ASSERT (mu_server_add_connection (server, p[0], data, loop, NULL));
+  return p[0];
+}
+
+static int
+read_conn (int fd, void *conn_data, void *server_data)
+{
+  char buf[80];
+  ssize_t n = read (fd, buf, sizeof buf - 1);
+
+  if (n < 0)
+    {
+      perror ("read");
+      exit (1);
+    }
+  buf[n] = 0;
+  printf ("%s: %s\n", (char*) conn_data, buf);
+  if (strcmp (conn_data, "one") == 0)
+    /* Add a connection while the loop is running */
+    make_conn ("world", read_conn, "two");
+  return MU_SERVER_CLOSE_CONN;
+}
+
+static int
+timeout_conn (int fd, void *conn_data, void *server_data)
+{
+  printf ("%s: timeout\n", (char*) conn_data);
+  return MU_SERVER_SHUTDOWN;
+}
+
+static size_t served, total;
+
+static int
+count_conn (int fd, void *conn_data, void *server_data)
+{
+  char c;
+
+  read (fd, &c, 1);
+  if (++served == total)
+    return MU_SERVER_SHUTDOWN;
+  return MU_SERVER_CLOSE_CONN;
+}
+
+int
+main (int argc, char **argv)
+{
+  MU_ASSERT (mu_server_create (&server));
+
+  if (argc == 3 && strcmp (argv[1], "-n") == 0)
+    {
+      struct rlimit rl;
+      size_t i;
+
+      total = strtoul (argv[2], NULL, 10);
+#ifndef HAVE_SYS_EPOLL_H
+      if (total + 16 >= FD_SETSIZE)
+	return 77;
+#endif
+      if (getrlimit (RLIMIT_NOFILE, &rl))
+	return 77;
+      if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < 2 * total + 16)
+	{
+	  if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < 2 * total + 16)
+	    return 77;
+	  rl.rlim_cur = 2 * total + 16;
+	  if (setrlimit (RLIMIT_NOFILE, &rl))
+	    return 77;
+	}
+      for (i = 0; i < total; i++)
+	if (make_conn ("x", count_conn, NULL) == -1)
+	  {
+	    perror ("pipe");
+	    return 1;
+	  }
+      mu_server_run (server);
+      printf ("%lu\n", (unsigned long) served);
+    }
+  else
+    {
+      struct timeval tv;
+      int fd;
+
+      make_conn ("hello", read_conn, "one");
+      fd = make_conn (NULL, read_conn, "idle");
+      tv.tv_sec = 0;
+      tv.tv_usec = 200000;
+      MU_ASSERT (mu_server_set_conn_timeout (server, fd, &tv, timeout_conn));
+      mu_server_run (server);
+    }
+  mu_server_destroy (&server);
+  return 0;
+}
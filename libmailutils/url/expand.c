@@ -166,6 +166,7 @@ mu_url_expand_path (mu_url_t url)
   size_t i;
   char *user = NULL;
   int param = 0;
+  int expand = 0;
   char *p;
   char *(*fun) (const char *, const char *, int) = _url_path_default;
 
@@ -187,17 +188,24 @@ mu_url_expand_path (mu_url_t url)
 	    fun = _url_path_rev_index;
 	  else
 	    return MU_ERR_NOENT;
+	  expand = 1;
 	}
       else if (strncmp (p, "user=", 5) == 0)
 	{
 	  user = p + 5;
+	  expand = 1;
 	}
       else if (strncmp (p, "param=", 6) == 0)
 	{
 	  param = strtoul (p + 6, NULL, 0);
+	  expand = 1;
 	}
     }
 
+  /* Leave alone parameters that don't pertain to path expansion */
+  if (!expand)
+    return 0;
+
   if (user)
     {
       char *p = fun (url->path, user, param);
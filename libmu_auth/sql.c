@@ -49,6 +49,7 @@
 #include <mailutils/util.h>
 #include <mailutils/sql.h>
 #include <mailutils/cstr.h>
+#include <mailutils/cctype.h>
 #include <mailutils/wordsplit.h>
 #include "sql.h"
 
@@ -121,6 +122,224 @@ mu_sql_expand_query (const char *query, const char *ustr)
   return res;
 }
 
+
+/* Prepared statements for the configured queries */
+struct sql_stmt
+{
+  struct sql_stmt *next;
+  const char *name;        /* Statement name */
+  const char *query;       /* Query as configured */
+  char *text;              /* Query text with placeholder, if any */
+  int nparams;             /* Number of parameters: 0 or 1 */
+  int disabled;            /* Statement cannot be prepared */
+};
+
+static struct sql_stmt *sql_stmt_list;
+
+/* If P points to a reference to the user variable ($user or ${user}),
+   return its length.  Otherwise, return 0. */
+static size_t
+user_ref_len (const char *p)
+{
+  if (strncmp (p, "${user}", 7) == 0)
+    return 7;
+  if (strncmp (p, "$user", 5) == 0 && !(mu_isalnum (p[5]) || p[5] == '_'))
+    return 5;
+  return 0;
+}
+
+/* Convert QUERY to the form suitable for preparing.  Each reference to
+   the user variable is replaced with the $1 placeholder.  The quotes
+   around the reference, if any, are removed.  Return NULL if the query
+   cannot be converted, e.g. because the reference is a part of a longer
+   quoted string. */
+static char *
+sql_stmt_text (const char *query, int *pnparams)
+{
+  char *text, *q;
+  const char *p;
+  int quote = 0;
+  int nparams = 0;
+
+  text = malloc (strlen (query) + 1);
+  if (!text)
+    return NULL;
+  for (p = query, q = text; *p; )
+    {
+      if (*p == '\\')
+	break;
+      else if (*p == '$')
+	{
+	  size_t len = user_ref_len (p);
+
+	  if (len == 0)
+	    break;
+	  if (quote)
+	    {
+	      /* Only a reference quoted as a whole can be replaced */
+	      if (q[-1] != quote || p[len] != quote)
+		break;
+	      q--;
+	      len++;
+	      quote = 0;
+	    }
+	  p += len;
+	  *q++ = '$';
+	  *q++ = '1';
+	  nparams = 1;
+	  continue;
+	}
+      else if (*p == '\'' || *p == '"')
+	{
+	  if (!quote)
+	    quote = *p;
+	  else if (quote == *p)
+	    quote = 0;
+	}
+      *q++ = *p++;
+    }
+
+  if (*p || quote)
+    {
+      free (text);
+      return NULL;
+    }
+  *q = 0;
+  *pnparams = nparams;
+  return text;
+}
+
+static struct sql_stmt *
+sql_stmt_lookup (const char *name, const char *query)
+{
+  struct sql_stmt *stmt;
+
+  for (stmt = sql_stmt_list; stmt; stmt = stmt->next)
+    if (strcmp (stmt->name, name) == 0 && stmt->query == query)
+      return stmt->disabled ? NULL : stmt;
+
+  stmt = calloc (1, sizeof (*stmt));
+  if (!stmt)
+    return NULL;
+  stmt->name = name;
+  stmt->query = query;
+  stmt->text = sql_stmt_text (query, &stmt->nparams);
+  if (!stmt->text)
+    {
+      mu_debug (MU_DEBCAT_AUTH, MU_DEBUG_TRACE1,
+		("cannot prepare SQL query `%s'", query));
+      stmt->disabled = 1;
+    }
+  stmt->next = sql_stmt_list;
+  sql_stmt_list = stmt;
+  return stmt->disabled ? NULL : stmt;
+}
+
+/* Run the configured QUERY for the user VALUE, using a connection from
+   the pool.  NAME identifies the query for prepared statements.  On
+   success, return the connection with the result stored in *PCONN.  The
+   caller must return it to the pool using mu_sql_pool_put when done. */
+int
+mu_sql_run_query (mu_sql_connection_t *pconn, const char *name,
+		  const char *query, const char *value)
+{
+  mu_sql_connection_t conn;
+  struct sql_stmt *stmt = NULL;
+  char *query_str = NULL;
+  int status, reused, retry = 0;
+
+  if (!query)
+    return MU_ERR_FAILURE;
+  if (mu_sql_module_config.prepared)
+    stmt = sql_stmt_lookup (name, query);
+  if (!stmt)
+    {
+      query_str = mu_sql_expand_query (query, value);
+      if (!query_str)
+	return MU_ERR_FAILURE;
+    }
+
+  for (;;)
+    {
+      status = mu_sql_pool_get (&conn, &reused,
+				mu_sql_module_config.interface,
+				mu_sql_module_config.host,
+				mu_sql_module_config.port,
+				mu_sql_module_config.user,
+				mu_sql_module_config.passwd,
+				mu_sql_module_config.db);
+      if (status)
+	{
+	  free (query_str);
+	  if (!conn)
+	    {
+	      mu_error ("%s", mu_strerror (status));
+	      return MU_ERR_FAILURE;
+	    }
+	  mu_error ("%s: %s", mu_strerror (status), mu_sql_strerror (conn));
+	  mu_sql_pool_put (&conn, status);
+	  return EAGAIN;
+	}
+
+      if (stmt)
+	{
+	  status = mu_sql_prepare (conn, stmt->name, stmt->text,
+				   stmt->nparams);
+	  if (status == 0)
+	    status = mu_sql_execute (conn, stmt->name, stmt->nparams, &value);
+	  else if (status == ENOSYS)
+	    {
+	      /* Not supported by the interface: use plain queries */
+	      stmt->disabled = 1;
+	      stmt = NULL;
+	      query_str = mu_sql_expand_query (query, value);
+	      if (!query_str)
+		{
+		  mu_sql_pool_put (&conn, 0);
+		  return MU_ERR_FAILURE;
+		}
+	    }
+	}
+      if (!stmt)
+	status = mu_sql_query (conn, query_str);
+      if (status == 0)
+	break;
+
+      if (reused && !retry)
+	{
+	  /* The connection might have been closed by the server since
+	     it was last used.  Retry once on a fresh one. */
+	  mu_debug (MU_DEBCAT_AUTH, MU_DEBUG_TRACE1,
+		    ("SQL query failed on a reused connection: %s",
+		     (status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
+		                               mu_strerror (status)));
+	  mu_sql_pool_put (&conn, status);
+	  retry = 1;
+	  continue;
+	}
+
+      mu_error (_("SQL query failed: %s"),
+		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
+	 	                          mu_strerror (status));
+      mu_sql_pool_put (&conn, status);
+      free (query_str);
+      return MU_ERR_FAILURE;
+    }
+  free (query_str);
+
+  status = mu_sql_store_result (conn);
+  if (status)
+    {
+      mu_error (_("cannot store SQL result: %s"),
+		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
+	 	                          mu_strerror (status));
+      mu_sql_pool_put (&conn, status);
+      return MU_ERR_FAILURE;
+    }
+  *pconn = conn;
+  return 0;
+}
+
 
 static int
 decode_tuple_v1_0 (mu_sql_connection_t conn, int n,
@@ -332,66 +551,16 @@ mu_auth_sql_by_name (struct mu_auth_data **return_data,
 		     void *call_data MU_ARG_UNUSED)
 {
   int status, rc;
-  char *query_str = NULL;
   mu_sql_connection_t conn;
   size_t n;
   
   if (!key)
     return EINVAL;
 
-  query_str = mu_sql_expand_query (mu_sql_module_config.getpwnam_query, key);
-
-  if (!query_str)
-    return MU_ERR_FAILURE;
-
-  status = mu_sql_connection_init (&conn,
-				   mu_sql_module_config.interface,
-				   mu_sql_module_config.host,
-				   mu_sql_module_config.port,
-				   mu_sql_module_config.user,
-				   mu_sql_module_config.passwd,
-				   mu_sql_module_config.db);
-
-  if (status)
-    {
-      mu_error ("%s: %s", mu_strerror (status), mu_sql_strerror (conn));
-      mu_sql_connection_destroy (&conn);
-      free (query_str);
-      return MU_ERR_FAILURE;
-    }
-
-  status = mu_sql_connect (conn);
-
-  if (status)
-    {
-      mu_error ("%s: %s", mu_strerror (status), mu_sql_strerror (conn));
-      mu_sql_connection_destroy (&conn);
-      free (query_str);
-      return EAGAIN;
-    }
-  
-  status = mu_sql_query (conn, query_str);
-  free (query_str);
-  
-  if (status)
-    {
-      mu_error (_("SQL query failed: %s"),
-		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
-	 	                          mu_strerror (status));
-      mu_sql_connection_destroy (&conn);
-      return MU_ERR_FAILURE;
-    }
-
-  status = mu_sql_store_result (conn);
-
-  if (status)
-    {
-      mu_error (_("cannot store SQL result: %s"),
-		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
-	 	                          mu_strerror (status));
-      mu_sql_connection_destroy (&conn);
-      return MU_ERR_FAILURE;
-    }
+  rc = mu_sql_run_query (&conn, "getpwnam",
+			 mu_sql_module_config.getpwnam_query, key);
+  if (rc)
+    return rc;
 
   status = mu_sql_num_tuples (conn, &n);
   if (status)
@@ -399,8 +568,7 @@ mu_auth_sql_by_name (struct mu_auth_data **return_data,
       mu_error (_("cannot get number of tuples: %s"),
                 (status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
                                           mu_strerror (status));
-      mu_sql_release_result (conn);
-      mu_sql_connection_destroy (&conn);
+      mu_sql_pool_put (&conn, status);
       return MU_ERR_FAILURE;
     }
   
@@ -409,9 +577,7 @@ mu_auth_sql_by_name (struct mu_auth_data **return_data,
   else
     rc = decode_tuple (conn, n, return_data);
   
-  mu_sql_release_result (conn);
-  mu_sql_disconnect (conn);
-  mu_sql_connection_destroy (&conn);
+  mu_sql_pool_put (&conn, 0);
   
   return rc;
 }
@@ -424,7 +590,6 @@ mu_auth_sql_by_uid (struct mu_auth_data **return_data,
 {
   char uidstr[64];
   int status, rc;
-  char *query_str = NULL;
   mu_sql_connection_t conn;
   size_t n;
   
@@ -432,60 +597,10 @@ mu_auth_sql_by_uid (struct mu_auth_data **return_data,
     return EINVAL;
 
   snprintf (uidstr, sizeof (uidstr), "%u", *(uid_t*)key);
-  query_str = mu_sql_expand_query (mu_sql_module_config.getpwuid_query,
-				   uidstr);
-
-  if (!query_str)
-    return ENOMEM;
-
-  status = mu_sql_connection_init (&conn,
-				   mu_sql_module_config.interface,
-				   mu_sql_module_config.host,
-				   mu_sql_module_config.port,
-				   mu_sql_module_config.user,
-				   mu_sql_module_config.passwd,
-				   mu_sql_module_config.db);
-
-  if (status)
-    {
-      mu_error ("%s: %s", mu_strerror (status), mu_sql_strerror (conn));
-      mu_sql_connection_destroy (&conn);
-      free (query_str);
-      return MU_ERR_FAILURE;
-    }
-
-  status = mu_sql_connect (conn);
-
-  if (status)
-    {
-      mu_error ("%s: %s", mu_strerror (status), mu_sql_strerror (conn));
-      mu_sql_connection_destroy (&conn);
-      free (query_str);
-      return EAGAIN;
-    }
-  
-  status = mu_sql_query (conn, query_str);
-  free (query_str);
-  
-  if (status)
-    {
-      mu_error (_("SQL query failed: %s"),
-		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
-	 	                          mu_strerror (status));
-      mu_sql_connection_destroy (&conn);
-      return MU_ERR_FAILURE;
-    }
-
-  status = mu_sql_store_result (conn);
-
-  if (status)
-    {
-      mu_error (_("cannot store SQL result: %s"),
-		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
-	 	                          mu_strerror (status));
-      mu_sql_connection_destroy (&conn);
-      return MU_ERR_FAILURE;
-    }
+  rc = mu_sql_run_query (&conn, "getpwuid",
+			 mu_sql_module_config.getpwuid_query, uidstr);
+  if (rc)
+    return rc;
 
   status = mu_sql_num_tuples (conn, &n);
   if (status)
@@ -493,8 +608,7 @@ mu_auth_sql_by_uid (struct mu_auth_data **return_data,
       mu_error (_("cannot get number of tuples: %s"),
                 (status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
                                           mu_strerror (status));
-      mu_sql_release_result (conn);
-      mu_sql_connection_destroy (&conn);
+      mu_sql_pool_put (&conn, status);
       return MU_ERR_FAILURE;
     }
 
@@ -503,9 +617,7 @@ mu_auth_sql_by_uid (struct mu_auth_data **return_data,
   else
     rc = decode_tuple (conn, n, return_data);
   
-  mu_sql_release_result (conn);
-  mu_sql_disconnect (conn);
-  mu_sql_connection_destroy (&conn);
+  mu_sql_pool_put (&conn, 0);
   
   return rc;
 }
@@ -514,64 +626,14 @@ int
 mu_sql_getpass (const char *username, char **passwd)
 {
   mu_sql_connection_t conn;
-  char *query_str;
   int status;
   char *sql_pass;
   size_t nt;
 
-  query_str = mu_sql_expand_query (mu_sql_module_config.getpass_query, username);
-
-  if (!query_str)
-    return MU_ERR_FAILURE;
-
-  status = mu_sql_connection_init (&conn,
-				   mu_sql_module_config.interface,
-				   mu_sql_module_config.host,
-				   mu_sql_module_config.port,
-				   mu_sql_module_config.user,
-				   mu_sql_module_config.passwd,
-				   mu_sql_module_config.db);
-
+  status = mu_sql_run_query (&conn, "getpass",
+			     mu_sql_module_config.getpass_query, username);
   if (status)
-    {
-      mu_error ("%s: %s", mu_strerror (status), mu_sql_strerror (conn));
-      mu_sql_connection_destroy (&conn);
-      free (query_str);
-      return MU_ERR_FAILURE;
-    }
-
-  status = mu_sql_connect (conn);
-
-  if (status)
-    {
-      mu_error ("%s: %s", mu_strerror (status), mu_sql_strerror (conn));
-      mu_sql_connection_destroy (&conn);
-      free (query_str);
-      return EAGAIN;
-    }
-  
-  status = mu_sql_query (conn, query_str);
-  free (query_str);
-  
-  if (status)
-    {
-      mu_error (_("SQL query failed: %s"),
-		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
-	 	                          mu_strerror (status));
-      mu_sql_connection_destroy (&conn);
-      return MU_ERR_FAILURE;
-    }
-  
-  status = mu_sql_store_result (conn);
-
-  if (status)
-    {
-      mu_error (_("cannot store SQL result: %s"),
-		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
-	 	                          mu_strerror (status));
-      mu_sql_connection_destroy (&conn);
-      return MU_ERR_FAILURE;
-    }
+    return status;
 
   status = mu_sql_num_tuples (conn, &nt);
   if (status)
@@ -579,14 +641,12 @@ mu_sql_getpass (const char *username, char **passwd)
       mu_error (_("cannot get number of tuples: %s"),
                 (status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
                                           mu_strerror (status));
-      mu_sql_release_result (conn);
-      mu_sql_connection_destroy (&conn);
+      mu_sql_pool_put (&conn, status);
       return MU_ERR_FAILURE;
     }
   if (nt == 0)
     {
-      mu_sql_release_result (conn);
-      mu_sql_connection_destroy (&conn);
+      mu_sql_pool_put (&conn, 0);
       return MU_ERR_FAILURE;
     }
 
@@ -596,23 +656,20 @@ mu_sql_getpass (const char *username, char **passwd)
       mu_error (_("cannot get password from SQL: %s"),
 		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
 	 	                          mu_strerror (status));
-      mu_sql_release_result (conn);
-      mu_sql_connection_destroy (&conn);
+      mu_sql_pool_put (&conn, status);
       return MU_ERR_FAILURE;
     }
 
   if (!sql_pass)
     {
       mu_error (_("SQL returned NULL password"));
-      mu_sql_release_result (conn);
-      mu_sql_connection_destroy (&conn);
+      mu_sql_pool_put (&conn, 0);
       return MU_ERR_FAILURE;
     }
 
   *passwd = strdup (sql_pass);
 
-  mu_sql_disconnect (conn);
-  mu_sql_connection_destroy (&conn);
+  mu_sql_pool_put (&conn, 0);
 
   if (!*passwd)
     return ENOMEM;
@@ -688,6 +745,12 @@ mu_sql_module_init (enum mu_gocs_op op, void *data)
   mu_sql_module_config.port = cfg->port;             
   mu_sql_module_config.password_type = cfg->password_type;    
   mu_sql_module_config.field_map = cfg->field_map;        
+  mu_sql_module_config.pool_size = cfg->pool_size;
+  mu_sql_module_config.check_interval = cfg->check_interval;
+  mu_sql_module_config.prepared = cfg->prepared;
+
+  mu_sql_pool_set_size (cfg->pool_size);
+  mu_sql_pool_set_check_interval (cfg->check_interval);
 
   return 0;
 }
@@ -92,6 +92,17 @@ static struct mu_cfg_param mu_sql_param[] = {
        "gecos, dir, shell, mailbox, quota, and <column> is the name of "
        "the corresponding SQL column."),
     N_("map") },
+  { "pool-size", mu_cfg_size, &sql_settings.pool_size, 0, NULL,
+    N_("Keep up to this number of idle connections open for reuse.  "
+       "0 means close each connection after use.") },
+  { "check-interval", mu_cfg_time, &sql_settings.check_interval, 0, NULL,
+    N_("Check whether an idle connection is alive before reusing it, "
+       "if it has not been used for this number of seconds.  0 means "
+       "check it each time."),
+    N_("seconds") },
+  { "prepared", mu_cfg_bool, &sql_settings.prepared, 0, NULL,
+    N_("Use prepared statements for the configured queries, if the "
+       "interface supports them.") },
   { NULL }
 };
 
@@ -335,8 +335,10 @@ mu_sv_code_command (mu_sieve_register_t *reg, mu_list_t arglist)
   return err;
 }
 
-int
-mu_sv_code_source (const char *name)
+/* Add NAME to the list of sources of the machine being compiled, unless
+   it is already there.  Return the copy of NAME kept in the list. */
+static char *
+register_source (const char *name)
 {
   char *s;
   
@@ -346,9 +348,14 @@ mu_sv_code_source (const char *name)
       s = mu_sieve_mstrdup (mu_sieve_machine, name);
       mu_list_append (mu_sieve_machine->source_list, s);
     }
-  
+  return s;
+}
+
+int
+mu_sv_code_source (const char *name)
+{
   return mu_sv_code_instr (_mu_sv_instr_source)
-	 || mu_sv_code_string (s);
+	 || mu_sv_code_string (register_source (name));
 }
 
 int
@@ -367,6 +374,10 @@ void
 mu_sv_change_source ()
 {
   sieve_source_changed = 1;
+  /* Register the source right away, so that the list includes the files
+     that produce no code as well */
+  if (mu_sieve_locus.mu_file)
+    register_source (mu_sieve_locus.mu_file);
 }
 
 static int
@@ -249,6 +249,15 @@ mu_sieve_get_locus (mu_sieve_machine_t mach, struct mu_locus *loc)
   return 1;
 }
 
+int
+mu_sieve_get_source_list (mu_sieve_machine_t mach, mu_list_t *plist)
+{
+  if (!mach->source_list)
+    return MU_ERR_NOENT;
+  *plist = mach->source_list;
+  return 0;
+}
+
 mu_message_t
 mu_sieve_get_message (mu_sieve_machine_t mach)
 {
@@ -415,6 +415,8 @@ mu_sieve_machine_dup (mu_sieve_machine_t const in, mu_sieve_machine_t *out)
 
   mach->progsize = in->progsize;
   mach->prog = in->prog;
+  /* Needed for the default comparator (see mu_sieve_get_comparator) */
+  mu_sv_register_standard_comparators (mach);
 
   mach->pc = 0;
   mach->reg = 0;
@@ -0,0 +1,879 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General
+   Public License along with this library.  If not, see
+   <http://www.gnu.org/licenses/>. */
+
+/* Persistent message cache.
+
+   The cache keeps the envelopes, sizes and texts of the messages of
+   an IMAP mailbox between sessions, so that reopening the mailbox
+   requires only fetching the UIDs and flags of its messages, plus
+   whatever has been added since the mailbox was last closed.
+
+   The cache is enabled by the "cache" URL parameter:
+
+     imap://smith@mail.example.org/INBOX;cache
+     imap://smith@mail.example.org/INBOX;cache=/var/cache/smith
+
+   The parameter value gives the cache directory.  If it is empty,
+   ".mu-imap-cache" in the user's home directory is used.  The directory
+   is created if it does not exist.
+
+   Each mailbox is kept in two files, named after the string
+   "USER@HOST:PORT/MAILBOX" with "/" and "%" characters encoded as
+   "%2F" and "%25".  The file with the suffix ".dat" holds the message
+   texts, as returned by the server, with CRLF line endings converted
+   to LF.  It is used as the message cache stream of the mailbox, so
+   that messages cached in one session remain available in the next.
+   The file is locked while the mailbox is open.  If the lock cannot be
+   obtained, the mailbox falls back to the temporary cache.
+
+   The file with the suffix ".idx" is a text file of the following
+   format:
+
+     # GNU Mailutils IMAP cache
+     version 1
+     uidvalidity UIDVALIDITY
+
+   followed by a line for each message:
+
+     UID SIZE LINES OFFSET DATE SUBJECT IN-REPLY-TO MESSAGE-ID ADDRESSES
+
+   LINES and OFFSET are "-" if the number of lines in the message is not
+   known, or its text is not cached.  DATE consists of nine numbers: the
+   year, month, day of month, hours, minutes, seconds, day of week and
+   day of year of the message date, and its offset from UTC in seconds.
+   String values are either "-", meaning NIL, or "'" followed by the
+   string with whitespace, control characters and "%" encoded as "%XX".
+   ADDRESSES are the From, Sender, Reply-To, To, Cc and Bcc address
+   lists, each one represented by the number of addresses in it followed
+   by the personal name, local part and domain of each address.
+
+   Message flags are not cached: they are refetched each time the
+   mailbox is opened.  The whole cache is discarded if the UIDVALIDITY
+   of the mailbox changes. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <mailutils/errno.h>
+#include <mailutils/stream.h>
+#include <mailutils/message.h>
+#include <mailutils/address.h>
+#include <mailutils/locker.h>
+#include <mailutils/url.h>
+#include <mailutils/util.h>
+#include <mailutils/io.h>
+#include <mailutils/nls.h>
+#include <mailutils/diag.h>
+#include <mailutils/sys/imap.h>
+
+#define IMAP_CACHE_VERSION 1
+#define IMAP_CACHE_DIR ".mu-imap-cache"
+
+/* The data file is compacted on close if it contains more than this
+   many bytes of messages that are no longer in the mailbox, and these
+   make up more than a half of its size. */
+#define IMAP_CACHE_SLACK 65536
+
+#define NO_LINES ((size_t) -1)
+
+struct cache_entry
+{
+  size_t uid;
+  size_t size;
+  size_t lines;                 /* NO_LINES, if unknown */
+  mu_off_t offset;              /* -1, if the text is not cached */
+  struct mu_imapenvelope *env;
+};
+
+struct _mu_imap_cache
+{
+  char *idxname;                /* Index file name */
+  char *datname;                /* Data file name */
+  mu_locker_t locker;           /* Data file locker */
+  mu_off_t datsize;             /* Size of the data file when opened */
+  struct cache_entry *tab;      /* Cached messages, sorted by UID */
+  size_t count;                 /* Number of entries in tab */
+};
+
+static void
+cache_entry_free (struct cache_entry *ent)
+{
+  mu_message_imapenvelope_free (ent->env);
+  ent->env = NULL;
+}
+
+static void
+cache_table_free (struct _mu_imap_cache *cp)
+{
+  size_t i;
+
+  for (i = 0; i < cp->count; i++)
+    cache_entry_free (&cp->tab[i]);
+  free (cp->tab);
+  cp->tab = NULL;
+  cp->count = 0;
+}
+
+static void
+cache_free (struct _mu_imap_cache *cp)
+{
+  cache_table_free (cp);
+  if (cp->locker)
+    {
+      mu_locker_unlock (cp->locker);
+      mu_locker_destroy (&cp->locker);
+    }
+  free (cp->idxname);
+  free (cp->datname);
+  free (cp);
+}
+
+/* Index syntax */
+
+static void
+put_string (mu_stream_t str, const char *s)
+{
+  if (!s)
+    {
+      mu_stream_write (str, " -", 2, NULL);
+      return;
+    }
+  mu_stream_write (str, " '", 2, NULL);
+  for (; *s; s++)
+    {
+      unsigned char c = *s;
+      if (c <= ' ' || c == '%' || c == 127)
+	mu_stream_printf (str, "%%%02X", c);
+      else
+	mu_stream_write (str, s, 1, NULL);
+    }
+}
+
+static void
+put_address (mu_stream_t str, mu_address_t addr)
+{
+  size_t i, count = 0;
+
+  if (addr)
+    mu_address_get_count (addr, &count);
+  mu_stream_printf (str, " %lu", (unsigned long) count);
+  for (i = 1; i <= count; i++)
+    {
+      const char *s;
+
+      if (mu_address_sget_personal (addr, i, &s))
+	s = NULL;
+      put_string (str, s);
+      if (mu_address_sget_local_part (addr, i, &s))
+	s = NULL;
+      put_string (str, s);
+      if (mu_address_sget_domain (addr, i, &s))
+	s = NULL;
+      put_string (str, s);
+    }
+}
+
+/* Return the next whitespace-delimited token from *PP, or NULL if
+   there are no more tokens. */
+static char *
+get_token (char **pp)
+{
+  char *p = *pp, *start;
+
+  while (*p == ' ')
+    p++;
+  if (!*p)
+    return NULL;
+  start = p;
+  while (*p && *p != ' ')
+    p++;
+  if (*p)
+    *p++ = 0;
+  *pp = p;
+  return start;
+}
+
+static int
+get_number (char **pp, unsigned long *pn)
+{
+  char *tok = get_token (pp), *p;
+
+  if (!tok)
+    return MU_ERR_PARSE;
+  *pn = strtoul (tok, &p, 10);
+  return *p ? MU_ERR_PARSE : 0;
+}
+
+static int
+get_signed (char **pp, long *pn)
+{
+  char *tok = get_token (pp), *p;
+
+  if (!tok)
+    return MU_ERR_PARSE;
+  *pn = strtol (tok, &p, 10);
+  return *p ? MU_ERR_PARSE : 0;
+}
+
+/* Get a number that may be represented by "-".  Store DEF in *PN in
+   that case. */
+static int
+get_optnum (char **pp, unsigned long *pn, unsigned long def)
+{
+  char *tok = get_token (pp), *p;
+
+  if (!tok)
+    return MU_ERR_PARSE;
+  if (strcmp (tok, "-") == 0)
+    {
+      *pn = def;
+      return 0;
+    }
+  *pn = strtoul (tok, &p, 10);
+  return *p ? MU_ERR_PARSE : 0;
+}
+
+static int
+hexval (int c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+/* Get a string token.  Decode it in place and store a pointer to it in
+   *PS, or NULL if the token is "-". */
+static int
+get_string (char **pp, char **ps)
+{
+  char *tok = get_token (pp), *p, *q;
+
+  if (!tok)
+    return MU_ERR_PARSE;
+  if (strcmp (tok, "-") == 0)
+    {
+      *ps = NULL;
+      return 0;
+    }
+  if (*tok != '\'')
+    return MU_ERR_PARSE;
+  for (p = q = tok + 1; *p; )
+    {
+      if (*p == '%')
+	{
+	  int hi, lo;
+
+	  if ((hi = hexval (p[1])) == -1 || (lo = hexval (p[2])) == -1)
+	    return MU_ERR_PARSE;
+	  *q++ = (hi << 4) | lo;
+	  p += 3;
+	}
+      else
+	*q++ = *p++;
+    }
+  *q = 0;
+  *ps = tok + 1;
+  return 0;
+}
+
+static int
+get_dup_string (char **pp, char **ps)
+{
+  char *s;
+  int rc = get_string (pp, &s);
+
+  if (rc)
+    return rc;
+  if (!s)
+    *ps = NULL;
+  else if ((*ps = strdup (s)) == NULL)
+    return ENOMEM;
+  return 0;
+}
+
+static int
+get_address (char **pp, mu_address_t *paddr)
+{
+  unsigned long i, count;
+  int rc;
+
+  rc = get_number (pp, &count);
+  for (i = 0; rc == 0 && i < count; i++)
+    {
+      char *personal, *local, *domain;
+      mu_address_t addr;
+
+      if ((rc = get_string (pp, &personal))
+	  || (rc = get_string (pp, &local))
+	  || (rc = get_string (pp, &domain)))
+	break;
+      rc = mu_address_create_null (&addr);
+      if (rc)
+	break;
+      mu_address_set_local_part (addr, 1, local);
+      mu_address_set_domain (addr, 1, domain);
+      mu_address_set_personal (addr, 1, personal);
+      rc = mu_address_union (paddr, addr);
+      mu_address_destroy (&addr);
+    }
+  return rc;
+}
+
+static int
+parse_entry (char *buf, struct cache_entry *ent)
+{
+  struct mu_imapenvelope *env;
+  unsigned long v[12];
+  long off;
+  int rc;
+
+  memset (ent, 0, sizeof (*ent));
+  if (get_number (&buf, &v[0])
+      || get_number (&buf, &v[1])
+      || get_optnum (&buf, &v[2], NO_LINES)
+      || get_optnum (&buf, &v[3], (unsigned long) -1)
+      || get_number (&buf, &v[4])
+      || get_number (&buf, &v[5])
+      || get_number (&buf, &v[6])
+      || get_number (&buf, &v[7])
+      || get_number (&buf, &v[8])
+      || get_number (&buf, &v[9])
+      || get_number (&buf, &v[10])
+      || get_number (&buf, &v[11])
+      || get_signed (&buf, &off))
+    return MU_ERR_PARSE;
+  if (v[0] == 0)
+    return MU_ERR_PARSE;
+
+  env = calloc (1, sizeof (*env));
+  if (!env)
+    return ENOMEM;
+  ent->uid = v[0];
+  ent->size = v[1];
+  ent->lines = v[2];
+  ent->offset = v[3] == (unsigned long) -1 ? -1 : (mu_off_t) v[3];
+  ent->env = env;
+  env->date.tm_year = v[4];
+  env->date.tm_mon = v[5];
+  env->date.tm_mday = v[6];
+  env->date.tm_hour = v[7];
+  env->date.tm_min = v[8];
+  env->date.tm_sec = v[9];
+  env->date.tm_wday = v[10];
+  env->date.tm_yday = v[11];
+  env->tz.utc_offset = off;
+  env->tz.tz_name = NULL;
+
+  if ((rc = get_dup_string (&buf, &env->subject))
+      || (rc = get_dup_string (&buf, &env->in_reply_to))
+      || (rc = get_dup_string (&buf, &env->message_id))
+      || (rc = get_address (&buf, &env->from))
+      || (rc = get_address (&buf, &env->sender))
+      || (rc = get_address (&buf, &env->reply_to))
+      || (rc = get_address (&buf, &env->to))
+      || (rc = get_address (&buf, &env->cc))
+      || (rc = get_address (&buf, &env->bcc)))
+    {
+      cache_entry_free (ent);
+      return rc;
+    }
+  if (get_token (&buf))
+    {
+      cache_entry_free (ent);
+      return MU_ERR_PARSE;
+    }
+  return 0;
+}
+
+static int
+cache_read (struct _mu_imap_cache *cp, mu_stream_t str,
+	    unsigned long uidvalidity)
+{
+  char *buf = NULL;
+  size_t size = 0, n;
+  size_t max = 0;
+  unsigned long v;
+  int state = 0;
+  int rc;
+
+  while ((rc = mu_stream_getline (str, &buf, &size, &n)) == 0 && n > 0)
+    {
+      if (buf[n-1] == '\n')
+	buf[--n] = 0;
+      if (buf[0] == '#')
+	continue;
+      switch (state)
+	{
+	case 0:
+	  if (sscanf (buf, "version %lu", &v) != 1
+	      || v != IMAP_CACHE_VERSION)
+	    rc = MU_ERR_PARSE;
+	  break;
+
+	case 1:
+	  if (sscanf (buf, "uidvalidity %lu", &v) != 1 || v != uidvalidity)
+	    rc = MU_ERR_PARSE;
+	  break;
+
+	default:
+	  if (cp->count == max)
+	    {
+	      struct cache_entry *p;
+
+	      max = max ? 2 * max : 64;
+	      p = realloc (cp->tab, max * sizeof (cp->tab[0]));
+	      if (!p)
+		{
+		  rc = ENOMEM;
+		  break;
+		}
+	      cp->tab = p;
+	    }
+	  rc = parse_entry (buf, &cp->tab[cp->count]);
+	  if (rc == 0)
+	    {
+	      if (cp->count > 0 && cp->tab[cp->count].uid
+		                     <= cp->tab[cp->count-1].uid)
+		{
+		  cache_entry_free (&cp->tab[cp->count]);
+		  rc = MU_ERR_PARSE;
+		}
+	      else
+		cp->count++;
+	    }
+	}
+      if (rc)
+	break;
+      if (state < 2)
+	state++;
+    }
+  free (buf);
+  if (rc == 0 && state < 2)
+    rc = MU_ERR_PARSE;
+  return rc;
+}
+
+/* Load the index.  On failure, the cache is emptied. */
+static void
+cache_load (struct _mu_imap_cache *cp, mu_stream_t dat,
+	    struct _mu_imap_mailbox *imbx)
+{
+  mu_stream_t str;
+  int rc;
+
+  if (!(imbx->stats.flags & MU_IMAP_STAT_UIDVALIDITY))
+    rc = MU_ERR_INFO_UNAVAILABLE;
+  else
+    {
+      rc = mu_file_stream_create (&str, cp->idxname, MU_STREAM_READ);
+      if (rc == 0)
+	{
+	  rc = cache_read (cp, str, imbx->stats.uidvalidity);
+	  mu_stream_destroy (&str);
+	}
+    }
+
+  if (rc == 0)
+    rc = mu_stream_size (dat, &cp->datsize);
+  if (rc)
+    {
+      if (rc != ENOENT)
+	mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+		  (_("discarding stale or invalid cache %s"), cp->idxname));
+      cache_table_free (cp);
+      mu_stream_truncate (dat, 0);
+      cp->datsize = 0;
+    }
+  else
+    mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+	      (_("loaded %lu messages from cache %s"),
+	       (unsigned long) cp->count, cp->idxname));
+}
+
+/* Return the base name of the cache files for mailbox MBOX_NAME. */
+static int
+cache_base_name (mu_url_t url, const char *dir, const char *mbox_name,
+		 char **pname)
+{
+  const char *user, *host;
+  unsigned port;
+  char *key, *name;
+  int rc;
+
+  if (mu_url_sget_user (url, &user))
+    user = "";
+  if (mu_url_sget_host (url, &host))
+    host = "";
+  if (mu_url_get_port (url, &port))
+    port = 0;
+  rc = mu_asprintf (&key, "%s@%s:%u/%s", user, host, port, mbox_name);
+  if (rc)
+    return rc;
+  name = mu_make_file_name_encoded (dir, key);
+  free (key);
+  if (!name)
+    return ENOMEM;
+  *pname = name;
+  return 0;
+}
+
+static int
+cache_names (struct _mu_imap_cache *cp, mu_url_t url, const char *val,
+	     const char *mbox_name)
+{
+  char *dir, *base;
+  int rc;
+
+  if (val[0])
+    {
+      dir = strdup (val);
+      if (!dir)
+	return ENOMEM;
+    }
+  else
+    {
+      char *home = mu_get_homedir ();
+      if (!home)
+	return MU_ERR_NOENT;
+      dir = mu_make_file_name (home, IMAP_CACHE_DIR);
+      free (home);
+      if (!dir)
+	return ENOMEM;
+    }
+  if (mkdir (dir, 0700) && errno != EEXIST)
+    {
+      rc = errno;
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+		(_("cannot create cache directory %s: %s"),
+		 dir, mu_strerror (rc)));
+      free (dir);
+      return rc;
+    }
+
+  rc = cache_base_name (url, dir, mbox_name, &base);
+  free (dir);
+  if (rc)
+    return rc;
+  rc = mu_asprintf (&cp->idxname, "%s.idx", base);
+  if (rc == 0)
+    rc = mu_asprintf (&cp->datname, "%s.dat", base);
+  free (base);
+  return rc;
+}
+
+/* Open the persistent cache of the mailbox, if it is requested by the
+   "cache" URL parameter.  Must be called after the mailbox has been
+   selected.  On success, the data file becomes the message cache stream
+   of the mailbox. */
+int
+_mu_imap_cache_open (struct _mu_imap_mailbox *imbx, const char *mbox_name)
+{
+  struct _mu_imap_cache *cp;
+  const char *val;
+  mu_stream_t dat;
+  size_t i;
+  int rc;
+
+  rc = mu_url_sget_param (imbx->mbox->url, "cache", &val);
+  if (rc == MU_ERR_NOENT)
+    return 0;
+  else if (rc)
+    return rc;
+
+  cp = calloc (1, sizeof (*cp));
+  if (!cp)
+    return ENOMEM;
+  rc = cache_names (cp, imbx->mbox->url, val, mbox_name);
+  if (rc == 0)
+    rc = mu_locker_create (&cp->locker, cp->datname,
+			   MU_LOCKER_DOTLOCK | MU_LOCKER_PID);
+  if (rc == 0)
+    {
+      rc = mu_locker_lock (cp->locker);
+      if (rc)
+	{
+	  mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+		    (_("cannot lock cache %s: %s; using temporary cache"),
+		     cp->datname, mu_strerror (rc)));
+	  mu_locker_destroy (&cp->locker);
+	}
+    }
+  if (rc == 0)
+    rc = mu_file_stream_create (&dat, cp->datname,
+				MU_STREAM_RDWR | MU_STREAM_CREAT);
+  if (rc)
+    {
+      cache_free (cp);
+      /* Not fatal: the mailbox will use the temporary cache */
+      return 0;
+    }
+  mu_stream_set_buffer (dat, mu_buffer_full, 8192);
+
+  cache_load (cp, dat, imbx);
+
+  /* Discard the temporary cache left from a previous session */
+  if (imbx->cache)
+    {
+      for (i = 0; i < imbx->msgs_cnt; i++)
+	imbx->msgs[i].flags &= ~_MU_IMAP_MSG_CACHED;
+      mu_stream_unref (imbx->cache);
+    }
+  imbx->cache = dat;
+  imbx->pcache = cp;
+  return 0;
+}
+
+static int
+entry_cmp (const void *a, const void *b)
+{
+  const struct cache_entry *ea = a, *eb = b;
+  if (ea->uid < eb->uid)
+    return -1;
+  if (ea->uid > eb->uid)
+    return 1;
+  return 0;
+}
+
+/* Fill in IMSG from the cache.  Its UID must already be known.  Return
+   MU_ERR_NOENT if the message is not in the cache. */
+int
+_mu_imap_cache_restore (struct _mu_imap_mailbox *imbx,
+			struct _mu_imap_message *imsg)
+{
+  struct _mu_imap_cache *cp = imbx->pcache;
+  struct cache_entry key, *ent;
+
+  if (!cp || !cp->tab)
+    return MU_ERR_NOENT;
+  key.uid = imsg->uid;
+  ent = bsearch (&key, cp->tab, cp->count, sizeof (cp->tab[0]), entry_cmp);
+  if (!ent || !ent->env)
+    return MU_ERR_NOENT;
+
+  mu_message_imapenvelope_free (imsg->env);
+  imsg->env = ent->env;
+  ent->env = NULL;
+  imsg->message_size = ent->size;
+  if (ent->lines != NO_LINES)
+    {
+      imsg->message_lines = ent->lines;
+      imsg->flags |= _MU_IMAP_MSG_LINES;
+    }
+  if (ent->offset >= 0 && ent->offset + ent->size <= cp->datsize)
+    {
+      imsg->offset = ent->offset;
+      imsg->flags |= _MU_IMAP_MSG_CACHED;
+    }
+  return 0;
+}
+
+/* Free the cache table.  Called when the mailbox has been scanned. */
+void
+_mu_imap_cache_forget (struct _mu_imap_mailbox *imbx)
+{
+  if (imbx->pcache)
+    cache_table_free (imbx->pcache);
+}
+
+static int
+offset_cmp (const void *a, const void *b)
+{
+  struct _mu_imap_message const *ma = *(struct _mu_imap_message **) a;
+  struct _mu_imap_message const *mb = *(struct _mu_imap_message **) b;
+  if (ma->offset < mb->offset)
+    return -1;
+  if (ma->offset > mb->offset)
+    return 1;
+  return 0;
+}
+
+/* Move the cached message texts to the beginning of the data file,
+   in the order of their offsets, and truncate it. */
+static int
+cache_compact (struct _mu_imap_mailbox *imbx)
+{
+  struct _mu_imap_message **tab;
+  size_t i, n = 0;
+  mu_off_t wpos = 0;
+  char buf[8192];
+  int rc = 0;
+
+  tab = calloc (imbx->msgs_cnt, sizeof (tab[0]));
+  if (!tab)
+    return ENOMEM;
+  for (i = 0; i < imbx->msgs_cnt; i++)
+    if (imbx->msgs[i].flags & _MU_IMAP_MSG_CACHED)
+      tab[n++] = imbx->msgs + i;
+  qsort (tab, n, sizeof (tab[0]), offset_cmp);
+
+  /* Data are moved within the same file: avoid buffering */
+  rc = mu_stream_flush (imbx->cache);
+  if (rc == 0)
+    rc = mu_stream_set_buffer (imbx->cache, mu_buffer_none, 0);
+  for (i = 0; rc == 0 && i < n; i++)
+    {
+      struct _mu_imap_message *imsg = tab[i];
+      mu_off_t off;
+
+      if (imsg->offset == wpos)
+	{
+	  wpos += imsg->message_size;
+	  continue;
+	}
+      for (off = 0; rc == 0 && off < imsg->message_size; )
+	{
+	  size_t len = imsg->message_size - off;
+
+	  if (len > sizeof buf)
+	    len = sizeof buf;
+	  rc = mu_stream_seek (imbx->cache, imsg->offset + off,
+			       MU_SEEK_SET, NULL);
+	  if (rc == 0)
+	    rc = mu_stream_read (imbx->cache, buf, len, NULL);
+	  if (rc == 0)
+	    rc = mu_stream_seek (imbx->cache, wpos + off, MU_SEEK_SET, NULL);
+	  if (rc == 0)
+	    rc = mu_stream_write (imbx->cache, buf, len, NULL);
+	  off += len;
+	}
+      imsg->offset = wpos;
+      wpos += imsg->message_size;
+    }
+  free (tab);
+  if (rc == 0)
+    rc = mu_stream_truncate (imbx->cache, wpos);
+  return rc;
+}
+
+static int
+cache_write (mu_stream_t str, void *data)
+{
+  struct _mu_imap_mailbox *imbx = data;
+  size_t i;
+
+  mu_stream_printf (str, "# GNU Mailutils IMAP cache\n");
+  mu_stream_printf (str, "version %d\n", IMAP_CACHE_VERSION);
+  mu_stream_printf (str, "uidvalidity %lu\n", imbx->stats.uidvalidity);
+  for (i = 0; i < imbx->msgs_cnt && mu_stream_err (str) == 0; i++)
+    {
+      struct _mu_imap_message *imsg = imbx->msgs + i;
+      struct mu_imapenvelope *env = imsg->env;
+
+      if (!imsg->uid || !env)
+	continue;
+      mu_stream_printf (str, "%lu %lu", (unsigned long) imsg->uid,
+			(unsigned long) imsg->message_size);
+      if (imsg->flags & _MU_IMAP_MSG_LINES)
+	mu_stream_printf (str, " %lu", (unsigned long) imsg->message_lines);
+      else
+	mu_stream_write (str, " -", 2, NULL);
+      if (imsg->flags & _MU_IMAP_MSG_CACHED)
+	mu_stream_printf (str, " %lu", (unsigned long) imsg->offset);
+      else
+	mu_stream_write (str, " -", 2, NULL);
+      mu_stream_printf (str, " %d %d %d %d %d %d %d %d %d",
+			env->date.tm_year, env->date.tm_mon,
+			env->date.tm_mday, env->date.tm_hour,
+			env->date.tm_min, env->date.tm_sec,
+			env->date.tm_wday, env->date.tm_yday,
+			env->tz.utc_offset);
+      put_string (str, env->subject);
+      put_string (str, env->in_reply_to);
+      put_string (str, env->message_id);
+      put_address (str, env->from);
+      put_address (str, env->sender);
+      put_address (str, env->reply_to);
+      put_address (str, env->to);
+      put_address (str, env->cc);
+      put_address (str, env->bcc);
+      mu_stream_write (str, "\n", 1, NULL);
+    }
+  if (mu_stream_err (str))
+    return mu_stream_last_error (str);
+  return mu_stream_flush (str);
+}
+
+static int
+cache_save (struct _mu_imap_mailbox *imbx)
+{
+  struct _mu_imap_cache *cp = imbx->pcache;
+  mu_off_t size, live = 0;
+  size_t i;
+  int rc;
+
+  if (!(imbx->stats.flags & MU_IMAP_STAT_UIDVALIDITY))
+    return MU_ERR_INFO_UNAVAILABLE;
+
+  rc = mu_stream_flush (imbx->cache);
+  if (rc == 0)
+    rc = mu_stream_size (imbx->cache, &size);
+  if (rc)
+    return rc;
+  for (i = 0; i < imbx->msgs_cnt; i++)
+    if (imbx->msgs[i].flags & _MU_IMAP_MSG_CACHED)
+      live += imbx->msgs[i].message_size;
+  if (size - live > IMAP_CACHE_SLACK && size - live > live)
+    {
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+		(_("compacting cache %s"), cp->datname));
+      /* Remove the index first: it will be invalid if compaction
+	 does not succeed. */
+      if (unlink (cp->idxname) && errno != ENOENT)
+	return errno;
+      rc = cache_compact (imbx);
+      if (rc)
+	return rc;
+    }
+
+  return mu_tempfile_replace (cp->idxname, cache_write, imbx);
+}
+
+/* Save the cache index and close the cache.  The message cache stream
+   of the mailbox is closed as well. */
+int
+_mu_imap_cache_close (struct _mu_imap_mailbox *imbx)
+{
+  struct _mu_imap_cache *cp = imbx->pcache;
+  size_t i;
+  int rc;
+
+  if (!cp)
+    return 0;
+  rc = cache_save (imbx);
+  if (rc)
+    mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+	      (_("cannot save cache %s: %s"), cp->idxname,
+	       mu_strerror (rc)));
+  for (i = 0; i < imbx->msgs_cnt; i++)
+    imbx->msgs[i].flags &= ~_MU_IMAP_MSG_CACHED;
+  mu_stream_unref (imbx->cache);
+  imbx->cache = NULL;
+  cache_free (cp);
+  imbx->pcache = NULL;
+  return rc;
+}
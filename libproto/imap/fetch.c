@@ -863,7 +863,9 @@ _fill_response (void *item, void *data)
   switch (env->n++)
     {
     case env_date:
-      if (elt->type != imap_eltype_string)
+      if (_mu_imap_list_element_is_nil (elt))
+	rc = 0;
+      else if (elt->type != imap_eltype_string)
 	rc = MU_ERR_FAILURE;
       else
 	{
@@ -84,6 +84,50 @@ struct save_closure
   struct _mu_imap_message *imsg;
 };
 
+/* Decode the message TEXT returned by the server and copy it to STR.
+   Store the number of bytes written in *PSIZE. */
+static int
+_save_text (struct _mu_imap_mailbox *imbx, const char *text, mu_stream_t str,
+	    size_t *psize)
+{
+  int rc;
+  mu_stream_t istr, flt;
+  mu_off_t size;
+  
+  rc = mu_static_memory_stream_create (&istr, text, strlen (text));
+  if (rc)
+    {
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+		(_("mu_static_memory_stream_create: %s"),
+		 mu_strerror (rc)));
+      imbx->last_error = rc;
+      return rc;
+    }
+
+  rc = mu_filter_create (&flt, istr, "CRLF", MU_FILTER_DECODE,
+			 MU_STREAM_READ);
+  mu_stream_unref (istr);
+  if (rc)
+    {
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+		(_("mu_filter_create: %s"), mu_strerror (rc)));
+      imbx->last_error = rc;
+      return rc;
+    }
+      
+  rc = mu_stream_copy (str, flt, 0, &size);
+  mu_stream_destroy (&flt);
+  if (rc)
+    {
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+		(_("copying to cache failed: %s"), mu_strerror (rc)));
+      imbx->last_error = rc;
+      return rc;
+    }
+  *psize = size;
+  return 0;
+}
+
 static int
 _save_message_parser (void *item, void *data)
 {
@@ -91,47 +135,8 @@ _save_message_parser (void *item, void *data)
   struct save_closure *clos = data;
 
   if (resp->type == MU_IMAP_FETCH_BODY)
-    {
-      struct _mu_imap_message *imsg = clos->imsg;
-      struct _mu_imap_mailbox *imbx = imsg->imbx;
-      int rc;
-      mu_stream_t istr, flt;
-      mu_off_t size;
-  
-      rc = mu_static_memory_stream_create (&istr, resp->body.text,
-					   strlen (resp->body.text));
-      
-      if (rc)
-	{
-	  mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
-		    (_("mu_static_memory_stream_create: %s"),
-		     mu_strerror (rc)));
-	  imbx->last_error = rc;
-	  return 0;
-	}
-
-      rc = mu_filter_create (&flt, istr, "CRLF", MU_FILTER_DECODE,
-			     MU_STREAM_READ);
-      mu_stream_unref (istr);
-      if (rc)
-	{
-	  mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
-		    (_("mu_filter_create: %s"), mu_strerror (rc)));
-	  imbx->last_error = rc;
-	  return 0;
-	}
-      
-      rc = mu_stream_copy (clos->save_stream, flt, 0, &size);
-      mu_stream_destroy (&flt);
-      if (rc)
-	{
-	  mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
-		    (_("copying to cache failed: %s"), mu_strerror (rc)));
-	  imbx->last_error = rc;
-	  return 0;
-	}
-      clos->size = size;
-    }
+    _save_text (clos->imsg->imbx, resp->body.text, clos->save_stream,
+		&clos->size);
   else
     mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE0,
 	      (_("fetch returned a not requested item %d"),
@@ -146,72 +151,193 @@ _save_message (void *data, int code, size_t sdat, void *pdat)
   mu_list_foreach (list, _save_message_parser, data);
 }
 
+/* Message cache */
+
+/* Default maximum read-ahead window for mailboxes opened read-only */
+#define _IMAP_PREFETCH_DEFAULT 32
+
+struct cache_closure
+{
+  struct _mu_imap_mailbox *imbx;
+  size_t lo, hi;            /* Range of requested messages */
+  size_t msgno;             /* Number of the message being processed */
+};
+
 static int
-__imap_msg_get_stream (struct _mu_imap_message *imsg, size_t msgno,
-		       mu_stream_t *pstr)
+_cache_message_parser (void *item, void *data)
 {
+  union mu_imap_fetch_response *resp = item;
+  struct cache_closure *clos = data;
+  struct _mu_imap_mailbox *imbx = clos->imbx;
+  struct _mu_imap_message *imsg;
+  size_t size;
   int rc;
-  struct _mu_imap_mailbox *imbx = imsg->imbx;
-  mu_folder_t folder = imbx->mbox->folder;
-  mu_imap_t imap = folder->data;
   
-  if (!(imsg->flags & _MU_IMAP_MSG_CACHED))
+  if (resp->type != MU_IMAP_FETCH_BODY)
+    {
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE0,
+		(_("fetch returned a not requested item %d"),
+		 resp->type));
+      return 0;
+    }
+  if (clos->msgno < clos->lo || clos->msgno > clos->hi)
+    return 0;
+  imsg = imbx->msgs + clos->msgno - 1;
+  if (imsg->flags & _MU_IMAP_MSG_CACHED)
+    return 0;
+  
+  rc = mu_stream_seek (imbx->cache, 0, MU_SEEK_END, &imsg->offset);
+  if (rc)
+    {
+      imbx->last_error = rc;
+      return 0;
+    }
+  if (_save_text (imbx, resp->body.text, imbx->cache, &size) == 0)
     {
-      mu_msgset_t msgset;
-      
       mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
-		(_("caching message %lu"), (unsigned long) msgno));
-      if (!imbx->cache)
-	{
-	  rc = mu_temp_file_stream_create (&imbx->cache, NULL, 0);
-	  if (rc)
-	    /* FIXME: Try to recover first */
-	    return rc;
+		(_("cached message %lu: offset=%lu, size=%lu"),
+		 (unsigned long) clos->msgno,
+		 (unsigned long) imsg->offset,
+		 (unsigned long) size));
+      imsg->message_size = size;
+      imsg->flags |= _MU_IMAP_MSG_CACHED;
+    }
+  return 0;
+}
 
-	  mu_stream_set_buffer (imbx->cache, mu_buffer_full, 8192);
-	}
+static void
+_cache_message (void *data, int code, size_t sdat, void *pdat)
+{
+  struct cache_closure *clos = data;
+  mu_list_t list = pdat;
+
+  clos->msgno = sdat;
+  mu_list_foreach (list, _cache_message_parser, clos);
+}
+
+/* Set the maximum read-ahead window from the "prefetch" URL parameter. */
+static int
+_imap_prefetch_init (struct _mu_imap_mailbox *imbx, int flags)
+{
+  const char *val;
+  char *p;
+  unsigned long n;
+  int rc;
 
-      rc = mu_stream_size (imbx->cache, &imsg->offset);
+  rc = mu_url_sget_param (imbx->mbox->url, "prefetch", &val);
+  if (rc == MU_ERR_NOENT)
+    {
+      /* Messages read ahead are fetched with BODY.PEEK, so they would
+	 not get the \Seen flag when read.  This matters only if the
+	 mailbox is writable. */
+      imbx->prefetch_max = (flags & (MU_STREAM_WRITE|MU_STREAM_APPEND))
+	                     ? 0 : _IMAP_PREFETCH_DEFAULT;
+      return 0;
+    }
+  else if (rc)
+    return rc;
+  n = strtoul (val, &p, 10);
+  if (*p)
+    {
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+		(_("invalid read-ahead window: %s"), val));
+      return MU_ERR_PARSE;
+    }
+  imbx->prefetch_max = n;
+  return 0;
+}
+
+/* Fetch message MSGNO into the cache.  If messages are being accessed
+   sequentially, fetch the following ones as well, using a single FETCH
+   command.  The read-ahead window is doubled on each sequential miss,
+   up to prefetch_max, and reset on random access. */
+static int
+_imap_cache_messages (struct _mu_imap_mailbox *imbx, size_t msgno)
+{
+  mu_imap_t imap = imbx->mbox->folder->data;
+  mu_msgset_t msgset;
+  struct cache_closure clos;
+  size_t hi;
+  int rc;
+  
+  if (!imbx->cache)
+    {
+      rc = mu_temp_file_stream_create (&imbx->cache, NULL, 0);
       if (rc)
+	/* FIXME: Try to recover first */
 	return rc;
 
-      rc = mu_msgset_create (&msgset, NULL, MU_MSGSET_NUM);
-      if (rc == 0)
-	{
-	  struct save_closure clos;
-
-	  clos.imsg = imsg;
-	  clos.save_stream = imbx->cache;
+      mu_stream_set_buffer (imbx->cache, mu_buffer_full, 8192);
+    }
 
-	  rc = mu_msgset_add_range (msgset, msgno, msgno, MU_MSGSET_NUM);
-	  if (rc == 0)
-	    {
-	      _imap_mbx_clrerr (imbx);
-	      rc = _imap_fetch_with_callback (imap, msgset, "BODY[]",
-					      _save_message, &clos);
-	    }
-	  mu_msgset_free (msgset);
-	  if (rc == 0 && !_imap_mbx_errno (imbx))
-	    {
-	      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
-			(_("cached message %lu: offset=%lu, size=%lu"),
-			 (unsigned long) msgno,
-			 (unsigned long) imsg->offset,
-			 (unsigned long) clos.size));
-	      imsg->message_size = clos.size;
-	    }
-	}
+  if (imbx->prefetch_max > 1 && msgno == imbx->prefetch_next)
+    {
+      if (imbx->prefetch_window < 2)
+	imbx->prefetch_window = 2;
+      else if (imbx->prefetch_window < imbx->prefetch_max / 2)
+	imbx->prefetch_window *= 2;
+      else
+	imbx->prefetch_window = imbx->prefetch_max;
+    }
+  else
+    imbx->prefetch_window = 1;
+
+  /* Stop at the first message that is already cached */
+  for (hi = msgno;
+       hi - msgno + 1 < imbx->prefetch_window && hi < imbx->msgs_cnt
+	 && !(imbx->msgs[hi].flags & _MU_IMAP_MSG_CACHED);
+       hi++)
+    ;
+  imbx->prefetch_next = hi + 1;
+
+  if (hi > msgno)
+    mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+	      (_("caching messages %lu-%lu"),
+	       (unsigned long) msgno, (unsigned long) hi));
+  else
+    mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+	      (_("caching message %lu"), (unsigned long) msgno));
+  
+  rc = mu_msgset_create (&msgset, NULL, MU_MSGSET_NUM);
+  if (rc)
+    return rc;
+  rc = mu_msgset_add_range (msgset, msgno, hi, MU_MSGSET_NUM);
+  if (rc == 0)
+    {
+      clos.imbx = imbx;
+      clos.lo = msgno;
+      clos.hi = hi;
+      clos.msgno = 0;
+      _imap_mbx_clrerr (imbx);
+      rc = _imap_fetch_with_callback (imap, msgset,
+				      hi > msgno ? "BODY.PEEK[]" : "BODY[]",
+				      _cache_message, &clos);
+      if (rc == 0)
+	rc = _imap_mbx_errno (imbx);
+      if (rc == 0 && !(imbx->msgs[msgno - 1].flags & _MU_IMAP_MSG_CACHED))
+	rc = MU_ERR_FAILURE;
+    }
+  mu_msgset_free (msgset);
+  return rc;
+}
 
+static int
+__imap_msg_get_stream (struct _mu_imap_message *imsg, size_t msgno,
+		       mu_stream_t *pstr)
+{
+  struct _mu_imap_mailbox *imbx = imsg->imbx;
+  
+  if (!(imsg->flags & _MU_IMAP_MSG_CACHED))
+    {
+      int rc = _imap_cache_messages (imbx, msgno);
       if (rc)
 	return rc;
-
-      imsg->flags |= _MU_IMAP_MSG_CACHED;
     }
   return mu_streamref_create_abridged (pstr, imbx->cache,
 				       imsg->offset,
 				       imsg->offset + imsg->message_size - 1);
 }
-
+
 static int
 _imap_msg_scan (struct _mu_imap_message *imsg)
 {
@@ -362,6 +488,41 @@ _imap_msg_attr_setup (struct _mu_imap_message *imsg, mu_message_t message)
 /* ------------------------------- */
 /* Header functions                */
 /* ------------------------------- */
+/* Read the header of a message that is already in the cache. */
+static int
+_imap_hdr_fill_cached (struct _mu_imap_message *imsg, char **pbuf,
+		       size_t *plen)
+{
+  mu_stream_t str;
+  char *buf;
+  int rc;
+
+  rc = _imap_msg_scan (imsg);
+  if (rc)
+    return rc;
+  rc = mu_streamref_create_abridged (&str, imsg->imbx->cache,
+				     imsg->offset,
+				     imsg->offset + imsg->body_start - 1);
+  if (rc)
+    return rc;
+  buf = malloc (imsg->body_start + 1);
+  if (!buf)
+    rc = ENOMEM;
+  else
+    {
+      rc = mu_stream_read (str, buf, imsg->body_start, NULL);
+      if (rc == 0)
+	{
+	  *pbuf = buf;
+	  *plen = imsg->body_start;
+	}
+      else
+	free (buf);
+    }
+  mu_stream_destroy (&str);
+  return rc;
+}
+
 static int
 _imap_hdr_fill (void *data, char **pbuf, size_t *plen)
 {
@@ -373,6 +534,10 @@ _imap_hdr_fill (void *data, char **pbuf, size_t *plen)
   unsigned long msgno = _imap_msg_no (imsg);
   int rc;
 
+  /* Messages read ahead do not need another round trip */
+  if (imsg->flags & _MU_IMAP_MSG_CACHED)
+    return _imap_hdr_fill_cached (imsg, pbuf, plen);
+  
   rc = mu_msgset_create (&msgset, NULL, MU_MSGSET_NUM);
   if (rc == 0)
     {
@@ -719,13 +884,16 @@ _imap_mbx_destroy (mu_mailbox_t mailbox)
   if (!imbx)
     return;
 
+  /* The mailbox may be destroyed without being closed.  Save the cache
+     while the messages it describes are still there. */
+  _mu_imap_cache_close (imbx);
+  mu_stream_unref (imbx->cache);
   if (imbx->msgs)
     {
       for (i = 0; i < imbx->msgs_cnt; i++)
 	_imap_msg_free (imbx->msgs + i);
       free (imbx->msgs);
     }
-  mu_stream_unref (imbx->cache);
   free (imbx);
   mailbox->data = NULL;
 }
@@ -761,6 +929,12 @@ _imap_mbx_open (mu_mailbox_t mbox, int flags)
   else if (rc)
     return rc;
       
+  rc = _imap_prefetch_init (imbx, flags);
+  if (rc)
+    return rc;
+  imbx->prefetch_window = 0;
+  imbx->prefetch_next = 1;
+
   rc = mu_folder_open (folder, flags);
   if (rc)
     return rc;
@@ -782,6 +956,8 @@ _imap_mbx_open (mu_mailbox_t mbox, int flags)
 
   if (imbx->stats.flags & MU_IMAP_STAT_MESSAGE_COUNT)
     rc = _imap_realloc_messages (imbx, imbx->stats.message_count);
+  if (rc == 0)
+    rc = _mu_imap_cache_open (imbx, mbox_name);
   
   return rc;
 }
@@ -795,6 +971,7 @@ _imap_mbx_close (mu_mailbox_t mbox)
 
   mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
 	    (_("closing mailbox %s"), mu_url_to_string (mbox->url)));
+  _mu_imap_cache_close (mbox->data);
   if (mu_imap_capability_test (imap, "UNSELECT", NULL) == 0)
     rc = mu_imap_unselect (imap);
   else
@@ -1184,6 +1361,62 @@ _imap_fetch_callback (void *data, int code, size_t sdat, void *pdat)
     }
 }
 
+static char _imap_scan_items[] = "(UID FLAGS ENVELOPE RFC822.SIZE BODY)";
+
+/* Scan the mailbox using the persistent cache.  Fetch UIDs and flags
+   of messages starting from MSGNO, restore the cached ones and fetch
+   the rest in full. */
+static int
+_imap_mbx_scan_cached (struct _mu_imap_mailbox *imbx, size_t msgno)
+{
+  mu_imap_t imap = imbx->mbox->folder->data;
+  mu_msgset_t msgset;
+  size_t i, count = 0;
+  int rc;
+
+  rc = mu_msgset_create (&msgset, NULL, MU_MSGSET_NUM);
+  if (rc)
+    return rc;
+  rc = mu_msgset_add_range (msgset, msgno, MU_MSGNO_LAST, MU_MSGSET_NUM);
+  if (rc == 0)
+    {
+      _imap_mbx_clrerr (imbx);
+      rc = _imap_fetch_with_callback (imap, msgset, "(UID FLAGS)",
+				      _imap_fetch_callback, imbx);
+      if (rc == 0)
+	rc = _imap_mbx_errno (imbx);
+    }
+  mu_msgset_free (msgset);
+  if (rc)
+    return rc;
+
+  rc = mu_msgset_create (&msgset, NULL, MU_MSGSET_NUM);
+  if (rc)
+    return rc;
+  for (i = msgno; rc == 0 && i <= imbx->msgs_cnt; i++)
+    {
+      if (_mu_imap_cache_restore (imbx, imbx->msgs + i - 1) == 0)
+	continue;
+      rc = mu_msgset_add_range (msgset, i, i, MU_MSGSET_NUM);
+      count++;
+    }
+  _mu_imap_cache_forget (imbx);
+  mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+	    (_("%lu messages restored from cache, %lu to fetch"),
+	     (unsigned long) (imbx->msgs_cnt - msgno + 1 - count),
+	     (unsigned long) count));
+  if (rc == 0 && count)
+    {
+      _imap_mbx_clrerr (imbx);
+      rc = _imap_fetch_with_callback (imap, msgset, _imap_scan_items,
+				      _imap_fetch_callback, imbx);
+      if (rc == 0)
+	rc = _imap_mbx_errno (imbx);
+    }
+  mu_msgset_free (msgset);
+  return rc;
+}
+
 static int
 _imap_mbx_scan (mu_mailbox_t mbox, size_t msgno, size_t *pcount)
 {
@@ -1192,26 +1425,30 @@ _imap_mbx_scan (mu_mailbox_t mbox, size_t msgno, size_t *pcount)
   mu_imap_t imap = folder->data;
   mu_msgset_t msgset;
   int rc;
-  static char _imap_scan_items[] = "(UID FLAGS ENVELOPE RFC822.SIZE BODY)";
   
   mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
 	    (_("scanning mailbox %s"), mu_url_to_string (mbox->url)));
-  rc = mu_msgset_create (&msgset, NULL, MU_MSGSET_NUM);
-  if (rc)
-    return rc;
-  rc = mu_msgset_add_range (msgset, msgno, MU_MSGNO_LAST, MU_MSGSET_NUM);
-  if (rc)
+  if (imbx->pcache)
+    rc = _imap_mbx_scan_cached (imbx, msgno);
+  else
     {
+      rc = mu_msgset_create (&msgset, NULL, MU_MSGSET_NUM);
+      if (rc)
+	return rc;
+      rc = mu_msgset_add_range (msgset, msgno, MU_MSGNO_LAST, MU_MSGSET_NUM);
+      if (rc)
+	{
+	  mu_msgset_free (msgset);
+	  return rc;
+	}
+  
+      _imap_mbx_clrerr (imbx);
+      rc = _imap_fetch_with_callback (imap, msgset, _imap_scan_items,
+				      _imap_fetch_callback, imbx);
       mu_msgset_free (msgset);
-      return rc;
+      if (rc == 0)
+	rc = _imap_mbx_errno (imbx);
     }
-  
-  _imap_mbx_clrerr (imbx);
-  rc = _imap_fetch_with_callback (imap, msgset, _imap_scan_items,
-				  _imap_fetch_callback, imbx);
-  mu_msgset_free (msgset);
-  if (rc == 0)
-    rc = _imap_mbx_errno (imbx);
   if (rc == 0)
     {
       size_t i;
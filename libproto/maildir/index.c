@@ -0,0 +1,407 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General
+   Public License along with this library.  If not, see
+   <http://www.gnu.org/licenses/>. */
+
+/* Maildir index.
+
+   The index keeps the list of messages in cur/ along with the sizes
+   and line counts computed for them, so that the message files need
+   not be opened and read to obtain these.  It is enabled by the "index"
+   URL parameter:
+
+     maildir:///home/smith/Maildir;index
+     maildir:///home/smith/Maildir;index=/var/cache/mail/smith.idx
+
+   If the parameter has no value, the index is kept in the file
+   ".mu-index" in the maildir.
+
+   The index is a text file of the following format:
+
+     # GNU Mailutils maildir index
+     version 1
+     new MTIME
+     cur MTIME
+     count N
+
+   followed by N lines describing each message in cur/, in the order
+   of increasing delivery time:
+
+     BODY_START BODY_END HLINES BLINES MTIME NAME
+
+   MTIME is the modification time of the message file as of the moment
+   its BODY_START, BODY_END, HLINES and BLINES were computed.  If these
+   are not known, all five numbers are 0.
+
+   The "new" and "cur" lines keep the modification times of the
+   corresponding directories.  If they have not changed, the directory
+   contents is taken from the index without reading it.  Otherwise,
+   the directory is read, and the data from the index are used for
+   those message files whose size and modification time are the same as
+   recorded in it. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#ifdef ENABLE_MAILDIR
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mailutils/types.h>
+#include <mailutils/debug.h>
+#include <mailutils/errno.h>
+#include <mailutils/error.h>
+#include <mailutils/stream.h>
+#include <mailutils/util.h>
+#include <mailutils/url.h>
+#include <mailutils/io.h>
+#include <mailutils/sys/mailbox.h>
+#include <maildir.h>
+
+#define MAILDIR_INDEX_VERSION 1
+#define MAILDIR_INDEX_NAME ".mu-index"
+
+/* Return the modification time of the subdirectory SUFFIX of AMD, or 0
+   if it cannot be determined or is too recent to be relied upon, i.e.
+   the directory can still be modified within the same second. */
+time_t
+maildir_dir_mtime (struct _amd_data *amd, const char *suffix)
+{
+  char *name = maildir_mkfilename (amd->name, suffix, NULL);
+  struct stat st;
+  int rc = stat (name, &st);
+
+  free (name);
+  if (rc || st.st_mtime >= time (NULL))
+    return 0;
+  return st.st_mtime;
+}
+
+/* Store in *PNAME the name of the index file for AMD.  Return
+   MU_ERR_NOENT if the index is not enabled. */
+int
+maildir_index_name (struct _amd_data *amd, char **pname)
+{
+  const char *val;
+  int rc;
+
+  rc = mu_url_sget_param (amd->mailbox->url, "index", &val);
+  if (rc)
+    return rc;
+  if (val[0])
+    {
+      *pname = strdup (val);
+      if (!*pname)
+	return ENOMEM;
+    }
+  else
+    {
+      *pname = mu_make_file_name (amd->name, MAILDIR_INDEX_NAME);
+      if (!*pname)
+	return ENOMEM;
+    }
+  return 0;
+}
+
+void
+maildir_index_free (struct maildir_index *idx)
+{
+  size_t i;
+
+  for (i = 0; i < idx->count; i++)
+    free (idx->msg[i].file_name);
+  free (idx->msg);
+  idx->msg = NULL;
+  idx->count = 0;
+}
+
+static int
+index_read (struct _amd_data *amd, mu_stream_t str, struct maildir_index *idx)
+{
+  char *buf = NULL;
+  size_t size = 0, n;
+  unsigned long v[5];
+  unsigned long count = 0;
+  size_t i = 0;
+  int state = 0;
+  int rc;
+
+  while ((rc = mu_stream_getline (str, &buf, &size, &n)) == 0 && n > 0)
+    {
+      if (buf[0] == '#')
+	continue;
+      switch (state)
+	{
+	case 0:
+	  if (sscanf (buf, "version %lu", &v[0]) != 1
+	      || v[0] != MAILDIR_INDEX_VERSION)
+	    rc = MU_ERR_PARSE;
+	  break;
+
+	case 1:
+	  if (sscanf (buf, "new %lu", &v[0]) != 1)
+	    rc = MU_ERR_PARSE;
+	  else
+	    idx->new_mtime = v[0];
+	  break;
+
+	case 2:
+	  if (sscanf (buf, "cur %lu", &v[0]) != 1)
+	    rc = MU_ERR_PARSE;
+	  else
+	    idx->cur_mtime = v[0];
+	  break;
+
+	case 3:
+	  if (sscanf (buf, "count %lu", &count) != 1)
+	    rc = MU_ERR_PARSE;
+	  else if (count)
+	    {
+	      idx->msg = calloc (count, sizeof (idx->msg[0]));
+	      if (!idx->msg)
+		rc = ENOMEM;
+	    }
+	  break;
+
+	default:
+	  {
+	    struct _maildir_message *msg = &idx->msg[i];
+	    int len;
+
+	    if (i == count
+		|| sscanf (buf, "%lu %lu %lu %lu %lu %n",
+			   &v[0], &v[1], &v[2], &v[3], &v[4], &len) != 5
+		|| v[0] > v[1]
+		|| buf[n - 1] != '\n'
+		|| len >= n - 1)
+	      {
+		rc = MU_ERR_PARSE;
+		break;
+	      }
+	    buf[n - 1] = 0;
+	    msg->file_name = strdup (buf + len);
+	    if (!msg->file_name)
+	      {
+		rc = ENOMEM;
+		break;
+	      }
+	    idx->count = ++i;
+	    msg->dir = CURSUF;
+	    msg->amd_message.body_start = v[0];
+	    msg->amd_message.body_end = v[1];
+	    msg->amd_message.header_lines = v[2];
+	    msg->amd_message.body_lines = v[3];
+	    msg->amd_message.mtime = v[4];
+	    msg->amd_message.amd = amd;
+	    if (i > 1
+		&& amd->msg_cmp (&msg[-1].amd_message, &msg->amd_message) >= 0)
+	      rc = MU_ERR_PARSE;
+	  }
+	}
+      if (rc)
+	break;
+      if (state < 4)
+	state++;
+    }
+  free (buf);
+
+  if (rc == 0 && (state < 4 || i != count))
+    rc = MU_ERR_PARSE;
+  return rc;
+}
+
+/* Load the index of AMD into IDX.  Return 0 on success, MU_ERR_NOENT
+   if the index is not enabled or does not exist, or another error code
+   if it is invalid. */
+int
+maildir_index_load (struct _amd_data *amd, struct maildir_index *idx)
+{
+  char *name;
+  mu_stream_t str;
+  int rc;
+
+  memset (idx, 0, sizeof (*idx));
+  rc = maildir_index_name (amd, &name);
+  if (rc)
+    return rc;
+  rc = mu_file_stream_create (&str, name, MU_STREAM_READ);
+  if (rc == 0)
+    {
+      rc = index_read (amd, str, idx);
+      mu_stream_destroy (&str);
+      if (rc)
+	{
+	  mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+		    ("ignoring invalid index %s", name));
+	  maildir_index_free (idx);
+	}
+      else
+	mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+		  ("loaded %lu messages from index %s",
+		   (unsigned long) idx->count, name));
+    }
+  else if (rc == ENOENT)
+    rc = MU_ERR_NOENT;
+  free (name);
+  return rc;
+}
+
+/* Copy the data from IDX to the messages of AMD that have not been
+   modified since the index was written.  Both the message array and
+   the index are sorted, so this takes a single pass over each. */
+int
+maildir_index_apply (struct _amd_data *amd, struct maildir_index *idx)
+{
+  size_t i = 0, j = 0;
+
+  while (i < amd->msg_count && j < idx->count)
+    {
+      struct _amd_message *mhm = amd->msg_array[i];
+      struct _amd_message *ent = &idx->msg[j].amd_message;
+      int rc = amd->msg_cmp (mhm, ent);
+
+      if (rc < 0)
+	i++;
+      else if (rc > 0)
+	j++;
+      else
+	{
+	  if (ent->body_end && mhm->body_end == 0)
+	    {
+	      char *name;
+	      struct stat st;
+
+	      rc = amd->cur_msg_file_name (mhm, &name);
+	      if (rc)
+		return rc;
+	      if (stat (name, &st) == 0
+		  && st.st_mtime == ent->mtime
+		  && st.st_size == ent->body_end)
+		{
+		  mhm->body_start = ent->body_start;
+		  mhm->body_end = ent->body_end;
+		  mhm->header_lines = ent->header_lines;
+		  mhm->body_lines = ent->body_lines;
+		  mhm->mtime = ent->mtime;
+		}
+	      free (name);
+	    }
+	  i++;
+	  j++;
+	}
+    }
+  return 0;
+}
+
+static int
+index_write (mu_stream_t str, void *data)
+{
+  struct _amd_data *amd = data;
+  struct _maildir_data *md = (struct _maildir_data *) amd;
+  size_t i, count = 0;
+
+  for (i = 0; i < amd->msg_count; i++)
+    {
+      struct _maildir_message *msg =
+	(struct _maildir_message *) amd->msg_array[i];
+      if (strcmp (msg->dir, CURSUF) == 0)
+	{
+	  if (strchr (msg->file_name, '\n'))
+	    return MU_ERR_FAILURE;
+	  count++;
+	}
+    }
+
+  mu_stream_printf (str, "# GNU Mailutils maildir index\n");
+  mu_stream_printf (str, "version %d\n", MAILDIR_INDEX_VERSION);
+  mu_stream_printf (str, "new %lu\n", (unsigned long) md->new_mtime);
+  mu_stream_printf (str, "cur %lu\n", (unsigned long) md->cur_mtime);
+  mu_stream_printf (str, "count %lu\n", (unsigned long) count);
+  for (i = 0; i < amd->msg_count && mu_stream_err (str) == 0; i++)
+    {
+      struct _maildir_message *msg =
+	(struct _maildir_message *) amd->msg_array[i];
+      struct _amd_message *mhm = &msg->amd_message;
+
+      if (strcmp (msg->dir, CURSUF))
+	continue;
+      if (mhm->body_end)
+	mu_stream_printf (str, "%lu %lu %lu %lu %lu %s\n",
+			  (unsigned long) mhm->body_start,
+			  (unsigned long) mhm->body_end,
+			  (unsigned long) mhm->header_lines,
+			  (unsigned long) mhm->body_lines,
+			  (unsigned long) mhm->mtime,
+			  msg->file_name);
+      else
+	mu_stream_printf (str, "0 0 0 0 0 %s\n", msg->file_name);
+    }
+  if (mu_stream_err (str))
+    return mu_stream_last_error (str);
+  return mu_stream_flush (str);
+}
+
+/* Write out the index for AMD, unless it is up to date. */
+int
+maildir_index_save (struct _amd_data *amd)
+{
+  struct _maildir_data *md = (struct _maildir_data *) amd;
+  char *name;
+  size_t i, known = 0;
+  int rc;
+
+  rc = maildir_index_name (amd, &name);
+  if (rc)
+    return rc == MU_ERR_NOENT ? 0 : rc;
+
+  /* If any of the directories has changed since the last scan, the
+     message list may be out of date.  Force rescanning them next time. */
+  if (maildir_dir_mtime (amd, NEWSUF) != md->new_mtime)
+    md->new_mtime = 0;
+  if (maildir_dir_mtime (amd, CURSUF) != md->cur_mtime)
+    md->cur_mtime = 0;
+
+  for (i = 0; i < amd->msg_count; i++)
+    if (amd->msg_array[i]->body_end)
+      known++;
+  if (md->idx_clean && md->new_mtime && md->cur_mtime
+      && known == md->idx_known)
+    {
+      free (name);
+      return 0;
+    }
+
+  rc = mu_tempfile_replace (name, index_write, amd);
+  if (rc)
+    mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+	      ("cannot write index %s: %s", name, mu_strerror (rc)));
+  else
+    {
+      md->idx_clean = 1;
+      md->idx_known = known;
+    }
+  free (name);
+  return rc;
+}
+
+#endif
@@ -23,3 +23,38 @@
 
 extern char *maildir_mkfilename (const char *dir, const char *suffix,
 				 const char *name);
+
+#include <mailutils/sys/amd.h>
+
+struct _maildir_message
+{
+  struct _amd_message amd_message;
+  char *dir;
+  char *file_name;
+  unsigned long uid;
+};
+
+struct _maildir_data
+{
+  struct _amd_data amd;
+  time_t new_mtime;      /* Modification times of new/ and cur/ at the */
+  time_t cur_mtime;      /* moment of the last scan, 0 if unreliable */
+  int idx_clean;         /* Index is up to date */
+  size_t idx_known;      /* Number of indexed messages with known sizes */
+};
+
+/* Contents of the maildir index file */
+struct maildir_index
+{
+  time_t new_mtime;
+  time_t cur_mtime;
+  size_t count;
+  struct _maildir_message *msg;
+};
+
+time_t maildir_dir_mtime (struct _amd_data *amd, const char *suffix);
+int maildir_index_name (struct _amd_data *amd, char **pname);
+int maildir_index_load (struct _amd_data *amd, struct maildir_index *idx);
+void maildir_index_free (struct maildir_index *idx);
+int maildir_index_apply (struct _amd_data *amd, struct maildir_index *idx);
+int maildir_index_save (struct _amd_data *amd);
@@ -74,14 +74,6 @@
 # define PATH_MAX _POSIX_PATH_MAX
 #endif
 
-struct _maildir_message
-{
-  struct _amd_message amd_message;
-  char *dir;
-  char *file_name;
-  unsigned long uid;
-};
-
 
 /* Attribute handling.
    FIXME: P (Passed) is not handled */
@@ -135,6 +127,18 @@ maildir_name_info_ptr (char *name)
   return NULL;
 }
 
+/* Set attributes of MSG from the info part of its file name */
+static void
+maildir_message_set_flags (struct _maildir_message *msg)
+{
+  char *p = maildir_name_info_ptr (msg->file_name);
+  if (p)
+    msg->amd_message.attr_flags = info_to_flags (p);
+  else
+    msg->amd_message.attr_flags = 0;
+  msg->amd_message.orig_flags = msg->amd_message.attr_flags;
+}
+
 
 static int
 maildir_message_cmp (struct _amd_message *a, struct _amd_message *b)
@@ -586,7 +590,6 @@ maildir_scan_dir (struct _amd_data *amd, DIR *dir, char *dirname)
 {
   struct dirent *entry;
   struct _maildir_message *msg, key;
-  char *p;
   size_t index;
   int rc = 0;
   int need_sort = 0;
@@ -619,13 +622,7 @@ maildir_scan_dir (struct _amd_data *amd, DIR *dir, char *dirname)
 	      
 	  msg->dir = dirname;
 	  msg->file_name = strdup (entry->d_name);
-
-	  p = maildir_name_info_ptr (msg->file_name);
-	  if (p)
-	    msg->amd_message.attr_flags = info_to_flags (p);
-	  else
-	    msg->amd_message.attr_flags = 0;
-	  msg->amd_message.orig_flags = msg->amd_message.attr_flags;
+	  maildir_message_set_flags (msg);
 	  need_sort = 1;
 	}
     }
@@ -635,17 +632,78 @@ maildir_scan_dir (struct _amd_data *amd, DIR *dir, char *dirname)
   return rc;
 }
 
+/* Return the most recent modification time of the maildir directory
+   and its new/ and cur/ subdirectories. */
+static time_t
+maildir_last_mtime (struct _amd_data *amd)
+{
+  static char *subdirs[] = { NEWSUF, CURSUF, NULL };
+  struct stat st;
+  time_t t = 0;
+  int i;
+
+  if (stat (amd->name, &st) == 0)
+    t = st.st_mtime;
+  for (i = 0; subdirs[i]; i++)
+    {
+      char *name = maildir_mkfilename (amd->name, subdirs[i], NULL);
+      if (stat (name, &st) == 0 && st.st_mtime > t)
+	t = st.st_mtime;
+      free (name);
+    }
+  return t;
+}
+
+/* Messages are delivered to new/ and renamed within cur/, which does
+   not affect the modification time of the maildir itself. */
+static int
+maildir_is_updated (struct _amd_data *amd)
+{
+  return amd->mtime == maildir_last_mtime (amd);
+}
+
+/* Fill the message list of AMD from the index IDX */
+static int
+maildir_scan_index (struct _amd_data *amd, struct maildir_index *idx)
+{
+  size_t i;
+  int rc;
+  
+  for (i = 0; i < idx->count; i++)
+    {
+      struct _maildir_message *msg = malloc (sizeof (*msg));
+      if (!msg)
+	return ENOMEM;
+      *msg = idx->msg[i];
+      rc = _amd_message_append (amd, (struct _amd_message *) msg);
+      if (rc)
+	{
+	  free (msg);
+	  return rc;
+	}
+      maildir_message_set_flags (msg);
+      if (msg->amd_message.body_end)
+	((struct _maildir_data *) amd)->idx_known++;
+      /* The file name is owned by the message now */
+      idx->msg[i].file_name = NULL;
+    }
+  return 0;
+}
+
 static int
 maildir_scan0 (mu_mailbox_t mailbox, size_t msgno MU_ARG_UNUSED,
 	       size_t *pcount, 
 	       int do_notify)
 {
   struct _amd_data *amd = mailbox->data;
+  struct _maildir_data *md = mailbox->data;
   DIR *dir;
   int status = 0;
   char *name;
   struct stat st;
   size_t i;
+  struct maildir_index idx;
+  int use_index = 0;
   
   if (amd == NULL)
     return EINVAL;
@@ -653,33 +711,58 @@ maildir_scan0 (mu_mailbox_t mailbox, size_t msgno MU_ARG_UNUSED,
     return 0;
   mu_monitor_wrlock (mailbox->monitor);
 
+  /* The index is used only when the mailbox is scanned for the first
+     time. */
+  if (amd->msg_count == 0)
+    use_index = maildir_index_load (amd, &idx) == 0;
+  md->idx_clean = use_index;
+  md->idx_known = 0;
+  
   /* 1st phase: Flush tmp/ */
   maildir_flush (amd);
 
   /* 2nd phase: Scan and deliver messages from new */
   name = maildir_mkfilename (amd->name, NEWSUF, NULL);
 
-  status = maildir_opendir (&dir, name,
-			    PERMS |
-			    mu_stream_flags_to_mode (mailbox->flags, 1));
-  if (status == 0)
+  if (use_index && stat (name, &st) == 0 && st.st_mtime == idx.new_mtime)
+    /* Nothing has been delivered since the index was written */;
+  else
     {
-      maildir_deliver_new (amd, dir);
-      closedir (dir);
+      md->idx_clean = 0;
+      status = maildir_opendir (&dir, name,
+				PERMS |
+				mu_stream_flags_to_mode (mailbox->flags, 1));
+      if (status == 0)
+	{
+	  maildir_deliver_new (amd, dir);
+	  closedir (dir);
+	}
     }
   free (name);
 
   name = maildir_mkfilename (amd->name, CURSUF, NULL);
   /* 3rd phase: Scan cur/ */
-  status = maildir_opendir (&dir, name,
-			    PERMS |
-			    mu_stream_flags_to_mode (mailbox->flags, 1));
-  if (status == 0)
+  if (md->idx_clean && stat (name, &st) == 0 && st.st_mtime == idx.cur_mtime)
+    status = maildir_scan_index (amd, &idx);
+  else
     {
-      status = maildir_scan_dir (amd, dir, CURSUF);
-      closedir (dir);
+      md->idx_clean = 0;
+      status = maildir_opendir (&dir, name,
+				PERMS |
+				mu_stream_flags_to_mode (mailbox->flags, 1));
+      if (status == 0)
+	{
+	  status = maildir_scan_dir (amd, dir, CURSUF);
+	  closedir (dir);
+	}
+      if (status == 0 && use_index)
+	status = maildir_index_apply (amd, &idx);
     }
   free (name);
+  if (use_index)
+    maildir_index_free (&idx);
+  md->new_mtime = maildir_dir_mtime (amd, NEWSUF);
+  md->cur_mtime = maildir_dir_mtime (amd, CURSUF);
 
   for (i = 1; i <= amd->msg_count; i++)
     {
@@ -690,8 +773,7 @@ maildir_scan0 (mu_mailbox_t mailbox, size_t msgno MU_ARG_UNUSED,
 	DISPATCH_ADD_MSG (mailbox, amd, i);
     }
   
-  if (stat (amd->name, &st) == 0)
-    amd->mtime = st.st_mtime;
+  amd->mtime = maildir_last_mtime (amd);
 
   if (pcount)
     *pcount = amd->msg_count;
@@ -707,7 +789,6 @@ maildir_qfetch (struct _amd_data *amd, mu_message_qid_t qid)
 {
   struct _maildir_message *msg;
   char *name = strrchr (qid, '/');
-  char *p;
   char *dir;
   
   if (!name)
@@ -727,13 +808,7 @@ maildir_qfetch (struct _amd_data *amd, mu_message_qid_t qid)
   msg = calloc (1, sizeof(*msg));
   msg->file_name = strdup (name);
   msg->dir = dir;
-  
-  p = maildir_name_info_ptr (msg->file_name);
-  if (p)
-    msg->amd_message.attr_flags = info_to_flags (p);
-  else
-    msg->amd_message.attr_flags = 0;
-  msg->amd_message.orig_flags = msg->amd_message.attr_flags;
+  maildir_message_set_flags (msg);
   msg->uid = amd->next_uid (amd);
   _amd_message_insert (amd, (struct _amd_message*) msg);
   return 0;
@@ -809,6 +884,12 @@ maildir_chattr_msg (struct _amd_message *amsg, int expunge)
   return rc;
 }
 
+static int
+maildir_close (struct _amd_data *amd)
+{
+  return maildir_index_save (amd);
+}
+
      
 int
 _mailbox_maildir_init (mu_mailbox_t mailbox)
@@ -816,7 +897,7 @@ _mailbox_maildir_init (mu_mailbox_t mailbox)
   int rc;
   struct _amd_data *amd;
 
-  rc = amd_init_mailbox (mailbox, sizeof (struct _amd_data), &amd);
+  rc = amd_init_mailbox (mailbox, sizeof (struct _maildir_data), &amd);
   if (rc)
     return rc;
 
@@ -834,6 +915,8 @@ _mailbox_maildir_init (mu_mailbox_t mailbox)
   amd->next_uid = maildir_next_uid;
   amd->remove = maildir_remove;
   amd->chattr_msg = maildir_chattr_msg;
+  amd->close = maildir_close;
+  amd->is_updated = maildir_is_updated;
   amd->capabilities = MU_AMD_STATUS;
   
   /* Set our properties.  */
@@ -435,6 +435,29 @@ _rcpt_to_addr (mu_smtp_t smtp, mu_address_t addr, size_t *pcount)
   return status;
 }
 
+/* Collect the replies to pipelined MAIL and RCPT commands.  Return
+   MU_ERR_REPLY if the sender or all recipients were rejected. */
+static int
+_smtp_pipeline_replies (mu_smtp_t smtp)
+{
+  int status, rc;
+  size_t rcpt_cnt = 0;
+
+  rc = mu_smtp_pipeline_reply (smtp);
+  if (rc && rc != MU_ERR_REPLY)
+    return rc;
+  while ((status = mu_smtp_pipeline_reply (smtp)) != MU_ERR_NOENT)
+    {
+      if (status == 0)
+	rcpt_cnt++;
+      else if (status != MU_ERR_REPLY)
+	return status;
+    }
+  if (rc)
+    return rc;
+  return rcpt_cnt ? 0 : MU_ERR_REPLY;
+}
+
 static int
 smtp_send_message (mu_mailer_t mailer, mu_message_t msg,
 		   mu_address_t argfrom, mu_address_t argto)
@@ -443,6 +466,8 @@ smtp_send_message (mu_mailer_t mailer, mu_message_t msg,
   mu_smtp_t smtp;
   int status;
   size_t size, lines, count;
+  size_t msgsize = 0;
+  int use_size = 0, pipeline;
   const char *mail_from, *size_str;
   mu_header_t     header;
       
@@ -469,7 +494,7 @@ smtp_send_message (mu_mailer_t mailer, mu_message_t msg,
       mu_message_size (msg, &size) == 0 &&
       mu_message_lines (msg, &lines) == 0)
     {
-      size_t msgsize = size + lines;
+      msgsize = size + lines;
       if (strncmp (size_str, "SIZE ", 5) == 0)
 	{
 	  size_t maxsize = strtoul (size_str + 5, NULL, 10);
@@ -477,10 +502,17 @@ smtp_send_message (mu_mailer_t mailer, mu_message_t msg,
 	  if (msgsize && maxsize && msgsize > maxsize)
 	    return EFBIG;
 	}
-      status = mu_smtp_mail_basic (smtp, mail_from,
-				   "SIZE=%lu",
-				   (unsigned long) msgsize);
+      use_size = 1;
     }
+
+  /* If the server supports pipelining, send MAIL and all RCPT commands
+     at once and collect the replies afterwards. */
+  pipeline = mu_smtp_pipeline_begin (smtp) == 0;
+  
+  if (use_size)
+    status = mu_smtp_mail_basic (smtp, mail_from,
+				 "SIZE=%lu",
+				 (unsigned long) msgsize);
   else
     status = mu_smtp_mail_basic (smtp, mail_from, NULL);
   if (status)
@@ -505,6 +537,17 @@ smtp_send_message (mu_mailer_t mailer, mu_message_t msg,
       return status;
     }
 
+  if (pipeline)
+    {
+      status = _smtp_pipeline_replies (smtp);
+      if (status)
+	{
+	  if (status == MU_ERR_REPLY)
+	    mu_smtp_rset (smtp);
+	  return status;
+	}
+    }
+
   if (mu_header_sget_value (header, MU_HEADER_BCC, NULL) == 0||
       mu_header_sget_value (header, MU_HEADER_FCC, NULL) == 0)
     {
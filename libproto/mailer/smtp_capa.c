@@ -42,3 +42,12 @@ mu_smtp_capa_test (mu_smtp_t smtp, const char *name, const char **pret)
     return MU_ERR_FAILURE;
   return mu_list_locate (smtp->capa, (void*) name, (void**)pret);
 }
+
+/* Return true if the server has advertised capability NAME.  Unlike
+   mu_smtp_capa_test, never issues EHLO. */
+int
+_mu_smtp_capa_p (mu_smtp_t smtp, const char *name)
+{
+  return smtp->capa && MU_SMTP_FISSET (smtp, _MU_SMTP_ESMTP)
+         && mu_list_locate (smtp->capa, (void*) name, NULL) == 0;
+}
@@ -59,6 +59,7 @@ mu_smtp_destroy (mu_smtp_t *psmtp)
   free (smtp->rdbuf);
   free (smtp->flbuf);
   mu_list_destroy (&smtp->mlrepl);
+  free (smtp->pipeq);
 
   mu_list_destroy (&smtp->authmech);
   if (smtp->secret)
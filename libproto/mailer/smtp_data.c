@@ -30,19 +30,10 @@
 #include <mailutils/sys/stream.h>
 #include <mailutils/sys/smtp.h>
 
-int
-_mu_smtp_data_begin (mu_smtp_t smtp)
+/* Prepare the carrier for sending the message text */
+void
+_mu_smtp_payload_begin (mu_smtp_t smtp)
 {
-  int status;
-  
-  status = mu_smtp_write (smtp, "DATA\r\n");
-  MU_SMTP_CHECK_ERROR (smtp, status);
-  status = mu_smtp_response (smtp);
-  MU_SMTP_CHECK_ERROR (smtp, status);
-  
-  if (smtp->replcode[0] != '3')
-    return MU_ERR_REPLY;
-  
   if (mu_smtp_trace_mask (smtp, MU_SMTP_TRACE_QRY, MU_XSCRIPT_PAYLOAD))
     _mu_smtp_xscript_level (smtp, MU_XSCRIPT_PAYLOAD);
 
@@ -58,6 +49,22 @@ _mu_smtp_data_begin (mu_smtp_t smtp)
 			   MU_IOCTL_OP_SET, &newbuf) == 0)
 	MU_SMTP_FSET (smtp, _MU_SMTP_SAVEBUF);
     }
+}
+
+int
+_mu_smtp_data_begin (mu_smtp_t smtp)
+{
+  int status;
+  
+  status = mu_smtp_write (smtp, "DATA\r\n");
+  MU_SMTP_CHECK_ERROR (smtp, status);
+  status = mu_smtp_response (smtp);
+  MU_SMTP_CHECK_ERROR (smtp, status);
+  
+  if (smtp->replcode[0] != '3')
+    return MU_ERR_REPLY;
+
+  _mu_smtp_payload_begin (smtp);
   return 0;
 }
 
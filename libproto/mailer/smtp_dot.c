@@ -31,7 +31,7 @@
 int
 mu_smtp_dot (mu_smtp_t smtp)
 {
-  int status;
+  int status, rc = 0;
   
   if (!smtp)
     return EINVAL;
@@ -39,10 +39,20 @@ mu_smtp_dot (mu_smtp_t smtp)
     return MU_ERR_FAILURE;
   if (smtp->state != MU_SMTP_DOT)
     return MU_ERR_SEQ;
+  /* Collect replies to pipelined BDAT chunks, if any */
+  while ((status = mu_smtp_pipeline_reply (smtp)) != MU_ERR_NOENT)
+    {
+      if (status == MU_ERR_REPLY)
+	rc = status;
+      else if (status)
+	return status;
+    }
   status = mu_smtp_response (smtp);
   MU_SMTP_CHECK_ERROR (smtp, status);
   if (smtp->replcode[0] != '2')
     return MU_ERR_REPLY;
+  if (rc)
+    return rc;
   smtp->state = MU_SMTP_MAIL; /* FIXME: Force _EHLO perhaps? */
   return 0;
 }
@@ -55,6 +55,13 @@ mu_smtp_mail_basic (mu_smtp_t smtp, const char *email, const char *fmt, ...)
     }
   status = mu_smtp_write (smtp, "\r\n");
   MU_SMTP_CHECK_ERROR (smtp, status);
+  if (MU_SMTP_FISSET (smtp, _MU_SMTP_PIPE))
+    {
+      status = _mu_smtp_pipeq_add (smtp, _MU_SMTP_PIPE_MAIL);
+      MU_SMTP_CHECK_ERROR (smtp, status);
+      smtp->state = MU_SMTP_RCPT;
+      return 0;
+    }
   status = mu_smtp_response (smtp);
   MU_SMTP_CHECK_ERROR (smtp, status);
 
@@ -0,0 +1,100 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or modify
+   it under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Command pipelining (RFC 2920).
+
+   After a successful call to mu_smtp_pipeline_begin, mu_smtp_mail_basic
+   and mu_smtp_rcpt_basic send their commands without waiting for the
+   replies.  The replies are then obtained, in the order the commands
+   were sent, by calling mu_smtp_pipeline_reply until it returns
+   MU_ERR_NOENT.  The first call to mu_smtp_pipeline_reply ends the
+   pipeline. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <mailutils/errno.h>
+#include <mailutils/smtp.h>
+#include <mailutils/stream.h>
+#include <mailutils/sys/smtp.h>
+
+int
+_mu_smtp_pipeq_add (mu_smtp_t smtp, int cmd)
+{
+  if (smtp->pipeq_cnt == smtp->pipeq_max)
+    {
+      size_t n = smtp->pipeq_max ? 2 * smtp->pipeq_max : 16;
+      char *p = realloc (smtp->pipeq, n);
+      if (!p)
+	return ENOMEM;
+      smtp->pipeq = p;
+      smtp->pipeq_max = n;
+    }
+  smtp->pipeq[smtp->pipeq_cnt++] = cmd;
+  return 0;
+}
+
+int
+mu_smtp_pipeline_begin (mu_smtp_t smtp)
+{
+  if (!smtp)
+    return EINVAL;
+  if (MU_SMTP_FISSET (smtp, _MU_SMTP_ERR))
+    return MU_ERR_FAILURE;
+  if (smtp->pipeq_cnt)
+    return MU_ERR_SEQ;
+  if (!_mu_smtp_capa_p (smtp, "PIPELINING"))
+    return ENOSYS;
+  MU_SMTP_FSET (smtp, _MU_SMTP_PIPE);
+  return 0;
+}
+
+int
+mu_smtp_pipeline_reply (mu_smtp_t smtp)
+{
+  int status, cmd;
+
+  if (!smtp)
+    return EINVAL;
+  if (MU_SMTP_FISSET (smtp, _MU_SMTP_ERR))
+    return MU_ERR_FAILURE;
+  if (MU_SMTP_FISSET (smtp, _MU_SMTP_PIPE))
+    {
+      MU_SMTP_FCLR (smtp, _MU_SMTP_PIPE);
+      status = mu_stream_flush (smtp->carrier);
+      MU_SMTP_CHECK_ERROR (smtp, status);
+    }
+  if (smtp->pipeq_pos == smtp->pipeq_cnt)
+    return MU_ERR_NOENT;
+  cmd = smtp->pipeq[smtp->pipeq_pos++];
+  if (smtp->pipeq_pos == smtp->pipeq_cnt)
+    smtp->pipeq_pos = smtp->pipeq_cnt = 0;
+
+  status = mu_smtp_response (smtp);
+  MU_SMTP_CHECK_ERROR (smtp, status);
+  if (smtp->replcode[0] != '2')
+    {
+      if (cmd == _MU_SMTP_PIPE_MAIL)
+	smtp->state = MU_SMTP_MAIL;
+      return MU_ERR_REPLY;
+    }
+  if (cmd == _MU_SMTP_PIPE_RCPT && smtp->state == MU_SMTP_RCPT)
+    smtp->state = MU_SMTP_MORE;
+  return 0;
+}
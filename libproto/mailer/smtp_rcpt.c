@@ -54,6 +54,13 @@ mu_smtp_rcpt_basic (mu_smtp_t smtp, const char *email, const char *fmt, ...)
     }
   status = mu_smtp_write (smtp, "\r\n");
   MU_SMTP_CHECK_ERROR (smtp, status);
+  if (MU_SMTP_FISSET (smtp, _MU_SMTP_PIPE))
+    {
+      /* The state changes to MU_SMTP_MORE when the reply is received */
+      status = _mu_smtp_pipeq_add (smtp, _MU_SMTP_PIPE_RCPT);
+      MU_SMTP_CHECK_ERROR (smtp, status);
+      return 0;
+    }
   status = mu_smtp_response (smtp);
   MU_SMTP_CHECK_ERROR (smtp, status);
 
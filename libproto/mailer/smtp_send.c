@@ -41,12 +41,131 @@ _smtp_data_send (mu_smtp_t smtp, mu_stream_t stream)
   return status;
 }
 
+/* Chunking (RFC 3030) */
+
+#define BDAT_CHUNK_SIZE (64*1024)
+
+/* Read from STR until SIZE bytes are read or end of file is reached. */
+static int
+_smtp_fill (mu_stream_t str, char *buf, size_t size, size_t *pn)
+{
+  size_t total = 0;
+
+  while (total < size)
+    {
+      size_t n;
+      int status = mu_stream_read (str, buf + total, size - total, &n);
+      if (status)
+	return status;
+      if (n == 0)
+	break;
+      total += n;
+    }
+  *pn = total;
+  return 0;
+}
+
+static int
+_smtp_bdat_chunk (mu_smtp_t smtp, const char *buf, size_t size, int last)
+{
+  int status;
+  int xlev = _mu_smtp_xscript_level (smtp, MU_XSCRIPT_NORMAL);
+  
+  status = mu_smtp_write (smtp, "BDAT %lu%s\r\n", (unsigned long) size,
+			  last ? " LAST" : "");
+  _mu_smtp_xscript_level (smtp, xlev);
+  MU_SMTP_CHECK_ERROR (smtp, status);
+  status = mu_stream_write (smtp->carrier, buf, size, NULL);
+  MU_SMTP_CHECK_ERROR (smtp, status);
+  if (last)
+    return mu_stream_flush (smtp->carrier);
+
+  /* Replies to intermediate chunks are collected by mu_smtp_dot if
+     the server supports pipelining. */
+  if (_mu_smtp_capa_p (smtp, "PIPELINING"))
+    return _mu_smtp_pipeq_add (smtp, _MU_SMTP_PIPE_BDAT);
+  
+  status = mu_stream_flush (smtp->carrier);
+  MU_SMTP_CHECK_ERROR (smtp, status);
+  xlev = _mu_smtp_xscript_level (smtp, MU_XSCRIPT_NORMAL);
+  status = mu_smtp_response (smtp);
+  _mu_smtp_xscript_level (smtp, xlev);
+  MU_SMTP_CHECK_ERROR (smtp, status);
+  if (smtp->replcode[0] != '2')
+    return MU_ERR_REPLY;
+  return 0;
+}
+
+/* Send STREAM in a series of BDAT commands.  The message is converted
+   to CRLF form, but no dot-stuffing is necessary.  Each chunk is read
+   ahead of sending the previous one, so that the latter can be marked
+   as LAST if needed. */
+static int
+_smtp_bdat_send (mu_smtp_t smtp, mu_stream_t stream)
+{
+  int status;
+  char *buf[2];
+  size_t len[2];
+  int i = 0;
+  
+  /* Each buffer holds a chunk, the CR carried over from the previous
+     one and the terminating newline. */
+  buf[0] = malloc (2 * (BDAT_CHUNK_SIZE + 2));
+  if (!buf[0])
+    return ENOMEM;
+  buf[1] = buf[0] + BDAT_CHUNK_SIZE + 2;
+
+  _mu_smtp_payload_begin (smtp);
+  
+  status = _smtp_fill (stream, buf[0], BDAT_CHUNK_SIZE, &len[0]);
+  while (status == 0)
+    {
+      int j = !i;
+      size_t off = 0;
+
+      /* Don't split the CRLF pair between chunks: some servers wait
+	 for the LF before acknowledging the chunk. */
+      if (len[i] && buf[i][len[i] - 1] == '\r')
+	{
+	  buf[j][0] = '\r';
+	  len[i]--;
+	  off = 1;
+	}
+      status = _smtp_fill (stream, buf[j] + off, BDAT_CHUNK_SIZE, &len[j]);
+      if (status)
+	break;
+      if (len[j] == 0)
+	{
+	  len[i] += off;
+	  if (off)
+	    /* The message ends in a bare CR */
+	    buf[i][len[i]++] = '\n';
+	  else if (len[i] && buf[i][len[i] - 1] != '\n')
+	    {
+	      buf[i][len[i]++] = '\r';
+	      buf[i][len[i]++] = '\n';
+	    }
+	  status = _smtp_bdat_chunk (smtp, buf[i], len[i], 1);
+	  break;
+	}
+      len[j] += off;
+      status = _smtp_bdat_chunk (smtp, buf[i], len[i], 0);
+      i = j;
+    }
+  
+  free (buf[0]);
+  _mu_smtp_data_end (smtp);
+  if (status == MU_ERR_REPLY)
+    smtp->state = MU_SMTP_MAIL;
+  return status;
+}
 
 int
 mu_smtp_send_stream (mu_smtp_t smtp, mu_stream_t stream)
 {
   int status;
   mu_stream_t input;
+  int bdat;
   
   if (!smtp)
     return EINVAL;
@@ -55,12 +174,16 @@ mu_smtp_send_stream (mu_smtp_t smtp, mu_stream_t stream)
   if (smtp->state != MU_SMTP_MORE)
     return MU_ERR_SEQ;
 
-  status = mu_filter_create (&input, stream, "CRLFDOT", MU_FILTER_ENCODE,
-			     MU_STREAM_READ);
+  bdat = _mu_smtp_capa_p (smtp, "CHUNKING");
+  status = mu_filter_create (&input, stream, bdat ? "CRLF" : "CRLFDOT",
+			     MU_FILTER_ENCODE, MU_STREAM_READ);
   if (status)
     return status;
-  
-  status = _smtp_data_send (smtp, input);
+
+  if (bdat)
+    status = _smtp_bdat_send (smtp, input);
+  else
+    status = _smtp_data_send (smtp, input);
   mu_stream_destroy (&input);
   return status;
 }
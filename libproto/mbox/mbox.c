@@ -42,24 +42,14 @@ mbox_destroy (mu_mailbox_t mailbox)
 {
   if (mailbox->data)
     {
-      size_t i;
       mbox_data_t mud = mailbox->data;
       mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
 		("mbox_destroy (%s)", mud->name));
       mu_monitor_wrlock (mailbox->monitor);
-      for (i = 0; i < mud->umessages_count; i++)
-	{
-	  mbox_message_t mum = mud->umessages[i];
-	  if (mum)
-	    {
-	      mu_message_destroy (&mum->message, mum);
-	      free (mum);
-	    }
-	}
-      if (mud->umessages)
-	free (mud->umessages);
+      mbox_free_messages (mud);
       if (mud->name)
 	free (mud->name);
+      free (mud->idxname);
       free (mud);
       mailbox->data = NULL;
       mu_monitor_unlock (mailbox->monitor);
@@ -82,9 +72,11 @@ mbox_open (mu_mailbox_t mailbox, int flags)
   /* Get a stream.  */
   if (mailbox->stream == NULL)
     {
-      /* We do not try to mmap for CREAT or APPEND, it is not supported.  */
+      /* We do not try to mmap for CREAT or APPEND, it is not supported.
+	 The "nommap" URL parameter disables it as well.  */
       status = (flags & MU_STREAM_CREAT)
-	          || (mailbox->flags & MU_STREAM_APPEND);
+	          || (mailbox->flags & MU_STREAM_APPEND)
+	          || mu_url_sget_param (mailbox->url, "nommap", NULL) == 0;
 
       /* Try to mmap () the file first.  */
       if (status == 0)
@@ -117,7 +109,6 @@ static int
 mbox_close (mu_mailbox_t mailbox)
 {
   mbox_data_t mud = mailbox->data;
-  size_t i; 
 
   if (mud == NULL)
     return EINVAL;
@@ -140,20 +131,7 @@ mbox_close (mu_mailbox_t mailbox)
   /* Before closing we need to remove all the messages
      - to reclaim the memory
      - to prepare for another scan.  */
-  for (i = 0; i < mud->umessages_count; i++)
-    {
-      mbox_message_t mum = mud->umessages[i];
-      /* Destroy attached messages.  */
-      if (mum)
-	{
-	  mu_message_destroy (&(mum->message), mum);
-	  free (mum);
-	}
-    }
-  if (mud->umessages)
-    free (mud->umessages);
-  mud->umessages = NULL;
-  mud->messages_count = mud->umessages_count = 0;
+  mbox_free_messages (mud);
   mud->size = 0;
   mud->uidvalidity = 0;
   mud->uidnext = 0;
@@ -261,6 +239,32 @@ mbox_message_qid (mu_message_t msg, mu_message_qid_t *pqid)
   return mu_asprintf (pqid, "%lu", (unsigned long) mum->envel_from);
 }
 
+/* Return the X-UIDL value found by the scanner or loaded from the index.
+   If there is none, or the header has been modified since, fail, so that
+   mu_message_get_uidl falls back to the header. */
+static int
+mbox_message_uidl (mu_message_t msg, char *buffer, size_t buflen,
+		   size_t *pwriten)
+{
+  mbox_message_t mum = mu_message_get_owner (msg);
+  mu_header_t header;
+  size_t n;
+
+  if (!mum->uidl)
+    return MU_ERR_NOENT;
+  if (mu_message_get_header (msg, &header) == 0
+      && mu_header_is_modified (header))
+    return MU_ERR_NOENT;
+  n = strlen (mum->uidl);
+  if (n >= buflen)
+    n = buflen - 1;
+  memcpy (buffer, mum->uidl, n);
+  buffer[n] = 0;
+  if (pwriten)
+    *pwriten = n;
+  return 0;
+}
+
 
 /* Mbox message headers */
 
@@ -568,6 +572,7 @@ new_message (mu_mailbox_t mailbox, mbox_message_t mum, mu_message_t *pmsg)
   /* Set the UID.  */
   mu_message_set_uid (msg, mbox_message_uid, mum);
   mu_message_set_qid (msg, mbox_message_qid, mum);
+  mu_message_set_uidl (msg, mbox_message_uidl, mum);
   
   /* Attach the message to the mailbox mbox data.  */
   mum->message = msg;
@@ -1032,13 +1037,83 @@ uid_to_stream (mu_stream_t ostr, mu_message_t msg, mbox_data_t mud, int flags)
   return 0;
 }
 
+/* Verbatim body copying.
+
+   If the message body is kept in a file and contains no lines beginning
+   with "From ", it needs no escaping and can be copied to the mailbox
+   file by the kernel (see mu_stream_copy), without passing it through
+   the FROM filter. */
+
+static int
+_scan_from_line (const char *ptr, size_t size, void *data)
+{
+  static char from[] = "From ";
+  const char *end = ptr + size;
+
+  if (size >= 5 && memcmp (ptr, from, 5) == 0)
+    return MU_ERR_FAILURE;
+  while ((ptr = memchr (ptr, '\n', end - ptr)) != NULL)
+    {
+      ptr++;
+      if (end - ptr < 5)
+	break;
+      if (memcmp (ptr, from, 5) == 0)
+	return MU_ERR_FAILURE;
+    }
+  return 0;
+}
+
+/* Return the body stream of MSG in *PSTR, if it can be copied verbatim */
+static int
+body_verbatim_stream (mu_message_t msg, mu_stream_t *pstr)
+{
+  mu_body_t body;
+  mu_stream_t str;
+  int status;
+  
+  status = mu_message_get_body (msg, &body);
+  if (status)
+    return status;
+  status = mu_body_get_streamref (body, &str);
+  if (status)
+    return status;
+  status = mu_stream_fd_scan (str, _scan_from_line, NULL);
+  if (status)
+    mu_stream_destroy (&str);
+  else
+    *pstr = str;
+  return status;
+}
+
+/* Copy the body stream ISTR to the current position of OSTR.  If the
+   descriptor underlying OSTR is open for appending, the kernel copy is
+   not possible, so the flag is cleared for the duration of the copy.
+   The caller must hold the mailbox lock and OSTR must be positioned at
+   its end. */
+static int
+copy_body_verbatim (mu_stream_t ostr, mu_stream_t istr)
+{
+  struct mu_fd_segment seg;
+  int fl = -1;
+  int status;
+  
+  if (mu_stream_ioctl (ostr, MU_IOCTL_FD, MU_IOCTL_FD_GET_SEGMENT, &seg) == 0
+      && (fl = fcntl (seg.fd, F_GETFL)) != -1
+      && (!(fl & O_APPEND) || fcntl (seg.fd, F_SETFL, fl & ~O_APPEND)))
+    fl = -1;
+  status = mu_stream_copy (ostr, istr, 0, NULL);
+  if (fl != -1)
+    fcntl (seg.fd, F_SETFL, fl);
+  return status;
+}
+
 /* Append MSG to stream OSTR in its current position */
 static int
 append_message_to_stream (mu_stream_t ostr, mu_message_t msg,
 			  mbox_data_t mud, int flags)
 {
   int status;
-  mu_stream_t istr, flt;
+  mu_stream_t istr, flt, bstr = NULL;
   
   status = msg_envelope_to_stream (ostr, msg);
   if (status)
@@ -1076,12 +1151,31 @@ append_message_to_stream (mu_stream_t ostr, mu_message_t msg,
       if (status)
 	return status;
       
-      status = mu_message_get_body (msg, &body);
-      if (status)
-	return status;
-      status = mu_body_get_streamref (body, &istr);
+      if (body_verbatim_stream (msg, &bstr) == 0)
+	istr = NULL;
+      else
+	{
+	  status = mu_message_get_body (msg, &body);
+	  if (status)
+	    return status;
+	  status = mu_body_get_streamref (body, &istr);
+	  if (status)
+	    return status;
+	}
+    }
+  else if (body_verbatim_stream (msg, &bstr) == 0)
+    {
+      /* Only the header needs filtering */
+      mu_header_t hdr;
+      
+      status = mu_message_get_header (msg, &hdr);
+      if (status == 0)
+	status = mu_header_get_streamref (hdr, &istr);
       if (status)
-	return status;
+	{
+	  mu_stream_destroy (&bstr);
+	  return status;
+	}
     }
   else
     {
@@ -1090,16 +1184,25 @@ append_message_to_stream (mu_stream_t ostr, mu_message_t msg,
 	return status;
     }
 
-  status = mu_filter_create (&flt, istr, "FROM",
-			     MU_FILTER_ENCODE, MU_STREAM_READ);
-  mu_stream_unref (istr);
-  if (status == 0)
+  if (istr)
+    {
+      status = mu_filter_create (&flt, istr, "FROM",
+				 MU_FILTER_ENCODE, MU_STREAM_READ);
+      mu_stream_unref (istr);
+      if (status == 0)
+	{
+	  status = mu_stream_copy (ostr, flt, 0, NULL);
+	  mu_stream_destroy (&flt);
+	}
+    }
+  if (bstr)
     {
-      status = mu_stream_copy (ostr, flt, 0, NULL);
-      mu_stream_destroy (&flt);
       if (status == 0)
-	status = mu_stream_write (ostr, "\n", 1, NULL);
+	status = copy_body_verbatim (ostr, bstr);
+      mu_stream_destroy (&bstr);
     }
+  if (status == 0)
+    status = mu_stream_write (ostr, "\n", 1, NULL);
   
   return status;
 }
@@ -1154,29 +1257,95 @@ mbox_append_message (mu_mailbox_t mailbox, mu_message_t msg)
 }
 
 
+/* Rescan the mailbox after it has been rewritten starting from the
+   message number DIRTY (0-based).  Preceding messages are left intact. */
 static void
-mbox_reset (mu_mailbox_t mailbox)
+mbox_reset (mu_mailbox_t mailbox, size_t dirty)
 {
   mbox_data_t mud = mailbox->data;
   size_t i;
 
   mu_monitor_wrlock (mailbox->monitor);
-  for (i = 0; i < mud->messages_count; i++)
+  for (i = dirty; i < mud->messages_count; i++)
     {
       /* Clear all the references */
       mbox_message_t mum = mud->umessages[i];
+      mu_off_t envel_from = mum->envel_from;
       mu_message_destroy (&mum->message, mum);
       memset (mum, 0, sizeof (*mum));
-      mum->envel_from = mum->envel_from_end = 0;
-      mum->body = mum->body_end = 0;
-      mum->header_lines = mum->body_lines = 0;
+      /* The first rewritten message starts at the same offset */
+      if (i == dirty)
+	mum->envel_from = envel_from;
     }
   mu_monitor_unlock (mailbox->monitor);
   /* This resets the messages_count, the last argument 0 means
      not to send event notification.  */
-  mbox_scan0 (mailbox, 1, NULL, 0);
+  mbox_scan0 (mailbox, dirty + 1, NULL, 0);
 }
 
+/* Size of the buffer used to move data within the mailbox */
+#define MBOX_MOVE_BUFSIZE (1024*1024)
+
+/* Move LEN bytes from offset FROM to offset TO within STREAM.  TO must
+   not be greater than FROM. */
+static int
+mbox_move_block (mu_stream_t stream, mu_off_t to, mu_off_t from,
+		 mu_off_t len)
+{
+  char *buf;
+  size_t bufsize = MBOX_MOVE_BUFSIZE;
+  int status = 0;
+
+  if (to == from || len == 0)
+    return 0;
+  if (bufsize > len)
+    bufsize = len;
+  buf = malloc (bufsize);
+  if (!buf)
+    return ENOMEM;
+  while (len > 0)
+    {
+      size_t n = len < bufsize ? len : bufsize;
+
+      status = mu_stream_seek (stream, from, MU_SEEK_SET, NULL);
+      if (status)
+	break;
+      status = mu_stream_read (stream, buf, n, NULL);
+      if (status)
+	break;
+      status = mu_stream_seek (stream, to, MU_SEEK_SET, NULL);
+      if (status)
+	break;
+      status = mu_stream_write (stream, buf, n, NULL);
+      if (status)
+	break;
+      from += n;
+      to += n;
+      len -= n;
+    }
+  free (buf);
+  return status;
+}
+
+/* Reset the temporary stream */
+static int
+tempstr_reset (mu_stream_t tempstr)
+{
+  int status = mu_stream_truncate (tempstr, 0);
+  if (status == 0)
+    status = mu_stream_seek (tempstr, 0, MU_SEEK_SET, NULL);
+  return status;
+}
+
+/* Rewrite the mailbox starting from the message DIRTY.
+
+   As long as possible, the mailbox is rewritten in place: unmodified
+   messages are moved towards the beginning of the file with large block
+   copies, and modified ones are formatted in TEMPSTR and written back
+   at the current write position.  This works as long as the write
+   position stays below the data that have not been read yet.  If a
+   modified message grows so that this condition breaks, the rest of the
+   mailbox is accumulated in TEMPSTR and copied back at the end. */
 static int
 mbox_expunge_unlocked (mu_mailbox_t mailbox, size_t dirty, int remove_deleted,
 		       mu_stream_t tempstr)
@@ -1185,16 +1354,20 @@ mbox_expunge_unlocked (mu_mailbox_t mailbox, size_t dirty, int remove_deleted,
   int status;
   size_t i;
   size_t save_imapbase = 0;  /* uidvalidity is save in the first message.  */
-  mu_off_t start_off;
+  mu_off_t wpos;             /* Write position in the mailbox.  */
   mu_off_t size;
   size_t expcount = 0;
+  int inplace = 1;           /* Rewriting in place.  */
   
   /* Set the marker position.  */
-  start_off = mud->umessages[dirty]->envel_from;
+  wpos = mud->umessages[dirty]->envel_from;
 
   for (i = dirty; i < mud->messages_count; i++)
     {
       mbox_message_t mum = mud->umessages[i];
+      /* Start of the data that have not been read yet. */
+      mu_off_t next = (i + 1 < mud->messages_count) ?
+	                 mud->umessages[i + 1]->envel_from : mud->size;
       
       if (remove_deleted && ATTRIBUTE_IS_DELETED (mum->attr_flags))
 	{
@@ -1239,6 +1412,12 @@ mbox_expunge_unlocked (mu_mailbox_t mailbox, size_t dirty, int remove_deleted,
 		  return status;
 		}
 	    }
+	  if (inplace && (status = tempstr_reset (tempstr)) != 0)
+	    {
+	      mu_error (_("%s:%d: error resetting temporary stream: %s"),
+			__FILE__, __LINE__, mu_strerror (status));
+	      return status;
+	    }
 	  status = append_message_to_stream (tempstr, mum->message, mud,
 					     flags);
 	  if (status != 0)
@@ -1250,11 +1429,80 @@ mbox_expunge_unlocked (mu_mailbox_t mailbox, size_t dirty, int remove_deleted,
 	  /* Clear the dirty bits.  */
 	  mum->attr_flags &= ~MU_ATTRIBUTE_MODIFIED;
 	  mu_message_clear_modified (mum->message);
+
+	  if (inplace)
+	    {
+	      mu_off_t len;
+	      
+	      status = mu_stream_size (tempstr, &len);
+	      if (status)
+		{
+		  mu_error (_("%s:%d: cannot get size of the temp stream: %s"),
+			    __FILE__, __LINE__,
+			    mu_stream_strerror (tempstr, status));
+		  return status;
+		}
+	      if (wpos + len <= next)
+		{
+		  status = mu_stream_seek (tempstr, 0, MU_SEEK_SET, NULL);
+		  if (status == 0)
+		    status = mu_stream_seek (mailbox->stream, wpos,
+					     MU_SEEK_SET, NULL);
+		  if (status == 0)
+		    status = mu_stream_copy (mailbox->stream, tempstr, len,
+					     NULL);
+		  if (status)
+		    {
+		      mu_error (_("%s:%d: copying from the temporary stream: %s"),
+				__FILE__, __LINE__,
+				mu_strerror (status));
+		      return status;
+		    }
+		  wpos += len;
+		}
+	      else
+		/* The message remains in tempstr, and the rest of the
+		   mailbox will be appended to it. */
+		inplace = 0;
+	    }
 	}
       else
 	{
-	  /* Otherwise, copy bits from mailbox->stream as is. */
+	  mu_off_t len = mum->body_end - mum->envel_from;
+
+	  /* Otherwise, copy bits from mailbox->stream as is, adding
+	     the separating newline. */
+	  if (inplace && wpos + len + 1 <= next)
+	    {
+	      status = mbox_move_block (mailbox->stream, wpos,
+					mum->envel_from, len);
+	      if (status == 0)
+		status = mu_stream_seek (mailbox->stream, wpos + len,
+					 MU_SEEK_SET, NULL);
+	      if (status == 0)
+		status = mu_stream_write (mailbox->stream, "\n", 1, NULL);
+	      if (status)
+		{
+		  mu_error (_("%s:%d: error moving message: %s"),
+			    __FILE__, __LINE__,
+			    mu_strerror (status));
+		  return status;
+		}
+	      wpos += len + 1;
+	      continue;
+	    }
 	  
+	  if (inplace)
+	    {
+	      status = tempstr_reset (tempstr);
+	      if (status)
+		{
+		  mu_error (_("%s:%d: error resetting temporary stream: %s"),
+			    __FILE__, __LINE__, mu_strerror (status));
+		  return status;
+		}
+	      inplace = 0;
+	    }
 	  status = mu_stream_seek (mailbox->stream, mum->envel_from,
 				   MU_SEEK_SET, NULL);
 	  if (status)
@@ -1264,8 +1512,9 @@ mbox_expunge_unlocked (mu_mailbox_t mailbox, size_t dirty, int remove_deleted,
 		        mu_stream_strerror (mailbox->stream, status));
 	      return status;
 	    }
-	  status = mu_stream_copy (tempstr, mailbox->stream,
-				   mum->body_end - mum->envel_from, NULL);
+	  status = mu_stream_copy (tempstr, mailbox->stream, len, NULL);
+	  if (status == 0)
+	    status = mu_stream_write (tempstr, "\n", 1, NULL);
 	  if (status)
 	    {
 	      mu_error (_("%s:%d: error copying: %s"),
@@ -1286,23 +1535,38 @@ mbox_expunge_unlocked (mu_mailbox_t mailbox, size_t dirty, int remove_deleted,
 	{
 	  mu_off_t len = size - mud->size;
 
-	  status = mu_stream_seek (mailbox->stream, mud->size, MU_SEEK_SET,
-				   NULL);
-	  if (status)
+	  if (inplace)
 	    {
-	      mu_error (_("%s:%d: seek error: %s"),
-			__FILE__, __LINE__,
-			mu_stream_strerror (mailbox->stream, status));
-	      return status;
+	      status = mbox_move_block (mailbox->stream, wpos, mud->size, len);
+	      if (status)
+		{
+		  mu_error (_("%s:%d: error moving new mail: %s"),
+			    __FILE__, __LINE__,
+			    mu_strerror (status));
+		  return status;
+		}
+	      wpos += len;
 	    }
-  
-	  status = mu_stream_copy (tempstr, mailbox->stream, len, NULL);
-	  if (status)
+	  else
 	    {
-	      mu_error (_("%s:%d: error writing to temporary stream: %s"),
-			__FILE__, __LINE__,
-			mu_strerror (status));
-	      return status;
+	      status = mu_stream_seek (mailbox->stream, mud->size,
+				       MU_SEEK_SET, NULL);
+	      if (status)
+		{
+		  mu_error (_("%s:%d: seek error: %s"),
+			    __FILE__, __LINE__,
+			    mu_stream_strerror (mailbox->stream, status));
+		  return status;
+		}
+  
+	      status = mu_stream_copy (tempstr, mailbox->stream, len, NULL);
+	      if (status)
+		{
+		  mu_error (_("%s:%d: error writing to temporary stream: %s"),
+			    __FILE__, __LINE__,
+			    mu_strerror (status));
+		  return status;
+		}
 	    }
 	}
       else if (size < mud->size)
@@ -1316,45 +1580,48 @@ mbox_expunge_unlocked (mu_mailbox_t mailbox, size_t dirty, int remove_deleted,
 	}
     }
 
-  
-  /* Copy data from tempstr back to the mailbox. */
-  status = mu_stream_seek (mailbox->stream, start_off, MU_SEEK_SET, NULL);
-  if (status)
+  if (!inplace)
     {
-      mu_error (_("%s:%d: seek error: %s"),
-		__FILE__, __LINE__,
-		mu_stream_strerror (mailbox->stream, status));
-      return status;
-    }
+      /* Copy data from tempstr back to the mailbox. */
+      status = mu_stream_seek (mailbox->stream, wpos, MU_SEEK_SET, NULL);
+      if (status)
+	{
+	  mu_error (_("%s:%d: seek error: %s"),
+		    __FILE__, __LINE__,
+		    mu_stream_strerror (mailbox->stream, status));
+	  return status;
+	}
   
-  status = mu_stream_size (tempstr, &size);
-  if (status)
-    {
-      mu_error (_("%s:%d: cannot get size of the temp stream: %s"),
-		__FILE__, __LINE__,
-		mu_stream_strerror (tempstr, status));
-      return status;
-    }
+      status = mu_stream_size (tempstr, &size);
+      if (status)
+	{
+	  mu_error (_("%s:%d: cannot get size of the temp stream: %s"),
+		    __FILE__, __LINE__,
+		    mu_stream_strerror (tempstr, status));
+	  return status;
+	}
   
-  status = mu_stream_seek (tempstr, 0, MU_SEEK_SET, NULL);
-  if (status)
-    {
-      mu_error (_("%s:%d: seek error: %s"),
-		__FILE__, __LINE__,
-		mu_stream_strerror (mailbox->stream, status));
-      return status;
-    }
+      status = mu_stream_seek (tempstr, 0, MU_SEEK_SET, NULL);
+      if (status)
+	{
+	  mu_error (_("%s:%d: seek error: %s"),
+		    __FILE__, __LINE__,
+		    mu_stream_strerror (mailbox->stream, status));
+	  return status;
+	}
 
-  status = mu_stream_copy (mailbox->stream, tempstr, size, NULL);
-  if (status)
-    {
-      mu_error (_("%s:%d: copying from the temporary stream: %s"),
-		__FILE__, __LINE__,
-		mu_strerror (status));
-      return status;
+      status = mu_stream_copy (mailbox->stream, tempstr, size, NULL);
+      if (status)
+	{
+	  mu_error (_("%s:%d: copying from the temporary stream: %s"),
+		    __FILE__, __LINE__,
+		    mu_strerror (status));
+	  return status;
+	}
+      wpos += size;
     }
   
-  status = mu_stream_truncate (mailbox->stream, start_off + size);
+  status = mu_stream_truncate (mailbox->stream, wpos);
   if (status)
     {
       mu_error (_("%s:%d: error truncating stream: %s"),
@@ -1417,6 +1684,10 @@ mbox_expunge0 (mu_mailbox_t mailbox, int remove_deleted)
       sigaddset (&signalset, SIGINT);
       sigaddset (&signalset, SIGWINCH);
       sigprocmask (SIG_BLOCK, &signalset, 0);
+
+      /* The index becomes invalid as soon as we start rewriting the
+	 mailbox.  It will be recreated by mbox_reset. */
+      mbox_index_remove (mailbox);
       
       status = mbox_expunge_unlocked (mailbox, dirty, remove_deleted,
 				      tempstr);
@@ -1429,7 +1700,7 @@ mbox_expunge0 (mu_mailbox_t mailbox, int remove_deleted)
       mu_stream_destroy (&tempstr);
       
       if (status == 0)
-	mbox_reset (mailbox);
+	mbox_reset (mailbox, dirty);
     }
   if (mailbox->locker)
     mu_locker_unlock (mailbox->locker);
@@ -1441,6 +1712,31 @@ mbox_expunge0 (mu_mailbox_t mailbox, int remove_deleted)
    parsing on the name or even test for existence.  However we do strip any
    leading "mbox:" part of the name, this is suppose to be the
    protocol/scheme name.  */
+/* Set the number of scanning threads from the "threads" URL parameter. */
+static int
+mbox_threads_init (mbox_data_t mud)
+{
+  const char *val;
+  char *p;
+  unsigned long n;
+  int rc;
+
+  rc = mu_url_sget_param (mud->mailbox->url, "threads", &val);
+  if (rc == MU_ERR_NOENT)
+    return 0;
+  else if (rc)
+    return rc;
+  n = strtoul (val, &p, 10);
+  if (*p)
+    {
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+		("%s: invalid number of threads: %s", mud->name, val));
+      return MU_ERR_PARSE;
+    }
+  mud->scan_threads = n;
+  return 0;
+}
+
 int
 _mailbox_mbox_init (mu_mailbox_t mailbox)
 {
@@ -1474,6 +1770,18 @@ _mailbox_mbox_init (mu_mailbox_t mailbox)
       return status;
     }
 
+  status = mbox_index_init (mud);
+  if (status == 0)
+    status = mbox_threads_init (mud);
+  if (status)
+    {
+      free (mud->name);
+      free (mud->idxname);
+      free (mud);
+      mailbox->data = NULL;
+      return status;
+    }
+
   /* Overloading the defaults.  */
   mailbox->_destroy = mbox_destroy;
 
@@ -64,6 +64,8 @@
 
 struct _mbox_message;
 struct _mbox_data;
+struct _mbox_slab;
+struct _mbox_uidl_chunk;
 
 typedef struct _mbox_data *mbox_data_t;
 typedef struct _mbox_message *mbox_message_t;
@@ -80,6 +82,7 @@ struct _mbox_message
   size_t body_lines;           /* Number of lines in message body */
   size_t uid;                  /* IMAP-style uid.  */
   int attr_flags;              /* Packed "Status:" attribute flags */
+  const char *uidl;            /* Value of X-UIDL, if any (in uidl_chunks) */
 
   mu_message_t message;        /* A message attached to it.  */
   mbox_data_t mud;             /* Reference to the containing UNIX mailbox */
@@ -95,10 +98,14 @@ struct _mbox_data
   mbox_message_t *umessages;   /* Array.  */
   size_t umessages_count;      /* Number of slots in umessages. */
   size_t messages_count;       /* Number of used slots in umessages. */
+  struct _mbox_slab *slabs;    /* Storage for the message descriptors */
   mu_off_t size;               /* Size of the mailbox.  */
   unsigned long uidvalidity;
   size_t uidnext;              /* Expected next UID value */
   char *name;                  /* Disk file name */
+  char *idxname;               /* Name of the index file, if enabled */
+  size_t scan_threads;         /* Number of threads for scanning */
+  struct _mbox_uidl_chunk *uidl_chunks; /* Storage for the X-UIDL values */
 
   mu_mailbox_t mailbox; /* Back pointer. */
 };
@@ -107,6 +114,15 @@ int mbox_scan0 (mu_mailbox_t mailbox, size_t msgno, size_t *pcount,
 		int do_notif);
 int mbox_scan1 (mu_mailbox_t mailbox, mu_off_t offset, int do_notif);
 
+int mbox_alloc_messages (mbox_data_t mud, size_t count);
+void mbox_free_messages (mbox_data_t mud);
+const char *mbox_save_uidl (mbox_data_t mud, const char *str, size_t len);
+
+int mbox_index_init (mbox_data_t mud);
+int mbox_index_load (mu_mailbox_t mailbox, int *pgrown);
+int mbox_index_save (mu_mailbox_t mailbox);
+void mbox_index_remove (mu_mailbox_t mailbox);
+
 #ifdef WITH_PTHREAD
 void mbox_cleanup (void *arg);
 #endif
@@ -0,0 +1,346 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General
+   Public License along with this library.  If not, see
+   <http://www.gnu.org/licenses/>. */
+
+/* Mailbox index.
+
+   The index is an auxiliary file that keeps the results of the last
+   full scan of the mailbox.  When the mailbox is reopened, the index
+   is loaded instead of scanning the file.  If the mailbox has grown
+   since the index was written, only the last indexed message and the
+   data appended after it are rescanned.
+
+   The index is enabled by the "index" URL parameter:
+
+     mbox:///var/mail/smith;index
+     mbox:///var/mail/smith;index=/var/cache/mail/smith.idx
+
+   If the parameter has no value, the index is kept in the file
+   ".NAME.idx" in the same directory as the mailbox.
+
+   The index is a text file of the following format:
+
+     # GNU Mailutils mbox index
+     version 1
+     stat DEV INO SIZE MTIME
+     imapbase UIDVALIDITY UIDNEXT
+     count N
+
+   followed by N lines describing each message:
+
+     ENVEL_FROM ENVEL_FROM_END BODY BODY_END HLINES BLINES UID FLAGS UIDL
+
+   UIDL is the value of the X-UIDL header of the message, or "-" if it
+   has none.
+
+   The "stat" line identifies the state of the mailbox file at the moment
+   the index was created.  The index is considered valid if the mailbox
+   is the same file (DEV and INO), and either its size and modification
+   time are unchanged, or it has grown and still has envelope lines at
+   the indexed offsets. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <mbox0.h>
+#include <mailutils/cstr.h>
+#include <mailutils/io.h>
+
+#define MBOX_INDEX_VERSION 2
+
+int
+mbox_index_init (mbox_data_t mud)
+{
+  const char *val;
+  int rc;
+
+  rc = mu_url_sget_param (mud->mailbox->url, "index", &val);
+  if (rc == MU_ERR_NOENT)
+    return 0;
+  else if (rc)
+    return rc;
+
+  if (val[0])
+    {
+      mud->idxname = strdup (val);
+      if (!mud->idxname)
+	return ENOMEM;
+    }
+  else
+    {
+      char *p = strrchr (mud->name, '/');
+      if (p)
+	rc = mu_asprintf (&mud->idxname, "%.*s/.%s.idx",
+			  (int) (p - mud->name), mud->name, p + 1);
+      else
+	rc = mu_asprintf (&mud->idxname, ".%s.idx", mud->name);
+      if (rc)
+	return rc;
+    }
+  mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+	    ("mbox index for %s: %s", mud->name, mud->idxname));
+  return 0;
+}
+
+/* Return true if there is an envelope line at offset OFF in MAILBOX */
+static int
+is_envelope_at (mu_mailbox_t mailbox, mu_off_t off)
+{
+  mu_stream_t stream;
+  char buf[5];
+  size_t n;
+  int rc;
+
+  if (mu_streamref_create (&stream, mailbox->stream))
+    return 0;
+  rc = mu_stream_seek (stream, off, MU_SEEK_SET, NULL) == 0
+       && mu_stream_read (stream, buf, sizeof buf, &n) == 0
+       && n == sizeof buf
+       && memcmp (buf, "From ", sizeof buf) == 0;
+  mu_stream_destroy (&stream);
+  return rc;
+}
+
+static int
+index_read (mu_mailbox_t mailbox, mu_stream_t str, struct stat *st,
+	    int *pgrown)
+{
+  mbox_data_t mud = mailbox->data;
+  char *buf = NULL;
+  size_t size = 0, n;
+  unsigned long v[8];
+  unsigned long count = 0;
+  size_t i = 0;
+  int state = 0;
+  int len;
+  int rc;
+
+  while ((rc = mu_stream_getline (str, &buf, &size, &n)) == 0 && n > 0)
+    {
+      if (buf[0] == '#')
+	continue;
+      switch (state)
+	{
+	case 0:
+	  if (sscanf (buf, "version %lu", &v[0]) != 1
+	      || v[0] != MBOX_INDEX_VERSION)
+	    rc = MU_ERR_PARSE;
+	  break;
+
+	case 1:
+	  if (sscanf (buf, "stat %lu %lu %lu %lu",
+		      &v[0], &v[1], &v[2], &v[3]) != 4
+	      || v[0] != (unsigned long) st->st_dev
+	      || v[1] != (unsigned long) st->st_ino
+	      || v[2] > (unsigned long) st->st_size
+	      || (v[2] == (unsigned long) st->st_size
+		  && v[3] != (unsigned long) st->st_mtime))
+	    rc = MU_ERR_PARSE;
+	  else if (v[2] < (unsigned long) st->st_size)
+	    {
+	      /* The mailbox has grown.  Make sure new data begin
+		 with a new message. */
+	      if (!is_envelope_at (mailbox, v[2]))
+		rc = MU_ERR_PARSE;
+	      *pgrown = 1;
+	    }
+	  else
+	    *pgrown = 0;
+	  break;
+
+	case 2:
+	  if (sscanf (buf, "imapbase %lu %lu", &v[0], &v[1]) != 2)
+	    rc = MU_ERR_PARSE;
+	  else
+	    {
+	      mud->uidvalidity = v[0];
+	      mud->uidnext = v[1];
+	    }
+	  break;
+
+	case 3:
+	  if (sscanf (buf, "count %lu", &count) != 1 || count == 0)
+	    rc = MU_ERR_PARSE;
+	  else
+	    rc = mbox_alloc_messages (mud, count);
+	  break;
+
+	default:
+	  if (i == count
+	      || sscanf (buf, "%lu %lu %lu %lu %lu %lu %lu %lu %n",
+			 &v[0], &v[1], &v[2], &v[3],
+			 &v[4], &v[5], &v[6], &v[7], &len) != 8
+	      || !(v[0] < v[1] && v[1] <= v[2] && v[2] <= v[3]))
+	    rc = MU_ERR_PARSE;
+	  else
+	    {
+	      mbox_message_t mum = mud->umessages[i++];
+	      char *p = buf + len;
+	      size_t n = mu_str_skip_cset_comp (p, " \t\n") - p;
+
+	      if (n == 1 && *p == '-')
+		mum->uidl = NULL;
+	      else
+		mum->uidl = mbox_save_uidl (mud, p, n);
+	      mum->envel_from = v[0];
+	      mum->envel_from_end = v[1];
+	      mum->body = v[2];
+	      mum->body_end = v[3];
+	      mum->header_lines = v[4];
+	      mum->body_lines = v[5];
+	      mum->uid = v[6];
+	      mum->attr_flags = v[7];
+	      mum->mud = mud;
+	    }
+	}
+      if (rc)
+	break;
+      if (state < 4)
+	state++;
+    }
+  free (buf);
+
+  if (rc == 0
+      && (i == 0 || i != count
+	  || !is_envelope_at (mailbox, mud->umessages[i - 1]->envel_from)))
+    rc = MU_ERR_PARSE;
+  if (rc == 0)
+    mud->messages_count = count;
+  return rc;
+}
+
+/* Load the index of MAILBOX.  On success, fill in the message table
+   and return 0.  Set *PGROWN to 1 if the mailbox has grown since the
+   index was written, i.e. the last indexed message must be rescanned
+   along with any new messages that follow it. */
+int
+mbox_index_load (mu_mailbox_t mailbox, int *pgrown)
+{
+  mbox_data_t mud = mailbox->data;
+  mu_stream_t str;
+  struct stat st;
+  int rc;
+
+  if (!mud->idxname)
+    return MU_ERR_NOENT;
+  if (stat (mud->name, &st))
+    return errno;
+
+  rc = mu_file_stream_create (&str, mud->idxname, MU_STREAM_READ);
+  if (rc)
+    return rc;
+  rc = index_read (mailbox, str, &st, pgrown);
+  mu_stream_destroy (&str);
+
+  if (rc)
+    {
+      mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+		("ignoring stale or invalid index %s", mud->idxname));
+      mud->messages_count = 0;
+      mud->uidvalidity = 0;
+      mud->uidnext = 0;
+    }
+  else
+    mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_TRACE1,
+	      ("loaded %lu messages from index %s%s",
+	       (unsigned long) mud->messages_count, mud->idxname,
+	       *pgrown ? ", rescanning tail" : ""));
+  return rc;
+}
+
+struct index_write_closure
+{
+  mu_mailbox_t mailbox;
+  struct stat *st;          /* Status of the mailbox file */
+};
+
+static int
+index_write (mu_stream_t str, void *data)
+{
+  struct index_write_closure *clos = data;
+  mbox_data_t mud = clos->mailbox->data;
+  struct stat *st = clos->st;
+  size_t i;
+
+  mu_stream_printf (str, "# GNU Mailutils mbox index\n");
+  mu_stream_printf (str, "version %d\n", MBOX_INDEX_VERSION);
+  mu_stream_printf (str, "stat %lu %lu %lu %lu\n",
+		    (unsigned long) st->st_dev,
+		    (unsigned long) st->st_ino,
+		    (unsigned long) st->st_size,
+		    (unsigned long) st->st_mtime);
+  mu_stream_printf (str, "imapbase %lu %lu\n",
+		    mud->uidvalidity, (unsigned long) mud->uidnext);
+  mu_stream_printf (str, "count %lu\n", (unsigned long) mud->messages_count);
+  for (i = 0; i < mud->messages_count && mu_stream_err (str) == 0; i++)
+    {
+      mbox_message_t mum = mud->umessages[i];
+      mu_stream_printf (str, "%lu %lu %lu %lu %lu %lu %lu %lu %s\n",
+			(unsigned long) mum->envel_from,
+			(unsigned long) mum->envel_from_end,
+			(unsigned long) mum->body,
+			(unsigned long) mum->body_end,
+			(unsigned long) mum->header_lines,
+			(unsigned long) mum->body_lines,
+			(unsigned long) mum->uid,
+			(unsigned long) mum->attr_flags,
+			mum->uidl ? mum->uidl : "-");
+    }
+  if (mu_stream_err (str))
+    return mu_stream_last_error (str);
+  return mu_stream_flush (str);
+}
+
+/* Write out the index for MAILBOX.  The function must be called right
+   after a complete scan, before any of the message attributes has had
+   a chance to be modified by the caller. */
+int
+mbox_index_save (mu_mailbox_t mailbox)
+{
+  mbox_data_t mud = mailbox->data;
+  struct index_write_closure clos;
+  struct stat st;
+  int rc;
+
+  if (!mud->idxname || mud->messages_count == 0)
+    return 0;
+  if (stat (mud->name, &st))
+    return errno;
+  if (st.st_size != mud->size)
+    /* Mailbox has been modified while being scanned */
+    return MU_ERR_FAILURE;
+
+  clos.mailbox = mailbox;
+  clos.st = &st;
+  rc = mu_tempfile_replace (mud->idxname, index_write, &clos);
+  if (rc)
+    mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+	      ("cannot write index %s: %s", mud->idxname,
+	       mu_strerror (rc)));
+  return rc;
+}
+
+/* Remove the index, e.g. before rewriting the mailbox. */
+void
+mbox_index_remove (mu_mailbox_t mailbox)
+{
+  mbox_data_t mud = mailbox->data;
+  if (mud->idxname && unlink (mud->idxname) && errno != ENOENT)
+    mu_debug (MU_DEBCAT_MAILBOX, MU_DEBUG_ERROR,
+	      ("cannot remove index %s: %s", mud->idxname,
+	       mu_strerror (errno)));
+}
@@ -33,6 +33,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include <mbox0.h>
 #include <mailutils/cctype.h>
 #include <mailutils/cstr.h>
@@ -243,33 +244,17 @@ do                                                                           \
 } while (0)
 
 /* Allocate slots for the new messages.  */
-/*    size_t num = 2 * ((mud)->messages_count) + 10; */
 #define ALLOCATE_MSGS(mbox,mud)                                              \
 do                                                                           \
 {                                                                            \
-  if ((mud)->messages_count >= (mud)->umessages_count)                       \
+  if ((mud)->messages_count >= (mud)->umessages_count                        \
+      && mbox_alloc_messages (mud, (mud)->messages_count + 1))               \
     {                                                                        \
-      mbox_message_t *m;                                                     \
-      size_t num = ((mud)->umessages_count) + 1;                             \
-      m = realloc ((mud)->umessages, num * sizeof (*m));                     \
-    if (m == NULL)                                                           \
-      {                                                                      \
-	if (mailbox->locker)						     \
-	  mu_locker_unlock (mbox->locker);				     \
-        mu_monitor_unlock (mbox->monitor);                                   \
-        return ENOMEM;                                                       \
-      }                                                                      \
-    (mud)->umessages = m;                                                    \
-    (mud)->umessages[num - 1] = calloc (1, sizeof (*(mum)));                 \
-    if ((mud)->umessages[num - 1] == NULL)                                   \
-      {                                                                      \
-	if (mailbox->locker)						     \
-	  mu_locker_unlock (mbox->locker);				     \
-        mu_monitor_unlock (mbox->monitor);                                   \
-        return ENOMEM;                                                       \
-      }                                                                      \
-    (mud)->umessages_count = num;                                            \
-  }                                                                          \
+      if (mailbox->locker)						     \
+	mu_locker_unlock (mbox->locker);				     \
+      mu_monitor_unlock (mbox->monitor);                                     \
+      return ENOMEM;                                                         \
+    }                                                                        \
 } while (0)
 
 #define ISSTATUS(buf) (                                                       \
@@ -288,6 +273,14 @@ do                                                                           \
   && (buf[3] == 'I' || buf[3] == 'i')				\
   && (buf[4] == 'D' || buf[4] == 'd')				\
   && (buf[5] == ':' || buf[5] == ' ' || buf[5] == '\t'))
+#define IS_X_UIDL(buf) (					\
+ (buf[0] == 'X' || buf[0] == 'x')		                \
+  && buf[1] == '-'						\
+  && (buf[2] == 'U' || buf[2] == 'u')				\
+  && (buf[3] == 'I' || buf[3] == 'i')				\
+  && (buf[4] == 'D' || buf[4] == 'd')				\
+  && (buf[5] == 'L' || buf[5] == 'l')				\
+  && (buf[6] == ':' || buf[6] == ' ' || buf[6] == '\t'))
 #define IS_X_IMAPBASE(buf) (					\
  (buf[0] == 'X' || buf[0] == 'x')		                \
   && buf[1] == '-'						\
@@ -301,16 +294,171 @@ do                                                                           \
   && (buf[9] == 'E' || buf[9] == 'e')				\
   && (buf[10] == ':' || buf[10] == ' ' || buf[10] == '\t'))
 
+/* Message descriptors are allocated in slabs.  Each slab holds the
+   descriptors for the slots added by one extension of the umessages
+   array.  The array grows geometrically, so that a mailbox of N messages
+   takes O(log N) allocations. */
+struct _mbox_slab
+{
+  struct _mbox_slab *next;
+  struct _mbox_message msg[1];
+};
+
+/* UIDL values are stored back to back in fixed-size chunks.  A chunk is
+   never moved or freed before the mailbox is closed, so the values stay
+   valid as long as the message descriptors. */
+struct _mbox_uidl_chunk
+{
+  struct _mbox_uidl_chunk *next;
+  size_t level;
+  char buf[4096];
+};
+
+#define MBOX_MIN_SLOTS 64
+
+/* Make sure MUD has descriptors for at least COUNT messages. */
+int
+mbox_alloc_messages (mbox_data_t mud, size_t count)
+{
+  size_t num, i;
+  mbox_message_t *m;
+  struct _mbox_slab *slab;
+
+  if (count <= mud->umessages_count)
+    return 0;
+  num = mud->umessages_count * 2;
+  if (num < MBOX_MIN_SLOTS)
+    num = MBOX_MIN_SLOTS;
+  if (num < count)
+    num = count;
+  if (num > (size_t) -1 / sizeof (struct _mbox_message))
+    return ENOMEM;
+  
+  m = realloc (mud->umessages, num * sizeof (*m));
+  if (m == NULL)
+    return ENOMEM;
+  mud->umessages = m;
+
+  slab = calloc (1, sizeof (*slab) +
+		 (num - mud->umessages_count - 1) * sizeof (slab->msg[0]));
+  if (slab == NULL)
+    return ENOMEM;
+  slab->next = mud->slabs;
+  mud->slabs = slab;
+  for (i = mud->umessages_count; i < num; i++)
+    m[i] = &slab->msg[i - mud->umessages_count];
+  mud->umessages_count = num;
+  return 0;
+}
+
+/* Destroy all message descriptors in MUD. */
+void
+mbox_free_messages (mbox_data_t mud)
+{
+  size_t i;
+
+  for (i = 0; i < mud->umessages_count; i++)
+    {
+      mbox_message_t mum = mud->umessages[i];
+      mu_message_destroy (&mum->message, mum);
+    }
+  free (mud->umessages);
+  mud->umessages = NULL;
+  mud->messages_count = mud->umessages_count = 0;
+  while (mud->slabs)
+    {
+      struct _mbox_slab *next = mud->slabs->next;
+      free (mud->slabs);
+      mud->slabs = next;
+    }
+  while (mud->uidl_chunks)
+    {
+      struct _mbox_uidl_chunk *next = mud->uidl_chunks->next;
+      free (mud->uidl_chunks);
+      mud->uidl_chunks = next;
+    }
+}
+
+/* Longest UIDL allowed by RFC 1939 */
+#define MBOX_UIDL_MAX 70
+
+/* Store a copy of the UIDL value STR of length LEN in MUD.  Return the
+   copy, or NULL if the value is not valid or there is not enough
+   memory. */
+const char *
+mbox_save_uidl (mbox_data_t mud, const char *str, size_t len)
+{
+  struct _mbox_uidl_chunk *chunk = mud->uidl_chunks;
+  char *p;
+  
+  if (len == 0 || len > MBOX_UIDL_MAX)
+    return NULL;
+  if (!chunk || sizeof (chunk->buf) - chunk->level < len + 1)
+    {
+      chunk = malloc (sizeof (*chunk));
+      if (!chunk)
+	return NULL;
+      chunk->level = 0;
+      chunk->next = mud->uidl_chunks;
+      mud->uidl_chunks = chunk;
+    }
+  p = chunk->buf + chunk->level;
+  memcpy (p, str, len);
+  p[len] = 0;
+  chunk->level += len + 1;
+  return p;
+}
+
 #define MBOX_SCAN_NOTIFY 0x1
 #define MBOX_SCAN_ONEMSG 0x2
 
+#define MSGLINELEN 1024
+
+/* Analyze the header line BUF of the message MUM. */
+static void
+mbox_scan_header_line (mbox_data_t mud, mbox_message_t mum, char *buf,
+		       size_t *pmin_uid)
+{
+  if (ISSTATUS (buf))
+    {
+      ATTRIBUTE_SET(buf, mum, 'r', 'R', MU_ATTRIBUTE_READ);
+      ATTRIBUTE_SET(buf, mum, 'o', 'O', MU_ATTRIBUTE_SEEN);
+      ATTRIBUTE_SET(buf, mum, 'a', 'A', MU_ATTRIBUTE_ANSWERED);
+      ATTRIBUTE_SET(buf, mum, 'd', 'D', MU_ATTRIBUTE_DELETED);
+    }
+  else if (IS_X_UID (buf))
+    {
+      char *p;
+      unsigned long n = strtoul (buf + 6, &p, 10);
+      if ((*p == 0 || mu_isspace (*p)) && n > *pmin_uid)
+	mum->uid = *pmin_uid = n;
+    }
+  else if (mud->messages_count == 1 && IS_X_IMAPBASE (buf))
+    {
+      char *p;
+      unsigned long n = strtoul (buf + 11, &p, 10);
+      if (mu_isspace (*p))
+	mud->uidvalidity = n;
+      n = strtoul (mu_str_skip_cset (p, " \t"), &p, 10);
+      if (*p == 0 || mu_isspace (*p))
+	mud->uidnext = n;
+      else
+	mud->uidvalidity = 0;
+    }
+  else if (IS_X_UIDL (buf))
+    {
+      char *p = mu_str_skip_cset (buf + 7, " \t");
+      char *q = mu_str_skip_cset_comp (p, " \t\r\n");
+      mum->uidl = mbox_save_uidl (mud, p, q - p);
+    }
+}
+
 int
 mbox_scan_internal (mu_mailbox_t mailbox, mbox_message_t mum,
 		    mu_off_t total,
 		    size_t *pmin_uid,
 		    int flags)
 {
-#define MSGLINELEN 1024
   char buf[MSGLINELEN];
   int inheader;
   int inbody;
@@ -320,7 +468,7 @@ mbox_scan_internal (mu_mailbox_t mailbox, mbox_message_t mum,
   int newline;
   size_t n = 0;
   mu_stream_t stream;
-  size_t min_uid = 0;
+  size_t min_uid = pmin_uid ? *pmin_uid : 0;
   int zn, isfrom = 0;
   char *temp;
   
@@ -388,34 +536,12 @@ mbox_scan_internal (mu_mailbox_t mailbox, mbox_message_t mum,
               mum->envel_from_end = total;
 	      mum->body_end = mum->body = 0;
 	      mum->attr_flags = 0;
+	      mum->uid = 0;
+	      mum->uidl = NULL;
 	      lines = 0;
 	    }
-	  else if (ISSTATUS (buf))
-	    {
-	      ATTRIBUTE_SET(buf, mum, 'r', 'R', MU_ATTRIBUTE_READ);
-	      ATTRIBUTE_SET(buf, mum, 'o', 'O', MU_ATTRIBUTE_SEEN);
-	      ATTRIBUTE_SET(buf, mum, 'a', 'A', MU_ATTRIBUTE_ANSWERED);
-	      ATTRIBUTE_SET(buf, mum, 'd', 'D', MU_ATTRIBUTE_DELETED);
-	    }
-	  else if (IS_X_UID (buf))
-	    {
-	      char *p;
-	      unsigned long n = strtoul (buf + 6, &p, 10);
-	      if ((*p == 0 || mu_isspace (*p)) && n > min_uid)
-		mum->uid = min_uid = n;
-	    }
-	  else if (mud->messages_count == 1 && IS_X_IMAPBASE (buf))
-	    {
-	      char *p;
-	      unsigned long n = strtoul (buf + 11, &p, 10);
-	      if (mu_isspace (*p))
-		mud->uidvalidity = n;
-	      n = strtoul (mu_str_skip_cset (p, " \t"), &p, 10);
-	      if (*p == 0 || mu_isspace (*p))
-		mud->uidnext = n;
-	      else
-		mud->uidvalidity = 0;
-	    }
+	  else
+	    mbox_scan_header_line (mud, mum, buf, &min_uid);
 	}
 
       /* Body.  */
@@ -464,6 +590,408 @@ mbox_scan_internal (mu_mailbox_t mailbox, mbox_message_t mum,
   return status;
 }
 
+/* Memory-mapped scanner.
+
+   When the mailbox stream is a memory-mapped file, the mailbox is scanned
+   directly in memory, without copying it line by line through the stream
+   buffers.  Only the envelope and header lines are copied out and analyzed
+   with the macros above.  Message bodies are skipped by looking for
+   newlines with memchr and checking whether the next line begins with
+   "From ".  Only such candidate lines are submitted to VALID.
+
+   The resulting message descriptors are the same as those produced by
+   mbox_scan_internal, except that header lines longer than MSGLINELEN
+   are analyzed as a whole, instead of being split into chunks. */
+
+/* Copy the line starting at P into BUF, truncating it to MSGLINELEN-1
+   bytes.  Return the length of the line, including the terminating
+   newline. */
+static size_t
+mapped_getline (char *buf, const char *p, const char *end)
+{
+  const char *q = memchr (p, '\n', end - p);
+  size_t len = q ? q - p + 1 : end - p;
+  size_t n = len < MSGLINELEN ? len : MSGLINELEN - 1;
+
+  memcpy (buf, p, n);
+  buf[n] = 0;
+  return len;
+}
+
+/* Return true if the line at P is a valid envelope line. */
+static int
+mapped_is_envelope (const char *p, const char *end)
+{
+  char buf[MSGLINELEN];
+  char *s = buf;
+  char *temp;
+  int zn, isfrom;
+
+  if (end - p < 5 || memcmp (p, "From ", 5))
+    return 0;
+  mapped_getline (buf, p, end);
+  VALID (s, temp, isfrom, zn);
+  return isfrom;
+}
+
+/* Find the first valid envelope line in the range [P, END), such that
+   P[-1] is a newline.  Store the number of lines preceding it in
+   *PLINES.  Return END if no more envelope lines are found. */
+static const char *
+mapped_find_envelope (const char *p, const char *end, size_t *plines)
+{
+  size_t lines = 0;
+
+  while (p < end)
+    {
+      if (*p == 'F' && mapped_is_envelope (p, end))
+	break;
+      p = memchr (p, '\n', end - p);
+      if (!p)
+	{
+	  p = end;
+	  break;
+	}
+      p++;
+      lines++;
+    }
+  *plines = lines;
+  return p;
+}
+
+/* Scan the message whose envelope line starts at P.  Fill in MUM and
+   return the start of the next envelope line, or END.  Store the number
+   of lines scanned in *PLINES. */
+static const char *
+mapped_scan_message (mbox_data_t mud, mbox_message_t mum,
+		     const char *base, const char *p, const char *end,
+		     size_t *pmin_uid, size_t *plines)
+{
+  char buf[MSGLINELEN];
+  const char *body;
+  size_t len, lines = 0;
+  int newline = 0;
+  int zn, isfrom;
+  char *temp;
+
+  mum->mud = mud;
+  mum->envel_from = p - base;
+  p += mapped_getline (buf, p, end);
+  mum->envel_from_end = p - base;
+  mum->body_end = mum->body = 0;
+  mum->attr_flags = 0;
+  mum->uid = 0;
+  mum->uidl = NULL;
+
+  /* Analyze the header. */
+  while (p < end)
+    {
+      len = mapped_getline (buf, p, end);
+      if (*buf == '\n')
+	{
+	  p++;
+	  lines++;
+	  mum->body = p - base;
+	  mum->header_lines = lines;
+	  break;
+	}
+      VALID (buf, temp, isfrom, zn);
+      if (isfrom)
+	break;
+      if (p[len - 1] == '\n')
+	lines++;
+      mbox_scan_header_line (mud, mum, buf, pmin_uid);
+      p += len;
+    }
+
+  if (mum->body)
+    {
+      /* Skip the body, up to the next envelope. */
+      body = p;
+      p = mapped_find_envelope (body, end, &lines);
+      /* The empty line preceding the envelope belongs to the mailbox
+	 structure, not to the message. */
+      if (p - 1 >= body && p[-1] == '\n' && p[-2] == '\n')
+	newline = 1;
+    }
+  /* Otherwise, the message either has no body or is truncated. */
+  mum->body_end = p - base - newline;
+  mum->body_lines = lines - newline;
+  *plines = lines;
+  return p;
+}
+
+static int
+mbox_scan_mapped (mu_mailbox_t mailbox, const char *base, size_t size,
+		  mu_off_t total, size_t *pmin_uid, int flags)
+{
+  mbox_data_t mud = mailbox->data;
+  mbox_message_t mum;
+  const char *end = base + size;
+  const char *p;
+  size_t min_uid = *pmin_uid;
+  size_t lines, nlines = 0;
+
+  /* Skip to the first envelope. */
+  p = base + total;
+  if (!mapped_is_envelope (p, end))
+    p = mapped_find_envelope (p, end, &lines);
+
+  while (p < end)
+    {
+      ALLOCATE_MSGS (mailbox, mud);
+      mum = mud->umessages[mud->messages_count++];
+      p = mapped_scan_message (mud, mum, base, p, end, &min_uid, &lines);
+      nlines += lines;
+
+      if (mum->uid == 0)
+	{
+	  mum->uid = ++min_uid;
+	  /* Note that modification for when expunging.  */
+	  mum->attr_flags |= MU_ATTRIBUTE_MODIFIED;
+	}
+
+      if (mailbox->locker && (mud->messages_count % 100) == 0)
+	mu_locker_touchlock (mailbox->locker);
+
+      if (flags & MBOX_SCAN_NOTIFY)
+	{
+	  DISPATCH_ADD_MSG (mailbox, mud);
+	  if (nlines >= 1000)
+	    {
+	      DISPATCH_PROGRESS (mailbox, mud);
+	      nlines = 0;
+	    }
+	}
+    }
+  *pmin_uid = min_uid;
+  return 0;
+}
+
+/* Notify the observers about messages START+1 through COUNT, which
+   have been loaded from the index or by the parallel scanner. */
+static int
+mbox_dispatch_loaded (mu_mailbox_t mailbox, size_t start, size_t count)
+{
+  size_t i;
+  int bailing = 0;
+
+  if (!mailbox->observable)
+    return 0;
+  mu_monitor_unlock (mailbox->monitor);
+  for (i = start; i < count && !bailing; i++)
+    {
+      size_t tmp = i + 1;
+      bailing = mu_observable_notify (mailbox->observable, MU_EVT_MESSAGE_ADD,
+				      &tmp);
+    }
+  mu_monitor_wrlock (mailbox->monitor);
+  return bailing;
+}
+
+#ifdef WITH_PTHREAD
+/* Parallel scanner.
+
+   The mapped mailbox is split into byte ranges, one per thread.  The
+   start of each range is moved forward to the nearest envelope line, so
+   that each range holds a sequence of complete messages.  The ranges are
+   scanned concurrently into private descriptor tables.  Each message
+   gets the largest X-UID value found in its header as a tentative UID.
+   The tables are then joined in order, and UIDs are assigned the same
+   way mbox_scan_mapped does it. */
+
+/* Do not bother splitting ranges shorter than this. */
+#define MBOX_PSCAN_MIN_RANGE (4*1024*1024)
+
+struct mapped_range
+{
+  struct _mbox_data mud;        /* Private descriptor table */
+  const char *base;             /* Start of the mapping */
+  const char *start;            /* Start of the range */
+  const char *end;              /* End of the range */
+  pthread_t tid;                /* Scanning thread */
+  int joinable;                 /* True if tid must be joined */
+  int status;                   /* Result */
+};
+
+static void *
+mapped_scan_range (void *data)
+{
+  struct mapped_range *r = data;
+  const char *p = r->start;
+
+  while (p < r->end)
+    {
+      mbox_message_t mum;
+      size_t min_uid = 0, lines;
+
+      r->status = mbox_alloc_messages (&r->mud, r->mud.messages_count + 1);
+      if (r->status)
+	break;
+      mum = r->mud.umessages[r->mud.messages_count++];
+      p = mapped_scan_message (&r->mud, mum, r->base, p, r->end,
+			       &min_uid, &lines);
+    }
+  return NULL;
+}
+
+static int
+mbox_scan_parallel (mu_mailbox_t mailbox, const char *base, size_t size,
+		    mu_off_t total, size_t *pmin_uid, size_t nthreads,
+		    int flags)
+{
+  mbox_data_t mud = mailbox->data;
+  const char *end = base + size;
+  const char *p;
+  struct mapped_range *rtab;
+  size_t i, j, n, count, len, min_uid = *pmin_uid;
+  size_t start_count = mud->messages_count;
+  int status = 0;
+
+  /* Skip to the first envelope. */
+  p = base + total;
+  if (!mapped_is_envelope (p, end))
+    p = mapped_find_envelope (p, end, &count);
+  if (p == end)
+    return 0;
+
+  len = end - p;
+  if (nthreads > len / MBOX_PSCAN_MIN_RANGE)
+    nthreads = len / MBOX_PSCAN_MIN_RANGE;
+  if (nthreads < 2)
+    return mbox_scan_mapped (mailbox, base, size, p - base, pmin_uid, flags);
+
+  rtab = calloc (nthreads, sizeof (rtab[0]));
+  if (!rtab)
+    return ENOMEM;
+
+  /* Split the mailbox into ranges. */
+  for (i = n = 0; i < nthreads && p < end; i++)
+    {
+      const char *q = base + total + len / nthreads * (i + 1);
+
+      rtab[n].base = base;
+      rtab[n].start = p;
+      if (q < p)
+	q = p;
+      if (i + 1 == nthreads || q >= end)
+	q = end;
+      else
+	{
+	  /* Move to the start of the next line, and then to the next
+	     envelope. */
+	  q = memchr (q - 1, '\n', end - q + 1);
+	  q = q ? mapped_find_envelope (q + 1, end, &count) : end;
+	}
+      rtab[n].end = q;
+      n++;
+      p = q;
+    }
+
+  /* Scan the ranges.  If a thread cannot be created, the range is
+     scanned in the current thread. */
+  if (start_count == 0)
+    {
+      /* X-IMAPbase is looked for in the first message only. */
+      rtab[0].mud.uidvalidity = mud->uidvalidity;
+      rtab[0].mud.uidnext = mud->uidnext;
+    }
+  for (i = 1; i < n; i++)
+    {
+      if (pthread_create (&rtab[i].tid, NULL, mapped_scan_range, &rtab[i]))
+	mapped_scan_range (&rtab[i]);
+      else
+	rtab[i].joinable = 1;
+    }
+  mapped_scan_range (&rtab[0]);
+  for (i = 1; i < n; i++)
+    if (rtab[i].joinable)
+      pthread_join (rtab[i].tid, NULL);
+
+  /* Join the results. */
+  for (i = count = 0; i < n; i++)
+    {
+      if (rtab[i].status)
+	status = rtab[i].status;
+      count += rtab[i].mud.messages_count;
+    }
+  if (status == 0)
+    status = mbox_alloc_messages (mud, start_count + count);
+
+  if (status == 0)
+    {
+      if (start_count == 0)
+	{
+	  mud->uidvalidity = rtab[0].mud.uidvalidity;
+	  mud->uidnext = rtab[0].mud.uidnext;
+	}
+      for (i = 0; i < n; i++)
+	{
+	  for (j = 0; j < rtab[i].mud.messages_count; j++)
+	    {
+	      mbox_message_t mum = mud->umessages[mud->messages_count++];
+
+	      *mum = *rtab[i].mud.umessages[j];
+	      mum->mud = mud;
+	      /* The range storage is freed below */
+	      if (mum->uidl)
+		mum->uidl = mbox_save_uidl (mud, mum->uidl,
+					    strlen (mum->uidl));
+	      if (mum->uid > min_uid)
+		min_uid = mum->uid;
+	      else
+		{
+		  mum->uid = ++min_uid;
+		  /* Note that modification for when expunging.  */
+		  mum->attr_flags |= MU_ATTRIBUTE_MODIFIED;
+		}
+	    }
+	}
+    }
+
+  for (i = 0; i < n; i++)
+    mbox_free_messages (&rtab[i].mud);
+  free (rtab);
+
+  if (status)
+    {
+      if (mailbox->locker)
+	mu_locker_unlock (mailbox->locker);
+      mu_monitor_unlock (mailbox->monitor);
+      return status;
+    }
+
+  *pmin_uid = min_uid;
+  if (mailbox->locker)
+    mu_locker_touchlock (mailbox->locker);
+  if ((flags & MBOX_SCAN_NOTIFY)
+      && mbox_dispatch_loaded (mailbox, start_count, mud->messages_count))
+    {
+      if (mailbox->locker)
+	mu_locker_unlock (mailbox->locker);
+      return EINTR;
+    }
+  return 0;
+}
+#endif
+
+/* Return true if none of the first COUNT messages has attributes or
+   contents modified in memory. */
+static int
+mbox_unchanged_p (mbox_data_t mud, size_t count)
+{
+  size_t i;
+
+  for (i = 0; i < count && i < mud->messages_count; i++)
+    {
+      mbox_message_t mum = mud->umessages[i];
+      if ((mum->attr_flags & (MU_ATTRIBUTE_MODIFIED|MU_ATTRIBUTE_DELETED))
+	  || (mum->message && mu_message_is_modified (mum->message)))
+	return 0;
+    }
+  return 1;
+}
+
 int
 mbox_scan0 (mu_mailbox_t mailbox, size_t msgno, size_t *pcount, int do_notif)
 {
@@ -471,7 +999,8 @@ mbox_scan0 (mu_mailbox_t mailbox, size_t msgno, size_t *pcount, int do_notif)
   mbox_data_t mud = mailbox->data;
   mbox_message_t mum = NULL;
   mu_off_t total = 0;
-  size_t min_uid;
+  size_t min_uid = 0;
+  int grown = 1;
   
   /* Sanity.  */
   if (mud == NULL)
@@ -505,16 +1034,68 @@ mbox_scan0 (mu_mailbox_t mailbox, size_t msgno, size_t *pcount, int do_notif)
   if (mud->umessages && msgno > 0 && mud->messages_count > 0
       && msgno <= mud->messages_count)
     {
-      mum = mud->umessages[msgno - 1];
-      if (mum)
-	total = mum->envel_from;
+      /* The message is rescanned from its envelope line, which
+	 reinitializes its descriptor. */
+      if (mud->umessages[msgno - 1])
+	total = mud->umessages[msgno - 1]->envel_from;
       mud->messages_count = msgno - 1;
+      if (msgno > 1)
+	min_uid = mud->umessages[msgno - 2]->uid;
     }
   else
     mud->messages_count = 0;
 
-  status = mbox_scan_internal (mailbox, mum, total, &min_uid,
-			       do_notif ? MBOX_SCAN_NOTIFY : 0);
+  if (total == 0 && mbox_index_load (mailbox, &grown) == 0)
+    {
+      if (grown)
+	{
+	  /* Rescan the last indexed message and whatever follows it. */
+	  total = mud->umessages[--mud->messages_count]->envel_from;
+	  if (mud->messages_count)
+	    min_uid = mud->umessages[mud->messages_count - 1]->uid;
+	}
+      if (do_notif && mbox_dispatch_loaded (mailbox, 0, mud->messages_count))
+	{
+	  if (mailbox->locker)
+	    mu_locker_unlock (mailbox->locker);
+	  mu_monitor_unlock (mailbox->monitor);
+	  return EINTR;
+	}
+    }
+
+  if (grown)
+    {
+      struct mu_mapfile_region reg;
+
+      if (mu_stream_flush (mailbox->stream) == 0
+	  && mu_stream_ioctl (mailbox->stream, MU_IOCTL_MAPFILESTREAM,
+			      MU_IOCTL_MAPFILESTREAM_GET_REGION, &reg) == 0)
+	{
+#ifdef WITH_PTHREAD
+	  if (mud->scan_threads > 1)
+	    status = mbox_scan_parallel (mailbox, reg.start, reg.size,
+					 total, &min_uid, mud->scan_threads,
+					 do_notif ? MBOX_SCAN_NOTIFY : 0);
+	  else
+#endif
+	    status = mbox_scan_mapped (mailbox, reg.start, reg.size,
+				       total, &min_uid,
+				       do_notif ? MBOX_SCAN_NOTIFY : 0);
+	}
+      else
+	status = mbox_scan_internal (mailbox, mum, total, &min_uid,
+				     do_notif ? MBOX_SCAN_NOTIFY : 0);
+      /* Update the index after a successful scan, unless the messages
+	 kept from before it have changes not yet written to the mailbox */
+      if (status == 0 && mbox_unchanged_p (mud, msgno ? msgno - 1 : 0))
+	mbox_index_save (mailbox);
+    }
+  else
+    {
+      status = 0;
+      if (mud->messages_count)
+	min_uid = mud->umessages[mud->messages_count - 1]->uid;
+    }
     
   if (pcount)
     *pcount = mud->messages_count;
@@ -250,6 +250,8 @@ mh_scan0 (mu_mailbox_t mailbox, size_t msgno MU_ARG_UNUSED, size_t *pcount,
 	}
       else
 	{
+	  if (msg->amd_message.attr_flags != attr_flags)
+	    _mu_mailbox_changes_note (mailbox, num);
 	  msg->amd_message.attr_flags = attr_flags;
 	  msg->amd_message.orig_flags = msg->amd_message.attr_flags;
 	}
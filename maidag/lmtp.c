@@ -93,6 +93,23 @@ lmtp_reply (mu_stream_t iostr, char *code, char *enh, char *fmt, ...)
     }
 }
 
+/* Send out the pending replies.  Flushing the iostream itself would
+   discard any input read ahead, so only its output part is flushed. */
+static void
+lmtp_flush (mu_stream_t iostr)
+{
+  mu_stream_t str[2];
+
+  if (mu_stream_ioctl (iostr, MU_IOCTL_SUBSTREAM, MU_IOCTL_OP_GET, str))
+    mu_stream_flush (iostr);
+  else
+    {
+      mu_stream_flush (str[1]);
+      mu_stream_unref (str[0]);
+      mu_stream_unref (str[1]);
+    }
+}
+
 enum lmtp_state
   {
     state_none,
@@ -306,14 +323,10 @@ dot_temp_fail (void *item, void *cbdata)
   return 0;
 }
 
-int
-dot_deliver (void *item, void *cbdata)
+static void
+dot_reply (mu_stream_t iostr, const char *name, int status, const char *errp)
 {
-  char *name = item;
-  mu_stream_t iostr = cbdata;
-  char *errp = NULL;
-  
-  switch (deliver_to_user (mesg, name, &errp))
+  switch (status)
     {
     case 0:
       lmtp_reply (iostr, "250", "2.0.0", "%s: delivered", name);
@@ -335,10 +348,252 @@ dot_deliver (void *item, void *cbdata)
 		    name);
       break;
     }
+}
+
+int
+dot_deliver (void *item, void *cbdata)
+{
+  char *name = item;
+  mu_stream_t iostr = cbdata;
+  char *errp = NULL;
+  
+  dot_reply (iostr, name, deliver_to_user (mesg, name, &errp), errp);
   free (errp);
   return 0;
 }
 
+
+/* Parallel delivery.
+
+   Each recipient is served by a separate child process, at most
+   lmtp_delivery_jobs of them running simultaneously.  The message is
+   spooled to a named temporary file, which each child opens anew, so
+   that the children don't share the file offset.  The exit code of a
+   child is the return value of deliver_to_user, and the error text, if
+   any, is passed back over a pipe.  Replies are sent in RCPT order, as
+   soon as all preceding recipients are served. */
+
+size_t lmtp_delivery_jobs = 1;
+static char *spool_name;        /* Name of the spool file, if any */
+
+/* Directory for spool files.  When it is on the same file system as
+   the mailboxes, the kernel is able to copy message bodies from the
+   spool file directly (see mu_stream_copy). */
+char *lmtp_spool_dir;
+
+struct dlv_job
+{
+  char *name;        /* Recipient name */
+  pid_t pid;         /* PID of the delivery process, 0 if not running */
+  int fd;            /* Read end of the pipe */
+  int status;        /* Delivery status */
+  char *errp;        /* Error text */
+};
+
+static int
+spool_create (mu_stream_t *pstr, int named)
+{
+  int rc, fd;
+  struct mu_tempfile_hints hints, *phints = NULL;
+  int hflags = 0;
+
+  if (lmtp_spool_dir)
+    {
+      hints.tmpdir = lmtp_spool_dir;
+      phints = &hints;
+      hflags = MU_TEMPFILE_TMPDIR;
+    }
+  if (!named)
+    return mu_temp_file_stream_create (pstr, phints, hflags);
+  rc = mu_tempfile (phints, hflags, &fd, &spool_name);
+  if (rc)
+    return rc;
+  rc = mu_fd_stream_create (pstr, spool_name, fd,
+			    MU_STREAM_RDWR | MU_STREAM_SEEK);
+  if (rc)
+    {
+      close (fd);
+      unlink (spool_name);
+      free (spool_name);
+      spool_name = NULL;
+    }
+  return rc;
+}
+
+static void
+spool_remove ()
+{
+  if (spool_name)
+    {
+      unlink (spool_name);
+      free (spool_name);
+      spool_name = NULL;
+    }
+}
+
+static void
+job_run (struct dlv_job *job, int fd)
+{
+  mu_stream_t str;
+  mu_message_t msg;
+  char *errp = NULL;
+  int status;
+
+  status = mu_file_stream_create (&str, spool_name, MU_STREAM_READ);
+  if (status == 0)
+    {
+      status = mu_stream_to_message (str, &msg);
+      mu_stream_unref (str);
+    }
+  if (status)
+    {
+      maidag_error (_("error creating temporary message: %s"),
+		    mu_strerror (status));
+      status = EX_TEMPFAIL;
+    }
+  else
+    status = deliver_to_user (msg, job->name, &errp);
+  if (errp)
+    write (fd, errp, strlen (errp));
+  _exit (status);
+}
+
+static int
+job_start (struct dlv_job *job)
+{
+  int p[2];
+
+  if (pipe (p))
+    {
+      mu_diag_funcall (MU_DIAG_ERROR, "pipe", NULL, errno);
+      job->status = EX_TEMPFAIL;
+      return 1;
+    }
+  job->pid = fork ();
+  if (job->pid == -1)
+    {
+      mu_diag_funcall (MU_DIAG_ERROR, "fork", NULL, errno);
+      close (p[0]);
+      close (p[1]);
+      job->pid = 0;
+      job->status = EX_TEMPFAIL;
+      return 1;
+    }
+  if (job->pid == 0)
+    {
+      close (p[0]);
+      job_run (job, p[1]);
+    }
+  close (p[1]);
+  job->fd = p[0];
+  return 0;
+}
+
+static void
+job_finish (struct dlv_job *job, int status)
+{
+  char buf[512];
+  ssize_t n;
+  size_t len = 0;
+  
+  job->pid = 0;
+  if (WIFEXITED (status))
+    job->status = WEXITSTATUS (status);
+  else
+    job->status = EX_TEMPFAIL;
+  
+  while ((n = read (job->fd, buf, sizeof buf)) > 0)
+    {
+      char *p = realloc (job->errp, len + n + 1);
+      if (!p)
+	break;
+      memcpy (p + len, buf, n);
+      len += n;
+      p[len] = 0;
+      job->errp = p;
+    }
+  close (job->fd);
+}
+
+/* Wait for one of the running jobs to terminate.  Return the number of
+   jobs that terminated. */
+static size_t
+job_wait (struct dlv_job *jobs, size_t count)
+{
+  int status;
+  pid_t pid;
+  size_t i, n = 0;
+  
+  pid = waitpid (-1, &status, 0);
+  if (pid == -1)
+    {
+      if (errno == EINTR)
+	return 0;
+      /* Should not happen: somebody else has reaped our children */
+      mu_diag_funcall (MU_DIAG_ERROR, "waitpid", NULL, errno);
+      for (i = 0; i < count; i++)
+	if (jobs[i].pid)
+	  {
+	    job_finish (&jobs[i], -1);
+	    n++;
+	  }
+      return n;
+    }
+  for (i = 0; i < count; i++)
+    if (jobs[i].pid == pid)
+      {
+	job_finish (&jobs[i], status);
+	return 1;
+      }
+  return 0;
+}
+
+static void
+dot_deliver_parallel (mu_stream_t iostr)
+{
+  size_t count, i, next, running = 0;
+  struct dlv_job *jobs;
+  mu_iterator_t itr;
+  RETSIGTYPE (*chld) (int);
+  
+  mu_list_count (rcpt_list, &count);
+  jobs = calloc (count, sizeof (jobs[0]));
+  if (!jobs || mu_list_get_iterator (rcpt_list, &itr))
+    {
+      free (jobs);
+      mu_list_foreach (rcpt_list, dot_deliver, iostr);
+      return;
+    }
+  for (i = 0, mu_iterator_first (itr); !mu_iterator_is_done (itr);
+       mu_iterator_next (itr), i++)
+    mu_iterator_current (itr, (void**) &jobs[i].name);
+  mu_iterator_destroy (&itr);
+
+  /* Don't let the server's SIGCHLD handler reap our children */
+  chld = signal (SIGCHLD, SIG_DFL);
+  for (i = next = 0; i < count || running; )
+    {
+      if (i < count && running < lmtp_delivery_jobs)
+	{
+	  if (job_start (&jobs[i]) == 0)
+	    running++;
+	  i++;
+	}
+      else
+	running -= job_wait (jobs, count);
+
+      for (; next < i && jobs[next].pid == 0; next++)
+	{
+	  dot_reply (iostr, jobs[next].name, jobs[next].status,
+		     jobs[next].errp);
+	  free (jobs[next].errp);
+	}
+      lmtp_flush (iostr);
+    }
+  signal (SIGCHLD, chld);
+  free (jobs);
+}
+
 int
 cfun_data (mu_stream_t iostr, char *arg)
 {
@@ -347,6 +602,8 @@ cfun_data (mu_stream_t iostr, char *arg)
   time_t t;
   struct tm *tm;
   int xlev = MU_XSCRIPT_PAYLOAD, xlev_switch = 0;
+  size_t count;
+  int parallel;
   
   if (*arg)
     {
@@ -364,7 +621,9 @@ cfun_data (mu_stream_t iostr, char *arg)
       return 1;
     }
 
-  rc = mu_temp_file_stream_create (&tempstr, NULL, 0);
+  mu_list_count (rcpt_list, &count);
+  parallel = lmtp_delivery_jobs > 1 && count > 1;
+  rc = spool_create (&tempstr, parallel);
   if (rc)
     {
       maidag_error (_("unable to open temporary file: %s"), mu_strerror (rc));
@@ -387,6 +646,7 @@ cfun_data (mu_stream_t iostr, char *arg)
     }
 
   lmtp_reply (iostr, "354", NULL, "Go ahead");
+  lmtp_flush (iostr);
 
   if (mu_stream_ioctl (iostr, MU_IOCTL_XSCRIPTSTREAM,
                        MU_IOCTL_XSCRIPTSTREAM_LEVEL, &xlev) == 0)
@@ -411,9 +671,16 @@ cfun_data (mu_stream_t iostr, char *arg)
       mu_list_foreach (rcpt_list, dot_temp_fail, iostr);
     }
   
-  rc = mu_list_foreach (rcpt_list, dot_deliver, iostr);
+  if (parallel)
+    {
+      dot_deliver_parallel (iostr);
+      rc = 0;
+    }
+  else
+    rc = mu_list_foreach (rcpt_list, dot_deliver, iostr);
 
   mu_message_destroy (&mesg, mu_message_get_owner (mesg));
+  spool_remove ();
   if (rc)
     mu_list_foreach (rcpt_list, dot_temp_fail, iostr);
 
@@ -515,6 +782,13 @@ to_fgets (mu_stream_t iostr, char **pbuf, size_t *psize, size_t *pnread,
 	  unsigned int timeout)
 {
   int rc;
+  int flags = MU_STREAM_READY_RD;
+  struct timeval tv = { 0, 0 };
+  
+  /* Replies to pipelined commands are accumulated in the output buffer
+     and sent when no more input is available (RFC 2920, 3.2) */
+  if (mu_stream_wait (iostr, &flags, &tv) || !(flags & MU_STREAM_READY_RD))
+    lmtp_flush (iostr);
   
   alarm (timeout);
   rc = mu_stream_getline (iostr, pbuf, psize, pnread);
@@ -555,6 +829,7 @@ lmtp_loop (mu_stream_t iostr, unsigned int timeout)
       if (state == state_end)
 	break;
     }
+  lmtp_flush (iostr);
   return 0;
 }
 
@@ -570,16 +845,36 @@ lmtp_connection (int fd, struct sockaddr *sa, int salen,
 		 struct mu_srv_config *pconf,
 		 void *data)
 {
-  mu_stream_t str;
-  int rc;
-  
-  rc = mu_fd_stream_create (&str, NULL, fd, MU_STREAM_RDWR);
+  mu_stream_t str, istream, ostream;
+  int rc, yes = 1;
+
+  /* Use separate streams for input and output.  The input is line
+     buffered, so that the CRLFDOT filter in cfun_data does not read past
+     the end of the message.  The output is fully buffered and flushed
+     before waiting for more input (see to_fgets). */
+  rc = mu_fd_stream_create (&istream, NULL, fd, MU_STREAM_READ);
   if (rc)
     {
       mu_diag_funcall (MU_DIAG_ERROR, "mu_fd_stream_create", NULL, rc);
       return rc;
     }
-  mu_stream_set_buffer (str, mu_buffer_line, 0);
+  mu_stream_set_buffer (istream, mu_buffer_line, 0);
+  rc = mu_fd_stream_create (&ostream, NULL, fd, MU_STREAM_WRITE);
+  if (rc)
+    {
+      mu_diag_funcall (MU_DIAG_ERROR, "mu_fd_stream_create", NULL, rc);
+      mu_stream_destroy (&istream);
+      return rc;
+    }
+  mu_stream_ioctl (ostream, MU_IOCTL_FD, MU_IOCTL_FD_SET_BORROW, &yes);
+  rc = mu_iostream_create (&str, istream, ostream);
+  mu_stream_unref (istream);
+  mu_stream_unref (ostream);
+  if (rc)
+    {
+      mu_diag_funcall (MU_DIAG_ERROR, "mu_iostream_create", NULL, rc);
+      return rc;
+    }
 
   if (pconf->transcript || maidag_transcript)
     str = lmtp_transcript (str);
@@ -686,6 +981,7 @@ maidag_lmtp_server ()
 			   "MU_STDOUT_FD", rc);
 	  return 1;
 	} 
+      mu_stream_set_buffer (ostream, mu_buffer_full, 0);
 
       rc = mu_iostream_create (&str, istream, ostream);
       mu_stream_unref (istream);
@@ -450,6 +450,10 @@ struct mu_cfg_param maidag_cfg_param[] = {
        "sql { ... } instead."),
     N_("query") },
 #endif
+  { "sieve-cache-size", mu_cfg_size, &sieve_cache_size, 0, NULL,
+    N_("Keep at most this number of compiled Sieve scripts in memory.  "
+       "Zero disables caching."),
+    N_("n") },
   { "message-id-header", mu_cfg_string, &message_id_header, 0, NULL,
     N_("When logging Sieve actions, identify messages by the value of "
        "this header."),
@@ -481,6 +485,14 @@ struct mu_cfg_param maidag_cfg_param[] = {
     N_("url") },
   { "reuse-address", mu_cfg_bool, &reuse_lmtp_address, 0, NULL,
     N_("Reuse existing address (LMTP mode).  Default is \"yes\".") },
+  { "delivery-jobs", mu_cfg_size, &lmtp_delivery_jobs, 0, NULL,
+    N_("In LMTP mode, deliver the message to at most this number of "
+       "recipients in parallel.  Default is 1."),
+    N_("n") },
+  { "spool-directory", mu_cfg_string, &lmtp_spool_dir, 0, NULL,
+    N_("In LMTP mode, keep incoming messages in temporary files in this "
+       "directory."),
+    N_("dir") },
   { "filter", mu_cfg_section, NULL, 0, NULL,
     N_("Add a message filter") },
   { ".server", mu_cfg_section, NULL, 0, NULL,
@@ -136,6 +136,8 @@ extern mu_m_server_t server;
 extern char *lmtp_url_string;
 extern int reuse_lmtp_address;
 extern mu_list_t lmtp_groups;
+extern size_t lmtp_delivery_jobs;
+extern char *lmtp_spool_dir;
 extern mu_acl_t maidag_acl;
 extern int maidag_transcript;
 
@@ -200,6 +202,7 @@ int python_check_msg (mu_message_t msg, struct mu_auth_data *auth,
 		      const char *prog);
 
 /* sieve.c */
+extern size_t sieve_cache_size;
 int sieve_check_msg (mu_message_t msg, struct mu_auth_data *auth,
 		     const char *prog);
 
@@ -172,66 +172,13 @@ int
 sql_retrieve_quota (char *name, mu_off_t *quota)
 {
   mu_sql_connection_t conn;
-  char *query_str;
   int rc, status;
   char *tmp;
   size_t n;
   
-  query_str = mu_sql_expand_query (quota_query, name);
-  if (!query_str)
+  if (mu_sql_run_query (&conn, "quota", quota_query, name))
     return RETR_FAILURE;
 
-  status = mu_sql_connection_init (&conn,
-				   mu_sql_module_config.interface,
-				   mu_sql_module_config.host,
-				   mu_sql_module_config.port,
-				   mu_sql_module_config.user,
-				   mu_sql_module_config.passwd,
-				   mu_sql_module_config.db);
-  
-  if (status)
-    {
-      mu_error ("%s. SQL error: %s",
-		mu_strerror (status), mu_sql_strerror (conn));
-      mu_sql_connection_destroy (&conn);
-      free (query_str);
-      return RETR_FAILURE;
-    }
-
-  status = mu_sql_connect (conn);
-
-  if (status)
-    {
-      mu_error ("%s. SQL error: %s",
-		mu_strerror (status), mu_sql_strerror (conn));
-      mu_sql_connection_destroy (&conn);
-      free (query_str);
-      return  RETR_FAILURE;
-    }
-  
-  status = mu_sql_query (conn, query_str);
-  free (query_str);
-  
-  if (status)
-    {
-      mu_error (_("SQL query failed: %s"),
-		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
-	 	                          mu_strerror (status));
-      mu_sql_connection_destroy (&conn);
-      return  RETR_FAILURE;
-    }
-
-  status = mu_sql_store_result (conn);
-
-  if (status)
-    {
-      mu_error (_("cannot store SQL result: %s"),
-		(status == MU_ERR_SQL) ?  mu_sql_strerror (conn) :
-	 	                          mu_strerror (status));
-      mu_sql_connection_destroy (&conn);
-      return RETR_FAILURE;
-    }
-
   mu_sql_num_tuples (conn, &n);
   if (n == 0)
     {
@@ -264,9 +211,7 @@ sql_retrieve_quota (char *name, mu_off_t *quota)
 	}
     }
   
-  mu_sql_release_result (conn);
-  mu_sql_disconnect (conn);
-  mu_sql_connection_destroy (&conn);
+  mu_sql_pool_put (&conn, 0);
   return rc;
 }
 #endif
@@ -57,29 +57,296 @@ _sieve_action_log (void *user_name,
   mu_stream_printf (stream, "\n");
 }
 
-int
-sieve_check_msg (mu_message_t msg, struct mu_auth_data *auth, const char *prog)
+/* Cache of compiled scripts.
+
+   Compiling a script takes considerably more time than running it, so
+   in LMTP mode, where a single process serves many deliveries, the
+   compiled machines are kept in a list, the most recently used one
+   first.  A cached machine is never run itself: each message is
+   processed by a duplicate of it (see mu_sieve_machine_dup), which
+   shares the compiled code but has its own runtime state.
+
+   A machine is identified by the script file name, the user it was
+   compiled for, and the device, inode, modification time and size of
+   the file and of each file it includes.  If any of these changes, the
+   script is compiled anew. */
+
+size_t sieve_cache_size = 16;  /* Max. number of cached machines */
+static mu_list_t sieve_cache;
+
+struct sieve_source_stat
 {
-  int rc;
+  char *file;
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+  off_t size;
+};
+
+struct sieve_cache_entry
+{
+  char *file;
+  uid_t uid;
+  struct sieve_source_stat *srcv; /* The script and the included files */
+  size_t srcc;
   mu_sieve_machine_t mach;
+};
+
+static void
+sieve_cache_entry_free (void *item)
+{
+  struct sieve_cache_entry *ent = item;
+  size_t i;
+  
+  free (ent->file);
+  for (i = 0; i < ent->srcc; i++)
+    free (ent->srcv[i].file);
+  free (ent->srcv);
+  if (ent->mach)
+    mu_sieve_machine_destroy (&ent->mach);
+  free (ent);
+}
+
+static void
+source_stat_set (struct sieve_source_stat *sp, struct stat *st)
+{
+  sp->dev = st->st_dev;
+  sp->ino = st->st_ino;
+  sp->mtime = st->st_mtime;
+  sp->size = st->st_size;
+}
+
+static int
+source_stat_changed (struct sieve_source_stat *sp, struct stat *st)
+{
+  return sp->dev != st->st_dev || sp->ino != st->st_ino
+         || sp->mtime != st->st_mtime || sp->size != st->st_size;
+}
+
+/* Return true if any of the sources of ENT has changed since it was
+   compiled.  ST is the current status of the script file. */
+static int
+sieve_cache_entry_stale (struct sieve_cache_entry *ent, struct stat *st)
+{
+  size_t i;
+  struct stat ist;
+  
+  if (source_stat_changed (&ent->srcv[0], st))
+    return 1;
+  for (i = 1; i < ent->srcc; i++)
+    if (stat (ent->srcv[i].file, &ist)
+	|| source_stat_changed (&ent->srcv[i], &ist))
+      return 1;
+  return 0;
+}
+
+/* Look up the machine compiled from FILE for user UID.  If found,
+   move it to the head of the cache.  A stale entry is removed. */
+static mu_sieve_machine_t
+sieve_cache_lookup (const char *file, uid_t uid, struct stat *st)
+{
+  mu_iterator_t itr;
+  struct sieve_cache_entry *ent, *found = NULL;
+
+  if (!sieve_cache || mu_list_get_iterator (sieve_cache, &itr))
+    return NULL;
+  for (mu_iterator_first (itr); !mu_iterator_is_done (itr);
+       mu_iterator_next (itr))
+    {
+      mu_iterator_current (itr, (void**)&ent);
+      if (ent->uid == uid && strcmp (ent->file, file) == 0)
+	{
+	  found = ent;
+	  break;
+	}
+    }
+  mu_iterator_destroy (&itr);
+  
+  if (!found)
+    return NULL;
+  if (sieve_cache_entry_stale (found, st))
+    {
+      mu_list_remove (sieve_cache, found);
+      return NULL;
+    }
+  if (mu_list_remove_nd (sieve_cache, found) == 0
+      && mu_list_prepend (sieve_cache, found))
+    {
+      sieve_cache_entry_free (found);
+      return NULL;
+    }
+  return found->mach;
+}
+
+/* Record in ENT the status of the files included by its script */
+static int
+sieve_cache_entry_sources (struct sieve_cache_entry *ent)
+{
+  mu_list_t list;
+  mu_iterator_t itr;
+  size_t count;
+  struct sieve_source_stat *p;
+  int rc;
+
+  rc = mu_sieve_get_source_list (ent->mach, &list);
+  if (rc == 0)
+    rc = mu_list_count (list, &count);
+  if (rc)
+    return rc;
+  p = realloc (ent->srcv, (count + 1) * sizeof (ent->srcv[0]));
+  if (!p)
+    return ENOMEM;
+  ent->srcv = p;
+  rc = mu_list_get_iterator (list, &itr);
+  if (rc)
+    return rc;
+  for (mu_iterator_first (itr); !mu_iterator_is_done (itr);
+       mu_iterator_next (itr))
+    {
+      const char *name;
+      struct sieve_source_stat *sp = &ent->srcv[ent->srcc];
+      struct stat st;
+      
+      mu_iterator_current (itr, (void**)&name);
+      if (strcmp (name, ent->file) == 0)
+	continue;
+      if (stat (name, &st))
+	{
+	  rc = errno;
+	  break;
+	}
+      sp->file = strdup (name);
+      if (!sp->file)
+	{
+	  rc = ENOMEM;
+	  break;
+	}
+      source_stat_set (sp, &st);
+      ent->srcc++;
+    }
+  mu_iterator_destroy (&itr);
+  return rc;
+}
 
+/* Add MACH, compiled from FILE for user UID, to the cache.  Return 0 on
+   success.  On error, MACH is not cached and the caller remains
+   responsible for it. */
+static int
+sieve_cache_add (const char *file, uid_t uid, struct stat *st,
+		 mu_sieve_machine_t mach)
+{
+  struct sieve_cache_entry *ent;
+  size_t count;
+  int rc;
+  
+  if (!sieve_cache)
+    {
+      rc = mu_list_create (&sieve_cache);
+      if (rc)
+	return rc;
+      mu_list_set_destroy_item (sieve_cache, sieve_cache_entry_free);
+    }
+
+  ent = calloc (1, sizeof (*ent));
+  if (!ent)
+    return ENOMEM;
+  ent->file = strdup (file);
+  ent->srcv = malloc (sizeof (ent->srcv[0]));
+  if (!ent->file || !ent->srcv)
+    rc = ENOMEM;
+  else
+    {
+      ent->uid = uid;
+      ent->srcv[0].file = NULL; /* Same as ent->file */
+      source_stat_set (&ent->srcv[0], st);
+      ent->srcc = 1;
+      ent->mach = mach;
+      rc = sieve_cache_entry_sources (ent);
+      if (rc == 0)
+	rc = mu_list_prepend (sieve_cache, ent);
+    }
+  if (rc)
+    {
+      ent->mach = NULL;
+      sieve_cache_entry_free (ent);
+      return rc;
+    }
+
+  /* Evict the least recently used entries */
+  while (mu_list_count (sieve_cache, &count) == 0 && count > sieve_cache_size)
+    {
+      void *last;
+      if (mu_list_tail (sieve_cache, &last))
+	break;
+      mu_list_remove (sieve_cache, last);
+    }
+  return 0;
+}
+
+static int
+sieve_compile (mu_sieve_machine_t *pmach, const char *prog)
+{
+  mu_sieve_machine_t mach;
+  int rc;
+  
   rc = mu_sieve_machine_init (&mach);
   if (rc)
     {
       mu_error (_("Cannot initialize sieve machine: %s"),
 		mu_strerror (rc));
+      return rc;
     }
+  if (sieve_enable_log)
+    mu_sieve_set_logger (mach, _sieve_action_log);
+  rc = mu_sieve_compile (mach, prog);
+  if (rc)
+    mu_sieve_machine_destroy (&mach);
   else
+    *pmach = mach;
+  return rc;
+}
+
+int
+sieve_check_msg (mu_message_t msg, struct mu_auth_data *auth, const char *prog)
+{
+  int rc;
+  mu_sieve_machine_t mach, cmach;
+  struct stat st;
+  
+  if (sieve_cache_size == 0 || stat (prog, &st))
     {
-      mu_sieve_set_data (mach, auth->name);
-      if (sieve_enable_log)
-	mu_sieve_set_logger (mach, _sieve_action_log);
-	  
-      rc = mu_sieve_compile (mach, prog);
-      if (rc == 0)
-	mu_sieve_message (mach, msg);
-      mu_sieve_machine_destroy (&mach);
+      if (sieve_compile (&mach, prog) == 0)
+	{
+	  mu_sieve_set_data (mach, auth->name);
+	  mu_sieve_message (mach, msg);
+	  mu_sieve_machine_destroy (&mach);
+	}
+      return 0;
     }
+
+  cmach = sieve_cache_lookup (prog, auth->uid, &st);
+  if (!cmach)
+    {
+      if (sieve_compile (&cmach, prog))
+	return 0;
+      if (sieve_cache_add (prog, auth->uid, &st, cmach))
+	{
+	  mu_sieve_set_data (cmach, auth->name);
+	  mu_sieve_message (cmach, msg);
+	  mu_sieve_machine_destroy (&cmach);
+	  return 0;
+	}
+    }
+
+  rc = mu_sieve_machine_dup (cmach, &mach);
+  if (rc)
+    {
+      mu_error (_("Cannot initialize sieve machine: %s"),
+		mu_strerror (rc));
+      return 0;
+    }
+  mu_sieve_set_data (mach, auth->name);
+  mu_sieve_message (mach, msg);
+  mu_sieve_machine_destroy (&mach);
   return 0;
 }
-
@@ -0,0 +1,114 @@
+#! /bin/sh
+# Measure the per-message cost of Sieve filtering in maidag LMTP mode.
+# Copyright (C) 2013 Free Software Foundation, Inc.
+#
+# GNU Mailutils is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 3, or (at
+# your option) any later version.
+#
+# GNU Mailutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>.
+
+# Usage: sievebench.sh [-r RULES] [-o MAIDAG-OPTION]... [COUNT]
+#
+# Run from the maidag/tests build directory.  A Sieve script of RULES
+# rules (default 200) is created, and COUNT messages (default 500) are
+# delivered to the current user in a single LMTP session, first with the
+# compiled script cache disabled, then with it enabled.  The average
+# time per message is printed for each run, along with the time of a
+# run without the script, which gives the cost of the delivery itself.
+
+rules=200
+opts=
+while test $# -gt 0
+do
+  case $1 in
+  -r) rules=$2; shift 2;;
+  -o) opts="$opts $2"; shift 2;;
+  *)  break
+  esac
+done
+count=${1:-500}
+
+: ${MAIDAG:=`pwd`/../maidag}
+
+dir=`mktemp -d ${TMPDIR:-/tmp}/sievebench.XXXXXX` || exit 1
+trap 'rm -rf $dir' 0 1 2 13 15
+user=`id -un`
+
+# Create the script.  None of the rules matches, so that each message
+# runs through all of them and is kept.
+{ echo 'require ["fileinto", "reject"];'
+  i=0
+  while test $i -lt $rules
+  do
+    case `expr $i % 4` in
+    0) echo "if header :contains \"subject\" \"rule$i\" { discard; stop; }";;
+    1) echo "if address :domain :is \"from\" \"domain$i.example.net\" { fileinto \"$dir/box$i\"; }";;
+    2) echo "if allof (size :over 1M, header :matches \"to\" \"*rule$i*\") { reject \"too big\"; }";;
+    3) echo "if exists \"X-Rule$i\" { fileinto \"$dir/box$i\"; }";;
+    esac
+    i=`expr $i + 1`
+  done
+} > $dir/filter.sv
+
+# Create the session
+{ i=0
+  while test $i -lt $count
+  do
+    cat <<EOF
+LHLO localhost
+MAIL FROM:<gulliver@example.net>
+RCPT TO:<$user>
+DATA
+From: Lemuel Gulliver <gulliver@example.net>
+To: $user
+Subject: Message $i
+
+Message $i
+.
+RSET
+EOF
+    i=`expr $i + 1`
+  done
+  echo QUIT
+} | sed 's/$/\r/' > $dir/session
+
+now() {
+  date +%s%N
+}
+
+# run [OPTION...]
+# Deliver the messages.  Print the elapsed time in ns.
+run() {
+  rm -f $dir/$user
+  start=`now`
+  $MAIDAG --no-site-config --no-user-config \
+          --set "|mailbox|mailbox-pattern=$dir/\${user}" \
+          --set .auth.authorization=system --set 'group=()' \
+          $opts "$@" --lmtp < $dir/session > $dir/output 2>/dev/null
+  stop=`now`
+  if test `grep -c ': delivered' $dir/output` -ne $count; then
+    echo >&2 "$0: delivery failed"
+    exit 1
+  fi
+  echo `expr $stop - $start`
+}
+
+report() {
+  printf "%-30s %10.3f ms/message\n" "$1" `expr $2 / $count / 1000`e-3
+}
+
+base=`run` || exit 1
+nocache=`run --script=$dir/filter.sv --set sieve-cache-size=0` || exit 1
+cache=`run --script=$dir/filter.sv` || exit 1
+
+report "no script" $base
+report "sieve, no cache" $nocache
+report "sieve, cache" $cache
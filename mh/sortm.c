@@ -27,6 +27,7 @@ static char args_doc[] = N_("[MSGLIST]");
 
 #define ARG_QUICKSORT 1024
 #define ARG_SHELL     1025
+#define ARG_MERGESORT 1026
 
 /* GNU options */
 static struct argp_option options[] = {
@@ -71,6 +72,8 @@ static struct argp_option options[] = {
    N_("use shell algorithm"), 40 },
   {"quicksort", ARG_QUICKSORT,  0, 0,
    N_("use quicksort algorithm (default)"), 40 },
+  {"mergesort", ARG_MERGESORT,  0, 0,
+   N_("use stable merge sort algorithm"), 40 },
 
   { NULL },
 };
@@ -106,12 +109,34 @@ static int action = ACTION_REORDER;
 static char *format_str = mh_list_format;
 static mh_format_t format;
 
-typedef int (*compfun) (void *, void *);
-static void addop (char *field, compfun comp);
-static void remop (compfun comp);
-static int comp_text (void *a, void *b);
-static int comp_date (void *a, void *b);
-static int comp_number (void *a, void *b);
+/* Sort keys are extracted from each message only once, before sorting.
+   A key is not set if the message lacks the corresponding header, or if
+   its value cannot be parsed.  Such keys compare equal to anything. */
+struct sort_key
+{
+  int set;                   /* Key is present */
+  union
+  {
+    char *text;              /* Case-folded text */
+    long number;             /* Numeric value */
+    time_t date;             /* Parsed date */
+  } v;
+};
+
+typedef int (*compfun) (struct sort_key *, struct sort_key *);
+
+struct sort_type
+{
+  int (*key) (struct sort_key *, const char *);
+  compfun comp;
+};
+
+static void addop (char *field, struct sort_type *type);
+static void remop (struct sort_type *type);
+static int comp_text (struct sort_key *a, struct sort_key *b);
+static int comp_date (struct sort_key *a, struct sort_key *b);
+static int comp_number (struct sort_key *a, struct sort_key *b);
+static struct sort_type text_type, date_type, number_type;
 
 static error_t
 opt_handler (int key, char *arg, struct argp_state *state)
@@ -123,23 +148,23 @@ opt_handler (int key, char *arg, struct argp_state *state)
       break;
       
     case ARG_DATEFIELD:
-      addop (arg, comp_date);
+      addop (arg, &date_type);
       break;
       
     case ARG_NUMFIELD:
-      addop (arg, comp_number);
+      addop (arg, &number_type);
       break;
 
     case ARG_NODATEFIELD:
-      remop (comp_date);
+      remop (&date_type);
       break;
       
     case ARG_TEXTFIELD:
-      addop (arg, comp_text);
+      addop (arg, &text_type);
       break;
       
     case ARG_NOTEXTFIELD:
-      remop (comp_text);
+      remop (&text_type);
       break;
       
     case ARG_LIMIT:
@@ -185,6 +210,7 @@ opt_handler (int key, char *arg, struct argp_state *state)
 
     case ARG_SHELL:
     case ARG_QUICKSORT:
+    case ARG_MERGESORT:
       algorithm = key;
       break;
       
@@ -196,16 +222,25 @@ opt_handler (int key, char *arg, struct argp_state *state)
 
 
 /* *********************** Comparison functions **************************** */
+
+static int key_text (struct sort_key *key, const char *value);
+static int key_date (struct sort_key *key, const char *value);
+static int key_number (struct sort_key *key, const char *value);
+
+static struct sort_type text_type = { key_text, comp_text };
+static struct sort_type date_type = { key_date, comp_date };
+static struct sort_type number_type = { key_number, comp_number };
+
 struct comp_op
 {
   char *field;
-  compfun comp;
+  struct sort_type *type;
 };
 
 static mu_list_t oplist;
 
 static void
-addop (char *field, compfun comp)
+addop (char *field, struct sort_type *type)
 {
   struct comp_op *op = mu_alloc (sizeof (*op));
   
@@ -219,14 +254,14 @@ addop (char *field, compfun comp)
       mu_list_set_destroy_item (oplist, mu_list_free_item);
     }
   op->field = field;
-  op->comp = comp;
+  op->type = type;
   mu_list_append (oplist, op);
 }
 
 struct rem_data
 {
   struct comp_op *op;
-  compfun comp;
+  struct sort_type *type;
 };
 
 static int
@@ -234,108 +269,67 @@ rem_action (void *item, void *data)
 {
   struct comp_op *op = item;
   struct rem_data *d = data;
-  if (d->comp == op->comp)
+  if (d->type == op->type)
     d->op = op;
   return 0;
 }
 
 static void
-remop (compfun comp)
+remop (struct sort_type *type)
 {
   struct rem_data d;
-  d.comp = comp;
+  d.type = type;
   d.op = NULL;
   mu_list_foreach (oplist, rem_action, &d);
   mu_list_remove (oplist, d.op);
 }
 
-struct comp_data
-{
-  int r;
-  mu_message_t m[2];
-};
-
 static int
-compare_action (void *item, void *data)
+key_text (struct sort_key *key, const char *value)
 {
-  struct comp_op *op = item;
-  struct comp_data *dp = data;
-  char *a, *ap, *b, *bp;
-  mu_header_t h;
-  
-  if (mu_message_get_header (dp->m[0], &h)
-      || mu_header_aget_value (h, op->field, &a))
-    return 0;
+  char *p;
 
-  if (mu_message_get_header (dp->m[1], &h)
-      || mu_header_aget_value (h, op->field, &b))
-    {
-      free (a);
-      return 0;
-    }
-
-  ap = a;
-  bp = b;
-  if (mu_c_strcasecmp (op->field, MU_HEADER_SUBJECT) == 0)
-    {
-      if (mu_c_strncasecmp (ap, "re:", 3) == 0)
-	ap += 3;
-      if (mu_c_strncasecmp (b, "re:", 3) == 0)
-	bp += 3;
-    }
-  
-  dp->r = op->comp (ap, bp);
-  free (a);
-  free (b);
-
-  return dp->r; /* go on until the difference is found */
+  key->v.text = mu_strdup (value);
+  /* Fold the same way as mu_c_strcasecmp does */
+  for (p = key->v.text; *p; p++)
+    if (mu_isascii (*p))
+      *p = mu_toupper (*p);
+  return 0;
 }
 
+/* Compare the folded keys as mu_c_strcasecmp compares the original
+   values, i.e. as plain (possibly signed) chars, so that 8-bit text
+   sorts as before. */
 static int
-compare_messages (mu_message_t a, mu_message_t b, size_t anum, size_t bnum)
+comp_text (struct sort_key *a, struct sort_key *b)
 {
-  struct comp_data d;
+  const char *p = a->v.text, *q = b->v.text;
 
-  d.r = 0;
-  d.m[0] = a;
-  d.m[1] = b;
-  mu_list_foreach (oplist, compare_action, &d);
-  if (d.r == 0)
-    {
-      if (anum < bnum)
-	d.r = -1;
-      else if (anum > bnum)
-	d.r = 1;
-    }
-      
-  if (verbose > 1)
-    fprintf (stderr, "%d\n", d.r);
-  return d.r;
+  for (; *p && *p == *q; p++, q++)
+    ;
+  return (int) *p - (int) *q;
 }
 
 static int
-comp_text (void *a, void *b)
+key_number (struct sort_key *key, const char *value)
 {
-  return mu_c_strcasecmp (a, b);
+  key->v.number = strtol (value, NULL, 0);
+  return 0;
 }
 
 static int
-comp_number (void *a, void *b)
+comp_number (struct sort_key *a, struct sort_key *b)
 {
-  long na, nb;
-
-  na = strtol (a, NULL, 0);
-  nb = strtol (b, NULL, 0);
-  if (na > nb)
+  if (a->v.number > b->v.number)
     return 1;
-  else if (na < nb)
+  else if (a->v.number < b->v.number)
     return -1;
   return 0;
 }
 
 /*FIXME: Also used in imap4d*/
 static int
-_parse_822_date (char *date, time_t * timep)
+_parse_822_date (const char *date, time_t * timep)
 {
   struct tm tm;
   struct mu_timezone tz;
@@ -350,13 +344,16 @@ _parse_822_date (char *date, time_t * timep)
 }
 
 static int
-comp_date (void *a, void *b)
+key_date (struct sort_key *key, const char *value)
 {
-  time_t ta, tb;
-  
-  if (_parse_822_date (a, &ta) || _parse_822_date (b, &tb))
-    return 0;
+  return _parse_822_date (value, &key->v.date);
+}
 
+static int
+comp_date (struct sort_key *a, struct sort_key *b)
+{
+  time_t ta = a->v.date, tb = b->v.date;
+  
   if (ta < tb)
     {
       if (limit && tb - ta <= limit)
@@ -372,32 +369,125 @@ comp_date (void *a, void *b)
   return 0;
 }
 
-
-/* *********************** Sorting routines ***************************** */
+
+/* ****************************** Sort keys ******************************* */
+
+struct sort_entry
+{
+  size_t msgno;
+  struct sort_key *keys;     /* Array of nops keys */
+};
+
+static struct comp_op **ops;
+static size_t nops;
+static struct sort_entry *entries;
+static struct sort_key *keybuf;
 
 static int
-comp0 (size_t na, size_t nb)
+_add_op (void *item, void *data)
+{
+  ops[nops++] = item;
+  return 0;
+}
+
+static void
+fill_keys (struct sort_entry *ent)
+{
+  mu_message_t msg;
+  mu_header_t h;
+  size_t i;
+
+  if (mu_mailbox_get_message (mbox, ent->msgno, &msg)
+      || mu_message_get_header (msg, &h))
+    return;
+  for (i = 0; i < nops; i++)
+    {
+      const char *val;
+
+      if (mu_header_sget_value (h, ops[i]->field, &val))
+	continue;
+      if (mu_c_strcasecmp (ops[i]->field, MU_HEADER_SUBJECT) == 0
+	  && mu_c_strncasecmp (val, "re:", 3) == 0)
+	val += 3;
+      ent->keys[i].set = ops[i]->type->key (&ent->keys[i], val) == 0;
+    }
+}
+
+/* Extract sort keys from all messages in msgarr. */
+static void
+make_keys ()
+{
+  size_t i, count;
+
+  mu_list_count (oplist, &count);
+  ops = mu_calloc (count, sizeof (ops[0]));
+  nops = 0;
+  mu_list_foreach (oplist, _add_op, NULL);
+
+  entries = mu_calloc (msgcount, sizeof (entries[0]));
+  keybuf = mu_calloc (msgcount * nops, sizeof (keybuf[0]));
+  for (i = 0; i < msgcount; i++)
+    {
+      entries[i].msgno = msgarr[i];
+      entries[i].keys = keybuf + i * nops;
+      fill_keys (&entries[i]);
+    }
+}
+
+/* Store the sorted message numbers back to msgarr and free the keys. */
+static void
+free_keys ()
 {
-  mu_message_t a, b;
+  size_t i, j;
 
-  if (mu_mailbox_get_message (mbox, na, &a)
-      || mu_mailbox_get_message (mbox, nb, &b))
-    return 0;
+  for (i = 0; i < msgcount; i++)
+    {
+      msgarr[i] = entries[i].msgno;
+      for (j = 0; j < nops; j++)
+	if (ops[j]->type == &text_type && entries[i].keys[j].set)
+	  free (entries[i].keys[j].v.text);
+    }
+  free (keybuf);
+  free (entries);
+  free (ops);
+}
+
+
+/* *********************** Sorting routines ***************************** */
+
+static int
+comp0 (struct sort_entry *a, struct sort_entry *b)
+{
+  size_t i;
+  int r = 0;
+  
   if (verbose > 1)
     fprintf (stderr,
 	     _("comparing messages %s and %s: "),
-	     mu_umaxtostr (0, na),
-	     mu_umaxtostr (1, nb));
-  return compare_messages (a, b, na, nb);
+	     mu_umaxtostr (0, a->msgno),
+	     mu_umaxtostr (1, b->msgno));
+  for (i = 0; r == 0 && i < nops; i++)
+    if (a->keys[i].set && b->keys[i].set)
+      r = ops[i]->type->comp (&a->keys[i], &b->keys[i]);
+  if (r == 0)
+    {
+      if (a->msgno < b->msgno)
+	r = -1;
+      else if (a->msgno > b->msgno)
+	r = 1;
+    }
+  if (verbose > 1)
+    fprintf (stderr, "%d\n", r);
+  return r;
 }
 
 int
 comp (const void *a, const void *b)
 {
-  return comp0 (* (size_t*) a, * (size_t*) b);
+  return comp0 ((struct sort_entry *) a, (struct sort_entry *) b);
 }
 
-
+
 /* ****************************** Shell sort ****************************** */
 #define prevdst(h) ((h)-1)/3
 
@@ -416,7 +506,7 @@ void
 shell_sort ()
 {
     int h, s, i, j;
-    size_t hold;
+    struct sort_entry hold;
 
     for (h = startdst (msgcount, &s); s > 0; s--, h = prevdst (h))
       {
@@ -424,15 +514,58 @@ shell_sort ()
 	  fprintf (stderr, _("distance %d\n"), h);
         for (j = h; j < msgcount; j++)
 	  {
-            hold = msgarr[j];
+            hold = entries[j];
             for (i = j - h;
-		 i >= 0 && comp0 (hold, msgarr[i]) < 0; i -= h)
-	      msgarr[i + h] = msgarr[i];
-	    msgarr[i + h] = hold;
+		 i >= 0 && comp0 (&hold, &entries[i]) < 0; i -= h)
+	      entries[i + h] = entries[i];
+	    entries[i + h] = hold;
 	  }
       }
 }
 
+
+/* ****************************** Merge sort ****************************** */
+
+/* Sort N entries starting at BASE.  TMP is a scratch array of at least
+   N/2 entries.  The first half is moved to TMP and merged back with the
+   second one in place. */
+static void
+merge_sort_r (struct sort_entry *base, size_t n, struct sort_entry *tmp)
+{
+  size_t h, i, j, k;
+
+  if (n < 2)
+    return;
+  h = n / 2;
+  merge_sort_r (base, h, tmp);
+  merge_sort_r (base + h, n - h, tmp);
+  if (comp0 (&base[h - 1], &base[h]) <= 0)
+    return;
+
+  memcpy (tmp, base, h * sizeof (tmp[0]));
+  for (i = 0, j = h, k = 0; i < h && j < n; )
+    {
+      if (comp0 (&base[j], &tmp[i]) < 0)
+	base[k++] = base[j++];
+      else
+	base[k++] = tmp[i++];
+    }
+  while (i < h)
+    base[k++] = tmp[i++];
+}
+
+void
+merge_sort ()
+{
+  struct sort_entry *tmp;
+
+  if (msgcount < 2)
+    return;
+  tmp = mu_calloc (msgcount / 2, sizeof (tmp[0]));
+  merge_sort_r (entries, msgcount, tmp);
+  free (tmp);
+}
+
 
 /* ****************************** Actions ********************************* */
 
@@ -494,16 +627,22 @@ sort ()
   oldlist = mu_alloc (msgcount * sizeof (*oldlist));
   memcpy (oldlist, msgarr, msgcount * sizeof (*oldlist));
 
+  make_keys ();
   switch (algorithm)
     {
     case ARG_QUICKSORT:
-      qsort (msgarr, msgcount, sizeof (msgarr[0]), comp);
+      qsort (entries, msgcount, sizeof (entries[0]), comp);
       break;
 
     case ARG_SHELL:
       shell_sort ();
       break;
+
+    case ARG_MERGESORT:
+      merge_sort ();
+      break;
     }
+  free_keys ();
 
   switch (action)
     {
@@ -612,7 +751,7 @@ main (int argc, char **argv)
   mh_argp_parse (&argc, &argv, 0, options, mh_option,
 		 args_doc, doc, opt_handler, NULL, &index);
   if (!oplist)
-    addop ("date", comp_date);
+    addop ("date", &date_type);
 
   if (action == ACTION_LIST && mh_format_parse (format_str, &format))
     {
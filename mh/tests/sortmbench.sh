@@ -0,0 +1,72 @@
+#! /bin/sh
+# Measure the time sortm takes to sort a large folder.
+# Copyright (C) 2013 Free Software Foundation, Inc.
+#
+# GNU Mailutils is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License as
+# published by the Free Software Foundation; either version 3, or (at
+# your option) any later version.
+#
+# GNU Mailutils is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>.
+
+# Usage: sortmbench.sh [COUNT]
+#
+# Run from the mh/tests build directory.  A synthetic MH folder of COUNT
+# messages (default 50000) is created, with random dates, senders,
+# subjects and a numeric X-Seq header.  It is then sorted with each
+# algorithm on several sets of keys, in dry-run mode, so that the folder
+# is not modified between runs.  The elapsed time of each run is printed.
+
+count=${1:-50000}
+
+: ${SORTM:=`pwd`/../sortm}
+
+dir=`mktemp -d ${TMPDIR:-/tmp}/sortmbench.XXXXXX` || exit 1
+trap 'rm -rf $dir' 0 1 2 13 15
+
+mkdir $dir/Mail $dir/Mail/inbox || exit 1
+MH=$dir/mh_profile
+export MH
+cat > $MH <<EOT
+Path: $dir/Mail
+EOT
+
+awk -v count=$count -v dir=$dir/Mail/inbox 'BEGIN {
+  split("Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov Dec", mon)
+  srand(1)
+  for (i = 1; i <= count; i++) {
+    file = dir "/" i
+    printf("From: user%d@example.org\n", int(rand() * 500)) > file
+    printf("Date: %02d %s %d %02d:%02d:%02d +0000\n",
+           1 + int(rand() * 28), mon[1 + int(rand() * 12)],
+           2000 + int(rand() * 14), int(rand() * 24), int(rand() * 60),
+           int(rand() * 60)) > file
+    printf("Subject: %sTopic %d\n", rand() < 0.5 ? "Re: " : "",
+           int(rand() * 5000)) > file
+    printf("X-Seq: %d\n\n", int(rand() * 100000)) > file
+    printf("Message %d\n", i) > file
+    close(file)
+  }
+}' || exit 1
+
+now() {
+  date +%s%N
+}
+
+for keys in "" "-nodate -text Subject" "-text From" "-nodate --numfield X-Seq"
+do
+  for alg in quicksort shell mergesort
+  do
+    start=`now`
+    $SORTM --$alg $keys --dry-run --noverbose +inbox >/dev/null 2>&1 || exit 1
+    stop=`now`
+    printf "%-28s %-10s %10.3f ms\n" "${keys:-date}" $alg \
+      `expr \( $stop - $start \) / 1000`e-3
+  done
+done
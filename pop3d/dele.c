@@ -39,6 +39,7 @@ pop3d_dele (char *arg, struct pop3d_session *sess)
 
   mu_message_get_attribute (msg, &attr);
   pop3d_mark_deleted (attr);
+  pop3d_msgtab_dele (num);
   pop3d_outf ("+OK Message %s marked\n", mu_umaxtostr (0, num));
   return OK;
 }
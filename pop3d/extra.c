@@ -19,6 +19,7 @@
 #include "mailutils/libargp.h"
 
 mu_stream_t iostream;
+int pop3d_output_fd = -1;  /* Output descriptor of a plaintext session */
 
 void
 pop3d_parse_command (char *cmd, char **pcmd, char **parg)
@@ -161,8 +162,11 @@ pop3d_setio (int ifd, int ofd, int tls)
     }
   else
 #endif
-  if (mu_iostream_create (&str, istream, ostream))
-    pop3d_abquit (ERR_FILE);
+    {
+      if (mu_iostream_create (&str, istream, ostream))
+	pop3d_abquit (ERR_FILE);
+      pop3d_output_fd = ofd;
+    }
 
   /* Convert all writes to CRLF form.
      There is no need to convert reads, as the code ignores extra \r anyway.
@@ -219,6 +223,7 @@ pop3d_init_tls_server ()
   if (rc)
     return 1;
 
+  pop3d_output_fd = -1;
   stream[0] = stream[1] = tlsstream;
   rc = mu_stream_ioctl (iostream, MU_IOCTL_SUBSTREAM, MU_IOCTL_OP_SET, stream);
   mu_stream_unref (stream[0]);
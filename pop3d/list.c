@@ -42,10 +42,9 @@ int
 pop3d_list (char *arg, struct pop3d_session *sess)
 {
   size_t mesgno;
-  mu_message_t msg = NULL;
-  mu_attribute_t attr = NULL;
   size_t size = 0;
   size_t lines = 0;
+  int rc;
 
   if (state != TRANSACTION)
     return ERR_WRONG_STATE;
@@ -60,15 +59,11 @@ pop3d_list (char *arg, struct pop3d_session *sess)
       mu_mailbox_messages_count (mbox, &total);
       for (mesgno = 1; mesgno <= total; mesgno++)
 	{
-	  mu_mailbox_get_message (mbox, mesgno, &msg);
-	  mu_message_get_attribute (msg, &attr);
-	  if (!pop3d_is_deleted (attr))
+	  if (pop3d_msgtab_size (mesgno, &size, &lines) == OK)
 	    {
-	      mu_message_size (msg, &size);
-	      mu_message_lines (msg, &lines);
 	      pop3d_outf ("%s %s", 
                           mu_umaxtostr (0, mesgno), 
-                          mu_umaxtostr (1, size + lines));
+                          mu_umaxtostr (1, size));
 	      if (pop3d_xlines)
 		pop3d_outf (" %s", mu_umaxtostr (2, lines));
 	      pop3d_outf ("\n");
@@ -79,16 +74,12 @@ pop3d_list (char *arg, struct pop3d_session *sess)
   else
     {
       mesgno = strtoul (arg, NULL, 10);
-      if (mu_mailbox_get_message (mbox, mesgno, &msg) != 0)
-	return ERR_NO_MESG;
-      mu_message_get_attribute (msg, &attr);
-      if (pop3d_is_deleted (attr))
-	return ERR_MESG_DELE;
-      mu_message_size (msg, &size);
-      mu_message_lines (msg, &lines);
+      rc = pop3d_msgtab_size (mesgno, &size, &lines);
+      if (rc != OK)
+	return rc;
       pop3d_outf ("+OK %s %s", 
                   mu_umaxtostr (0, mesgno),
-                  mu_umaxtostr (1, size + lines));
+                  mu_umaxtostr (1, size));
       if (pop3d_xlines)
 	pop3d_outf (" %s", mu_umaxtostr (2, lines));
       pop3d_outf ("\n");
@@ -0,0 +1,211 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   GNU Mailutils is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GNU Mailutils is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include "pop3d.h"
+
+/* Message table.
+
+   The sizes and deletion marks of all messages are collected once, when
+   the mailbox is opened, so that STAT, LIST and UIDL need not create
+   message objects on each call.  UIDLs are computed on first use and
+   kept for the rest of the session.  (The mbox driver takes them from
+   the mailbox index, if there is one.)  The table is kept in sync with
+   DELE and RSET, which also maintain the totals reported by STAT. */
+
+#define MSGTAB_DELETED 0x01   /* Message is deleted in the mailbox */
+#define MSGTAB_DELE    0x02   /* Message is marked by DELE */
+
+struct msgtab_entry
+{
+  size_t size;                /* Size of the message */
+  size_t lines;               /* Number of lines in it */
+  char *uidl;                 /* UIDL, if already computed */
+  int flags;                  /* MSGTAB_ flags */
+};
+
+static struct msgtab_entry *msgtab;
+static size_t msgtab_count;      /* Number of entries in msgtab */
+static size_t msgtab_num;        /* Number of messages not deleted */
+static size_t msgtab_octets;     /* Their size, as reported by STAT */
+
+static struct msgtab_entry *
+msgtab_entry (size_t mesgno)
+{
+  if (mesgno == 0 || mesgno > msgtab_count)
+    return NULL;
+  return &msgtab[mesgno - 1];
+}
+
+/* rfc1939: if the POP3 server host internally represents end-of-line as a
+   single character, then the POP3 server simply counts each occurrence of
+   this character in a message as two octets. */
+#define ENTRY_OCTETS(ent) ((ent)->size + (ent)->lines)
+
+void
+pop3d_msgtab_init ()
+{
+  size_t i;
+
+  pop3d_msgtab_free ();
+  mu_mailbox_messages_count (mbox, &msgtab_count);
+  if (msgtab_count == 0)
+    return;
+  msgtab = mu_calloc (msgtab_count, sizeof (msgtab[0]));
+  for (i = 0; i < msgtab_count; i++)
+    {
+      struct msgtab_entry *ent = &msgtab[i];
+      mu_message_t msg;
+      mu_attribute_t attr;
+
+      if (mu_mailbox_get_message (mbox, i + 1, &msg))
+	{
+	  ent->flags = MSGTAB_DELETED;
+	  continue;
+	}
+      mu_message_get_attribute (msg, &attr);
+      if (mu_attribute_is_deleted (attr))
+	ent->flags |= MSGTAB_DELETED;
+      if (mu_attribute_is_userflag (attr, POP3_ATTRIBUTE_DELE))
+	ent->flags |= MSGTAB_DELE;
+      mu_message_size (msg, &ent->size);
+      mu_message_lines (msg, &ent->lines);
+      if (!ent->flags)
+	{
+	  msgtab_num++;
+	  msgtab_octets += ENTRY_OCTETS (ent);
+	}
+    }
+}
+
+void
+pop3d_msgtab_free ()
+{
+  size_t i;
+
+  for (i = 0; i < msgtab_count; i++)
+    free (msgtab[i].uidl);
+  free (msgtab);
+  msgtab = NULL;
+  msgtab_count = msgtab_num = msgtab_octets = 0;
+}
+
+/* Return the number of messages not marked as deleted and their total
+   size. */
+void
+pop3d_msgtab_stat (size_t *pnum, size_t *poctets)
+{
+  *pnum = msgtab_num;
+  *poctets = msgtab_octets;
+}
+
+/* Return ERR_NO_MESG if there is no message MESGNO, ERR_MESG_DELE if
+   it is marked as deleted and OK otherwise. */
+int
+pop3d_msgtab_check (size_t mesgno)
+{
+  struct msgtab_entry *ent = msgtab_entry (mesgno);
+
+  if (!ent)
+    return ERR_NO_MESG;
+  if (ent->flags)
+    return ERR_MESG_DELE;
+  return OK;
+}
+
+/* Return the size of the message MESGNO, as reported to the client,
+   and the number of lines in it. */
+int
+pop3d_msgtab_size (size_t mesgno, size_t *psize, size_t *plines)
+{
+  int rc = pop3d_msgtab_check (mesgno);
+
+  if (rc == OK)
+    {
+      struct msgtab_entry *ent = msgtab_entry (mesgno);
+      *psize = ENTRY_OCTETS (ent);
+      *plines = ent->lines;
+    }
+  return rc;
+}
+
+/* Return the UIDL of the message MESGNO */
+int
+pop3d_msgtab_uidl (size_t mesgno, const char **puidl)
+{
+  int rc = pop3d_msgtab_check (mesgno);
+  struct msgtab_entry *ent;
+
+  if (rc != OK)
+    return rc;
+  ent = msgtab_entry (mesgno);
+  if (!ent->uidl)
+    {
+      mu_message_t msg;
+      char uidl[128];
+
+      if (mu_mailbox_get_message (mbox, mesgno, &msg))
+	return ERR_NO_MESG;
+      mu_message_get_uidl (msg, uidl, sizeof (uidl), NULL);
+      ent->uidl = mu_strdup (uidl);
+      /* If the message had no X-UIDL header, mu_message_get_uidl has
+	 added one, so the message has grown. */
+      msgtab_octets -= ENTRY_OCTETS (ent);
+      mu_message_size (msg, &ent->size);
+      mu_message_lines (msg, &ent->lines);
+      msgtab_octets += ENTRY_OCTETS (ent);
+    }
+  *puidl = ent->uidl;
+  return OK;
+}
+
+/* Mark the message MESGNO for deletion */
+void
+pop3d_msgtab_dele (size_t mesgno)
+{
+  struct msgtab_entry *ent = msgtab_entry (mesgno);
+
+  if (!ent)
+    return;
+  if (!ent->flags)
+    {
+      msgtab_num--;
+      msgtab_octets -= ENTRY_OCTETS (ent);
+    }
+  ent->flags |= MSGTAB_DELE;
+}
+
+/* Remove all deletion marks set by DELE.  Call FUN for each message
+   that had one. */
+void
+pop3d_msgtab_rset (void (*fun) (size_t))
+{
+  size_t i;
+
+  for (i = 0; i < msgtab_count; i++)
+    {
+      struct msgtab_entry *ent = &msgtab[i];
+      if (ent->flags & MSGTAB_DELE)
+	{
+	  ent->flags &= ~MSGTAB_DELE;
+	  if (!ent->flags)
+	    {
+	      msgtab_num++;
+	      msgtab_octets += ENTRY_OCTETS (ent);
+	    }
+	  fun (i + 1);
+	}
+    }
+}
@@ -590,6 +590,11 @@ main (int argc, char **argv)
 		   argc, argv, 0, NULL, server))
     exit (EX_CONFIG); /* FIXME: No way to discern from EX_USAGE? */
 
+  /* A session ends in pop3d_bye, which exits.  Its state, including
+     the privileges of the logged in user, must never be inherited by
+     another client, so a pre-forked worker serves one connection. */
+  mu_m_server_set_max_worker_requests (server, 1);
+
   if (expire == 0)
     expire_on_exit = 1;
 
@@ -214,6 +214,7 @@ struct pop3d_command
 };
 
 extern mu_stream_t iostream;
+extern int pop3d_output_fd;
 extern mu_pop_server_t pop3srv;
 extern mu_mailbox_t mbox;
 extern int state;
@@ -266,7 +267,10 @@ extern int pop3d_quit           (char *, struct pop3d_session *);
 extern int pop3d_retr           (char *, struct pop3d_session *);
 extern int pop3d_rset           (char *, struct pop3d_session *);
 
-void pop3d_send_payload (mu_stream_t stream, mu_stream_t linestr,
+/* Send the whole body in pop3d_send_payload */
+#define POP3D_ALL_LINES ((size_t) -1)
+
+void pop3d_send_payload (mu_stream_t hstream, mu_stream_t bstream,
 			 size_t maxlines);
 
 extern void pop3d_bye           (void);
@@ -291,6 +295,15 @@ extern void pop3d_flush_output  (void);
 
 extern int pop3d_is_master      (void);
 
+extern void pop3d_msgtab_init (void);
+extern void pop3d_msgtab_free (void);
+extern void pop3d_msgtab_stat (size_t *pnum, size_t *poctets);
+extern int pop3d_msgtab_check (size_t mesgno);
+extern int pop3d_msgtab_size (size_t mesgno, size_t *psize, size_t *plines);
+extern int pop3d_msgtab_uidl (size_t mesgno, const char **puidl);
+extern void pop3d_msgtab_dele (size_t mesgno);
+extern void pop3d_msgtab_rset (void (*fun) (size_t));
+
 extern void pop3d_mark_deleted (mu_attribute_t attr);
 extern int pop3d_is_deleted (mu_attribute_t attr);
 extern void pop3d_unset_deleted (mu_attribute_t attr);
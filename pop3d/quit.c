@@ -42,6 +42,7 @@ pop3d_quit (char *arg, struct pop3d_session *sess)
 	err = ERR_FILE;
       manlock_unlock (mbox);
       mu_mailbox_destroy (&mbox);
+      pop3d_msgtab_free ();
       mu_diag_output (MU_DIAG_INFO, _("session ended for user: %s"), username);
     }
   else
@@ -16,16 +16,257 @@
    along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include "pop3d.h"
+#include <limits.h>
+#include <sys/uio.h>
 
 size_t pop3d_output_bufsize = 64 * 1024;
 
+/* Fast path for plaintext sessions.
+
+   Instead of passing the message through the DOT and CRLF filters, the
+   text is scanned for the places where these would insert something:
+   a dot at the beginning of a line and a CR before a LF that is not
+   preceded by one.  Only these characters are supplied from memory.
+   The text in between is sent directly from a memory mapping of the
+   mailbox file using writev.
+
+   Sendfile is not used: the kernel would queue references to the pages
+   of the mailbox file instead of copying them, so that rewriting the
+   mailbox (e.g. on QUIT) could alter the data not yet delivered. */
+
+#if defined IOV_MAX && IOV_MAX < 256
+# define PAYLOAD_IOV_MAX IOV_MAX
+#else
+# define PAYLOAD_IOV_MAX 256
+#endif
+
+enum payload_state
+  {
+    payload_init,     /* Nothing sent yet */
+    payload_char,     /* Last character sent was not a newline */
+    payload_cr,       /* Last character sent was \r */
+    payload_lf        /* Last character sent was \n */
+  };
+
+struct payload
+{
+  int fd;                       /* Output descriptor */
+  enum payload_state state;
+  int limited;                  /* Is the number of lines limited? */
+  size_t maxlines;              /* Number of lines left to send */
+  struct iovec iov[PAYLOAD_IOV_MAX];
+  int iovcnt;
+};
+
+static int
+payload_writev (int fd, struct iovec *iov, int cnt)
+{
+  while (cnt)
+    {
+      ssize_t n = writev (fd, iov, cnt);
+      if (n == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return errno;
+	}
+      for (; cnt && (size_t) n >= iov->iov_len; iov++, cnt--)
+	n -= iov->iov_len;
+      if (cnt)
+	{
+	  iov->iov_base = (char *) iov->iov_base + n;
+	  iov->iov_len -= n;
+	}
+    }
+  return 0;
+}
+
+static int
+payload_flush (struct payload *pl)
+{
+  int rc = payload_writev (pl->fd, pl->iov, pl->iovcnt);
+  pl->iovcnt = 0;
+  return rc;
+}
+
+static int
+payload_add (struct payload *pl, const char *ptr, size_t len)
+{
+  struct iovec *iov;
+
+  if (len == 0)
+    return 0;
+  if (pl->iovcnt)
+    {
+      iov = &pl->iov[pl->iovcnt - 1];
+      if ((char *) iov->iov_base + iov->iov_len == ptr)
+	{
+	  iov->iov_len += len;
+	  return 0;
+	}
+    }
+  if (pl->iovcnt == PAYLOAD_IOV_MAX)
+    {
+      int rc = payload_flush (pl);
+      if (rc)
+	return rc;
+    }
+  iov = &pl->iov[pl->iovcnt++];
+  iov->iov_base = (char *) ptr;
+  iov->iov_len = len;
+  return 0;
+}
+
+/* Terminate the current line, as the filters would do upon receiving
+   a \n. */
+static int
+payload_newline (struct payload *pl)
+{
+  int rc;
+  
+  if (pl->state == payload_cr)
+    rc = payload_add (pl, "\n", 1);
+  else
+    rc = payload_add (pl, "\r\n", 2);
+  pl->state = payload_lf;
+  return rc;
+}
+
+static int
+payload_text (struct payload *pl, const char *text, size_t len)
+{
+  int rc = 0;
+  
+  while (len && rc == 0)
+    {
+      const char *q;
+      size_t n;
+      
+      if (pl->limited && pl->maxlines == 0)
+	break;
+      if ((pl->state == payload_init || pl->state == payload_lf)
+	  && *text == '.')
+	{
+	  rc = payload_add (pl, ".", 1);
+	  if (rc)
+	    break;
+	}
+
+      q = memchr (text, '\n', len);
+      if (!q)
+	{
+	  rc = payload_add (pl, text, len);
+	  pl->state = text[len-1] == '\r' ? payload_cr : payload_char;
+	  break;
+	}
+      n = q - text;
+      if (n ? q[-1] == '\r' : pl->state == payload_cr)
+	rc = payload_add (pl, text, n + 1);
+      else if ((rc = payload_add (pl, text, n)) == 0)
+	rc = payload_add (pl, "\r\n", 2);
+      pl->state = payload_lf;
+      if (pl->limited)
+	pl->maxlines--;
+      text += n + 1;
+      len -= n + 1;
+    }
+  return rc;
+}
+
+static int
+payload_mapped (const char *text, size_t len, void *data)
+{
+  struct payload *pl = data;
+  int rc;
+
+  rc = payload_text (pl, text, len);
+  /* The mapping goes away on return */
+  if (rc == 0)
+    rc = payload_flush (pl);
+  return rc;
+}
+
+static int
+payload_stream (struct payload *pl, mu_stream_t str)
+{
+  char buf[8192];
+  size_t n;
+  int rc;
+  
+  rc = mu_stream_fd_scan (str, payload_mapped, pl);
+  if (rc != ENOSYS)
+    return rc;
+
+  while (!(pl->limited && pl->maxlines == 0)
+	 && (rc = mu_stream_read (str, buf, sizeof buf, &n)) == 0
+	 && n > 0)
+    {
+      rc = payload_text (pl, buf, n);
+      if (rc == 0)
+	rc = payload_flush (pl);
+      if (rc)
+	break;
+    }
+  return rc;
+}
+
+/* Send the payload using the fast path.  Return ENOSYS if it is not
+   applicable. */
+static int
+send_payload_fast (mu_stream_t hstream, mu_stream_t bstream, size_t maxlines)
+{
+  struct payload pl;
+  struct mu_fd_segment seg;
+  int rc;
+  
+  if (pop3d_output_fd == -1 || pop3d_transcript)
+    return ENOSYS;
+  /* Make sure the bulk of the payload comes from a file */
+  if (mu_stream_ioctl (maxlines ? bstream : hstream,
+		       MU_IOCTL_FD, MU_IOCTL_FD_GET_SEGMENT, &seg))
+    return ENOSYS;
+
+  pop3d_flush_output ();
+  memset (&pl, 0, sizeof pl);
+  pl.fd = pop3d_output_fd;
+  pl.state = payload_init;
+
+  rc = payload_stream (&pl, hstream);
+  if (rc == 0 && maxlines)
+    {
+      pl.limited = maxlines != POP3D_ALL_LINES;
+      pl.maxlines = maxlines;
+      rc = payload_stream (&pl, bstream);
+    }
+  if (rc == 0 && pl.state != payload_lf)
+    rc = payload_newline (&pl);
+  if (rc == 0)
+    rc = payload_add (&pl, ".\r\n", 3);
+  if (rc == 0)
+    rc = payload_flush (&pl);
+  if (rc)
+    {
+      mu_diag_output (MU_DIAG_ERROR, _("Write failed: %s"), mu_strerror (rc));
+      pop3d_abquit (ERR_IO);
+    }
+  return 0;
+}
+
+/* Send the header from HSTREAM, followed by at most MAXLINES lines of
+   the body from BSTREAM.  The header includes the empty line that ends
+   it. */
 void
-pop3d_send_payload (mu_stream_t stream, mu_stream_t linestr, size_t maxlines)
+pop3d_send_payload (mu_stream_t hstream, mu_stream_t bstream,
+		    size_t maxlines)
 {
   mu_stream_t flt;
   struct mu_buffer_query oldbuf, newbuf;
-  int xscript_level = set_xscript_level (MU_XSCRIPT_PAYLOAD);
+  int xscript_level;
 
+  if (send_payload_fast (hstream, bstream, maxlines) == 0)
+    return;
+
+  xscript_level = set_xscript_level (MU_XSCRIPT_PAYLOAD);
   oldbuf.type = MU_TRANSPORT_OUTPUT;
   mu_stream_ioctl (iostream, MU_IOCTL_TRANSPORT_BUFFER, MU_IOCTL_OP_GET,
 		   &oldbuf);
@@ -38,16 +279,17 @@ pop3d_send_payload (mu_stream_t stream, mu_stream_t linestr, size_t maxlines)
   mu_filter_create (&flt, iostream, "DOT", MU_FILTER_ENCODE,
 		    MU_STREAM_WRITE);
   
-  mu_stream_copy (flt, stream, 0, NULL);
+  mu_stream_copy (flt, hstream, 0, NULL);
 
-  if (maxlines)
+  if (maxlines == POP3D_ALL_LINES)
+    mu_stream_copy (flt, bstream, 0, NULL);
+  else if (maxlines)
     {
       char *buf = NULL;
       size_t size = 0, n;
 
-      mu_stream_write (flt, "\n", 1, NULL);
       for (; maxlines > 0 &&
-	     mu_stream_getline (linestr, &buf, &size, &n) == 0 &&
+	     mu_stream_getline (bstream, &buf, &size, &n) == 0 &&
 	     n > 0; maxlines--)
 	mu_stream_write (flt, buf, n, NULL);
       free (buf);
@@ -69,7 +311,9 @@ pop3d_retr (char *arg, struct pop3d_session *sess)
   size_t mesgno;
   mu_message_t msg = NULL;
   mu_attribute_t attr = NULL;
-  mu_stream_t stream;
+  mu_header_t hdr;
+  mu_body_t body;
+  mu_stream_t hstream, bstream;
   
   if ((strlen (arg) == 0) || (strchr (arg, ' ') != NULL))
     return ERR_BAD_ARGS;
@@ -86,12 +330,22 @@ pop3d_retr (char *arg, struct pop3d_session *sess)
   if (pop3d_is_deleted (attr))
     return ERR_MESG_DELE;
 
-  if (mu_message_get_streamref (msg, &stream))
+  /* The header and body are sent separately, so that the fast path can
+     use the file behind the body stream. */
+  mu_message_get_header (msg, &hdr);
+  if (mu_header_get_streamref (hdr, &hstream))
     return ERR_UNKNOWN;
+  mu_message_get_body (msg, &body);
+  if (mu_body_get_streamref (body, &bstream))
+    {
+      mu_stream_unref (hstream);
+      return ERR_UNKNOWN;
+    }
   
   pop3d_outf ("+OK\n");
-  pop3d_send_payload (stream, NULL, 0);
-  mu_stream_destroy (&stream);
+  pop3d_send_payload (hstream, bstream, POP3D_ALL_LINES);
+  mu_stream_unref (hstream);
+  mu_stream_unref (bstream);
   
   if (!mu_attribute_is_read (attr))
     mu_attribute_set_read (attr);
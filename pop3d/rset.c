@@ -17,30 +17,29 @@
 
 #include "pop3d.h"
 
-/* Resets the connection so that no messages are marked as deleted */
+static void
+undelete (size_t mesgno)
+{
+  mu_message_t msg = NULL;
+  mu_attribute_t attr = NULL;
+  mu_mailbox_get_message (mbox, mesgno, &msg);
+  mu_message_get_attribute (msg, &attr);
+  pop3d_unset_deleted (attr);
+}
+
+/* Resets the connection so that no messages are marked as deleted.
+   Only the messages marked by DELE are visited. */
 
 int
 pop3d_rset (char *arg, struct pop3d_session *sess)
 {
-  size_t i;
-  size_t total = 0;
-
   if (strlen (arg) != 0)
     return ERR_BAD_ARGS;
 
   if (state != TRANSACTION)
     return ERR_WRONG_STATE;
 
-  mu_mailbox_messages_count (mbox, &total);
-
-  for (i = 1; i <= total; i++)
-    {
-      mu_message_t msg = NULL;
-      mu_attribute_t attr = NULL;
-      mu_mailbox_get_message (mbox, i, &msg);
-      mu_message_get_attribute (msg, &attr);
-      pop3d_unset_deleted (attr);
-    }
+  pop3d_msgtab_rset (undelete);
   pop3d_outf ("+OK\n");
   return OK;
 }
@@ -21,9 +21,8 @@ int
 pop3d_uidl (char *arg, struct pop3d_session *sess)
 {
   size_t mesgno;
-  char uidl[128];
-  mu_message_t msg;
-  mu_attribute_t attr;
+  const char *uidl;
+  int rc;
 
   if (state != TRANSACTION)
     return ERR_WRONG_STATE;
@@ -38,25 +37,17 @@ pop3d_uidl (char *arg, struct pop3d_session *sess)
       mu_mailbox_messages_count (mbox, &total);
       for (mesgno = 1; mesgno <= total; mesgno++)
         {
-          mu_mailbox_get_message (mbox, mesgno, &msg);
-          mu_message_get_attribute (msg, &attr);
-          if (!pop3d_is_deleted (attr))
-            {
-              mu_message_get_uidl (msg, uidl, sizeof (uidl), NULL);
-              pop3d_outf ("%s %s\n", mu_umaxtostr (0, mesgno), uidl);
-            }
+          if (pop3d_msgtab_uidl (mesgno, &uidl) == OK)
+            pop3d_outf ("%s %s\n", mu_umaxtostr (0, mesgno), uidl);
         }
       pop3d_outf (".\n");
     }
   else
     {
       mesgno = strtoul (arg, NULL, 10);
-      if (mu_mailbox_get_message (mbox, mesgno, &msg) != 0)
-        return ERR_NO_MESG;
-      mu_message_get_attribute (msg, &attr);
-      if (pop3d_is_deleted (attr))
-        return ERR_MESG_DELE;
-      mu_message_get_uidl (msg, uidl, sizeof (uidl), NULL);
+      rc = pop3d_msgtab_uidl (mesgno, &uidl);
+      if (rc != OK)
+        return rc;
       pop3d_outf ("+OK %s %s\n", mu_umaxtostr (0, mesgno), uidl);
     }
 
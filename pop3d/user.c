@@ -58,6 +58,7 @@ pop3d_begin_session ()
     pop3d_undelete_all ();
 
   deliver_pending_bulletins ();
+  pop3d_msgtab_init ();
   
   /* log mailbox stats */
   mu_mailbox_get_url (mbox, &url);
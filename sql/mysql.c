@@ -219,6 +219,13 @@ mu_mysql_errstr (mu_sql_connection_t conn)
   return mysql_error (mp->mysql);
 }
 
+static int
+mu_mysql_ping (mu_sql_connection_t conn)
+{
+  struct mu_mysql_data *mp = conn->data;
+  return mysql_ping (mp->mysql) ? MU_ERR_SQL : 0;
+}
+
 
 /* MySQL scrambled password support */
 
@@ -368,5 +375,6 @@ MU_DECL_SQL_DISPATCH_T(mysql) = {
   mu_mysql_get_column,
   mu_mysql_get_field_number,
   mu_mysql_errstr,
+  mu_mysql_ping
 };
 
@@ -378,6 +378,24 @@ odbc_errstr (mu_sql_connection_t conn)
   return dp->err.text;
 }
 
+#ifdef SQL_ATTR_CONNECTION_DEAD
+static int
+odbc_ping (mu_sql_connection_t conn)
+{
+  struct mu_odbc_data *dp = conn->data;
+  SQLUINTEGER dead;
+  long rc;
+
+  rc = SQLGetConnectAttr (dp->dbc, SQL_ATTR_CONNECTION_DEAD, &dead, 0, NULL);
+  if (rc != SQL_SUCCESS && rc != SQL_SUCCESS_WITH_INFO)
+    {
+      mu_odbc_diag (dp, SQL_HANDLE_DBC, dp->dbc, "SQLGetConnectAttr");
+      return MU_ERR_SQL;
+    }
+  return dead == SQL_CD_TRUE ? MU_ERR_SQL : 0;
+}
+#endif
+
 MU_DECL_SQL_DISPATCH_T(odbc) = {
   "odbc",
   0,
@@ -393,4 +411,7 @@ MU_DECL_SQL_DISPATCH_T(odbc) = {
   odbc_get_column,
   odbc_get_field_number,
   odbc_errstr,
+#ifdef SQL_ATTR_CONNECTION_DEAD
+  odbc_ping
+#endif
 };
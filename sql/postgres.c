@@ -115,6 +115,63 @@ postgres_query (mu_sql_connection_t conn, char *query)
   return 0;
 }
 
+static int
+postgres_ping (mu_sql_connection_t conn)
+{
+  struct mu_pgsql_data *dp = conn->data;
+  PGresult *res;
+  int rc;
+
+  if (PQstatus (dp->pgconn) != CONNECTION_OK)
+    return MU_ERR_SQL;
+  res = PQexec (dp->pgconn, "");
+  if (res == NULL)
+    return MU_ERR_SQL;
+  rc = PQresultStatus (res) == PGRES_EMPTY_QUERY ? 0 : MU_ERR_SQL;
+  PQclear (res);
+  return rc;
+}
+
+static int
+postgres_prepare (mu_sql_connection_t conn, const char *name,
+		  const char *query, int nparams)
+{
+  struct mu_pgsql_data *dp = conn->data;
+  PGresult *res;
+  int rc;
+
+  res = PQprepare (dp->pgconn, name, query, nparams, NULL);
+  if (res == NULL)
+    return MU_ERR_SQL;
+  rc = PQresultStatus (res) == PGRES_COMMAND_OK ? 0 : MU_ERR_SQL;
+  PQclear (res);
+  return rc;
+}
+
+static int
+postgres_execute (mu_sql_connection_t conn, const char *name,
+		  int nparams, const char **params)
+{
+  struct mu_pgsql_data *dp = conn->data;
+  ExecStatusType stat;
+
+  dp->res = PQexecPrepared (dp->pgconn, name, nparams, params,
+			    NULL, NULL, 0);
+  if (dp->res == NULL)
+    return MU_ERR_SQL;
+
+  stat = PQresultStatus (dp->res);
+
+  if (stat != PGRES_COMMAND_OK && stat != PGRES_TUPLES_OK)
+    {
+      PQclear (dp->res);
+      dp->res = NULL;
+      return MU_ERR_SQL;
+    }
+
+  return 0;
+}
+
 static int
 postgres_store_result (mu_sql_connection_t conn)
 {
@@ -196,6 +253,9 @@ MU_DECL_SQL_DISPATCH_T(postgres) = {
   postgres_get_column,
   postgres_get_field_number,
   postgres_errstr,
+  postgres_ping,
+  postgres_prepare,
+  postgres_execute
 };
 
 #endif
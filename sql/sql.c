@@ -19,6 +19,7 @@
 # include <config.h>
 #endif
 
+#include <unistd.h>
 #include <mailutils/mailutils.h>
 #include <mailutils/sql.h>
 #include "modlist.h"
@@ -151,6 +152,7 @@ mu_sql_connection_destroy (mu_sql_connection_t *conn)
 
   mu_sql_disconnect (*conn);
   SQL_F (*conn, destroy) (*conn);
+  mu_list_destroy (&(*conn)->stmts);
   free (*conn);
   *conn = NULL;
   return 0;
@@ -178,7 +180,10 @@ mu_sql_connect (mu_sql_connection_t conn)
     }
   rc = SQL_F (conn, connect) (conn);
   if (!rc)
-    conn->state = mu_sql_connected;
+    {
+      conn->state = mu_sql_connected;
+      conn->pid = getpid ();
+    }
   return rc;
 }
 
@@ -204,7 +209,11 @@ mu_sql_disconnect (mu_sql_connection_t conn)
     }
   rc = SQL_F (conn, disconnect) (conn);
   if (rc == 0)
-    conn->state = mu_sql_not_connected;
+    {
+      conn->state = mu_sql_not_connected;
+      /* Prepared statements do not survive the session */
+      mu_list_clear (conn->stmts);
+    }
   return rc;
 }
 
@@ -401,3 +410,312 @@ mu_sql_strerror (mu_sql_connection_t conn)
     return strerror (EINVAL);
   return SQL_F (conn, errstr) (conn);
 }
+
+int
+mu_sql_ping (mu_sql_connection_t conn)
+{
+  mu_sql_dispatch_t *tab;
+
+  if (!conn)
+    return EINVAL;
+
+  switch (conn->state)
+    {
+    case mu_sql_not_connected:
+      return MU_ERR_DB_NOT_CONNECTED;
+
+    case mu_sql_connected:
+    case mu_sql_query_run:
+      break;
+
+    case mu_sql_result_available:
+      return MU_ERR_RESULT_NOT_RELEASED;
+    }
+
+  tab = get_sql_entry (conn->interface);
+  if (!tab->ping)
+    return ENOSYS;
+  return tab->ping (conn);
+}
+
+static int
+name_cmp (const void *a, const void *b)
+{
+  return strcmp (a, b);
+}
+
+/* Prepare QUERY as the statement NAME, unless it has already been
+   prepared on this connection. */
+int
+mu_sql_prepare (mu_sql_connection_t conn, const char *name,
+		const char *query, int nparams)
+{
+  mu_sql_dispatch_t *tab;
+  char *copy;
+  int rc;
+
+  if (!conn || !name || !query)
+    return EINVAL;
+
+  switch (conn->state)
+    {
+    case mu_sql_not_connected:
+      return MU_ERR_DB_NOT_CONNECTED;
+
+    case mu_sql_connected:
+    case mu_sql_query_run:
+      break;
+
+    case mu_sql_result_available:
+      return MU_ERR_RESULT_NOT_RELEASED;
+    }
+
+  tab = get_sql_entry (conn->interface);
+  if (!tab->prepare || !tab->execute)
+    return ENOSYS;
+
+  if (!conn->stmts)
+    {
+      rc = mu_list_create (&conn->stmts);
+      if (rc)
+	return rc;
+      mu_list_set_comparator (conn->stmts, name_cmp);
+      mu_list_set_destroy_item (conn->stmts, mu_list_free_item);
+    }
+  else if (mu_list_locate (conn->stmts, (void*) name, NULL) == 0)
+    return 0;
+
+  copy = strdup (name);
+  if (!copy)
+    return ENOMEM;
+  rc = tab->prepare (conn, name, query, nparams);
+  if (rc == 0)
+    rc = mu_list_append (conn->stmts, copy);
+  if (rc)
+    free (copy);
+  return rc;
+}
+
+int
+mu_sql_execute (mu_sql_connection_t conn, const char *name,
+		int nparams, const char **params)
+{
+  int rc;
+
+  if (!conn || !name)
+    return EINVAL;
+
+  switch (conn->state)
+    {
+    case mu_sql_not_connected:
+      return MU_ERR_DB_NOT_CONNECTED;
+
+    case mu_sql_connected:
+    case mu_sql_query_run:
+      break;
+
+    case mu_sql_result_available:
+      return MU_ERR_RESULT_NOT_RELEASED;
+    }
+
+  if (!conn->stmts || mu_list_locate (conn->stmts, (void*) name, NULL))
+    return MU_ERR_NOENT;
+
+  rc = SQL_F (conn, execute) (conn, name, nparams, params);
+  if (rc == 0)
+    conn->state = mu_sql_query_run;
+  return rc;
+}
+
+/* Connection pool.
+
+   Instead of being closed after use, a connection can be returned to
+   the pool by mu_sql_pool_put.  A subsequent mu_sql_pool_get with the
+   same parameters will reuse it.  Connections that have been idle for
+   more than check_interval seconds are checked before being reused. */
+
+static mu_list_t sql_pool;        /* Idle connections */
+static size_t sql_pool_size;      /* Max. number of idle connections */
+static time_t sql_check_interval; /* Check connections idle longer than this */
+
+void
+mu_sql_pool_set_size (size_t size)
+{
+  sql_pool_size = size;
+}
+
+void
+mu_sql_pool_set_check_interval (time_t interval)
+{
+  sql_check_interval = interval;
+}
+
+static int
+str_eq (const char *a, const char *b)
+{
+  if (!a || !b)
+    return a == b;
+  return strcmp (a, b) == 0;
+}
+
+static int
+conn_match (mu_sql_connection_t conn, int interface,
+	    char *server, int port, char *login,
+	    char *password, char *dbname)
+{
+  return conn->interface == interface
+         && conn->port == port
+         && str_eq (conn->server, server)
+         && str_eq (conn->login, login)
+         && str_eq (conn->password, password)
+         && str_eq (conn->dbname, dbname);
+}
+
+/* Drop a connection inherited from the parent process.  It is still
+   in use there, so it must neither be closed nor released. */
+static void
+conn_abandon (mu_sql_connection_t conn)
+{
+  mu_list_destroy (&conn->stmts);
+  free (conn);
+}
+
+static int
+conn_healthy (mu_sql_connection_t conn)
+{
+  int rc;
+
+  if (sql_check_interval && time (NULL) - conn->mtime < sql_check_interval)
+    return 1;
+  rc = mu_sql_ping (conn);
+  if (rc == 0 || rc == ENOSYS)
+    return 1;
+  mu_debug (MU_DEBCAT_AUTH, MU_DEBUG_TRACE1,
+	    ("dropping stale SQL connection: %s",
+	     rc == MU_ERR_SQL ? mu_sql_strerror (conn) : mu_strerror (rc)));
+  return 0;
+}
+
+/* Get a connection with the given parameters.  If an idle one is
+   available from the pool, reuse it and set *REUSED to 1.  Otherwise,
+   create and connect a new one, and set *REUSED to 0.  On error, *PCONN
+   is set to the failed connection (or NULL), so that the caller can
+   obtain the error description via mu_sql_strerror.  It must then be
+   disposed of using mu_sql_pool_put. */
+int
+mu_sql_pool_get (mu_sql_connection_t *pconn, int *reused, int interface,
+		 char *server, int port, char *login,
+		 char *password, char *dbname)
+{
+  mu_iterator_t itr;
+  mu_sql_connection_t conn = NULL;
+  pid_t pid = getpid ();
+  int rc;
+
+  if (sql_pool && mu_list_get_iterator (sql_pool, &itr) == 0)
+    {
+      for (mu_iterator_first (itr); !mu_iterator_is_done (itr);
+	   mu_iterator_next (itr))
+	{
+	  mu_sql_connection_t p;
+
+	  mu_iterator_current (itr, (void **)&p);
+	  if (p->pid != pid)
+	    {
+	      mu_iterator_ctl (itr, mu_itrctl_delete, NULL);
+	      conn_abandon (p);
+	    }
+	  else if (conn_match (p, interface, server, port, login,
+			       password, dbname))
+	    {
+	      mu_iterator_ctl (itr, mu_itrctl_delete, NULL);
+	      if (conn_healthy (p))
+		{
+		  conn = p;
+		  break;
+		}
+	      mu_sql_connection_destroy (&p);
+	    }
+	}
+      mu_iterator_destroy (&itr);
+    }
+
+  if (conn)
+    {
+      if (reused)
+	*reused = 1;
+      *pconn = conn;
+      return 0;
+    }
+
+  if (reused)
+    *reused = 0;
+  *pconn = NULL;
+  rc = mu_sql_connection_init (&conn, interface, server, port, login,
+			       password, dbname);
+  if (rc)
+    return rc;
+  *pconn = conn;
+  return mu_sql_connect (conn);
+}
+
+static void
+sql_pool_cleanup (void *data MU_ARG_UNUSED)
+{
+  mu_sql_pool_clear ();
+}
+
+/* Return the connection obtained from mu_sql_pool_get.  STATUS is the
+   result of the last operation on it.  If it is 0 and the pool is not
+   full, keep the connection for reuse.  Otherwise, close it. */
+void
+mu_sql_pool_put (mu_sql_connection_t *pconn, int status)
+{
+  mu_sql_connection_t conn;
+  size_t count;
+
+  if (!pconn || !*pconn)
+    return;
+  conn = *pconn;
+  *pconn = NULL;
+
+  if (conn->state == mu_sql_result_available)
+    mu_sql_release_result (conn);
+
+  if (status == 0 && sql_pool_size
+      && (conn->state == mu_sql_connected || conn->state == mu_sql_query_run))
+    {
+      if (!sql_pool)
+	{
+	  if (mu_list_create (&sql_pool) == 0)
+	    mu_onexit (sql_pool_cleanup, NULL);
+	}
+      if (sql_pool
+	  && mu_list_count (sql_pool, &count) == 0
+	  && count < sql_pool_size
+	  && mu_list_append (sql_pool, conn) == 0)
+	{
+	  conn->state = mu_sql_connected;
+	  conn->mtime = time (NULL);
+	  return;
+	}
+    }
+  mu_sql_connection_destroy (&conn);
+}
+
+/* Close all idle connections */
+void
+mu_sql_pool_clear (void)
+{
+  mu_sql_connection_t conn;
+  pid_t pid = getpid ();
+
+  while (mu_list_head (sql_pool, (void **)&conn) == 0)
+    {
+      mu_list_remove (sql_pool, conn);
+      if (conn->pid == pid)
+	mu_sql_connection_destroy (&conn);
+      else
+	conn_abandon (conn);
+    }
+}
@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mailutils/mailutils.h>
 
 int
@@ -28,10 +29,17 @@ main (int argc, char **argv)
   mu_mailbox_t mbox;
   size_t i, count;
   mu_message_t msg;
+  int uidl = 0;
   
+  if (argc == 3 && strcmp (argv[1], "-l") == 0)
+    {
+      uidl = 1;
+      argc--;
+      argv++;
+    }
   if (argc != 2)
     {
-      fprintf (stderr, "usage: %s MBOX\n", argv[0]);
+      fprintf (stderr, "usage: %s [-l] MBOX\n", argv[0]);
       return 1;
     }
 
@@ -46,7 +54,14 @@ main (int argc, char **argv)
       size_t uid;
       MU_ASSERT (mu_mailbox_get_message (mbox, i, &msg));
       MU_ASSERT (mu_message_get_uid (msg, &uid));
-      printf ("%lu: %lu\n", (unsigned long) i, (unsigned long) uid);
+      printf ("%lu: %lu", (unsigned long) i, (unsigned long) uid);
+      if (uidl)
+	{
+	  char buf[128];
+	  MU_ASSERT (mu_message_get_uidl (msg, buf, sizeof buf, NULL));
+	  printf (" %s", buf);
+	}
+      putchar ('\n');
     }
   mu_mailbox_close (mbox);
   mu_mailbox_destroy (&mbox);
@@ -0,0 +1,142 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   GNU Mailutils is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GNU Mailutils is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Usage: mbexp URL COMMAND...
+
+   Open the mailbox and execute the commands in order:
+
+     dN    mark message N as deleted
+     rN    mark message N as read
+     e     expunge the mailbox
+     s     synchronize the mailbox
+     m     print the modification sequence number
+     cN    print UIDs of messages changed since modification sequence N
+     n     print the number of messages
+     !CMD  run the shell command CMD
+*/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <mailutils/mailutils.h>
+
+static mu_attribute_t
+get_attribute (mu_mailbox_t mbox, const char *arg)
+{
+  mu_message_t msg;
+  mu_attribute_t attr;
+  char *p;
+  size_t n = strtoul (arg, &p, 10);
+
+  if (*p)
+    {
+      fprintf (stderr, "bad message number: %s\n", arg);
+      exit (1);
+    }
+  MU_ASSERT (mu_mailbox_get_message (mbox, n, &msg));
+  MU_ASSERT (mu_message_get_attribute (msg, &attr));
+  return attr;
+}
+
+int
+main (int argc, char **argv)
+{
+  mu_mailbox_t mbox;
+  size_t count;
+  int i;
+
+  if (argc < 3)
+    {
+      fprintf (stderr, "usage: %s URL COMMAND...\n", argv[0]);
+      return 1;
+    }
+
+  mu_registrar_record (mu_mbox_record);
+
+  MU_ASSERT (mu_mailbox_create (&mbox, argv[1]));
+  MU_ASSERT (mu_mailbox_open (mbox, MU_STREAM_RDWR));
+  MU_ASSERT (mu_mailbox_messages_count (mbox, &count));
+  for (i = 2; i < argc; i++)
+    {
+      switch (argv[i][0])
+	{
+	case 'd':
+	  MU_ASSERT (mu_attribute_set_deleted (get_attribute (mbox,
+							     argv[i] + 1)));
+	  break;
+
+	case 'r':
+	  MU_ASSERT (mu_attribute_set_read (get_attribute (mbox,
+							  argv[i] + 1)));
+	  break;
+
+	case 'e':
+	  MU_ASSERT (mu_mailbox_expunge (mbox));
+	  break;
+
+	case 's':
+	  MU_ASSERT (mu_mailbox_sync (mbox));
+	  break;
+
+	case 'm':
+	  {
+	    unsigned long modseq;
+	    MU_ASSERT (mu_mailbox_modseq (mbox, &modseq));
+	    mu_printf ("%lu\n", modseq);
+	  }
+	  break;
+
+	case 'c':
+	  {
+	    mu_msgset_t changes;
+	    int rc = mu_mailbox_changes (mbox, strtoul (argv[i] + 1, NULL, 10),
+					 &changes);
+	    if (rc)
+	      mu_printf ("%s\n", mu_strerror (rc));
+	    else
+	      {
+		mu_msgset_print (mu_strout, changes);
+		mu_printf ("\n");
+		mu_msgset_free (changes);
+	      }
+	  }
+	  break;
+
+	case 'n':
+	  MU_ASSERT (mu_mailbox_messages_count (mbox, &count));
+	  mu_printf ("%lu\n", (unsigned long) count);
+	  break;
+
+	case '!':
+	  if (system (argv[i] + 1))
+	    {
+	      fprintf (stderr, "command failed: %s\n", argv[i] + 1);
+	      return 1;
+	    }
+	  break;
+
+	default:
+	  fprintf (stderr, "unknown command: %s\n", argv[i]);
+	  return 1;
+	}
+    }
+  mu_mailbox_close (mbox);
+  mu_mailbox_destroy (&mbox);
+  return 0;
+}
@@ -0,0 +1,266 @@
+/* GNU Mailutils -- a suite of utilities for electronic mail
+   Copyright (C) 2013 Free Software Foundation, Inc.
+
+   GNU Mailutils is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GNU Mailutils is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GNU Mailutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Usage:
+
+     mbscan URL
+       Scan the mailbox and list its messages.  The mailbox can be of
+       any local format.
+
+     mbscan -t URL
+       Scan the mailbox and report the time it took and the maximum
+       resident set size of the process.
+
+     mbscan -D URL
+       Same as the first form, but destroy the mailbox without
+       closing it first.
+
+     mbscan -g SIZE FILE
+       Create a synthetic UNIX mailbox of approximately SIZE bytes.
+       SIZE can be suffixed with k, m or g.
+
+   To compare the memory-mapped and stream scanners on a large mailbox:
+
+     mbscan -g 1g /tmp/big.mbox
+     mbscan -t /tmp/big.mbox
+     mbscan -t 'mbox:///tmp/big.mbox;nommap'
+*/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <mailutils/mailutils.h>
+
+static void
+list_messages (mu_mailbox_t mbox)
+{
+  size_t i, count, uidnext;
+
+  MU_ASSERT (mu_mailbox_messages_count (mbox, &count));
+  MU_ASSERT (mu_mailbox_uidnext (mbox, &uidnext));
+  printf ("uidnext=%lu\n", (unsigned long) uidnext);
+  for (i = 1; i <= count; i++)
+    {
+      mu_message_t msg;
+      mu_header_t hdr;
+      mu_body_t body;
+      size_t uid, hsize, hlines, bsize, blines;
+
+      MU_ASSERT (mu_mailbox_get_message (mbox, i, &msg));
+      MU_ASSERT (mu_message_get_uid (msg, &uid));
+      MU_ASSERT (mu_message_get_header (msg, &hdr));
+      MU_ASSERT (mu_header_size (hdr, &hsize));
+      MU_ASSERT (mu_header_lines (hdr, &hlines));
+      MU_ASSERT (mu_message_get_body (msg, &body));
+      MU_ASSERT (mu_body_size (body, &bsize));
+      MU_ASSERT (mu_body_lines (body, &blines));
+      printf ("%lu: uid=%lu header=%lu/%lu body=%lu/%lu\n",
+	      (unsigned long) i, (unsigned long) uid,
+	      (unsigned long) hsize, (unsigned long) hlines,
+	      (unsigned long) bsize, (unsigned long) blines);
+    }
+}
+
+static void
+time_scan (mu_mailbox_t mbox)
+{
+  struct timeval start, stop;
+  struct rusage ru;
+  size_t count;
+  double t;
+
+  gettimeofday (&start, NULL);
+  MU_ASSERT (mu_mailbox_messages_count (mbox, &count));
+  gettimeofday (&stop, NULL);
+  t = (stop.tv_sec - start.tv_sec)
+        + (stop.tv_usec - start.tv_usec) / 1000000.0;
+  getrusage (RUSAGE_SELF, &ru);
+  printf ("%lu messages, %.3f s, %ld KB\n", (unsigned long) count, t,
+	  ru.ru_maxrss);
+}
+
+static unsigned long rnd_state = 1;
+
+static unsigned long
+rnd (unsigned long n)
+{
+  rnd_state = rnd_state * 1103515245 + 12345;
+  return (rnd_state / 65536) % n;
+}
+
+static const char *words[] = {
+  "the", "of", "and", "mail", "message", "From", "from", "server",
+  "mailbox", "delivery", "user", "header", "envelope", "quoted", "line",
+  "reply", "forwarded", "attachment", "text", "a", "to", "in", "is"
+};
+
+static void
+gen_line (FILE *fp, size_t len)
+{
+  size_t n = 0;
+
+  while (n < len)
+    {
+      const char *w = words[rnd (sizeof (words) / sizeof (words[0]))];
+      if (n)
+	{
+	  fputc (' ', fp);
+	  n++;
+	}
+      fputs (w, fp);
+      n += strlen (w);
+    }
+  fputc ('\n', fp);
+}
+
+static void
+generate (const char *sizestr, const char *file)
+{
+  char *p;
+  unsigned long long size = strtoull (sizestr, &p, 10);
+  unsigned long long total;
+  unsigned long n;
+  FILE *fp;
+
+  switch (*p)
+    {
+    case 'g':
+    case 'G':
+      size *= 1024;
+    case 'm':
+    case 'M':
+      size *= 1024;
+    case 'k':
+    case 'K':
+      size *= 1024;
+    case 0:
+      break;
+    default:
+      mu_error ("invalid size: %s", sizestr);
+      exit (1);
+    }
+
+  fp = fopen (file, "w");
+  if (!fp)
+    {
+      mu_error ("cannot create %s: %s", file, mu_strerror (errno));
+      exit (1);
+    }
+  for (n = 1; (total = ftell (fp)) < size; n++)
+    {
+      unsigned long i, lines = 5 + rnd (200);
+
+      fprintf (fp, "From user%lu@example.org Wed Dec  2 05:53:%02lu 1992\n",
+	       n % 1000, n % 60);
+      fprintf (fp, "Received: from mx.example.org by mail.example.net; "
+	       "Wed, 2 Dec 1992 05:53:%02lu +0000\n", n % 60);
+      fprintf (fp, "From: User %lu <user%lu@example.org>\n", n % 1000,
+	       n % 1000);
+      fprintf (fp, "To: Recipient <rcpt@example.net>\n");
+      fprintf (fp, "Subject: Test message %lu\n", n);
+      fprintf (fp, "Message-ID: <%lu@example.org>\n", n);
+      if (n == 1)
+	fprintf (fp, "X-IMAPbase: 1000000000 %lu\n",
+		 (unsigned long) (size / 512));
+      if (rnd (2))
+	fprintf (fp, "Status: RO\n");
+      switch (rnd (4))
+	{
+	case 0:
+	  fprintf (fp, "X-UID: %lu\n", 2 * n);
+	  break;
+	case 1:
+	  /* Out of order: ignored */
+	  fprintf (fp, "X-UID: 1\n");
+	}
+      fprintf (fp, "\n");
+      for (i = 0; i < lines; i++)
+	{
+	  switch (rnd (50))
+	    {
+	    case 0:
+	      fprintf (fp, "\n");
+	      break;
+	    case 1:
+	      /* Not an envelope line */
+	      fprintf (fp, "From the desk of user%lu\n", n % 1000);
+	      break;
+	    case 2:
+	      fprintf (fp, ">From user%lu@example.org Wed Dec  2 05:53 1992\n",
+		       n % 1000);
+	      break;
+	    default:
+	      gen_line (fp, 10 + rnd (70));
+	    }
+	}
+      fprintf (fp, "\n");
+    }
+  fclose (fp);
+}
+
+int
+main (int argc, char **argv)
+{
+  mu_mailbox_t mbox;
+  int tflag = 0;
+  int dflag = 0;
+
+  if (argc == 4 && strcmp (argv[1], "-g") == 0)
+    {
+      generate (argv[2], argv[3]);
+      return 0;
+    }
+
+  if (argc == 3 && strcmp (argv[1], "-t") == 0)
+    {
+      tflag = 1;
+      argc--;
+      argv++;
+    }
+  else if (argc == 3 && strcmp (argv[1], "-D") == 0)
+    {
+      dflag = 1;
+      argc--;
+      argv++;
+    }
+
+  if (argc != 2)
+    {
+      fprintf (stderr, "usage: %s [-t|-D] URL\n", argv[0]);
+      fprintf (stderr, "       %s -g SIZE FILE\n", argv[0]);
+      return 1;
+    }
+
+  mu_register_all_mbox_formats ();
+
+  MU_ASSERT (mu_mailbox_create (&mbox, argv[1]));
+  MU_ASSERT (mu_mailbox_open (mbox, MU_STREAM_READ));
+  if (tflag)
+    time_scan (mbox);
+  else
+    list_messages (mbox);
+  if (!dflag)
+    mu_mailbox_close (mbox);
+  mu_mailbox_destroy (&mbox);
+  return 0;
+}
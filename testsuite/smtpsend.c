@@ -31,7 +31,7 @@ static char usage_text[] =
 "                   [family=4|6] [domain=STRING] [user=STRING] [pass=STRING]\n"
 "                   [service=STRING] [realm=STRING] [host=STRING]\n"
 "                   [auth=method[,...]] [url=STRING] [input=FILE] [raw=N]\n"
-"                   [skiphdr=name[,...]]\n";
+"                   [skiphdr=name[,...]] [pipeline=N]\n";
 
 static void
 usage ()
@@ -90,6 +90,7 @@ main (int argc, char **argv)
   char *port = NULL;
   int tls = 0;
   int raw = 1;
+  int pipeline = 0;
   int flags = 0;
   mu_stream_t stream;
   mu_smtp_t smtp;
@@ -180,6 +181,8 @@ main (int argc, char **argv)
 	infile = argv[i] + 6;
       else if (strncmp (argv[i], "raw=", 4) == 0)
 	raw = atoi (argv[i] + 4);
+      else if (strncmp (argv[i], "pipeline=", 9) == 0)
+	pipeline = atoi (argv[i] + 9);
       else if (strncmp (argv[i], "rcpt=", 5) == 0)
 	{
 	  if (!rcpt_list)
@@ -272,8 +275,17 @@ main (int argc, char **argv)
 	}
     }
   
+  if (pipeline)
+    MU_ASSERT (mu_smtp_pipeline_begin (smtp));
   MU_ASSERT (mu_smtp_mail_basic (smtp, from, NULL));
   mu_list_foreach (rcpt_list, send_rcpt_command, smtp);
+  if (pipeline)
+    {
+      int status;
+      
+      while ((status = mu_smtp_pipeline_reply (smtp)) != MU_ERR_NOENT)
+	MU_ASSERT (status);
+    }
   
   if (raw)
     {